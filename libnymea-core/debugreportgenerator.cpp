@@ -33,6 +33,7 @@
 #include "nymeasettings.h"
 #include "nymeacore.h"
 #include "nymeaconfiguration.h"
+#include "ruleengine/rulesnapshot.h"
 #include "version.h"
 
 #include <QDir>
@@ -59,9 +60,14 @@ DebugReportGenerator::~DebugReportGenerator()
     cleanupReport();
 }
 
-QByteArray DebugReportGenerator::reportFileData() const
+QString DebugReportGenerator::reportFilePath() const
 {
-    return m_reportFileData;
+    return QStandardPaths::writableLocation(QStandardPaths::TempLocation) + "/" + m_reportFileName;
+}
+
+qint64 DebugReportGenerator::reportFileSize() const
+{
+    return m_reportFileSize;
 }
 
 QString DebugReportGenerator::reportFileName()
@@ -208,10 +214,19 @@ void DebugReportGenerator::saveConfigs()
     copyFileToReportDirectory(NymeaSettings(NymeaSettings::SettingsRoleGlobal).fileName(), "config");
     copyFileToReportDirectory(NymeaSettings(NymeaSettings::SettingsRoleThings).fileName(), "config");
     copyFileToReportDirectory(NymeaSettings(NymeaSettings::SettingsRoleThingStates).fileName(), "config");
-    copyFileToReportDirectory(NymeaSettings(NymeaSettings::SettingsRoleRules).fileName(), "config");
+    copyFileToReportDirectory(RuleSnapshot::fileName(), "config");
     copyFileToReportDirectory(NymeaSettings(NymeaSettings::SettingsRolePlugins).fileName(), "config");
     copyFileToReportDirectory(NymeaSettings(NymeaSettings::SettingsRoleTags).fileName(), "config");
     copyFileToReportDirectory(NymeaCore::instance()->configuration()->logDBName(), "config");
+
+    // The rule snapshot is binary, add a readable dump of the rules next to it
+    QFile rulesFile(m_reportDirectory.path() + "/config/rules.txt");
+    if (!rulesFile.open(QIODevice::WriteOnly)) {
+        qCWarning(dcDebugServer()) << "Could not open rules file" << rulesFile.fileName();
+        return;
+    }
+    rulesFile.write(RuleSnapshot::toText(NymeaCore::instance()->ruleEngine()->rules()));
+    rulesFile.close();
 }
 
 void DebugReportGenerator::saveEnv()
@@ -326,17 +341,19 @@ void DebugReportGenerator::onCompressProcessFinished(int exitCode, QProcess::Exi
         qCWarning(dcDebugServer()) << "Could not delete report directory" << m_reportDirectory.path();
     }
 
-    // Read the file
-    QFile reportFile(QStandardPaths::writableLocation(QStandardPaths::TempLocation) + "/" + m_reportFileName);
+    // Hash the file, it gets streamed from disk when downloaded
+    QFile reportFile(reportFilePath());
     if (!reportFile.open(QIODevice::ReadOnly)) {
         qCWarning(dcDebugServer()) << "Could not open report file name for reading" << reportFile.fileName();
         m_isReady = true;
         m_isValid = false;
         emit finished(false);
     } else {
-        m_reportFileData = reportFile.readAll();
-        m_md5Sum =  QString::fromUtf8(QCryptographicHash::hash(m_reportFileData, QCryptographicHash::Md5).toHex());
-        qCDebug(dcDebugServer()) << "File generated successfully" << reportFile.fileName() << m_reportFileData.size() << "B" << m_md5Sum;
+        QCryptographicHash hash(QCryptographicHash::Md5);
+        hash.addData(&reportFile);
+        m_reportFileSize = reportFile.size();
+        m_md5Sum =  QString::fromUtf8(hash.result().toHex());
+        qCDebug(dcDebugServer()) << "File generated successfully" << reportFile.fileName() << m_reportFileSize << "B" << m_md5Sum;
         m_isReady = true;
         m_isValid = true;
         emit finished(true);
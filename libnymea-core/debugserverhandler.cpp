@@ -35,6 +35,11 @@
 #include "loggingcategories.h"
 #include "debugserverhandler.h"
 #include "nymeaconfiguration.h"
+#include "startuptracer.h"
+#include "servermanager.h"
+#include "hardware/plugintimermanagerimplementation.h"
+#include "ruleengine/ruleactionexecutor.h"
+#include "ruleengine/rulesnapshot.h"
 #include "stdio.h"
 #include "version.h"
 
@@ -97,12 +102,11 @@ HttpReply *DebugServerHandler::processDebugRequest(const QString &requestPath, c
             return reply;
         }
 
-        QByteArray logDatabaseRawData = logDatabaseFile.readAll();
         logDatabaseFile.close();
 
         HttpReply *reply = HttpReply::createSuccessReply();
         reply->setHeader(HttpReply::ContentTypeHeader, "application/sql");
-        reply->setPayload(logDatabaseRawData);
+        reply->setFileBody(logDatabaseFile.fileName());
         return reply;
     }
 
@@ -128,12 +132,11 @@ HttpReply *DebugServerHandler::processDebugRequest(const QString &requestPath, c
             return reply;
         }
 
-        QByteArray syslogFileData = syslogFile.readAll();
         syslogFile.close();
 
         HttpReply *reply = HttpReply::createSuccessReply();
         reply->setHeader(HttpReply::ContentTypeHeader, "text/plain");
-        reply->setPayload(syslogFileData);
+        reply->setFileBody(syslogFile.fileName());
         return reply;
     }
 
@@ -159,41 +162,20 @@ HttpReply *DebugServerHandler::processDebugRequest(const QString &requestPath, c
                 return reply;
             }
 
-            QByteArray settingsFileData = settingsFile.readAll();
             settingsFile.close();
 
             HttpReply *reply = HttpReply::createSuccessReply();
             reply->setHeader(HttpReply::ContentTypeHeader, "text/plain");
-            reply->setPayload(settingsFileData);
+            reply->setFileBody(settingsFile.fileName());
             return reply;
         }
 
         if (requestPath.startsWith("/debug/settings/rules")) {
-            QString settingsFileName = NymeaSettings(NymeaSettings::SettingsRoleRules).fileName();
-            qCDebug(dcDebugServer()) << "Loading" << settingsFileName;
-            QFile settingsFile(settingsFileName);
-            if (!settingsFile.exists()) {
-                qCWarning(dcDebugServer()) << "Could not read file for debug download" << settingsFileName << "file does not exist.";
-                HttpReply *reply = HttpReply::createErrorReply(HttpReply::NotFound);
-                reply->setHeader(HttpReply::ContentTypeHeader, "text/html");
-                reply->setPayload(createErrorXmlDocument(HttpReply::NotFound, tr("Could not find file \"%1\".").arg(settingsFileName)));
-                return reply;
-            }
-
-            if (!settingsFile.open(QFile::ReadOnly)) {
-                qCWarning(dcDebugServer()) << "Could not read file for debug download" << settingsFileName;
-                HttpReply *reply = HttpReply::createErrorReply(HttpReply::Forbidden);
-                reply->setHeader(HttpReply::ContentTypeHeader, "text/html");
-                reply->setPayload(createErrorXmlDocument(HttpReply::NotFound, tr("Could not open file \"%1\".").arg(settingsFileName)));
-                return reply;
-            }
-
-            QByteArray settingsFileData = settingsFile.readAll();
-            settingsFile.close();
-
+            // The rules are stored in a binary snapshot, serve a readable dump of them instead
+            qCDebug(dcDebugServer()) << "Loading rules from" << RuleSnapshot::fileName();
             HttpReply *reply = HttpReply::createSuccessReply();
             reply->setHeader(HttpReply::ContentTypeHeader, "text/plain");
-            reply->setPayload(settingsFileData);
+            reply->setPayload(RuleSnapshot::toText(NymeaCore::instance()->ruleEngine()->rules()));
             return reply;
         }
 
@@ -217,12 +199,11 @@ HttpReply *DebugServerHandler::processDebugRequest(const QString &requestPath, c
                 return reply;
             }
 
-            QByteArray settingsFileData = settingsFile.readAll();
             settingsFile.close();
 
             HttpReply *reply = HttpReply::createSuccessReply();
             reply->setHeader(HttpReply::ContentTypeHeader, "text/plain");
-            reply->setPayload(settingsFileData);
+            reply->setFileBody(settingsFile.fileName());
             return reply;
         }
 
@@ -246,12 +227,11 @@ HttpReply *DebugServerHandler::processDebugRequest(const QString &requestPath, c
                 return reply;
             }
 
-            QByteArray settingsFileData = settingsFile.readAll();
             settingsFile.close();
 
             HttpReply *reply = HttpReply::createSuccessReply();
             reply->setHeader(HttpReply::ContentTypeHeader, "text/plain");
-            reply->setPayload(settingsFileData);
+            reply->setFileBody(settingsFile.fileName());
             return reply;
         }
 
@@ -275,12 +255,11 @@ HttpReply *DebugServerHandler::processDebugRequest(const QString &requestPath, c
                 return reply;
             }
 
-            QByteArray settingsFileData = settingsFile.readAll();
             settingsFile.close();
 
             HttpReply *reply = HttpReply::createSuccessReply();
             reply->setHeader(HttpReply::ContentTypeHeader, "text/plain");
-            reply->setPayload(settingsFileData);
+            reply->setFileBody(settingsFile.fileName());
             return reply;
         }
 
@@ -304,12 +283,11 @@ HttpReply *DebugServerHandler::processDebugRequest(const QString &requestPath, c
                 return reply;
             }
 
-            QByteArray settingsFileData = settingsFile.readAll();
             settingsFile.close();
 
             HttpReply *reply = HttpReply::createSuccessReply();
             reply->setHeader(HttpReply::ContentTypeHeader, "text/plain");
-            reply->setPayload(settingsFileData);
+            reply->setFileBody(settingsFile.fileName());
             return reply;
         }
     }
@@ -334,12 +312,11 @@ HttpReply *DebugServerHandler::processDebugRequest(const QString &requestPath, c
             return reply;
         }
 
-        QByteArray settingsFileData = settingsFile.readAll();
         settingsFile.close();
 
         HttpReply *reply = HttpReply::createSuccessReply();
         reply->setHeader(HttpReply::ContentTypeHeader, "text/plain");
-        reply->setPayload(settingsFileData);
+        reply->setFileBody(settingsFile.fileName());
         return reply;
     }
 
@@ -363,12 +340,11 @@ HttpReply *DebugServerHandler::processDebugRequest(const QString &requestPath, c
             return reply;
         }
 
-        QByteArray settingsFileData = settingsFile.readAll();
         settingsFile.close();
 
         HttpReply *reply = HttpReply::createSuccessReply();
         reply->setHeader(HttpReply::ContentTypeHeader, "text/plain");
-        reply->setPayload(settingsFileData);
+        reply->setFileBody(settingsFile.fileName());
         return reply;
     }
 
@@ -417,6 +393,71 @@ HttpReply *DebugServerHandler::processDebugRequest(const QString &requestPath, c
         return m_tracePathReply;
     }
 
+    if (requestPath.startsWith("/debug/startup-trace.json")) {
+        qCDebug(dcDebugServer()) << "Request startup trace";
+        if (!StartupTracer::instance()->enabled()) {
+            HttpReply *reply = HttpReply::createErrorReply(HttpReply::NotFound);
+            reply->setHeader(HttpReply::ContentTypeHeader, "text/html");
+            //: The HTTP error message of the debug interface if the startup trace has not been recorded.
+            reply->setPayload(createErrorXmlDocument(HttpReply::NotFound, tr("Startup tracing is not enabled. Start nymead with --startup-trace to record it.")));
+            return reply;
+        }
+
+        HttpReply *reply = HttpReply::createSuccessReply();
+        reply->setHeader(HttpReply::ContentTypeHeader, "application/json");
+        reply->setPayload(StartupTracer::instance()->traceJson());
+        return reply;
+    }
+
+    if (requestPath.startsWith("/debug/startup-trace")) {
+        qCDebug(dcDebugServer()) << "Request startup trace summary";
+        HttpReply *reply = HttpReply::createSuccessReply();
+        reply->setHeader(HttpReply::ContentTypeHeader, "application/json");
+        reply->setPayload(QJsonDocument::fromVariant(StartupTracer::instance()->summary()).toJson(QJsonDocument::Indented));
+        return reply;
+    }
+
+    if (requestPath.startsWith("/debug/clients")) {
+        qCDebug(dcDebugServer()) << "Request client statistics";
+        HttpReply *reply = HttpReply::createSuccessReply();
+        reply->setHeader(HttpReply::ContentTypeHeader, "application/json");
+        reply->setPayload(QJsonDocument::fromVariant(NymeaCore::instance()->serverManager()->clientStatistics()).toJson(QJsonDocument::Indented));
+        return reply;
+    }
+
+    if (requestPath.startsWith("/debug/plugintimers")) {
+        qCDebug(dcDebugServer()) << "Request plugin timer statistics";
+        PluginTimerManagerImplementation *pluginTimerManager = qobject_cast<PluginTimerManagerImplementation *>(NymeaCore::instance()->hardwareManager()->pluginTimerManager());
+        HttpReply *reply = HttpReply::createSuccessReply();
+        reply->setHeader(HttpReply::ContentTypeHeader, "application/json");
+        reply->setPayload(QJsonDocument::fromVariant(pluginTimerManager ? pluginTimerManager->statistics() : QVariantMap()).toJson(QJsonDocument::Indented));
+        return reply;
+    }
+
+    if (requestPath.startsWith("/debug/ruleactions")) {
+        qCDebug(dcDebugServer()) << "Request rule action statistics";
+        HttpReply *reply = HttpReply::createSuccessReply();
+        reply->setHeader(HttpReply::ContentTypeHeader, "application/json");
+        reply->setPayload(QJsonDocument::fromVariant(NymeaCore::instance()->ruleActionExecutor()->statistics()).toJson(QJsonDocument::Indented));
+        return reply;
+    }
+
+    if (requestPath.startsWith("/debug/eventqueue")) {
+        qCDebug(dcDebugServer()) << "Request event queue statistics";
+        HttpReply *reply = HttpReply::createSuccessReply();
+        reply->setHeader(HttpReply::ContentTypeHeader, "application/json");
+        reply->setPayload(QJsonDocument::fromVariant(NymeaCore::instance()->eventQueueStatistics()).toJson(QJsonDocument::Indented));
+        return reply;
+    }
+
+    if (requestPath.startsWith("/debug/rulestatistics")) {
+        qCDebug(dcDebugServer()) << "Request rule statistics";
+        HttpReply *reply = HttpReply::createSuccessReply();
+        reply->setHeader(HttpReply::ContentTypeHeader, "application/json");
+        reply->setPayload(QJsonDocument::fromVariant(NymeaCore::instance()->ruleEngine()->ruleStatistics()).toJson(QJsonDocument::Indented));
+        return reply;
+    }
+
     if (requestPath.startsWith("/debug/logging-categories")) {
 
         if (requestQuery.isEmpty()) {
@@ -496,7 +537,7 @@ HttpReply *DebugServerHandler::processDebugRequest(const QString &requestPath, c
 
             // Everything looks good, send the requested debug report
             HttpReply *downloadReportReply = HttpReply::createSuccessReply();
-            downloadReportReply->setPayload(m_debugReportGenerator->reportFileData());
+            downloadReportReply->setFileBody(m_debugReportGenerator->reportFilePath());
             downloadReportReply->setHeader(HttpReply::ContentTypeHeader, "application/tar+gzip;");
             return downloadReportReply;
         } else {
@@ -520,7 +561,7 @@ HttpReply *DebugServerHandler::processDebugRequest(const QString &requestPath, c
                         // Success, the debug report is ready and valid
                         QVariantMap reportInformation;
                         reportInformation.insert("fileName", m_debugReportGenerator->reportFileName());
-                        reportInformation.insert("fileSize", m_debugReportGenerator->reportFileData().size());
+                        reportInformation.insert("fileSize", m_debugReportGenerator->reportFileSize());
                         reportInformation.insert("md5sum", m_debugReportGenerator->md5Sum());
 
                         HttpReply * httpReply = HttpReply::createSuccessReply();
@@ -1282,6 +1323,240 @@ QByteArray DebugServerHandler::createDebugXmlDocument()
 
     writer.writeEndElement(); // div download-row
 
+    // Download row startup trace
+    writer.writeStartElement("div");
+    writer.writeAttribute("class", "download-row");
+
+    writer.writeStartElement("div");
+    writer.writeAttribute("class", "download-name-column");
+    //: The startup trace download description of the debug interface
+    writer.writeTextElement("p", tr("Startup trace"));
+    writer.writeEndElement(); // div download-name-column
+
+    writer.writeStartElement("div");
+    writer.writeAttribute("class", "download-button-column");
+    writer.writeStartElement("form");
+    writer.writeAttribute("class", "download-button");
+    writer.writeStartElement("button");
+    writer.writeAttribute("class", "button");
+    writer.writeAttribute("type", "button");
+    if (!StartupTracer::instance()->enabled()) {
+        writer.writeAttribute("disabled", "disabled");
+    }
+    writer.writeAttribute("onClick", "downloadFile('/debug/startup-trace.json', 'startup-trace.json')");
+    writer.writeCharacters(tr("Download"));
+    writer.writeEndElement(); // button
+    writer.writeEndElement(); // form
+    writer.writeEndElement(); // div download-button-column
+
+    writer.writeStartElement("div");
+    writer.writeAttribute("class", "show-button-column");
+    writer.writeStartElement("form");
+    writer.writeAttribute("class", "show-button");
+    writer.writeStartElement("button");
+    writer.writeAttribute("class", "button");
+    writer.writeAttribute("type", "button");
+    if (!StartupTracer::instance()->enabled()) {
+        writer.writeAttribute("disabled", "disabled");
+    }
+    writer.writeAttribute("onClick", "showFile('/debug/startup-trace')");
+    writer.writeCharacters(tr("Show"));
+    writer.writeEndElement(); // button
+    writer.writeEndElement(); // form
+    writer.writeEndElement(); // div show-button-column
+
+    writer.writeEndElement(); // div download-row
+
+    // Download row client statistics
+    writer.writeStartElement("div");
+    writer.writeAttribute("class", "download-row");
+
+    writer.writeStartElement("div");
+    writer.writeAttribute("class", "download-name-column");
+    //: The client connection statistics download description of the debug interface
+    writer.writeTextElement("p", tr("Client connections"));
+    writer.writeEndElement(); // div download-name-column
+
+    writer.writeStartElement("div");
+    writer.writeAttribute("class", "download-button-column");
+    writer.writeStartElement("form");
+    writer.writeAttribute("class", "download-button");
+    writer.writeStartElement("button");
+    writer.writeAttribute("class", "button");
+    writer.writeAttribute("type", "button");
+    writer.writeAttribute("onClick", "downloadFile('/debug/clients', 'clients.json')");
+    writer.writeCharacters(tr("Download"));
+    writer.writeEndElement(); // button
+    writer.writeEndElement(); // form
+    writer.writeEndElement(); // div download-button-column
+
+    writer.writeStartElement("div");
+    writer.writeAttribute("class", "show-button-column");
+    writer.writeStartElement("form");
+    writer.writeAttribute("class", "show-button");
+    writer.writeStartElement("button");
+    writer.writeAttribute("class", "button");
+    writer.writeAttribute("type", "button");
+    writer.writeAttribute("onClick", "showFile('/debug/clients')");
+    writer.writeCharacters(tr("Show"));
+    writer.writeEndElement(); // button
+    writer.writeEndElement(); // form
+    writer.writeEndElement(); // div show-button-column
+
+    writer.writeEndElement(); // div download-row
+
+    // Download row plugin timer statistics
+    writer.writeStartElement("div");
+    writer.writeAttribute("class", "download-row");
+
+    writer.writeStartElement("div");
+    writer.writeAttribute("class", "download-name-column");
+    //: The plugin timer statistics download description of the debug interface
+    writer.writeTextElement("p", tr("Plugin timers"));
+    writer.writeEndElement(); // div download-name-column
+
+    writer.writeStartElement("div");
+    writer.writeAttribute("class", "download-button-column");
+    writer.writeStartElement("form");
+    writer.writeAttribute("class", "download-button");
+    writer.writeStartElement("button");
+    writer.writeAttribute("class", "button");
+    writer.writeAttribute("type", "button");
+    writer.writeAttribute("onClick", "downloadFile('/debug/plugintimers', 'plugintimers.json')");
+    writer.writeCharacters(tr("Download"));
+    writer.writeEndElement(); // button
+    writer.writeEndElement(); // form
+    writer.writeEndElement(); // div download-button-column
+
+    writer.writeStartElement("div");
+    writer.writeAttribute("class", "show-button-column");
+    writer.writeStartElement("form");
+    writer.writeAttribute("class", "show-button");
+    writer.writeStartElement("button");
+    writer.writeAttribute("class", "button");
+    writer.writeAttribute("type", "button");
+    writer.writeAttribute("onClick", "showFile('/debug/plugintimers')");
+    writer.writeCharacters(tr("Show"));
+    writer.writeEndElement(); // button
+    writer.writeEndElement(); // form
+    writer.writeEndElement(); // div show-button-column
+
+    writer.writeEndElement(); // div download-row
+
+    // Download row rule action statistics
+    writer.writeStartElement("div");
+    writer.writeAttribute("class", "download-row");
+
+    writer.writeStartElement("div");
+    writer.writeAttribute("class", "download-name-column");
+    //: The rule action statistics download description of the debug interface
+    writer.writeTextElement("p", tr("Rule actions"));
+    writer.writeEndElement(); // div download-name-column
+
+    writer.writeStartElement("div");
+    writer.writeAttribute("class", "download-button-column");
+    writer.writeStartElement("form");
+    writer.writeAttribute("class", "download-button");
+    writer.writeStartElement("button");
+    writer.writeAttribute("class", "button");
+    writer.writeAttribute("type", "button");
+    writer.writeAttribute("onClick", "downloadFile('/debug/ruleactions', 'ruleactions.json')");
+    writer.writeCharacters(tr("Download"));
+    writer.writeEndElement(); // button
+    writer.writeEndElement(); // form
+    writer.writeEndElement(); // div download-button-column
+
+    writer.writeStartElement("div");
+    writer.writeAttribute("class", "show-button-column");
+    writer.writeStartElement("form");
+    writer.writeAttribute("class", "show-button");
+    writer.writeStartElement("button");
+    writer.writeAttribute("class", "button");
+    writer.writeAttribute("type", "button");
+    writer.writeAttribute("onClick", "showFile('/debug/ruleactions')");
+    writer.writeCharacters(tr("Show"));
+    writer.writeEndElement(); // button
+    writer.writeEndElement(); // form
+    writer.writeEndElement(); // div show-button-column
+
+    writer.writeEndElement(); // div download-row
+
+    // Download row event queue statistics
+    writer.writeStartElement("div");
+    writer.writeAttribute("class", "download-row");
+
+    writer.writeStartElement("div");
+    writer.writeAttribute("class", "download-name-column");
+    //: The event queue statistics download description of the debug interface
+    writer.writeTextElement("p", tr("Event queue"));
+    writer.writeEndElement(); // div download-name-column
+
+    writer.writeStartElement("div");
+    writer.writeAttribute("class", "download-button-column");
+    writer.writeStartElement("form");
+    writer.writeAttribute("class", "download-button");
+    writer.writeStartElement("button");
+    writer.writeAttribute("class", "button");
+    writer.writeAttribute("type", "button");
+    writer.writeAttribute("onClick", "downloadFile('/debug/eventqueue', 'eventqueue.json')");
+    writer.writeCharacters(tr("Download"));
+    writer.writeEndElement(); // button
+    writer.writeEndElement(); // form
+    writer.writeEndElement(); // div download-button-column
+
+    writer.writeStartElement("div");
+    writer.writeAttribute("class", "show-button-column");
+    writer.writeStartElement("form");
+    writer.writeAttribute("class", "show-button");
+    writer.writeStartElement("button");
+    writer.writeAttribute("class", "button");
+    writer.writeAttribute("type", "button");
+    writer.writeAttribute("onClick", "showFile('/debug/eventqueue')");
+    writer.writeCharacters(tr("Show"));
+    writer.writeEndElement(); // button
+    writer.writeEndElement(); // form
+    writer.writeEndElement(); // div show-button-column
+
+    writer.writeEndElement(); // div download-row
+
+    // Download row rule statistics
+    writer.writeStartElement("div");
+    writer.writeAttribute("class", "download-row");
+
+    writer.writeStartElement("div");
+    writer.writeAttribute("class", "download-name-column");
+    //: The rule statistics download description of the debug interface
+    writer.writeTextElement("p", tr("Rule statistics"));
+    writer.writeEndElement(); // div download-name-column
+
+    writer.writeStartElement("div");
+    writer.writeAttribute("class", "download-button-column");
+    writer.writeStartElement("form");
+    writer.writeAttribute("class", "download-button");
+    writer.writeStartElement("button");
+    writer.writeAttribute("class", "button");
+    writer.writeAttribute("type", "button");
+    writer.writeAttribute("onClick", "downloadFile('/debug/rulestatistics', 'rulestatistics.json')");
+    writer.writeCharacters(tr("Download"));
+    writer.writeEndElement(); // button
+    writer.writeEndElement(); // form
+    writer.writeEndElement(); // div download-button-column
+
+    writer.writeStartElement("div");
+    writer.writeAttribute("class", "show-button-column");
+    writer.writeStartElement("form");
+    writer.writeAttribute("class", "show-button");
+    writer.writeStartElement("button");
+    writer.writeAttribute("class", "button");
+    writer.writeAttribute("type", "button");
+    writer.writeAttribute("onClick", "showFile('/debug/rulestatistics')");
+    writer.writeCharacters(tr("Show"));
+    writer.writeEndElement(); // button
+    writer.writeEndElement(); // form
+    writer.writeEndElement(); // div show-button-column
+
+    writer.writeEndElement(); // div download-row
+
 
     // Settings download section global
     writer.writeEmptyElement("hr");
@@ -1451,7 +1726,7 @@ QByteArray DebugServerHandler::createDebugXmlDocument()
 
     writer.writeStartElement("div");
     writer.writeAttribute("class", "download-path-column");
-    writer.writeTextElement("p", NymeaSettings(NymeaSettings::SettingsRoleRules).fileName());
+    writer.writeTextElement("p", RuleSnapshot::fileName());
     writer.writeEndElement(); // div download-path-column
 
     writer.writeStartElement("div");
@@ -1461,10 +1736,7 @@ QByteArray DebugServerHandler::createDebugXmlDocument()
     writer.writeStartElement("button");
     writer.writeAttribute("class", "button");
     writer.writeAttribute("type", "button");
-    if (!QFile::exists(NymeaSettings(NymeaSettings::SettingsRoleRules).fileName())) {
-        writer.writeAttribute("disabled", "true");
-    }
-    writer.writeAttribute("onClick", "downloadFile('/debug/settings/rules', 'rules.conf')");
+    writer.writeAttribute("onClick", "downloadFile('/debug/settings/rules', 'rules.txt')");
     writer.writeCharacters(tr("Download"));
     writer.writeEndElement(); // button
     writer.writeEndElement(); // form
@@ -1477,9 +1749,6 @@ QByteArray DebugServerHandler::createDebugXmlDocument()
     writer.writeStartElement("button");
     writer.writeAttribute("class", "button");
     writer.writeAttribute("type", "button");
-    if (!QFile::exists(NymeaSettings(NymeaSettings::SettingsRoleRules).fileName())) {
-        writer.writeAttribute("disabled", "true");
-    }
     writer.writeAttribute("onClick", "showFile('/debug/settings/rules')");
     writer.writeCharacters(tr("Show"));
     writer.writeEndElement(); // button
@@ -32,13 +32,26 @@
 #include "loggingcategories.h"
 #include "nymeacore.h"
 
+#include <QMetaMethod>
+
 namespace nymeaserver {
 
-PluginTimerImplementation::PluginTimerImplementation(int interval, QObject *parent) :
-    PluginTimer(parent),
-    m_interval(interval)
+PluginTimerImplementation::PluginTimerImplementation(int interval, const QString &owner, PluginTimerManagerImplementation *manager) :
+    PluginTimer(manager),
+    m_manager(manager),
+    m_owner(owner),
+    m_interval(interval),
+    m_remainingTicks(interval)
+{
+
+}
+
+PluginTimerImplementation::~PluginTimerImplementation()
 {
-    connect(NymeaCore::instance()->timeManager(), &TimeManager::tick, this, &PluginTimerImplementation::tick);
+    if (m_manager) {
+        m_manager->unscheduleTimer(this);
+        m_manager->m_tickObservers.removeAll(this);
+    }
 }
 
 int PluginTimerImplementation::interval() const
@@ -48,7 +61,10 @@ int PluginTimerImplementation::interval() const
 
 int PluginTimerImplementation::currentTick() const
 {
-    return m_currentTick;
+    if (m_manager && m_dueTick >= 0)
+        return m_interval - static_cast<int>(m_dueTick - m_manager->m_currentTick);
+
+    return m_interval - m_remainingTicks;
 }
 
 bool PluginTimerImplementation::running() const
@@ -56,6 +72,34 @@ bool PluginTimerImplementation::running() const
     return m_running;
 }
 
+QString PluginTimerImplementation::owner() const
+{
+    return m_owner;
+}
+
+void PluginTimerImplementation::connectNotify(const QMetaMethod &signal)
+{
+    if (!m_manager)
+        return;
+
+    // Only timers somebody is listening to get a currentTickChanged() on every tick
+    if (signal == QMetaMethod::fromSignal(&PluginTimer::currentTickChanged) && !m_manager->m_tickObservers.contains(this)) {
+        m_manager->m_tickObservers.append(this);
+    }
+}
+
+void PluginTimerImplementation::disconnectNotify(const QMetaMethod &signal)
+{
+    if (!m_manager)
+        return;
+
+    if (!signal.isValid() || signal == QMetaMethod::fromSignal(&PluginTimer::currentTickChanged)) {
+        if (!isSignalConnected(QMetaMethod::fromSignal(&PluginTimer::currentTickChanged))) {
+            m_manager->m_tickObservers.removeAll(this);
+        }
+    }
+}
+
 void PluginTimerImplementation::setRunning(bool running)
 {
     if (m_running != running) {
@@ -72,95 +116,102 @@ void PluginTimerImplementation::setPaused(bool paused)
     }
 }
 
-void PluginTimerImplementation::setCurrentTick(int tick)
+void PluginTimerImplementation::updateSchedule()
 {
-    if (m_currentTick != tick) {
-        m_currentTick = tick;
-        emit currentTickChanged(m_currentTick);
-    }
-}
-
-void PluginTimerImplementation::tick()
-{
-    if (m_paused)
+    if (!m_manager)
         return;
 
-    if (!m_running)
-        return;
-
-    setCurrentTick(m_currentTick += 1);
-
-    if (m_currentTick >= m_interval) {
-        emit timeout();
-        reset();
+    bool active = m_running && !m_paused;
+    if (active && m_dueTick < 0) {
+        m_manager->scheduleTimer(this, m_manager->m_currentTick + m_remainingTicks);
+    } else if (!active && m_dueTick >= 0) {
+        // Remember where we are to continue from there
+        m_remainingTicks = static_cast<int>(m_dueTick - m_manager->m_currentTick);
+        m_manager->unscheduleTimer(this);
     }
 }
 
 void PluginTimerImplementation::reset()
 {
-    setCurrentTick(0);
+    m_remainingTicks = m_interval;
+    if (m_manager && m_dueTick >= 0) {
+        m_manager->unscheduleTimer(this);
+        m_manager->scheduleTimer(this, m_manager->m_currentTick + m_interval);
+    }
+    emit currentTickChanged(0);
 }
 
 void PluginTimerImplementation::start()
 {
     setPaused(false);
     setRunning(true);
+    updateSchedule();
 }
 
 void PluginTimerImplementation::stop()
 {
     setPaused(false);
     setRunning(false);
+    updateSchedule();
 }
 
 void PluginTimerImplementation::pause()
 {
-    m_paused = true;
+    setPaused(true);
+    updateSchedule();
 }
 
 void PluginTimerImplementation::resume()
 {
-    m_paused = false;
+    setPaused(false);
+    updateSchedule();
 }
 
 
 PluginTimerManagerImplementation::PluginTimerManagerImplementation(QObject *parent) :
     PluginTimerManager(parent)
 {
+    // One connection to the central time tick dispatches all timers
+    connect(NymeaCore::instance()->timeManager(), &TimeManager::tick, this, &PluginTimerManagerImplementation::timeTick);
+
     m_available = true;
     qCDebug(dcHardware()) << "-->" << name() << "created successfully.";
 }
 
-PluginTimer *PluginTimerManagerImplementation::registerTimer(int seconds)
+PluginTimerManagerImplementation::~PluginTimerManagerImplementation()
 {
-    QPointer<PluginTimerImplementation> pluginTimer = new PluginTimerImplementation(seconds, this);
-    qCDebug(dcHardware()) << "Register timer" << pluginTimer->interval();
+    // The timers are deleted as children after the schedule is gone
+    foreach (const QPointer<PluginTimerImplementation> &timer, m_timers) {
+        if (!timer.isNull()) {
+            timer->m_manager = nullptr;
+        }
+    }
+}
 
-    // TODO: schedule timer for load balancing
+PluginTimer *PluginTimerManagerImplementation::registerTimer(int seconds)
+{
+    return registerTimer(seconds, "nymea");
+}
 
-    //    // Get min/max timer interval
-    //    PluginTimer *shortestTimer = nullptr;
-    //    PluginTimer *longestTimer = nullptr;
-    //    foreach (PluginTimer *timer, m_timers) {
-    //        if (!shortestTimer && !longestTimer) {
-    //            shortestTimer = timer;
-    //            longestTimer = timer;
-    //            continue;
-    //        }
+// Timers with the same interval are spread across the interval, so 60 timers with an interval of
+// 60 seconds time out one per second instead of all at once. The first timeout of a timer therefore
+// happens within the given interval, but not necessarily after the full interval.
+PluginTimer *PluginTimerManagerImplementation::registerTimer(int seconds, const QString &owner)
+{
+    int interval = qMax(1, seconds);
+    PluginTimerImplementation *pluginTimer = new PluginTimerImplementation(interval, owner, this);
 
-    //        if (timer->interval() < shortestTimer->interval()) {
-    //            shortestTimer = timer;
-    //            continue;
-    //        }
+    // Find the first tick in the least loaded phase of this interval
+    int phase = leastLoadedPhase(interval);
+    qint64 dueTick = m_currentTick + (phase - m_currentTick % interval + interval) % interval;
+    if (dueTick <= m_currentTick)
+        dueTick += interval;
 
-    //        if (timer->interval() > longestTimer->interval()) {
-    //            longestTimer = timer;
-    //            continue;
-    //        }
-    //    }
+    scheduleTimer(pluginTimer, dueTick);
+    qCDebug(dcHardware()) << "Register timer" << pluginTimer->interval() << "for" << owner << "in phase" << phase;
 
     m_timers.append(pluginTimer);
-    return pluginTimer.data();
+    return pluginTimer;
 }
 
 void PluginTimerManagerImplementation::unregisterTimer(PluginTimer *timer)
@@ -175,6 +226,8 @@ void PluginTimerManagerImplementation::unregisterTimer(PluginTimer *timer)
 
     foreach (QPointer<PluginTimerImplementation> tPointer, m_timers) {
         if (timerPointer.data() == tPointer.data()) {
+            unscheduleTimer(tPointer.data());
+            m_tickObservers.removeAll(tPointer.data());
             m_timers.removeAll(tPointer);
             tPointer->deleteLater();
         }
@@ -191,6 +244,53 @@ bool PluginTimerManagerImplementation::enabled() const
     return m_enabled;
 }
 
+// The timer load per owner, and the highest number of timeouts within the same second in the upcoming period
+QVariantMap PluginTimerManagerImplementation::statistics() const
+{
+    QVariantMap owners;
+    int window = 60;
+    foreach (const QPointer<PluginTimerImplementation> &timer, m_timers) {
+        if (timer.isNull())
+            continue;
+
+        QVariantMap ownerStatistics = owners.value(timer->owner()).toMap();
+        ownerStatistics["timers"] = ownerStatistics.value("timers").toInt() + 1;
+        ownerStatistics["timeouts"] = ownerStatistics.value("timeouts").toULongLong() + timer->m_timeoutCount;
+        if (timer->m_dueTick >= 0) {
+            ownerStatistics["running"] = ownerStatistics.value("running").toInt() + 1;
+            ownerStatistics["timeoutsPerMinute"] = ownerStatistics.value("timeoutsPerMinute").toDouble() + 60.0 / timer->interval();
+            window = qMax(window, timer->interval());
+        } else {
+            ownerStatistics["running"] = ownerStatistics.value("running").toInt();
+            ownerStatistics["timeoutsPerMinute"] = ownerStatistics.value("timeoutsPerMinute").toDouble();
+        }
+        owners.insert(timer->owner(), ownerStatistics);
+    }
+
+    // Count the timeouts per tick over the upcoming period
+    window = qMin(window, 3600);
+    QVector<int> timeoutsPerTick(window, 0);
+    foreach (const QPointer<PluginTimerImplementation> &timer, m_timers) {
+        if (timer.isNull() || timer->m_dueTick < 0)
+            continue;
+
+        for (qint64 tick = timer->m_dueTick; tick <= m_currentTick + window; tick += timer->interval()) {
+            timeoutsPerTick[static_cast<int>(tick - m_currentTick - 1)]++;
+        }
+    }
+
+    int peak = 0;
+    foreach (int timeouts, timeoutsPerTick) {
+        peak = qMax(peak, timeouts);
+    }
+
+    QVariantMap statistics;
+    statistics.insert("timers", m_timers.count());
+    statistics.insert("peakTimeoutsPerSecond", peak);
+    statistics.insert("owners", owners);
+    return statistics;
+}
+
 void PluginTimerManagerImplementation::timeTick()
 {
     // If timer resource is not enabled do nothing
@@ -198,9 +298,115 @@ void PluginTimerManagerImplementation::timeTick()
         return;
     }
 
-    foreach (PluginTimerImplementation *timer, m_timers) {
-        timer->tick();
+    m_currentTick++;
+
+    // Slots may delete other timers of this tick directly, so keep guarded pointers to them
+    QList<QPointer<PluginTimerImplementation> > dueTimers;
+    foreach (PluginTimerImplementation *timer, m_schedule.take(m_currentTick)) {
+        dueTimers.append(timer);
+    }
+
+    foreach (const QPointer<PluginTimerImplementation> &timer, dueTimers) {
+        // Deleted, unregistered, stopped or reset by an earlier timeout of this tick
+        if (timer.isNull() || timer->m_dueTick != m_currentTick)
+            continue;
+
+        // Schedule the next period before emitting, so the timer can be reset or stopped in the slot
+        unscheduleTimer(timer);
+        scheduleTimer(timer, m_currentTick + timer->interval());
+        timer->m_timeoutCount++;
+        emit timer->timeout();
+    }
+
+    QList<QPointer<PluginTimerImplementation> > tickObservers;
+    foreach (PluginTimerImplementation *timer, m_tickObservers) {
+        tickObservers.append(timer);
     }
+
+    foreach (const QPointer<PluginTimerImplementation> &timer, tickObservers) {
+        if (!timer.isNull()) {
+            emit timer->currentTickChanged(timer->currentTick());
+        }
+    }
+}
+
+int PluginTimerManagerImplementation::leastLoadedPhase(int interval) const
+{
+    // Without any other timer, the first timeout happens after the full interval
+    int naturalPhase = static_cast<int>(m_currentTick % interval);
+    QVector<int> load = m_phaseLoad.value(interval);
+    if (load.isEmpty())
+        return naturalPhase;
+
+    int minimumLoad = load.first();
+    foreach (int phaseLoad, load) {
+        minimumLoad = qMin(minimumLoad, phaseLoad);
+    }
+
+    // Distance of each phase to the next more loaded phase, walking twice around the circle in each direction
+    QVector<int> distance(interval, interval);
+    int lastLoaded = -1;
+    for (int i = 0; i < 2 * interval; i++) {
+        if (load.at(i % interval) > minimumLoad) {
+            lastLoaded = i;
+        } else if (lastLoaded >= 0) {
+            distance[i % interval] = qMin(distance.at(i % interval), i - lastLoaded);
+        }
+    }
+    lastLoaded = -1;
+    for (int i = 2 * interval - 1; i >= 0; i--) {
+        if (load.at(i % interval) > minimumLoad) {
+            lastLoaded = i;
+        } else if (lastLoaded >= 0) {
+            distance[i % interval] = qMin(distance.at(i % interval), lastLoaded - i);
+        }
+    }
+
+    // Pick the least loaded phase furthest away from others, preferring the natural phase on equal distance
+    int bestPhase = -1;
+    for (int i = 0; i < interval; i++) {
+        int phase = (naturalPhase + i) % interval;
+        if (load.at(phase) != minimumLoad)
+            continue;
+
+        if (bestPhase < 0 || distance.at(phase) > distance.at(bestPhase)) {
+            bestPhase = phase;
+        }
+    }
+    return bestPhase;
+}
+
+void PluginTimerManagerImplementation::scheduleTimer(PluginTimerImplementation *timer, qint64 dueTick)
+{
+    timer->m_dueTick = dueTick;
+    timer->m_phase = static_cast<int>(dueTick % timer->interval());
+    m_schedule[dueTick].append(timer);
+
+    QVector<int> &load = m_phaseLoad[timer->interval()];
+    if (load.isEmpty())
+        load.resize(timer->interval());
+
+    load[timer->m_phase]++;
+}
+
+void PluginTimerManagerImplementation::unscheduleTimer(PluginTimerImplementation *timer)
+{
+    if (timer->m_dueTick < 0)
+        return;
+
+    // The list of the current tick is already being dispatched
+    if (m_schedule.contains(timer->m_dueTick)) {
+        QList<PluginTimerImplementation *> &timers = m_schedule[timer->m_dueTick];
+        timers.removeAll(timer);
+        if (timers.isEmpty()) {
+            m_schedule.remove(timer->m_dueTick);
+        }
+    }
+
+    QVector<int> &load = m_phaseLoad[timer->interval()];
+    load[timer->m_phase]--;
+
+    timer->m_dueTick = -1;
 }
 
 void PluginTimerManagerImplementation::setEnabled(bool enabled)
@@ -210,12 +416,9 @@ void PluginTimerManagerImplementation::setEnabled(bool enabled)
         return;
     }
 
+    // While disabled the ticks are not counted, so all timers hold
     m_enabled = enabled;
     emit enabledChanged(enabled);
-
-    foreach (QPointer<PluginTimerImplementation> timer, m_timers) {
-        timer->setPaused(enabled);
-    }
 }
 
 bool PluginTimerManagerImplementation::enable()
@@ -236,6 +439,68 @@ bool PluginTimerManagerImplementation::disable()
     return true;
 }
 
+
+ScopedPluginTimerManager::ScopedPluginTimerManager(PluginTimerManager *pluginTimerManager, const QString &owner, QObject *parent) :
+    PluginTimerManager(parent),
+    m_pluginTimerManager(pluginTimerManager),
+    m_owner(owner)
+{
+    connect(pluginTimerManager, &PluginTimerManager::enabledChanged, this, &ScopedPluginTimerManager::enabledChanged);
+    connect(pluginTimerManager, &PluginTimerManager::availableChanged, this, &ScopedPluginTimerManager::availableChanged);
 }
 
+ScopedPluginTimerManager::~ScopedPluginTimerManager()
+{
+    // Clean up the timers the owner did not unregister
+    if (m_pluginTimerManager.isNull())
+        return;
 
+    foreach (const QPointer<PluginTimer> &timer, m_timers) {
+        if (!timer.isNull()) {
+            m_pluginTimerManager->unregisterTimer(timer.data());
+        }
+    }
+}
+
+PluginTimer *ScopedPluginTimerManager::registerTimer(int seconds)
+{
+    if (m_pluginTimerManager.isNull())
+        return nullptr;
+
+    PluginTimer *timer = nullptr;
+    PluginTimerManagerImplementation *implementation = qobject_cast<PluginTimerManagerImplementation *>(m_pluginTimerManager.data());
+    if (implementation) {
+        timer = implementation->registerTimer(seconds, m_owner);
+    } else {
+        timer = m_pluginTimerManager->registerTimer(seconds);
+    }
+    m_timers.append(timer);
+    return timer;
+}
+
+void ScopedPluginTimerManager::unregisterTimer(PluginTimer *timer)
+{
+    if (m_pluginTimerManager.isNull())
+        return;
+
+    m_timers.removeAll(timer);
+    m_pluginTimerManager->unregisterTimer(timer);
+}
+
+bool ScopedPluginTimerManager::available() const
+{
+    return !m_pluginTimerManager.isNull() && m_pluginTimerManager->available();
+}
+
+bool ScopedPluginTimerManager::enabled() const
+{
+    return !m_pluginTimerManager.isNull() && m_pluginTimerManager->enabled();
+}
+
+void ScopedPluginTimerManager::setEnabled(bool enabled)
+{
+    // Only the hardware manager enables the shared resource
+    Q_UNUSED(enabled)
+}
+
+}
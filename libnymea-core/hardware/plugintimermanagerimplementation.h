@@ -34,11 +34,16 @@
 #include <QTimer>
 #include <QObject>
 #include <QPointer>
+#include <QVector>
+#include <QHash>
+#include <QVariantMap>
 
 #include "plugintimer.h"
 
 namespace nymeaserver {
 
+class PluginTimerManagerImplementation;
+
 class PluginTimerImplementation : public PluginTimer
 {
     Q_OBJECT
@@ -46,24 +51,37 @@ class PluginTimerImplementation : public PluginTimer
     friend class PluginTimerManagerImplementation;
 
 public:
-    explicit PluginTimerImplementation(int interval, QObject *parent = nullptr);
+    explicit PluginTimerImplementation(int interval, const QString &owner, PluginTimerManagerImplementation *manager);
+    ~PluginTimerImplementation() override;
 
     int interval() const override;
     int currentTick() const override;
     bool running() const override;
 
+    QString owner() const;
+
+protected:
+    void connectNotify(const QMetaMethod &signal) override;
+    void disconnectNotify(const QMetaMethod &signal) override;
+
 private:
+    PluginTimerManagerImplementation *m_manager = nullptr;
+    QString m_owner;
     int m_interval;
-    int m_currentTick = 0;
+
+    // Absolute tick of the manager for the next timeout, -1 while the timer is not scheduled
+    qint64 m_dueTick = -1;
+    int m_phase = 0;
+    // Ticks until the next timeout while the timer is paused or stopped
+    int m_remainingTicks = 0;
+    quint64 m_timeoutCount = 0;
 
     bool m_paused = false;
     bool m_running = true;
 
     void setRunning(bool running);
     void setPaused(bool paused);
-    void setCurrentTick(int tick);
-
-    void tick();
+    void updateSchedule();
 
 public slots:
     void reset() override;
@@ -79,20 +97,36 @@ class PluginTimerManagerImplementation : public PluginTimerManager
     Q_OBJECT
 
     friend class HardwareManagerImplementation;
+    friend class PluginTimerImplementation;
 
 public:
     explicit PluginTimerManagerImplementation(QObject *parent = nullptr);
+    ~PluginTimerManagerImplementation() override;
 
     PluginTimer *registerTimer(int seconds = 60) override;
+    PluginTimer *registerTimer(int seconds, const QString &owner);
     void unregisterTimer(PluginTimer *timer = nullptr) override;
 
     bool available() const override;
     bool enabled() const override;
 
+    QVariantMap statistics() const;
+
 private:
     QList<QPointer<PluginTimerImplementation> > m_timers;
+
+    // The timer wheel: all timers due on a tick are dispatched from one list
+    qint64 m_currentTick = 0;
+    QHash<qint64, QList<PluginTimerImplementation *> > m_schedule; // due tick | timers
+    QHash<int, QVector<int> > m_phaseLoad; // interval | scheduled timers per phase
+    QList<PluginTimerImplementation *> m_tickObservers;
+
     void timeTick();
 
+    int leastLoadedPhase(int interval) const;
+    void scheduleTimer(PluginTimerImplementation *timer, qint64 dueTick);
+    void unscheduleTimer(PluginTimerImplementation *timer);
+
 protected:
     void setEnabled(bool enabled) override;
 
@@ -106,6 +140,30 @@ private:
 
 };
 
+// Registers all timers under the name of the owner, i.e. the plugin using it
+class ScopedPluginTimerManager : public PluginTimerManager
+{
+    Q_OBJECT
+
+public:
+    explicit ScopedPluginTimerManager(PluginTimerManager *pluginTimerManager, const QString &owner, QObject *parent = nullptr);
+    ~ScopedPluginTimerManager() override;
+
+    PluginTimer *registerTimer(int seconds = 60) override;
+    void unregisterTimer(PluginTimer *timer = nullptr) override;
+
+    bool available() const override;
+    bool enabled() const override;
+
+protected:
+    void setEnabled(bool enabled) override;
+
+private:
+    QPointer<PluginTimerManager> m_pluginTimerManager;
+    QString m_owner;
+    QList<QPointer<PluginTimer> > m_timers;
+};
+
 }
 
 #endif // PLUGINTIMERIMPLEMENTATION_H
@@ -0,0 +1,96 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* Copyright 2013 - 2020, nymea GmbH
+* Contact: contact@nymea.io
+*
+* This file is part of nymea.
+* This project including source code and documentation is protected by
+* copyright law, and remains the property of nymea GmbH. All rights, including
+* reproduction, publication, editing and translation, are reserved. The use of
+* this project is subject to the terms of a license agreement to be concluded
+* with nymea GmbH in accordance with the terms of use of nymea GmbH, available
+* under https://nymea.io/license
+*
+* GNU General Public License Usage
+* Alternatively, this project may be redistributed and/or modified under the
+* terms of the GNU General Public License as published by the Free Software
+* Foundation, GNU version 3. This project is distributed in the hope that it
+* will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+* of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+* Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with
+* this project. If not, see <https://www.gnu.org/licenses/>.
+*
+* For any further details and any questions please contact us under
+* contact@nymea.io or see our FAQ/Licensing Information on
+* https://nymea.io/license/faq
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+/*!
+    \class nymeaserver::ScopedHardwareManager
+    \brief The view of a single plugin on the shared hardware manager.
+
+    \ingroup hardware
+    \inmodule core
+
+    All hardware resources are forwarded to the shared \l{HardwareManager}. Only the
+    \l{PluginTimerManager} is wrapped, so that the timers of a plugin are registered under
+    its name and are cleaned up when the plugin is unloaded.
+*/
+
+#include "scopedhardwaremanager.h"
+#include "plugintimermanagerimplementation.h"
+
+namespace nymeaserver {
+
+/*! Constructs a ScopedHardwareManager for the given \a owner, forwarding to the given \a hardwareManager. */
+ScopedHardwareManager::ScopedHardwareManager(HardwareManager *hardwareManager, const QString &owner, QObject *parent) :
+    HardwareManager(parent),
+    m_hardwareManager(hardwareManager)
+{
+    m_pluginTimerManager = new ScopedPluginTimerManager(hardwareManager->pluginTimerManager(), owner, this);
+}
+
+Radio433 *ScopedHardwareManager::radio433()
+{
+    return m_hardwareManager->radio433();
+}
+
+PluginTimerManager *ScopedHardwareManager::pluginTimerManager()
+{
+    return m_pluginTimerManager;
+}
+
+NetworkAccessManager *ScopedHardwareManager::networkManager()
+{
+    return m_hardwareManager->networkManager();
+}
+
+UpnpDiscovery *ScopedHardwareManager::upnpDiscovery()
+{
+    return m_hardwareManager->upnpDiscovery();
+}
+
+PlatformZeroConfController *ScopedHardwareManager::zeroConfController()
+{
+    return m_hardwareManager->zeroConfController();
+}
+
+BluetoothLowEnergyManager *ScopedHardwareManager::bluetoothLowEnergyManager()
+{
+    return m_hardwareManager->bluetoothLowEnergyManager();
+}
+
+MqttProvider *ScopedHardwareManager::mqttProvider()
+{
+    return m_hardwareManager->mqttProvider();
+}
+
+I2CManager *ScopedHardwareManager::i2cManager()
+{
+    return m_hardwareManager->i2cManager();
+}
+
+}
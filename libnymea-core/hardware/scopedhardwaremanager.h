@@ -0,0 +1,66 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* Copyright 2013 - 2020, nymea GmbH
+* Contact: contact@nymea.io
+*
+* This file is part of nymea.
+* This project including source code and documentation is protected by
+* copyright law, and remains the property of nymea GmbH. All rights, including
+* reproduction, publication, editing and translation, are reserved. The use of
+* this project is subject to the terms of a license agreement to be concluded
+* with nymea GmbH in accordance with the terms of use of nymea GmbH, available
+* under https://nymea.io/license
+*
+* GNU General Public License Usage
+* Alternatively, this project may be redistributed and/or modified under the
+* terms of the GNU General Public License as published by the Free Software
+* Foundation, GNU version 3. This project is distributed in the hope that it
+* will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+* of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+* Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with
+* this project. If not, see <https://www.gnu.org/licenses/>.
+*
+* For any further details and any questions please contact us under
+* contact@nymea.io or see our FAQ/Licensing Information on
+* https://nymea.io/license/faq
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef SCOPEDHARDWAREMANAGER_H
+#define SCOPEDHARDWAREMANAGER_H
+
+#include <QObject>
+
+#include "hardwaremanager.h"
+
+namespace nymeaserver {
+
+class ScopedPluginTimerManager;
+
+// The view of a single plugin on the shared hardware manager
+class ScopedHardwareManager : public HardwareManager
+{
+    Q_OBJECT
+
+public:
+    explicit ScopedHardwareManager(HardwareManager *hardwareManager, const QString &owner, QObject *parent = nullptr);
+
+    Radio433 *radio433() override;
+    PluginTimerManager *pluginTimerManager() override;
+    NetworkAccessManager *networkManager() override;
+    UpnpDiscovery *upnpDiscovery() override;
+    PlatformZeroConfController *zeroConfController() override;
+    BluetoothLowEnergyManager *bluetoothLowEnergyManager() override;
+    MqttProvider *mqttProvider() override;
+    I2CManager *i2cManager() override;
+
+private:
+    HardwareManager *m_hardwareManager = nullptr;
+    ScopedPluginTimerManager *m_pluginTimerManager = nullptr;
+};
+
+}
+
+#endif // SCOPEDHARDWAREMANAGER_H
@@ -30,6 +30,7 @@
 
 #include "thingmanagerimplementation.h"
 #include "translator.h"
+#include "thingsetupscheduler.h"
 #if QT_VERSION >= QT_VERSION_CHECK(5,12,0)
 #include "scriptintegrationplugin.h"
 #endif
@@ -39,6 +40,8 @@
 #include "nymeasettings.h"
 #include "version.h"
 #include "plugininfocache.h"
+#include "startuptracer.h"
+#include "hardware/scopedhardwaremanager.h"
 
 #include "integrations/thingdiscoveryinfo.h"
 #include "integrations/thingpairinginfo.h"
@@ -63,16 +66,32 @@
 #include <QCoreApplication>
 #include <QStandardPaths>
 #include <QDir>
+#include <QMetaEnum>
 
 ThingManagerImplementation::ThingManagerImplementation(HardwareManager *hardwareManager, const QLocale &locale, QObject *parent) :
     ThingManager(parent),
     m_hardwareManager(hardwareManager),
     m_locale(locale),
-    m_translator(new Translator(this))
+    m_translator(new Translator(this)),
+    m_setupScheduler(new ThingSetupScheduler(this))
 {
     qRegisterMetaType<ThingClassId>();
     qRegisterMetaType<ThingDescriptor>();
 
+    connect(m_setupScheduler, &ThingSetupScheduler::setupFinished, this, [this](ThingSetupInfo *info){
+        if (info->status() != Thing::ThingErrorNoError) {
+            qCWarning(dcThingManager()) << "Error setting up thing" << info->thing()->name() << info->thing()->id().toString() << info->status() << info->displayMessage();
+            info->thing()->setSetupStatus(Thing::ThingSetupStatusFailed, info->status(), info->displayMessage());
+            emit thingChanged(info->thing());
+            return;
+        }
+
+        qCDebug(dcThingManager()) << "Setup complete for thing" << info->thing();
+        info->thing()->setSetupStatus(Thing::ThingSetupStatusComplete, Thing::ThingErrorNoError);
+        emit thingChanged(info->thing());
+        postSetupThing(info->thing());
+    });
+
     foreach (const Interface &interface, ThingUtils::allInterfaces()) {
         m_supportedInterfaces.insert(interface.name(), interface);
     }
@@ -167,6 +186,11 @@ void ThingManagerImplementation::registerStaticPlugin(IntegrationPlugin *plugin,
     loadPlugin(plugin, metaData);
 }
 
+ThingSetupScheduler *ThingManagerImplementation::setupScheduler() const
+{
+    return m_setupScheduler;
+}
+
 IntegrationPlugins ThingManagerImplementation::plugins() const
 {
     return m_integrationPlugins.values();
@@ -760,6 +784,7 @@ Thing::ThingError ThingManagerImplementation::removeConfiguredThing(const ThingI
     NymeaSettings stateCache(NymeaSettings::SettingsRoleThingStates);
     stateCache.remove(thingId.toString());
 
+    dropIOConnectionRanges(thingId);
     foreach (const IOConnectionId &ioConnectionId, m_ioConnections.keys()) {
         IOConnection ioConnection = m_ioConnections.value(ioConnectionId);
         if (ioConnection.inputThingId() == thing->id() || ioConnection.outputThingId() == thing->id()) {
@@ -999,7 +1024,7 @@ IOConnectionResult ThingManagerImplementation::connectIO(const IOConnection &con
     }
 
     // Finally add the connection
-    m_ioConnections.insert(connection.id(), connection);
+    addIOConnection(connection);
 
     storeIOConnections();
 
@@ -1021,7 +1046,11 @@ Thing::ThingError ThingManagerImplementation::disconnectIO(const IOConnectionId
         qCWarning(dcThingManager()) << "IO connection" << ioConnectionId << "not found. Cannot disconnect.";
         return Thing::ThingErrorItemNotFound;
     }
-    m_ioConnections.remove(ioConnectionId);
+    IOConnection ioConnection = m_ioConnections.take(ioConnectionId);
+    m_ioConnectionsByInput.remove(IOStateKey(ioConnection.inputThingId(), ioConnection.inputStateTypeId()));
+    m_ioConnectionsByOutput.remove(IOStateKey(ioConnection.outputThingId(), ioConnection.outputStateTypeId()));
+    m_ioConnectionRanges.remove(ioConnectionId);
+    m_pendingIOOutputs.remove(ioConnectionId);
 
     NymeaSettings settings(NymeaSettings::SettingsRoleIOConnections);
     settings.beginGroup("IOConnections");
@@ -1069,57 +1098,109 @@ ActionType ThingManagerImplementation::translateActionType(const PluginId &plugi
 
 ThingClass ThingManagerImplementation::translateThingClass(const ThingClass &thingClass, const QLocale &locale)
 {
-    ThingClass translatedThingClass = thingClass;
-    translatedThingClass.setDisplayName(translate(thingClass.pluginId(), thingClass.displayName(), locale));
+    return m_translator->translateThingClass(thingClass, locale);
+}
 
-    ParamTypes translatedSettingsTypes;
-    foreach (const ParamType &paramType, thingClass.settingsTypes()) {
-        translatedSettingsTypes.append(translateParamType(thingClass.pluginId(), paramType, locale));
+Vendor ThingManagerImplementation::translateVendor(const Vendor &vendor, const QLocale &locale)
+{
+    return m_translator->translateVendor(vendor, locale);
+}
+
+Thing::ThingError ThingManagerImplementation::reloadPlugin(const PluginId &pluginId)
+{
+    IntegrationPlugin *plugin = m_integrationPlugins.value(pluginId);
+    QString fileName = m_pluginFiles.value(pluginId);
+    if (fileName.isEmpty()) {
+        if (!plugin) {
+            qCWarning(dcThingManager()) << "Cannot reload plugin" << pluginId.toString() << "Plugin not found.";
+            return Thing::ThingErrorPluginNotFound;
+        }
+        qCWarning(dcThingManager()) << "Cannot reload plugin" << plugin->pluginName() << "because it is built into nymea.";
+        return Thing::ThingErrorUnsupportedFeature;
     }
-    translatedThingClass.setSettingsTypes(translatedSettingsTypes);
 
-    ParamTypes translatedParamTypes;
-    foreach (const ParamType &paramType, thingClass.paramTypes()) {
-        translatedParamTypes.append(translateParamType(thingClass.pluginId(), paramType, locale));
+    QList<Thing*> things;
+    foreach (Thing *thing, m_configuredThings) {
+        if (thing->pluginId() == pluginId) {
+            things.append(thing);
+        }
     }
-    translatedThingClass.setParamTypes(translatedParamTypes);
 
-    StateTypes translatedStateTypes;
-    foreach (const StateType &stateType, thingClass.stateTypes()) {
-        translatedStateTypes.append(translateStateType(thingClass.pluginId(), stateType, locale));
+    // A plugin which failed to load on a previous reload is not around any more, but it can be tried again
+    if (plugin) {
+        qCInfo(dcThingManager()) << "Unloading plugin" << plugin->pluginName() << "with" << things.count() << "things";
+        unloadPlugin(plugin);
     }
-    translatedThingClass.setStateTypes(translatedStateTypes);
 
-    EventTypes translatedEventTypes;
-    foreach (const EventType &eventType, thingClass.eventTypes()) {
-        translatedEventTypes.append(translateEventType(thingClass.pluginId(), eventType, locale));
+    qCInfo(dcThingManager()) << "Reloading plugin from" << fileName;
+    IntegrationPlugin *newPlugin = nullptr;
+    PluginMetadata metaData;
+    if (fileName.endsWith(".js")) {
+#if QT_VERSION >= QT_VERSION_CHECK(5,12,0)
+        ScriptIntegrationPlugin *scriptPlugin = new ScriptIntegrationPlugin(this);
+        if (scriptPlugin->loadScript(fileName)) {
+            metaData = PluginMetadata(scriptPlugin->metaData());
+        }
+        if (metaData.pluginId() == pluginId) {
+            newPlugin = scriptPlugin;
+        } else {
+            qCWarning(dcThingManager()) << "The plugin in" << fileName << "failed to load or has a different plugin ID now.";
+            delete scriptPlugin;
+        }
+#endif
+    } else {
+        QPluginLoader *loader = loadPluginLibrary(fileName, metaData);
+        if (loader && metaData.pluginId() != pluginId) {
+            qCWarning(dcThingManager()) << "The plugin in" << fileName << "has a different plugin ID now. Not loading it.";
+            loader->unload();
+            delete loader;
+        } else if (loader) {
+            m_pluginLoaders.insert(pluginId, loader);
+            PluginInfoCache::cachePluginInfo(loader->metaData().value("MetaData").toObject());
+            newPlugin = qobject_cast<IntegrationPlugin *>(loader->instance());
+        }
     }
-    translatedThingClass.setEventTypes(translatedEventTypes);
 
-    ActionTypes translatedActionTypes;
-    foreach (const ActionType &actionType, thingClass.actionTypes()) {
-        translatedActionTypes.append(translateActionType(thingClass.pluginId(), actionType, locale));
+    if (!newPlugin) {
+        qCWarning(dcThingManager()) << "Failed to reload plugin from" << fileName;
+        foreach (Thing *thing, things) {
+            thing->setSetupStatus(Thing::ThingSetupStatusFailed, Thing::ThingErrorPluginNotFound, tr("The plugin for this thing is not loaded."));
+            emit thingChanged(thing);
+        }
+        return Thing::ThingErrorPluginNotFound;
     }
-    translatedThingClass.setActionTypes(translatedActionTypes);
 
-    return translatedThingClass;
-}
+    loadPlugin(newPlugin, metaData);
 
-Vendor ThingManagerImplementation::translateVendor(const Vendor &vendor, const QLocale &locale)
-{
-    IntegrationPlugin *plugin = nullptr;
-    foreach (IntegrationPlugin *p, m_integrationPlugins) {
-        if (p->supportedVendors().contains(vendor)) {
-            plugin = p;
+    // Things keep their identity so rules, IO connections and clients keep referring to them. They only
+    // pick up the possibly updated thing class and are set up again.
+    QList<Thing*> setupList;
+    foreach (Thing *thing, things) {
+        ThingClass thingClass = m_supportedThings.value(thing->thingClassId());
+        if (!thingClass.isValid()) {
+            qCWarning(dcThingManager()) << "Plugin" << newPlugin->pluginName() << "has removed support for thing" << thing->name() << thing->id().toString();
+            thing->setSetupStatus(Thing::ThingSetupStatusFailed, Thing::ThingErrorThingClassNotFound);
+            emit thingChanged(thing);
+            continue;
+        }
+        thing->m_thingClass = thingClass;
+        // The ranges of the state types may have changed with the thing class
+        dropIOConnectionRanges(thing->id());
+        if (thing->parentId().isNull()) {
+            setupList.prepend(thing);
+        } else {
+            setupList.append(thing);
         }
     }
-    if (!plugin) {
-        return vendor;
+    m_setupScheduler->schedule(setupList);
+    foreach (Thing *thing, setupList) {
+        emit thingChanged(thing);
     }
 
-    Vendor translatedVendor = vendor;
-    translatedVendor.setDisplayName(translate(plugin->pluginId(), vendor.displayName(), locale));
-    return translatedVendor;
+    newPlugin->startMonitoringAutoThings();
+
+    qCInfo(dcThingManager()) << "Reloaded plugin" << newPlugin->pluginName() << "and scheduled setup for" << setupList.count() << "things";
+    return Thing::ThingErrorNoError;
 }
 
 Thing *ThingManagerImplementation::findConfiguredThing(const ThingId &id) const
@@ -1235,6 +1316,8 @@ ThingActionInfo *ThingManagerImplementation::executeAction(const Action &action)
 
 void ThingManagerImplementation::loadPlugins()
 {
+    StartupTraceScope loadPluginsTrace("Load plugins", "core");
+
     foreach (const QString &path, pluginSearchDirs()) {
         QDir dir(path);
         qCDebug(dcThingManager) << "Loading plugins from:" << dir.absolutePath();
@@ -1249,62 +1332,24 @@ void ThingManagerImplementation::loadPlugins()
             if (!fi.exists())
                 continue;
 
-            // Check plugin API version compatibility
-            QLibrary lib(fi.absoluteFilePath());
-            if (!lib.load()) {
-                qCWarning(dcThingManager()).nospace() << "Error loading plugin " << fi.absoluteFilePath() << ": " << lib.errorString();
-                continue;
-            }
-
-            QFunctionPointer versionFunc = lib.resolve("libnymea_api_version");
-            if (!versionFunc) {
-                qCWarning(dcThingManager()).nospace() << "Unable to resolve version in plugin " << fi.absoluteFilePath() << ". Not loading plugin.";
-                lib.unload();
-                continue;
-            }
-
-            QString version = reinterpret_cast<QString(*)()>(versionFunc)();
-            lib.unload();
-            QStringList parts = version.split('.');
-            QStringList coreParts = QString(LIBNYMEA_API_VERSION).split('.');
-            if (parts.length() != 3 || parts.at(0).toInt() != coreParts.at(0).toInt() || parts.at(1).toInt() > coreParts.at(1).toInt()) {
-                qCWarning(dcThingManager()).nospace() << "Libnymea API mismatch for " << fi.absoluteFilePath() << ". Core API: " << LIBNYMEA_API_VERSION << ", Plugin API: " << version;
-                continue;
-            }
-
-            // Version is ok. Now load the plugin
-            QPluginLoader loader;
-            loader.setFileName(fi.absoluteFilePath());
-            loader.setLoadHints(QLibrary::ResolveAllSymbolsHint);
-
-            qCDebug(dcThingManager()) << "Loading plugin from:" << fi.absoluteFilePath();
-            if (!loader.load()) {
-                qCWarning(dcThingManager) << "Could not load plugin data of" << entry << "\n" << loader.errorString();
-                continue;
-            }
-
-            QJsonObject pluginInfo = loader.metaData().value("MetaData").toObject();
-            PluginMetadata metaData(pluginInfo, false, false);
-            if (!metaData.isValid()) {
-                foreach (const QString &error, metaData.validationErrors()) {
-                    qCWarning(dcThingManager()) << error;
-                }
-                loader.unload();
-                continue;
-            }
+            StartupTraceScope pluginFileTrace(fi.fileName(), "plugin-load");
 
-            IntegrationPlugin *pluginIface = qobject_cast<IntegrationPlugin *>(loader.instance());
-            if (!pluginIface) {
-                qCWarning(dcThingManager) << "Could not get plugin instance of" << entry;
-                loader.unload();
+            PluginMetadata metaData;
+            QPluginLoader *loader = loadPluginLibrary(fi.absoluteFilePath(), metaData);
+            if (!loader) {
                 continue;
             }
-            if (m_integrationPlugins.contains(pluginIface->pluginId())) {
+            if (m_integrationPlugins.contains(metaData.pluginId())) {
                 qCWarning(dcThingManager()) << "A plugin with this ID is already loaded. Not loading" << entry;
+                loader->unload();
+                delete loader;
                 continue;
             }
+            IntegrationPlugin *pluginIface = qobject_cast<IntegrationPlugin *>(loader->instance());
             loadPlugin(pluginIface, metaData);
-            PluginInfoCache::cachePluginInfo(pluginInfo);
+            m_pluginLoaders.insert(metaData.pluginId(), loader);
+            m_pluginFiles.insert(metaData.pluginId(), fi.absoluteFilePath());
+            PluginInfoCache::cachePluginInfo(loader->metaData().value("MetaData").toObject());
         }
     }
 
@@ -1326,6 +1371,8 @@ void ThingManagerImplementation::loadPlugins()
                 continue;
             }
 
+            StartupTraceScope pluginFileTrace(jsFi.fileName(), "plugin-load");
+
             ScriptIntegrationPlugin *plugin = new ScriptIntegrationPlugin(this);
             bool ret = plugin->loadScript(jsFi.absoluteFilePath());
             if (!ret) {
@@ -1341,15 +1388,78 @@ void ThingManagerImplementation::loadPlugins()
                 }
             }
             loadPlugin(plugin, metaData);
+            m_pluginFiles.insert(metaData.pluginId(), jsFi.absoluteFilePath());
         }
     }
 #endif
 }
 
+QPluginLoader *ThingManagerImplementation::loadPluginLibrary(const QString &fileName, PluginMetadata &metaData)
+{
+    // Check plugin API version compatibility
+    QLibrary lib(fileName);
+    if (!lib.load()) {
+        qCWarning(dcThingManager()).nospace() << "Error loading plugin " << fileName << ": " << lib.errorString();
+        return nullptr;
+    }
+
+    QFunctionPointer versionFunc = lib.resolve("libnymea_api_version");
+    if (!versionFunc) {
+        qCWarning(dcThingManager()).nospace() << "Unable to resolve version in plugin " << fileName << ". Not loading plugin.";
+        lib.unload();
+        return nullptr;
+    }
+
+    QString version = reinterpret_cast<QString(*)()>(versionFunc)();
+    lib.unload();
+    QStringList parts = version.split('.');
+    QStringList coreParts = QString(LIBNYMEA_API_VERSION).split('.');
+    if (parts.length() != 3 || parts.at(0).toInt() != coreParts.at(0).toInt() || parts.at(1).toInt() > coreParts.at(1).toInt()) {
+        qCWarning(dcThingManager()).nospace() << "Libnymea API mismatch for " << fileName << ". Core API: " << LIBNYMEA_API_VERSION << ", Plugin API: " << version;
+        return nullptr;
+    }
+
+    // Version is ok. Now load the plugin
+    QPluginLoader *loader = new QPluginLoader(this);
+    loader->setFileName(fileName);
+    loader->setLoadHints(QLibrary::ResolveAllSymbolsHint);
+
+    qCDebug(dcThingManager()) << "Loading plugin from:" << fileName;
+    if (!loader->load()) {
+        qCWarning(dcThingManager) << "Could not load plugin data of" << fileName << "\n" << loader->errorString();
+        delete loader;
+        return nullptr;
+    }
+
+    metaData = PluginMetadata(loader->metaData().value("MetaData").toObject(), false, false);
+    if (!metaData.isValid()) {
+        foreach (const QString &error, metaData.validationErrors()) {
+            qCWarning(dcThingManager()) << error;
+        }
+        loader->unload();
+        delete loader;
+        return nullptr;
+    }
+
+    IntegrationPlugin *pluginIface = qobject_cast<IntegrationPlugin *>(loader->instance());
+    if (!pluginIface) {
+        qCWarning(dcThingManager) << "Could not get plugin instance of" << fileName;
+        loader->unload();
+        delete loader;
+        return nullptr;
+    }
+    return loader;
+}
+
 void ThingManagerImplementation::loadPlugin(IntegrationPlugin *pluginIface, const PluginMetadata &metaData)
 {
+    StartupTraceScope pluginTrace(metaData.pluginName(), "plugin", {{"pluginId", metaData.pluginId().toString()}});
+
     pluginIface->setParent(this);
-    pluginIface->initPlugin(metaData, this, m_hardwareManager);
+
+    // Each plugin gets its own view on the hardware resources, so its timers are accounted to it
+    ScopedHardwareManager *hardwareManager = new ScopedHardwareManager(m_hardwareManager, metaData.pluginName(), pluginIface);
+    pluginIface->initPlugin(metaData, this, hardwareManager);
 
     qCDebug(dcThingManager) << "**** Loaded plugin" << pluginIface->pluginName();
     foreach (const Vendor &vendor, pluginIface->supportedVendors()) {
@@ -1427,8 +1537,52 @@ void ThingManagerImplementation::loadPlugin(IntegrationPlugin *pluginIface, cons
     connect(pluginIface, &IntegrationPlugin::autoThingDisappeared, this, &ThingManagerImplementation::onAutoThingDisappeared, Qt::QueuedConnection);
 }
 
+void ThingManagerImplementation::unloadPlugin(IntegrationPlugin *plugin)
+{
+    PluginId pluginId = plugin->pluginId();
+    m_setupScheduler->cancel(pluginId);
+
+    foreach (Thing *thing, m_configuredThings) {
+        if (thing->pluginId() != pluginId) {
+            continue;
+        }
+        storeThingStates(thing);
+        plugin->thingRemoved(thing);
+        thing->setSetupStatus(Thing::ThingSetupStatusNone, Thing::ThingErrorNoError);
+        dropIOConnectionRanges(thing->id());
+    }
+
+    disconnect(plugin, nullptr, this, nullptr);
+    m_integrationPlugins.remove(pluginId);
+
+    foreach (const ThingClass &thingClass, plugin->supportedThings()) {
+        m_supportedThings.remove(thingClass.id());
+        m_vendorThingMap[thingClass.vendorId()].removeAll(thingClass.id());
+    }
+    // Vendors may be shared between plugins
+    foreach (const Vendor &vendor, plugin->supportedVendors()) {
+        if (m_vendorThingMap.value(vendor.id()).isEmpty()) {
+            m_vendorThingMap.remove(vendor.id());
+            m_supportedVendors.remove(vendor.id());
+        }
+    }
+
+    m_translator->unloadTranslations(pluginId);
+
+    QPluginLoader *loader = m_pluginLoaders.take(pluginId);
+    delete plugin;
+    if (loader) {
+        if (!loader->unload()) {
+            qCWarning(dcThingManager()) << "Failed to unload plugin library" << loader->fileName() << loader->errorString();
+        }
+        delete loader;
+    }
+}
+
 void ThingManagerImplementation::loadConfiguredThings()
 {
+    StartupTraceScope loadThingsTrace("Load configured things", "core");
+
     bool needsMigration = false;
     NymeaSettings settings(NymeaSettings::SettingsRoleThings);
     if (settings.childGroups().contains("ThingConfig")) {
@@ -1569,38 +1723,19 @@ void ThingManagerImplementation::loadConfiguredThings()
     }
 
 
-    QHash<ThingId, Thing*> setupList = m_configuredThings;
-    while (!setupList.isEmpty()) {
-        Thing *thing = nullptr;
-        foreach (Thing *d, setupList) {
-            if (d->parentId().isNull() || !setupList.contains(d->parentId())) {
-                thing = d;
-                setupList.take(d->id());
-                break;
-            }
+    // We load things in any case, knowing that they worked at some point. However, they'll be marked as
+    // non-working until the setup succeeds so the user might delete them in the meantime... The scheduler
+    // takes care of not reporting back things which have been removed while being set up.
+    // Parents are scheduled first so they get the first slots of their plugin.
+    QList<Thing*> setupList;
+    foreach (Thing *thing, m_configuredThings) {
+        if (thing->parentId().isNull()) {
+            setupList.prepend(thing);
+        } else {
+            setupList.append(thing);
         }
-        Q_ASSERT(thing != nullptr);
-
-        thing->setSetupStatus(Thing::ThingSetupStatusInProgress, Thing::ThingErrorNoError);
-        ThingSetupInfo *info = setupThing(thing);
-        // Set receiving object to "thing" because at startup we load it in any case, knowing that it worked at
-        // some point. However, it'll be marked as non-working until the setup succeeds so the user might delete
-        // it in the meantime... In that case we don't want to call postsetup on it.
-        connect(info, &ThingSetupInfo::finished, thing, [this, info](){
-
-            if (info->status() != Thing::ThingErrorNoError) {
-                qCWarning(dcThingManager()) << "Error setting up thing" << info->thing()->name() << info->thing()->id().toString() << info->status() << info->displayMessage();
-                info->thing()->setSetupStatus(Thing::ThingSetupStatusFailed, info->status(), info->displayMessage());
-                emit thingChanged(info->thing());
-                return;
-            }
-
-            qCDebug(dcThingManager()) << "Setup complete for thing" << info->thing();
-            info->thing()->setSetupStatus(Thing::ThingSetupStatusComplete, Thing::ThingErrorNoError);
-            emit thingChanged(info->thing());
-            postSetupThing(info->thing());
-        });
     }
+    m_setupScheduler->schedule(setupList);
 
     loadIOConnections();
 }
@@ -1646,6 +1781,7 @@ void ThingManagerImplementation::storeConfiguredThings()
 
 void ThingManagerImplementation::startMonitoringAutoThings()
 {
+    StartupTraceScope monitorTrace("Start monitoring auto things", "core");
     foreach (IntegrationPlugin *plugin, m_integrationPlugins) {
         plugin->startMonitoringAutoThings();
     }
@@ -1797,123 +1933,188 @@ void ThingManagerImplementation::slotThingStateValueChanged(const StateTypeId &s
 
 void ThingManagerImplementation::syncIOConnection(Thing *thing, const StateTypeId &stateTypeId)
 {
+    IOStateKey key(thing->id(), stateTypeId);
 
-    foreach (const IOConnection &ioConnection, m_ioConnections) {
-        // Check if this state is an input to an IO connection.
-        if (ioConnection.inputThingId() == thing->id() && ioConnection.inputStateTypeId() == stateTypeId) {
-            Thing *inputThing = thing;
-            QVariant inputValue = inputThing->stateValue(stateTypeId);
-
-            Thing *outputThing = m_configuredThings.value(ioConnection.outputThingId());
-            if (!outputThing) {
-                qCWarning(dcThingManager()) << "IO connection contains invalid output thing!";
-                continue;
-            }
-            IntegrationPlugin *plugin = m_integrationPlugins.value(outputThing->pluginId());
-            if (!plugin) {
-                qCWarning(dcThingManager()) << "Plugin not found for IO connection's output action.";
-                continue;
-            }
-            StateType inputStateType = inputThing->thingClass().getStateType(stateTypeId);
+    // Check if this state is an input to an IO connection.
+    QHash<IOStateKey, IOConnectionId>::const_iterator it = m_ioConnectionsByInput.constFind(key);
+    if (it != m_ioConnectionsByInput.constEnd()) {
+        syncIOOutput(m_ioConnections.value(it.value()));
+    }
 
-            StateType outputStateType = outputThing->thingClass().getStateType(ioConnection.outputStateTypeId());
-            if (outputStateType.id().isNull()) {
-                qCWarning(dcThingManager()) << "Could not find output state type for IO connection.";
-                continue;
-            }
-            QVariant outputValue;
-            if (outputStateType.ioType() == Types::IOTypeDigitalOutput) {
-                // Digital IOs are mapped as-is
-                outputValue = ioConnection.inverted() xor inputValue.toBool();
+    // Now check if this is an output state type and - if possible - update the inputs for bidirectional connections
+    it = m_ioConnectionsByOutput.constFind(key);
+    if (it != m_ioConnectionsByOutput.constEnd()) {
+        syncIOInput(m_ioConnections.value(it.value()));
+    }
+}
 
-                // We're already in sync! Skipping action.
-                if (outputThing->stateValue(outputStateType.id()) == outputValue) {
-                    continue;
-                }
-            } else {
-                // Analog IOs are mapped within the according min/max ranges
-                outputValue = mapValue(inputValue, inputStateType, outputStateType, ioConnection.inverted());
+void ThingManagerImplementation::syncIOOutput(const IOConnection &ioConnection)
+{
+    Thing *inputThing = m_configuredThings.value(ioConnection.inputThingId());
+    Thing *outputThing = m_configuredThings.value(ioConnection.outputThingId());
+    if (!inputThing || !outputThing) {
+        qCWarning(dcThingManager()) << "IO connection contains invalid output thing!";
+        return;
+    }
+    // Work on a copy, executing actions may re-enter and modify the cached ranges
+    IOConnectionRanges ranges;
+    if (!resolveIOConnection(ioConnection, &ranges)) {
+        return;
+    }
 
-                // We're already in sync (fuzzy, good enough)! Skipping action.
-                if (qFuzzyCompare(1.0 + outputThing->stateValue(outputStateType.id()).toDouble(), 1.0 + outputValue.toDouble())) {
-                    continue;
-                }
-            }
-            Action outputAction(ActionTypeId(ioConnection.outputStateTypeId()), ioConnection.outputThingId());
-
-            Param outputParam(ioConnection.outputStateTypeId(), outputValue);
-            outputAction.setParams(ParamList() << outputParam);
-            qCDebug(dcThingManager()) << "Executing IO connection action on" << outputThing->name() << outputParam;
-            ThingActionInfo* info = executeAction(outputAction);
-            connect(info, &ThingActionInfo::finished, this, [=](){
-                if (info->status() != Thing::ThingErrorNoError) {
-                    // An error happened... let's switch the input back to be in sync with the output
-                    qCWarning(dcThingManager()) << "Error syncing IO connection state. Reverting input back to old value.";
-                    if (inputStateType.ioType() == Types::IOTypeDigitalInput) {
-                        inputThing->setStateValue(inputStateType.id(), outputThing->stateValue(outputStateType.id()));
-                    } else {
-                        inputThing->setStateValue(inputStateType.id(), mapValue(outputThing->stateValue(outputStateType.id()), outputStateType, inputStateType, ioConnection.inverted()));
-                    }
-                }
-            });
+    QVariant inputValue = inputThing->stateValue(ioConnection.inputStateTypeId());
+    QVariant outputValue;
+    if (ranges.outputIOType == Types::IOTypeDigitalOutput) {
+        // Digital IOs are mapped as-is
+        outputValue = ioConnection.inverted() xor inputValue.toBool();
+
+        // We're already in sync! Skipping action.
+        if (outputThing->stateValue(ioConnection.outputStateTypeId()) == outputValue) {
+            return;
         }
+    } else {
+        // Analog IOs are mapped within the according min/max ranges
+        outputValue = mapValue(inputValue.toDouble(), ranges.inputMin, ranges.inputMax, ranges.outputMin, ranges.outputMax, ioConnection.inverted());
 
-        // Now check if this is an output state type and - if possible - update the inputs for bidirectional connections
-        if (ioConnection.outputThingId() == thing->id() && ioConnection.outputStateTypeId() == stateTypeId) {
-            Thing *outputThing = thing;
-            QVariant outputValue = outputThing->stateValue(stateTypeId);
+        // We're already in sync (fuzzy, good enough)! Skipping action.
+        if (qFuzzyCompare(1.0 + outputThing->stateValue(ioConnection.outputStateTypeId()).toDouble(), 1.0 + outputValue.toDouble())) {
+            return;
+        }
 
-            Thing *inputThing = m_configuredThings.value(ioConnection.inputThingId());
-            if (!inputThing) {
-                qCWarning(dcThingManager()) << "IO connection contains invalid input thing!";
-                continue;
-            }
-            IntegrationPlugin *plugin = m_integrationPlugins.value(inputThing->pluginId());
-            if (!plugin) {
-                qCWarning(dcThingManager()) << "Plugin not found for IO connection's input action.";
-                continue;
-            }
-            StateType outputStateType = outputThing->thingClass().getStateType(stateTypeId);
+        // Only one analog output action per connection is running at a time. Changes in the meantime are
+        // coalesced into a single action with the latest input value once the running one finished.
+        if (m_runningIOOutputs.contains(ioConnection.id())) {
+            m_pendingIOOutputs.insert(ioConnection.id());
+            return;
+        }
+        m_runningIOOutputs.insert(ioConnection.id());
+    }
 
-            StateType inputStateType = inputThing->thingClass().getStateType(ioConnection.inputStateTypeId());
-            if (inputStateType.id().isNull()) {
-                qCWarning(dcThingManager()) << "Could not find input state type for IO connection.";
-                continue;
-            }
+    Action outputAction(ActionTypeId(ioConnection.outputStateTypeId()), ioConnection.outputThingId());
 
-            if (!inputStateType.writable()) {
-                qCDebug(dcThingManager()) << "Input state is not writable. This connection is unidirectional.";
-                continue;
+    Param outputParam(ioConnection.outputStateTypeId(), outputValue);
+    outputAction.setParams(ParamList() << outputParam);
+    qCDebug(dcThingManager()) << "Executing IO connection action on" << outputThing->name() << outputParam;
+    ThingActionInfo* info = executeAction(outputAction);
+    connect(info, &ThingActionInfo::finished, this, [=](){
+        m_runningIOOutputs.remove(ioConnection.id());
+        if (info->status() != Thing::ThingErrorNoError) {
+            // An error happened... let's switch the input back to be in sync with the output
+            qCWarning(dcThingManager()) << "Error syncing IO connection state. Reverting input back to old value.";
+            QVariant outputStateValue = outputThing->stateValue(ioConnection.outputStateTypeId());
+            if (ranges.inputIOType == Types::IOTypeDigitalInput) {
+                inputThing->setStateValue(ioConnection.inputStateTypeId(), outputStateValue);
+            } else {
+                inputThing->setStateValue(ioConnection.inputStateTypeId(), mapValue(outputStateValue.toDouble(), ranges.outputMin, ranges.outputMax, ranges.inputMin, ranges.inputMax, ioConnection.inverted()));
             }
+        }
+        if (m_pendingIOOutputs.remove(ioConnection.id()) && m_ioConnections.contains(ioConnection.id())) {
+            syncIOOutput(m_ioConnections.value(ioConnection.id()));
+        }
+    });
+}
+
+void ThingManagerImplementation::syncIOInput(const IOConnection &ioConnection)
+{
+    Thing *outputThing = m_configuredThings.value(ioConnection.outputThingId());
+    Thing *inputThing = m_configuredThings.value(ioConnection.inputThingId());
+    if (!inputThing || !outputThing) {
+        qCWarning(dcThingManager()) << "IO connection contains invalid input thing!";
+        return;
+    }
+    // Work on a copy, executing actions may re-enter and modify the cached ranges
+    IOConnectionRanges ranges;
+    if (!resolveIOConnection(ioConnection, &ranges)) {
+        return;
+    }
 
-            QVariant inputValue;
-            if (inputStateType.ioType() == Types::IOTypeDigitalInput) {
-                // Digital IOs are mapped as-is
-                inputValue = ioConnection.inverted() xor outputValue.toBool();
+    if (!ranges.inputWritable) {
+        qCDebug(dcThingManager()) << "Input state is not writable. This connection is unidirectional.";
+        return;
+    }
 
-                // Prevent looping
-                if (inputThing->stateValue(inputStateType.id()) == inputValue) {
-                    continue;
-                }
-            } else {
-                // Analog IOs are mapped within the according min/max ranges
-                inputValue = mapValue(outputValue, outputStateType, inputStateType, ioConnection.inverted());
+    QVariant outputValue = outputThing->stateValue(ioConnection.outputStateTypeId());
+    QVariant inputValue;
+    if (ranges.inputIOType == Types::IOTypeDigitalInput) {
+        // Digital IOs are mapped as-is
+        inputValue = ioConnection.inverted() xor outputValue.toBool();
 
-                // Prevent looping even if the above calculation has rounding errors... Just skip this action if we're close enough already
-                if (qFuzzyCompare(1.0 + inputThing->stateValue(inputStateType.id()).toDouble(), 1.0 + inputValue.toDouble())) {
-                    continue;
-                }
-            }
-            Action inputAction(ActionTypeId(ioConnection.inputStateTypeId()), ioConnection.inputThingId());
+        // Prevent looping
+        if (inputThing->stateValue(ioConnection.inputStateTypeId()) == inputValue) {
+            return;
+        }
+    } else {
+        // Analog IOs are mapped within the according min/max ranges
+        inputValue = mapValue(outputValue.toDouble(), ranges.outputMin, ranges.outputMax, ranges.inputMin, ranges.inputMax, ioConnection.inverted());
+
+        // Prevent looping even if the above calculation has rounding errors... Just skip this action if we're close enough already
+        if (qFuzzyCompare(1.0 + inputThing->stateValue(ioConnection.inputStateTypeId()).toDouble(), 1.0 + inputValue.toDouble())) {
+            return;
+        }
+    }
+    Action inputAction(ActionTypeId(ioConnection.inputStateTypeId()), ioConnection.inputThingId());
+
+    Param inputParam(ioConnection.inputStateTypeId(), inputValue);
+    inputAction.setParams(ParamList() << inputParam);
+    qCDebug(dcThingManager()) << "Executing reverse IO connection action on" << inputThing->name() << inputParam;
+    executeAction(inputAction);
+}
+
+bool ThingManagerImplementation::resolveIOConnection(const IOConnection &ioConnection, IOConnectionRanges *ranges)
+{
+    QHash<IOConnectionId, IOConnectionRanges>::const_iterator it = m_ioConnectionRanges.constFind(ioConnection.id());
+    if (it != m_ioConnectionRanges.constEnd()) {
+        *ranges = it.value();
+        return true;
+    }
+
+    Thing *inputThing = m_configuredThings.value(ioConnection.inputThingId());
+    Thing *outputThing = m_configuredThings.value(ioConnection.outputThingId());
+    if (!inputThing || !outputThing) {
+        return false;
+    }
+    if (!m_integrationPlugins.contains(inputThing->pluginId()) || !m_integrationPlugins.contains(outputThing->pluginId())) {
+        qCWarning(dcThingManager()) << "Plugin not found for IO connection" << ioConnection.id();
+        return false;
+    }
+    StateType inputStateType = inputThing->thingClass().getStateType(ioConnection.inputStateTypeId());
+    StateType outputStateType = outputThing->thingClass().getStateType(ioConnection.outputStateTypeId());
+    if (inputStateType.id().isNull() || outputStateType.id().isNull()) {
+        qCWarning(dcThingManager()) << "Could not find state types for IO connection" << ioConnection.id();
+        return false;
+    }
+
+    ranges->inputIOType = inputStateType.ioType();
+    ranges->outputIOType = outputStateType.ioType();
+    ranges->inputWritable = inputStateType.writable();
+    ranges->inputMin = inputStateType.minValue().toDouble();
+    ranges->inputMax = inputStateType.maxValue().toDouble();
+    ranges->outputMin = outputStateType.minValue().toDouble();
+    ranges->outputMax = outputStateType.maxValue().toDouble();
+    m_ioConnectionRanges.insert(ioConnection.id(), *ranges);
+    return true;
+}
 
-            Param inputParam(ioConnection.inputStateTypeId(), inputValue);
-            inputAction.setParams(ParamList() << inputParam);
-            qCDebug(dcThingManager()) << "Executing reverse IO connection action on" << inputThing->name() << inputParam;
-            executeAction(inputAction);
+void ThingManagerImplementation::dropIOConnectionRanges(const ThingId &thingId)
+{
+    QHash<IOConnectionId, IOConnectionRanges>::iterator it = m_ioConnectionRanges.begin();
+    while (it != m_ioConnectionRanges.end()) {
+        IOConnection ioConnection = m_ioConnections.value(it.key());
+        if (ioConnection.inputThingId() == thingId || ioConnection.outputThingId() == thingId) {
+            it = m_ioConnectionRanges.erase(it);
+        } else {
+            ++it;
         }
     }
 }
 
+void ThingManagerImplementation::addIOConnection(const IOConnection &ioConnection)
+{
+    m_ioConnections.insert(ioConnection.id(), ioConnection);
+    m_ioConnectionsByInput.insert(IOStateKey(ioConnection.inputThingId(), ioConnection.inputStateTypeId()), ioConnection.id());
+    m_ioConnectionsByOutput.insert(IOStateKey(ioConnection.outputThingId(), ioConnection.outputStateTypeId()), ioConnection.id());
+}
+
 void ThingManagerImplementation::slotThingSettingChanged(const ParamTypeId &paramTypeId, const QVariant &value)
 {
     Thing *thing = qobject_cast<Thing*>(sender());
@@ -2013,12 +2214,26 @@ ThingSetupInfo* ThingManagerImplementation::setupThing(Thing *thing)
     thing->setStates(states);
     loadThingStates(thing);
 
-    connect(thing, &Thing::stateValueChanged, this, &ThingManagerImplementation::slotThingStateValueChanged);
-    connect(thing, &Thing::settingChanged, this, &ThingManagerImplementation::slotThingSettingChanged);
-    connect(thing, &Thing::nameChanged, this, &ThingManagerImplementation::slotThingNameChanged);
+    // Setups may be retried, make sure we're connected only once
+    connect(thing, &Thing::stateValueChanged, this, &ThingManagerImplementation::slotThingStateValueChanged, Qt::UniqueConnection);
+    connect(thing, &Thing::settingChanged, this, &ThingManagerImplementation::slotThingSettingChanged, Qt::UniqueConnection);
+    connect(thing, &Thing::nameChanged, this, &ThingManagerImplementation::slotThingNameChanged, Qt::UniqueConnection);
 
 
     ThingSetupInfo *info = new ThingSetupInfo(thing, this, 30000);
+
+    StartupTracer *tracer = StartupTracer::instance();
+    if (tracer->enabled() && !tracer->startupFinished()) {
+        QVariantMap traceArgs;
+        traceArgs.insert("thingId", thing->id().toString());
+        traceArgs.insert("thingClass", thingClass.name());
+        traceArgs.insert("plugin", plugin->pluginName());
+        int spanId = tracer->beginSpan(thing->name(), "thing", traceArgs);
+        connect(info, &ThingSetupInfo::finished, this, [tracer, spanId, info](){
+            tracer->endSpan(spanId, {{"status", QMetaEnum::fromType<Thing::ThingError>().valueToKey(info->status())}});
+        });
+    }
+
     plugin->setupThing(info);
 
     return info;
@@ -2088,7 +2303,7 @@ void ThingManagerImplementation::loadIOConnections()
         StateTypeId outputStateTypeId = connectionSettings.value("outputStateTypeId").toUuid();
         bool inverted = connectionSettings.value("inverted").toBool();
         IOConnection ioConnection(id, inputThingId, inputStateTypeId, outputThingId, outputStateTypeId, inverted);
-        m_ioConnections.insert(id, ioConnection);
+        addIOConnection(ioConnection);
         connectionSettings.endGroup();
 
         Thing *inputThing = m_configuredThings.value(inputThingId);
@@ -2100,13 +2315,8 @@ void ThingManagerImplementation::loadIOConnections()
     connectionSettings.endGroup();
 }
 
-QVariant ThingManagerImplementation::mapValue(const QVariant &value, const StateType &fromStateType, const StateType &toStateType, bool inverted) const
+double ThingManagerImplementation::mapValue(double fromValue, double fromMin, double fromMax, double toMin, double toMax, bool inverted)
 {
-    double fromMin = fromStateType.minValue().toDouble();
-    double fromMax = fromStateType.maxValue().toDouble();
-    double toMin = toStateType.minValue().toDouble();
-    double toMax = toStateType.maxValue().toDouble();
-    double fromValue = value.toDouble();
     double fromPercent = (fromValue - fromMin) / (fromMax - fromMin);
     fromPercent = inverted ? 1 - fromPercent : fromPercent;
     double toValue = toMin + (toMax - toMin) * fromPercent;
@@ -46,6 +46,7 @@
 
 #include <QObject>
 #include <QTimer>
+#include <QSet>
 #include <QLocale>
 #include <QPluginLoader>
 #include <QTranslator>
@@ -59,12 +60,14 @@ class IntegrationPlugin;
 class ThingPairingInfo;
 class HardwareManager;
 class Translator;
+class ThingSetupScheduler;
 
 class ThingManagerImplementation: public ThingManager
 {
     Q_OBJECT
 
     friend class IntegrationPlugin;
+    friend class ThingSetupScheduler;
 
 public:
     explicit ThingManagerImplementation(HardwareManager *hardwareManager, const QLocale &locale, QObject *parent = nullptr);
@@ -74,6 +77,8 @@ public:
     static QList<QJsonObject> pluginsMetadata();
     void registerStaticPlugin(IntegrationPlugin* plugin, const PluginMetadata &metaData);
 
+    ThingSetupScheduler *setupScheduler() const;
+
     IntegrationPlugins plugins() const override;
     IntegrationPlugin *plugin(const PluginId &pluginId) const override;
     Thing::ThingError setPluginConfig(const PluginId &pluginId, const ParamList &pluginConfig) override;
@@ -126,6 +131,8 @@ public:
     ThingClass translateThingClass(const ThingClass &thingClass, const QLocale &locale) override;
     Vendor translateVendor(const Vendor &vendor, const QLocale &locale) override;
 
+    Thing::ThingError reloadPlugin(const PluginId &pluginId) override;
+
 signals:
     void loaded();
 
@@ -147,6 +154,9 @@ private slots:
     void slotThingNameChanged();
 
 private:
+    QPluginLoader *loadPluginLibrary(const QString &fileName, PluginMetadata &metaData);
+    void unloadPlugin(IntegrationPlugin *plugin);
+
     // Builds a list of params ready to create a thing.
     // Template is thingClass.paramtypes, "first" has highest priority. If a param is not found neither in first nor in second, defaults apply.
     ParamList buildParams(const ParamTypes &types, const ParamList &first, const ParamList &second = ParamList());
@@ -160,14 +170,30 @@ private:
     void storeIOConnections();
     void loadIOConnections();
 
+    struct IOConnectionRanges {
+        Types::IOType inputIOType;
+        Types::IOType outputIOType;
+        bool inputWritable;
+        double inputMin;
+        double inputMax;
+        double outputMin;
+        double outputMax;
+    };
+
+    void addIOConnection(const IOConnection &ioConnection);
+    bool resolveIOConnection(const IOConnection &ioConnection, IOConnectionRanges *ranges);
+    void dropIOConnectionRanges(const ThingId &thingId);
     void syncIOConnection(Thing *inputThing, const StateTypeId &stateTypeId);
-    QVariant mapValue(const QVariant &value, const StateType &fromStateType, const StateType &toStateType, bool inverted) const;
+    void syncIOOutput(const IOConnection &ioConnection);
+    void syncIOInput(const IOConnection &ioConnection);
+    static double mapValue(double fromValue, double fromMin, double fromMax, double toMin, double toMax, bool inverted);
 
 private:
     HardwareManager *m_hardwareManager;
 
     QLocale m_locale;
     Translator *m_translator = nullptr;
+    ThingSetupScheduler *m_setupScheduler = nullptr;
     QHash<VendorId, Vendor> m_supportedVendors;
     QHash<QString, Interface> m_supportedInterfaces;
     QHash<VendorId, QList<ThingClassId> > m_vendorThingMap;
@@ -176,6 +202,8 @@ private:
     QHash<ThingDescriptorId, ThingDescriptor> m_discoveredThings;
 
     QHash<PluginId, IntegrationPlugin*> m_integrationPlugins;
+    QHash<PluginId, QString> m_pluginFiles;
+    QHash<PluginId, QPluginLoader*> m_pluginLoaders;
 
     class PairingContext {
     public:
@@ -188,6 +216,14 @@ private:
     QHash<PairingTransactionId, PairingContext> m_pendingPairings;
 
     QHash<IOConnectionId, IOConnection> m_ioConnections;
+
+    // IO connections by the thing and state on either end, both ends are unique over all connections
+    typedef QPair<ThingId, StateTypeId> IOStateKey;
+    QHash<IOStateKey, IOConnectionId> m_ioConnectionsByInput;
+    QHash<IOStateKey, IOConnectionId> m_ioConnectionsByOutput;
+    QHash<IOConnectionId, IOConnectionRanges> m_ioConnectionRanges;
+    QSet<IOConnectionId> m_runningIOOutputs;
+    QSet<IOConnectionId> m_pendingIOOutputs;
 };
 
 #endif // THINGMANAGERIMPLEMENTATION_H
@@ -0,0 +1,314 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* Copyright 2013 - 2020, nymea GmbH
+* Contact: contact@nymea.io
+*
+* This file is part of nymea.
+* This project including source code and documentation is protected by
+* copyright law, and remains the property of nymea GmbH. All rights, including
+* reproduction, publication, editing and translation, are reserved. The use of
+* this project is subject to the terms of a license agreement to be concluded
+* with nymea GmbH in accordance with the terms of use of nymea GmbH, available
+* under https://nymea.io/license
+*
+* GNU General Public License Usage
+* Alternatively, this project may be redistributed and/or modified under the
+* terms of the GNU General Public License as published by the Free Software
+* Foundation, GNU version 3. This project is distributed in the hope that it
+* will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+* of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+* Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with
+* this project. If not, see <https://www.gnu.org/licenses/>.
+*
+* For any further details and any questions please contact us under
+* contact@nymea.io or see our FAQ/Licensing Information on
+* https://nymea.io/license/faq
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+/*!
+    \class ThingSetupScheduler
+    \brief Sets up configured things concurrently with per plugin limits.
+
+    \ingroup things
+    \inmodule core
+
+    The ThingSetupScheduler is used by the \l{ThingManagerImplementation} to set up all the things
+    loaded from the configuration at startup. Setups are started concurrently, but never more than
+    \l{maxConcurrentSetups()} at a time per plugin, so that plugins with slow network based setups
+    don't block the others and plugins which can only handle a few setups at once are not flooded.
+
+    Child things are only set up once the setup of their parent has finished. Setups failing with a
+    temporary error (e.g. the hardware not being available yet) are retried with an exponential
+    backoff. Once all scheduled setups have finished, either successfully or by failing after all
+    retries, the \l{ready()} signal is emitted.
+*/
+
+/*! \fn void ThingSetupScheduler::setupFinished(ThingSetupInfo *info);
+    This signal is emitted when the setup for a thing has finished for good. The \a info holds the
+    result of the last setup attempt. Intermediate failures which will be retried are not reported.
+*/
+
+/*! \fn void ThingSetupScheduler::ready();
+    This signal is emitted when all scheduled setups have finished.
+*/
+
+#include "thingsetupscheduler.h"
+#include "thingmanagerimplementation.h"
+#include "loggingcategories.h"
+
+#include "integrations/thingsetupinfo.h"
+#include "integrations/integrationplugin.h"
+
+#include <QTimer>
+
+ThingSetupScheduler::ThingSetupScheduler(ThingManagerImplementation *thingManager) :
+    QObject(thingManager),
+    m_thingManager(thingManager)
+{
+    m_retryTimer = new QTimer(this);
+    m_retryTimer->setSingleShot(true);
+    connect(m_retryTimer, &QTimer::timeout, this, &ThingSetupScheduler::processQueue);
+}
+
+/*! Returns the default number of concurrent setups per plugin. 0 means unlimited. */
+int ThingSetupScheduler::maxConcurrentSetups() const
+{
+    return m_maxConcurrentSetups;
+}
+
+/*! Sets the default number of concurrent setups per plugin to \a maxConcurrentSetups. 0 means unlimited. */
+void ThingSetupScheduler::setMaxConcurrentSetups(int maxConcurrentSetups)
+{
+    m_maxConcurrentSetups = qMax(0, maxConcurrentSetups);
+}
+
+/*! Returns the number of concurrent setups for the plugin with the given \a pluginId. 0 means unlimited. */
+int ThingSetupScheduler::maxConcurrentSetups(const PluginId &pluginId) const
+{
+    return m_pluginLimits.value(pluginId, m_maxConcurrentSetups);
+}
+
+/*! Overrides the number of concurrent setups for the plugin with the given \a pluginId. 0 means unlimited,
+    a negative value restores the default. */
+void ThingSetupScheduler::setMaxConcurrentSetups(const PluginId &pluginId, int maxConcurrentSetups)
+{
+    if (maxConcurrentSetups < 0) {
+        m_pluginLimits.remove(pluginId);
+        return;
+    }
+    m_pluginLimits.insert(pluginId, maxConcurrentSetups);
+}
+
+/*! Returns how often a failed setup will be retried. */
+int ThingSetupScheduler::maxRetries() const
+{
+    return m_maxRetries;
+}
+
+/*! Returns the delay in milliseconds before the first retry. The delay doubles with every retry. */
+int ThingSetupScheduler::retryInterval() const
+{
+    return m_retryInterval;
+}
+
+/*! Failed setups will be retried up to \a maxRetries times, waiting \a retryInterval milliseconds
+    before the first retry and doubling the delay for each following one. */
+void ThingSetupScheduler::setRetryPolicy(int maxRetries, int retryInterval)
+{
+    m_maxRetries = qMax(0, maxRetries);
+    m_retryInterval = qMax(0, retryInterval);
+}
+
+/*! Schedules the setup for the given \a things. Setups which can be started right away are started
+    before this method returns. */
+void ThingSetupScheduler::schedule(const QList<Thing *> &things)
+{
+    if (m_ready) {
+        m_ready = false;
+        m_succeeded = 0;
+        m_failed = 0;
+        m_retried = 0;
+        m_clock.start();
+    }
+
+    foreach (Thing *thing, things) {
+        if (m_entries.contains(thing->id())) {
+            continue;
+        }
+
+        Entry entry;
+        entry.thing = thing;
+        entry.pluginId = thing->pluginId();
+        entry.parentId = thing->parentId();
+        m_entries.insert(thing->id(), entry);
+        m_queue.append(thing->id());
+
+        thing->setSetupStatus(Thing::ThingSetupStatusInProgress, Thing::ThingErrorNoError);
+
+        // The thing might be removed while we're still waiting for it to be set up
+        ThingId thingId = thing->id();
+        connect(thing, &QObject::destroyed, this, [this, thingId](){
+            if (!m_entries.contains(thingId)) {
+                return;
+            }
+            Entry entry = m_entries.value(thingId);
+            if (entry.running) {
+                m_runningSetups.remove(m_runningSetups.key(thingId));
+                m_runningPerPlugin[entry.pluginId]--;
+            }
+            finishEntry(thingId);
+            QMetaObject::invokeMethod(this, "processQueue", Qt::QueuedConnection);
+        });
+    }
+
+    qCDebug(dcThingManager()) << "Scheduled setup for" << things.count() << "things." << m_entries.count() << "setups pending.";
+    processQueue();
+}
+
+/*! Drops all pending and running setups for things of the plugin with the given \a pluginId. The
+    results of setups which are still running will be ignored. */
+void ThingSetupScheduler::cancel(const PluginId &pluginId)
+{
+    foreach (const ThingId &thingId, m_queue) {
+        Entry entry = m_entries.value(thingId);
+        if (entry.pluginId != pluginId) {
+            continue;
+        }
+        if (entry.running) {
+            m_runningSetups.remove(m_runningSetups.key(thingId));
+            m_runningPerPlugin[entry.pluginId]--;
+        }
+        finishEntry(thingId);
+    }
+    processQueue();
+}
+
+/*! Returns true if there are no pending setups. */
+bool ThingSetupScheduler::isReady() const
+{
+    return m_ready;
+}
+
+/*! Returns the number of setups which have not finished yet, including the running ones. */
+int ThingSetupScheduler::pendingSetups() const
+{
+    return m_entries.count();
+}
+
+/*! Returns the number of currently running setups. */
+int ThingSetupScheduler::runningSetups() const
+{
+    return m_runningSetups.count();
+}
+
+void ThingSetupScheduler::processQueue()
+{
+    qint64 now = m_clock.elapsed();
+    qint64 nextRetry = -1;
+
+    foreach (const ThingId &thingId, m_queue) {
+        Entry &entry = m_entries[thingId];
+        if (entry.running || waitingForParent(entry)) {
+            continue;
+        }
+
+        if (entry.notBefore > now) {
+            if (nextRetry < 0 || entry.notBefore < nextRetry) {
+                nextRetry = entry.notBefore;
+            }
+            continue;
+        }
+
+        int limit = maxConcurrentSetups(entry.pluginId);
+        if (limit > 0 && m_runningPerPlugin.value(entry.pluginId) >= limit) {
+            continue;
+        }
+
+        entry.running = true;
+        entry.attempts++;
+        m_runningPerPlugin[entry.pluginId]++;
+
+        ThingSetupInfo *info = m_thingManager->setupThing(entry.thing);
+        m_runningSetups.insert(info, thingId);
+        connect(info, &ThingSetupInfo::finished, this, &ThingSetupScheduler::onSetupFinished);
+    }
+
+    if (nextRetry >= 0) {
+        m_retryTimer->start(static_cast<int>(nextRetry - now));
+    }
+
+    if (!m_ready && m_entries.isEmpty()) {
+        m_ready = true;
+        m_retryTimer->stop();
+        qCInfo(dcThingManager()).nospace() << "All thing setups finished in " << m_clock.elapsed() << " ms (succeeded: " << m_succeeded << ", failed: " << m_failed << ", retries: " << m_retried << ")";
+        emit ready();
+    }
+}
+
+void ThingSetupScheduler::onSetupFinished()
+{
+    ThingSetupInfo *info = qobject_cast<ThingSetupInfo *>(sender());
+    if (!m_runningSetups.contains(info)) {
+        // The thing has been removed in the meantime
+        return;
+    }
+
+    ThingId thingId = m_runningSetups.take(info);
+    Entry &entry = m_entries[thingId];
+    entry.running = false;
+    m_runningPerPlugin[entry.pluginId]--;
+
+    Thing::ThingError status = info->status();
+    if (status != Thing::ThingErrorNoError && isRetryable(status) && entry.attempts <= m_maxRetries) {
+        int delay = m_retryInterval * (1 << qMin(entry.attempts - 1, 6));
+        entry.notBefore = m_clock.elapsed() + delay;
+        m_retried++;
+        qCDebug(dcThingManager()) << "Setup for thing" << entry.thing->name() << entry.thing->id().toString() << "failed with" << status << info->displayMessage() << "Retrying in" << delay << "ms (attempt" << entry.attempts + 1 << "of" << m_maxRetries + 1 << ")";
+
+        // Give the plugin the chance to clean up whatever it did set up before the failure
+        IntegrationPlugin *plugin = m_thingManager->plugin(entry.pluginId);
+        if (plugin) {
+            plugin->thingRemoved(entry.thing);
+        }
+    } else {
+        if (status == Thing::ThingErrorNoError) {
+            m_succeeded++;
+        } else {
+            m_failed++;
+        }
+        finishEntry(thingId);
+        emit setupFinished(info);
+    }
+
+    processQueue();
+}
+
+bool ThingSetupScheduler::isRetryable(Thing::ThingError error) const
+{
+    switch (error) {
+    case Thing::ThingErrorSetupFailed:
+    case Thing::ThingErrorHardwareNotAvailable:
+    case Thing::ThingErrorHardwareFailure:
+    case Thing::ThingErrorTimeout:
+        return true;
+    default:
+        return false;
+    }
+}
+
+bool ThingSetupScheduler::waitingForParent(const Entry &entry) const
+{
+    return !entry.parentId.isNull() && m_entries.contains(entry.parentId);
+}
+
+void ThingSetupScheduler::finishEntry(const ThingId &thingId)
+{
+    Entry entry = m_entries.take(thingId);
+    m_queue.removeAll(thingId);
+    if (entry.thing) {
+        disconnect(entry.thing, &QObject::destroyed, this, nullptr);
+    }
+}
@@ -0,0 +1,110 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* Copyright 2013 - 2020, nymea GmbH
+* Contact: contact@nymea.io
+*
+* This file is part of nymea.
+* This project including source code and documentation is protected by
+* copyright law, and remains the property of nymea GmbH. All rights, including
+* reproduction, publication, editing and translation, are reserved. The use of
+* this project is subject to the terms of a license agreement to be concluded
+* with nymea GmbH in accordance with the terms of use of nymea GmbH, available
+* under https://nymea.io/license
+*
+* GNU General Public License Usage
+* Alternatively, this project may be redistributed and/or modified under the
+* terms of the GNU General Public License as published by the Free Software
+* Foundation, GNU version 3. This project is distributed in the hope that it
+* will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+* of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+* Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with
+* this project. If not, see <https://www.gnu.org/licenses/>.
+*
+* For any further details and any questions please contact us under
+* contact@nymea.io or see our FAQ/Licensing Information on
+* https://nymea.io/license/faq
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef THINGSETUPSCHEDULER_H
+#define THINGSETUPSCHEDULER_H
+
+#include "typeutils.h"
+#include "integrations/thing.h"
+
+#include <QObject>
+#include <QPointer>
+#include <QElapsedTimer>
+
+class QTimer;
+class ThingSetupInfo;
+class ThingManagerImplementation;
+
+class ThingSetupScheduler : public QObject
+{
+    Q_OBJECT
+public:
+    explicit ThingSetupScheduler(ThingManagerImplementation *thingManager);
+
+    int maxConcurrentSetups() const;
+    void setMaxConcurrentSetups(int maxConcurrentSetups);
+
+    int maxConcurrentSetups(const PluginId &pluginId) const;
+    void setMaxConcurrentSetups(const PluginId &pluginId, int maxConcurrentSetups);
+
+    int maxRetries() const;
+    int retryInterval() const;
+    void setRetryPolicy(int maxRetries, int retryInterval);
+
+    void schedule(const QList<Thing *> &things);
+    void cancel(const PluginId &pluginId);
+
+    bool isReady() const;
+    int pendingSetups() const;
+    int runningSetups() const;
+
+signals:
+    void setupFinished(ThingSetupInfo *info);
+    void ready();
+
+private slots:
+    void processQueue();
+    void onSetupFinished();
+
+private:
+    struct Entry {
+        QPointer<Thing> thing;
+        PluginId pluginId;
+        ThingId parentId;
+        int attempts = 0;
+        qint64 notBefore = 0;
+        bool running = false;
+    };
+
+    bool isRetryable(Thing::ThingError error) const;
+    bool waitingForParent(const Entry &entry) const;
+    void finishEntry(const ThingId &thingId);
+
+    ThingManagerImplementation *m_thingManager = nullptr;
+
+    int m_maxConcurrentSetups = 0;
+    QHash<PluginId, int> m_pluginLimits;
+    int m_maxRetries = 0;
+    int m_retryInterval = 5000;
+
+    QList<ThingId> m_queue;
+    QHash<ThingId, Entry> m_entries;
+    QHash<PluginId, int> m_runningPerPlugin;
+    QHash<ThingSetupInfo *, ThingId> m_runningSetups;
+
+    QElapsedTimer m_clock;
+    QTimer *m_retryTimer = nullptr;
+    bool m_ready = true;
+    int m_succeeded = 0;
+    int m_failed = 0;
+    int m_retried = 0;
+};
+
+#endif // THINGSETUPSCHEDULER_H
@@ -36,6 +36,7 @@
 #include "integrations/integrationplugin.h"
 #include <QCoreApplication>
 #include <QDir>
+#include <QSet>
 
 Translator::Translator(ThingManagerImplementation *thingManager):
     m_thingManager(thingManager)
@@ -55,22 +56,130 @@ Translator::~Translator()
 
 QString Translator::translate(const PluginId &pluginId, const QString &string, const QLocale &locale)
 {
-    IntegrationPlugin *plugin = m_thingManager->plugins().findById(pluginId);
+    IntegrationPlugin *plugin = m_thingManager->plugin(pluginId);
     if (!plugin) {
         qCWarning(dcThingManager()) << "Unable to translate" << string << "Plugin not found";
         return string;
     }
 
-    if (!m_translatorContexts.contains(plugin->pluginId()) || !m_translatorContexts.value(plugin->pluginId()).translators.contains(locale.name())) {
+    QString localeName = locale.name();
+    QHash<PluginId, TranslatorContext>::iterator ctx = m_translatorContexts.find(pluginId);
+    if (ctx == m_translatorContexts.end() || !ctx->translators.contains(localeName)) {
         loadTranslator(plugin, locale);
+        ctx = m_translatorContexts.find(pluginId);
     }
 
-    QTranslator* translator = m_translatorContexts.value(plugin->pluginId()).translators.value(locale.name());
-    QString translatedString = translator->translate(plugin->pluginName().toUtf8(), string.toUtf8());
+    QHash<QString, QString> &strings = ctx->strings[localeName];
+    QHash<QString, QString>::const_iterator cached = strings.constFind(string);
+    if (cached != strings.constEnd()) {
+        return cached.value();
+    }
+
+    QTranslator* translator = ctx->translators.value(localeName);
+    QByteArray sourceText = string.toUtf8();
+    QString translatedString = translator->translate(ctx->pluginName.constData(), sourceText.constData());
     if (translatedString.isEmpty()) {
-        translatedString = translator->translate(plugin->metaObject()->className(), string.toUtf8());
+        translatedString = translator->translate(ctx->className.constData(), sourceText.constData());
+    }
+    if (translatedString.isEmpty()) {
+        translatedString = string;
+    }
+    strings.insert(string, translatedString);
+    return translatedString;
+}
+
+ThingClass Translator::translateThingClass(const ThingClass &thingClass, const QLocale &locale)
+{
+    PluginId pluginId = thingClass.pluginId();
+    QString localeName = locale.name();
+    ThingClass translatedThingClass = m_translatorContexts.value(pluginId).thingClasses.value(localeName).value(thingClass.id());
+    if (translatedThingClass.isValid()) {
+        return translatedThingClass;
+    }
+
+    if (!m_thingManager->plugin(pluginId)) {
+        return thingClass;
+    }
+
+    translatedThingClass = thingClass;
+    translatedThingClass.setDisplayName(translate(pluginId, thingClass.displayName(), locale));
+
+    ParamTypes translatedSettingsTypes;
+    foreach (ParamType paramType, thingClass.settingsTypes()) {
+        paramType.setDisplayName(translate(pluginId, paramType.displayName(), locale));
+        translatedSettingsTypes.append(paramType);
+    }
+    translatedThingClass.setSettingsTypes(translatedSettingsTypes);
+
+    ParamTypes translatedParamTypes;
+    foreach (ParamType paramType, thingClass.paramTypes()) {
+        paramType.setDisplayName(translate(pluginId, paramType.displayName(), locale));
+        translatedParamTypes.append(paramType);
+    }
+    translatedThingClass.setParamTypes(translatedParamTypes);
+
+    StateTypes translatedStateTypes;
+    foreach (StateType stateType, thingClass.stateTypes()) {
+        stateType.setDisplayName(translate(pluginId, stateType.displayName(), locale));
+        translatedStateTypes.append(stateType);
+    }
+    translatedThingClass.setStateTypes(translatedStateTypes);
+
+    EventTypes translatedEventTypes;
+    foreach (EventType eventType, thingClass.eventTypes()) {
+        eventType.setDisplayName(translate(pluginId, eventType.displayName(), locale));
+        translatedEventTypes.append(eventType);
     }
-    return translatedString.isEmpty() ? string : translatedString;
+    translatedThingClass.setEventTypes(translatedEventTypes);
+
+    ActionTypes translatedActionTypes;
+    foreach (ActionType actionType, thingClass.actionTypes()) {
+        actionType.setDisplayName(translate(pluginId, actionType.displayName(), locale));
+        translatedActionTypes.append(actionType);
+    }
+    translatedThingClass.setActionTypes(translatedActionTypes);
+
+    // The context has been created by translate() above
+    m_translatorContexts[pluginId].thingClasses[localeName].insert(thingClass.id(), translatedThingClass);
+    return translatedThingClass;
+}
+
+Vendor Translator::translateVendor(const Vendor &vendor, const QLocale &locale)
+{
+    QString localeName = locale.name();
+    Vendor translatedVendor = m_vendors.value(localeName).value(vendor.id());
+    if (!translatedVendor.id().isNull()) {
+        return translatedVendor;
+    }
+
+    IntegrationPlugin *plugin = nullptr;
+    foreach (IntegrationPlugin *p, m_thingManager->plugins()) {
+        if (p->supportedVendors().contains(vendor)) {
+            plugin = p;
+        }
+    }
+    if (!plugin) {
+        return vendor;
+    }
+
+    translatedVendor = vendor;
+    translatedVendor.setDisplayName(translate(plugin->pluginId(), vendor.displayName(), locale));
+    m_vendors[localeName].insert(vendor.id(), translatedVendor);
+    return translatedVendor;
+}
+
+void Translator::unloadTranslations(const PluginId &pluginId)
+{
+    // Locales without a translation share the en_US translator
+    TranslatorContext ctx = m_translatorContexts.take(pluginId);
+    QSet<QTranslator*> translators;
+    foreach (QTranslator *translator, ctx.translators) {
+        translators.insert(translator);
+    }
+    qDeleteAll(translators);
+
+    // Vendors may be shared between plugins, they are cheap to translate again
+    m_vendors.clear();
 }
 
 void Translator::loadTranslator(IntegrationPlugin *plugin, const QLocale &locale)
@@ -79,6 +188,8 @@ void Translator::loadTranslator(IntegrationPlugin *plugin, const QLocale &locale
         // Create default translator for this plugin
         TranslatorContext defaultCtx;
         defaultCtx.pluginId = plugin->pluginId();
+        defaultCtx.pluginName = plugin->pluginName().toUtf8();
+        defaultCtx.className = plugin->metaObject()->className();
         defaultCtx.translators.insert("en_US", new QTranslator());
         m_translatorContexts.insert(plugin->pluginId(), defaultCtx);
         if (locale == QLocale("en_US")) {
@@ -139,6 +250,8 @@ void Translator::loadTranslator(IntegrationPlugin *plugin, const QLocale &locale
     if (!m_translatorContexts.contains(plugin->pluginId())) {
         TranslatorContext ctx;
         ctx.pluginId = plugin->pluginId();
+        ctx.pluginName = plugin->pluginName().toUtf8();
+        ctx.className = plugin->metaObject()->className();
         m_translatorContexts.insert(plugin->pluginId(), ctx);
     }
     m_translatorContexts[plugin->pluginId()].translators.insert(locale.name(), translator);
@@ -33,6 +33,7 @@
 
 #include "typeutils.h"
 #include "types/thingclass.h"
+#include "types/vendor.h"
 
 #include <QTranslator>
 
@@ -46,6 +47,10 @@ public:
     ~Translator();
 
     QString translate(const PluginId &pluginId, const QString &string, const QLocale &locale);
+    ThingClass translateThingClass(const ThingClass &thingClass, const QLocale &locale);
+    Vendor translateVendor(const Vendor &vendor, const QLocale &locale);
+
+    void unloadTranslations(const PluginId &pluginId);
 
 private:
     void loadTranslator(IntegrationPlugin *plugin, const QLocale &locale);
@@ -55,9 +60,16 @@ private:
 
     struct TranslatorContext {
         PluginId pluginId;
+        QByteArray pluginName;
+        QByteArray className;
         QHash<QString, QTranslator*> translators;
+
+        // Translation results by locale name, built up lazily and kept until the plugin is unloaded
+        QHash<QString, QHash<QString, QString> > strings;
+        QHash<QString, QHash<ThingClassId, ThingClass> > thingClasses;
     };
     QHash<PluginId, TranslatorContext> m_translatorContexts;
+    QHash<QString, QHash<VendorId, Vendor> > m_vendors;
 };
 
 #endif // TRANSLATOR_H
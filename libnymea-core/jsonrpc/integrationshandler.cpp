@@ -128,6 +128,15 @@ IntegrationsHandler::IntegrationsHandler(ThingManager *thingManager, QObject *pa
     returns.insert("thingError", enumRef<Thing::ThingError>());
     registerMethod("SetPluginConfiguration", description, params, returns);
 
+    params.clear(); returns.clear();
+    description = "Reload a plugin without restarting the server. All things of this plugin are torn down, "
+                  "the plugin is loaded again from its file, which may have been updated in the meantime, and "
+                  "the things are set up again. Things of other plugins are not affected. Plugins built into "
+                  "nymea cannot be reloaded. The setup progress of the things is reported with ThingChanged notifications.";
+    params.insert("pluginId", enumValueName(Uuid));
+    returns.insert("thingError", enumRef<Thing::ThingError>());
+    registerMethod("ReloadPlugin", description, params, returns);
+
     params.clear(); returns.clear();
     description = "Add a new thing to the system. "
                     "Only things with a setupMethod of SetupMethodJustAdd can be added this way. "
@@ -571,6 +580,15 @@ JsonReply* IntegrationsHandler::SetPluginConfiguration(const QVariantMap &params
     return createReply(returns);
 }
 
+JsonReply* IntegrationsHandler::ReloadPlugin(const QVariantMap &params)
+{
+    QVariantMap returns;
+    PluginId pluginId = PluginId(params.value("pluginId").toString());
+    Thing::ThingError result = NymeaCore::instance()->thingManager()->reloadPlugin(pluginId);
+    returns.insert("thingError", enumValueName<Thing::ThingError>(result));
+    return createReply(returns);
+}
+
 JsonReply* IntegrationsHandler::AddThing(const QVariantMap &params, const JsonContext &context)
 {
     ThingClassId ThingClassId(params.value("thingClassId").toString());
@@ -50,6 +50,7 @@ public:
     Q_INVOKABLE JsonReply *GetPlugins(const QVariantMap &params, const JsonContext &context) const;
     Q_INVOKABLE JsonReply *GetPluginConfiguration(const QVariantMap &params) const;
     Q_INVOKABLE JsonReply *SetPluginConfiguration(const QVariantMap &params);
+    Q_INVOKABLE JsonReply *ReloadPlugin(const QVariantMap &params);
     Q_INVOKABLE JsonReply *AddThing(const QVariantMap &params, const JsonContext &context);
     Q_INVOKABLE JsonReply *PairThing(const QVariantMap &params, const JsonContext &context);
     Q_INVOKABLE JsonReply *ConfirmPairing(const QVariantMap &params);
@@ -458,6 +458,7 @@ void JsonRPCServerImplementation::registerTransportInterface(TransportInterface
         connect(interface, &TransportInterface::clientConnected, this, &JsonRPCServerImplementation::clientConnected);
         connect(interface, &TransportInterface::clientDisconnected, this, &JsonRPCServerImplementation::clientDisconnected);
         connect(interface, &TransportInterface::dataAvailable, this, &JsonRPCServerImplementation::processData);
+        connect(interface, &TransportInterface::packetAvailable, this, &JsonRPCServerImplementation::processPacket);
         m_interfaces.insert(interface, authenticationRequired);
     } else {
         m_interfaces[interface] = authenticationRequired;
@@ -469,6 +470,7 @@ void JsonRPCServerImplementation::unregisterTransportInterface(TransportInterfac
     disconnect(interface, &TransportInterface::clientConnected, this, &JsonRPCServerImplementation::clientConnected);
     disconnect(interface, &TransportInterface::clientDisconnected, this, &JsonRPCServerImplementation::clientDisconnected);
     disconnect(interface, &TransportInterface::dataAvailable, this, &JsonRPCServerImplementation::processData);
+    disconnect(interface, &TransportInterface::packetAvailable, this, &JsonRPCServerImplementation::processPacket);
     foreach (const QUuid &clientId, m_clientTransports.keys(interface)) {
         interface->terminateClientConnection(clientId);
         clientDisconnected(clientId);
@@ -585,38 +587,32 @@ void JsonRPCServerImplementation::processData(const QUuid &clientId, const QByte
     TransportInterface *interface = qobject_cast<TransportInterface *>(sender());
 
     // Handle packet fragmentation
-    QByteArray buffer = m_clientBuffers[clientId];
-    buffer.append(data);
-    int splitIndex = buffer.indexOf("}\n{");
-    while (splitIndex > -1) {
-        processJsonPacket(interface, clientId, buffer.left(splitIndex + 1));
-        buffer = buffer.right(buffer.length() - splitIndex - 2);
-        splitIndex = buffer.indexOf("}\n{");
+    JsonPacketReader &reader = m_clientReaders[clientId];
+    foreach (const JsonPacket &packet, reader.read(data)) {
+        processJsonPacket(interface, clientId, packet);
     }
-    if (buffer.trimmed().endsWith("}")) {
-        processJsonPacket(interface, clientId, buffer);
-        buffer.clear();
-    }
-    m_clientBuffers[clientId] = buffer;
 
-    if (buffer.size() > 1024 * 10) {
+    if (reader.bufferSize() > JsonPacketReader::maxBufferSize) {
         qCWarning(dcJsonRpc()) << "Client buffer larger than 10KB and no valid data. Dropping client connection.";
         interface->terminateClientConnection(clientId);
     }
 }
 
-void JsonRPCServerImplementation::processJsonPacket(TransportInterface *interface, const QUuid &clientId, const QByteArray &data)
+void JsonRPCServerImplementation::processPacket(const QUuid &clientId, const JsonPacket &packet)
 {
-    QJsonParseError error;
-    QJsonDocument jsonDoc = QJsonDocument::fromJson(data, &error);
+    TransportInterface *interface = qobject_cast<TransportInterface *>(sender());
+    processJsonPacket(interface, clientId, packet);
+}
 
-    if(error.error != QJsonParseError::NoError) {
-        qCWarning(dcJsonRpc) << "Failed to parse JSON data" << data << ":" << error.errorString();
-        sendErrorResponse(interface, clientId, -1, QString("Failed to parse JSON data: %1").arg(error.errorString()));
+void JsonRPCServerImplementation::processJsonPacket(TransportInterface *interface, const QUuid &clientId, const JsonPacket &packet)
+{
+    if (!packet.isValid()) {
+        qCWarning(dcJsonRpc) << "Failed to parse JSON data" << packet.data << ":" << packet.error;
+        sendErrorResponse(interface, clientId, -1, QString("Failed to parse JSON data: %1").arg(packet.error));
         return;
     }
 
-    QVariantMap message = jsonDoc.toVariant().toMap();
+    const QVariantMap &message = packet.message;
 
     bool success;
     int commandId = message.value("id").toInt(&success);
@@ -745,6 +741,13 @@ void JsonRPCServerImplementation::sendNotification(const QVariantMap &params)
     notification.insert("id", m_notificationId++);
     notification.insert("notification", handler->name() + "." + method.name());
 
+    // A state change supersedes any previous change of the same state which has not been sent yet to a slow client
+    QString coalesceKey;
+    if (method.name() == "StateChanged") {
+        QString thingId = params.contains("thingId") ? params.value("thingId").toString() : params.value("deviceId").toString();
+        coalesceKey = handler->name() + ".StateChanged:" + thingId + ":" + params.value("stateTypeId").toString();
+    }
+
     foreach (const QUuid &clientId, m_clientNotifications.keys()) {
 
         // Check if this client wants to be notified
@@ -775,7 +778,7 @@ void JsonRPCServerImplementation::sendNotification(const QVariantMap &params)
         qCDebug(dcJsonRpc()) << "Sending notification" << handler->name() + "." + method.name() << "to client" << clientId;
         qCDebug(dcJsonRpcTraffic()) << "Notification content:" << data;
 
-        m_clientTransports.value(clientId)->sendData(clientId, data);
+        m_clientTransports.value(clientId)->sendNotification(clientId, data, coalesceKey);
     }
 }
 
@@ -1018,7 +1021,7 @@ void JsonRPCServerImplementation::clientDisconnected(const QUuid &clientId)
     qCDebug(dcJsonRpc()) << "Client disconnected:" << clientId;
     m_clientTransports.remove(clientId);
     m_clientNotifications.remove(clientId);
-    m_clientBuffers.remove(clientId);
+    m_clientReaders.remove(clientId);
     m_clientLocales.remove(clientId);
     if (m_pushButtonTransactions.values().contains(clientId)) {
         NymeaCore::instance()->userManager()->cancelPushButtonAuth(m_pushButtonTransactions.key(clientId));
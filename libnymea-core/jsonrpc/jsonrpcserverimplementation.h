@@ -92,7 +92,7 @@ private:
     void sendUnauthorizedResponse(TransportInterface *interface, const QUuid &clientId, int commandId, const QString &error);
     QVariantMap createWelcomeMessage(TransportInterface *interface, const QUuid &clientId) const;
 
-    void processJsonPacket(TransportInterface *interface, const QUuid &clientId, const QByteArray &data);
+    void processJsonPacket(TransportInterface *interface, const QUuid &clientId, const JsonPacket &packet);
 
 private slots:
     void setup();
@@ -101,6 +101,7 @@ private slots:
     void clientDisconnected(const QUuid &clientId);
 
     void processData(const QUuid &clientId, const QByteArray &data);
+    void processPacket(const QUuid &clientId, const JsonPacket &packet);
 
     void sendNotification(const QVariantMap &params);
     void sendClientNotification(const QUuid &clientId, const QVariantMap &params);
@@ -119,7 +120,7 @@ private:
     QHash<JsonReply *, TransportInterface *> m_asyncReplies;
 
     QHash<QUuid, TransportInterface*> m_clientTransports;
-    QHash<QUuid, QByteArray> m_clientBuffers;
+    QHash<QUuid, JsonPacketReader> m_clientReaders;
     QHash<QUuid, QStringList> m_clientNotifications;
     QHash<QUuid, QLocale> m_clientLocales;
     QHash<int, QUuid> m_pushButtonTransactions;
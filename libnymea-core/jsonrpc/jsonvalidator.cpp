@@ -251,6 +251,9 @@ JsonValidator::Result JsonValidator::validateEntry(const QVariant &value, const
         // Time
         if (expectedBasicType == JsonHandler::Time) {
             QTime time = QTime::fromString(value.toString(), "hh:mm");
+            if (!time.isValid()) {
+                time = QTime::fromString(value.toString(), "hh:mm:ss");
+            }
             if (!time.isValid()) {
                 return Result(false, "Invalid Time: " + value.toString());
             }
@@ -90,6 +90,18 @@ RulesHandler::RulesHandler(QObject *parent) :
     ruleDescription.insert("executable", enumValueName(Bool));
     registerObject("RuleDescription", ruleDescription);
 
+    QVariantMap ruleStatistics;
+    ruleStatistics.insert("ruleId", enumValueName(Uuid));
+    ruleStatistics.insert("name", enumValueName(String));
+    ruleStatistics.insert("evaluations", enumValueName(Uint));
+    ruleStatistics.insert("matches", enumValueName(Uint));
+    ruleStatistics.insert("stateEvaluations", enumValueName(Uint));
+    ruleStatistics.insert("eventMatchingTime", enumValueName(Uint));
+    ruleStatistics.insert("stateEvaluationTime", enumValueName(Uint));
+    ruleStatistics.insert("actionDispatches", enumValueName(Uint));
+    registerObject("RuleStatistics", ruleStatistics);
+
+    registerObject<TriggerFilter>();
     registerObject<ParamDescriptor, ParamDescriptors>();
     registerObject<EventDescriptor, EventDescriptors>();
     registerObject<StateDescriptor>();
@@ -197,6 +209,18 @@ RulesHandler::RulesHandler(QObject *parent) :
     returns.insert("ruleError", enumRef<RuleEngine::RuleError>());
     registerMethod("ExecuteExitActions", description, params, returns);
 
+    params.clear(); returns.clear();
+    description = "Get the evaluation cost counters of the rules, intended to find rules which slow down the event processing. "
+                   "If a ruleId is given, only the counters of that rule are returned. For each rule this contains how often it "
+                   "has been evaluated and matched, how many actions it dispatched and the time spent in matching events "
+                   "(eventMatchingTime) and in evaluating its states (stateEvaluationTime), both in microseconds and estimated "
+                   "from every 16th evaluation. "
+                   "The counters start over when a rule is edited or the server is restarted.";
+    params.insert("o:ruleId", enumValueName(Uuid));
+    returns.insert("ruleError", enumRef<RuleEngine::RuleError>());
+    returns.insert("o:ruleStatistics", QVariantList() << objectRef("RuleStatistics"));
+    registerMethod("GetRuleStatistics", description, params, returns);
+
     // Notifications
     params.clear(); returns.clear();
     description = "Emitted whenever a Rule was removed.";
@@ -351,6 +375,26 @@ JsonReply *RulesHandler::ExecuteExitActions(const QVariantMap &params)
     return createReply(returns);
 }
 
+JsonReply *RulesHandler::GetRuleStatistics(const QVariantMap &params)
+{
+    QVariantMap returns;
+    QVariantList statistics;
+    if (params.contains("ruleId")) {
+        QVariantMap ruleStatistics = NymeaCore::instance()->ruleEngine()->ruleStatistics(RuleId(params.value("ruleId").toString()));
+        if (ruleStatistics.isEmpty()) {
+            returns.insert("ruleError", enumValueName<RuleEngine::RuleError>(RuleEngine::RuleErrorRuleNotFound));
+            return createReply(returns);
+        }
+        statistics.append(ruleStatistics);
+    } else {
+        statistics = NymeaCore::instance()->ruleEngine()->ruleStatistics();
+    }
+
+    returns.insert("ruleError", enumValueName<RuleEngine::RuleError>(RuleEngine::RuleErrorNoError));
+    returns.insert("ruleStatistics", statistics);
+    return createReply(returns);
+}
+
 void RulesHandler::ruleRemovedNotification(const RuleId &ruleId)
 {
     QVariantMap params;
@@ -59,6 +59,8 @@ public:
     Q_INVOKABLE JsonReply *ExecuteActions(const QVariantMap &params);
     Q_INVOKABLE JsonReply *ExecuteExitActions(const QVariantMap &params);
 
+    Q_INVOKABLE JsonReply *GetRuleStatistics(const QVariantMap &params);
+
 signals:
     void RuleRemoved(const QVariantMap &params);
     void RuleAdded(const QVariantMap &params);
@@ -22,12 +22,17 @@ HEADERS += nymeacore.h \
     integrations/plugininfocache.h \
     integrations/thingmanagerimplementation.h \
     integrations/translator.h \
+    integrations/thingsetupscheduler.h \
     experiences/experiencemanager.h \
     ruleengine/ruleengine.h \
     ruleengine/rule.h \
     ruleengine/stateevaluator.h \
+    ruleengine/rulesnapshot.h \
     ruleengine/ruleaction.h \
     ruleengine/ruleactionparam.h \
+    ruleengine/ruleactionexecutor.h \
+    ruleengine/triggerfilters.h \
+    ruleengine/statethresholdindex.h \
     scriptengine/script.h \
     scriptengine/scriptaction.h \
     scriptengine/scriptalarm.h \
@@ -41,10 +46,18 @@ HEADERS += nymeacore.h \
     servers/mocktcpserver.h \
     servers/webserver.h \
     servers/httprequest.h \
+    servers/httprequestparser.h \
     servers/httpreply.h \
     servers/bluetoothserver.h \
     servers/websocketserver.h \
     servers/mqttbroker.h \
+    servers/mqtttopictrie.h \
+    servers/sendqueue.h \
+    servers/iothreadpool.h \
+    servers/jsonpacketreader.h \
+    servers/tlssessioncache.h \
+    servers/staticfilecache.h \
+    servers/httpfiletransfer.h \
     jsonrpc/jsonrpcserverimplementation.h \
     jsonrpc/jsonvalidator.h \
     jsonrpc/integrationshandler.h \
@@ -76,6 +89,7 @@ HEADERS += nymeacore.h \
     cloud/cloudnotifications.h \
     hardwaremanagerimplementation.h \
     hardware/plugintimermanagerimplementation.h \
+    hardware/scopedhardwaremanager.h \
     hardware/radio433/radio433brennenstuhl.h \
     hardware/radio433/radio433transmitter.h \
     hardware/radio433/radio433brennenstuhlgateway.h \
@@ -90,6 +104,7 @@ HEADERS += nymeacore.h \
     hardware/network/mqtt/mqttchannelimplementation.h \
     hardware/i2c/i2cmanagerimplementation.h \
     debugserverhandler.h \
+    startuptracer.h \
     tagging/tagsstorage.h \
     tagging/tag.h \
     cloud/cloudtransport.h \
@@ -101,12 +116,17 @@ SOURCES += nymeacore.cpp \
     integrations/plugininfocache.cpp \
     integrations/thingmanagerimplementation.cpp \
     integrations/translator.cpp \
+    integrations/thingsetupscheduler.cpp \
     experiences/experiencemanager.cpp \
     ruleengine/ruleengine.cpp \
     ruleengine/rule.cpp \
     ruleengine/stateevaluator.cpp \
+    ruleengine/rulesnapshot.cpp \
     ruleengine/ruleaction.cpp \
     ruleengine/ruleactionparam.cpp \
+    ruleengine/ruleactionexecutor.cpp \
+    ruleengine/triggerfilters.cpp \
+    ruleengine/statethresholdindex.cpp \
     scriptengine/script.cpp \
     scriptengine/scriptaction.cpp \
     scriptengine/scriptalarm.cpp \
@@ -120,10 +140,18 @@ SOURCES += nymeacore.cpp \
     servers/mocktcpserver.cpp \
     servers/webserver.cpp \
     servers/httprequest.cpp \
+    servers/httprequestparser.cpp \
     servers/httpreply.cpp \
     servers/websocketserver.cpp \
     servers/bluetoothserver.cpp \
     servers/mqttbroker.cpp \
+    servers/mqtttopictrie.cpp \
+    servers/sendqueue.cpp \
+    servers/iothreadpool.cpp \
+    servers/jsonpacketreader.cpp \
+    servers/tlssessioncache.cpp \
+    servers/staticfilecache.cpp \
+    servers/httpfiletransfer.cpp \
     jsonrpc/jsonrpcserverimplementation.cpp \
     jsonrpc/jsonvalidator.cpp \
     jsonrpc/integrationshandler.cpp \
@@ -154,6 +182,7 @@ SOURCES += nymeacore.cpp \
     cloud/cloudnotifications.cpp \
     hardwaremanagerimplementation.cpp \
     hardware/plugintimermanagerimplementation.cpp \
+    hardware/scopedhardwaremanager.cpp \
     hardware/radio433/radio433brennenstuhl.cpp \
     hardware/radio433/radio433transmitter.cpp \
     hardware/radio433/radio433brennenstuhlgateway.cpp \
@@ -168,6 +197,7 @@ SOURCES += nymeacore.cpp \
     hardware/network/mqtt/mqttchannelimplementation.cpp \
     hardware/i2c/i2cmanagerimplementation.cpp \
     debugserverhandler.cpp \
+    startuptracer.cpp \
     tagging/tagsstorage.cpp \
     tagging/tag.cpp \
     cloud/cloudtransport.cpp \
@@ -33,6 +33,7 @@
 #include "loggingcategories.h"
 #include "logging.h"
 #include "logvaluetool.h"
+#include "startuptracer.h"
 
 #include <QCoreApplication>
 #include <QSqlDatabase>
@@ -694,6 +695,8 @@ void LogEngine::finalizeMigration3To4()
 
 bool LogEngine::initDB(const QString &username, const QString &password)
 {
+    StartupTraceScope trace("LogEngine::initDB", "core", {{"database", m_db.databaseName()}});
+
     m_db.close();
     bool opened = m_db.open(username, password);
     if (!opened) {
@@ -218,6 +218,45 @@ NymeaConfiguration::NymeaConfiguration(QObject *parent) :
     settings.setValue("logDBPassword", logDBPassword());
     settings.setValue("logDBMaxEntries", logDBMaxEntries());
     settings.endGroup();
+
+    // Write defaults for thing setup settings
+    settings.beginGroup("ThingSetup");
+    settings.setValue("concurrency", thingSetupConcurrency());
+    settings.setValue("retries", thingSetupRetries());
+    settings.setValue("retryInterval", thingSetupRetryInterval());
+    settings.endGroup();
+
+    // Write defaults for the rule action execution
+    settings.beginGroup("RuleActions");
+    settings.setValue("concurrency", ruleActionConcurrency());
+    settings.endGroup();
+
+    // Write defaults for the outgoing data limits of JSON-RPC clients
+    settings.beginGroup("SendQueue");
+    settings.setValue("highWatermark", sendQueueHighWatermark());
+    settings.setValue("lowWatermark", sendQueueLowWatermark());
+    settings.setValue("disconnectOnOverflow", sendQueueDisconnectOnOverflow());
+    settings.endGroup();
+
+    // Write defaults for the socket I/O threads of the JSON-RPC transports and the web servers
+    settings.beginGroup("IOThreads");
+    settings.setValue("threadCount", ioThreadCount());
+    settings.endGroup();
+
+    // Write defaults for the TLS session handling
+    settings.beginGroup("TLS");
+    settings.setValue("sessionCacheSize", tlsSessionCacheSize());
+    settings.setValue("sessionLifetime", tlsSessionLifetime());
+    settings.setValue("sessionTickets", tlsSessionTickets());
+    settings.endGroup();
+
+    // Write defaults for the request limits of the web servers
+    settings.beginGroup("HttpLimits");
+    settings.setValue("maxRequestLineSize", httpMaxRequestLineSize());
+    settings.setValue("maxHeaderSize", httpMaxHeaderSize());
+    settings.setValue("maxHeaderCount", httpMaxHeaderCount());
+    settings.setValue("maxBodySize", httpMaxBodySize());
+    settings.endGroup();
 }
 
 QUuid NymeaConfiguration::serverUuid() const
@@ -553,6 +592,145 @@ int NymeaConfiguration::logDBMaxEntries() const
     return settings.value("logDBMaxEntries", 200000).toInt();
 }
 
+int NymeaConfiguration::thingSetupConcurrency() const
+{
+    NymeaSettings settings(NymeaSettings::SettingsRoleGlobal);
+    settings.beginGroup("ThingSetup");
+    return settings.value("concurrency", 8).toInt();
+}
+
+QHash<PluginId, int> NymeaConfiguration::thingSetupPluginConcurrency() const
+{
+    QHash<PluginId, int> ret;
+    NymeaSettings settings(NymeaSettings::SettingsRoleGlobal);
+    settings.beginGroup("ThingSetup");
+    settings.beginGroup("PluginConcurrency");
+    foreach (const QString &key, settings.childKeys()) {
+        PluginId pluginId(key);
+        if (pluginId.isNull()) {
+            qCWarning(dcApplication()) << "Invalid plugin id" << key << "in thing setup configuration. Ignoring it.";
+            continue;
+        }
+        ret.insert(pluginId, settings.value(key).toInt());
+    }
+    return ret;
+}
+
+int NymeaConfiguration::thingSetupRetries() const
+{
+    NymeaSettings settings(NymeaSettings::SettingsRoleGlobal);
+    settings.beginGroup("ThingSetup");
+    return settings.value("retries", 2).toInt();
+}
+
+int NymeaConfiguration::thingSetupRetryInterval() const
+{
+    NymeaSettings settings(NymeaSettings::SettingsRoleGlobal);
+    settings.beginGroup("ThingSetup");
+    return settings.value("retryInterval", 5000).toInt();
+}
+
+int NymeaConfiguration::ruleActionConcurrency() const
+{
+    NymeaSettings settings(NymeaSettings::SettingsRoleGlobal);
+    settings.beginGroup("RuleActions");
+    return settings.value("concurrency", 4).toInt();
+}
+
+QHash<PluginId, int> NymeaConfiguration::ruleActionPluginConcurrency() const
+{
+    QHash<PluginId, int> ret;
+    NymeaSettings settings(NymeaSettings::SettingsRoleGlobal);
+    settings.beginGroup("RuleActions");
+    settings.beginGroup("PluginConcurrency");
+    foreach (const QString &key, settings.childKeys()) {
+        PluginId pluginId(key);
+        if (pluginId.isNull()) {
+            qCWarning(dcApplication()) << "Invalid plugin id" << key << "in rule action configuration. Ignoring it.";
+            continue;
+        }
+        ret.insert(pluginId, settings.value(key).toInt());
+    }
+    return ret;
+}
+
+qint64 NymeaConfiguration::sendQueueHighWatermark() const
+{
+    NymeaSettings settings(NymeaSettings::SettingsRoleGlobal);
+    settings.beginGroup("SendQueue");
+    return settings.value("highWatermark", 4 * 1024 * 1024).toLongLong();
+}
+
+qint64 NymeaConfiguration::sendQueueLowWatermark() const
+{
+    NymeaSettings settings(NymeaSettings::SettingsRoleGlobal);
+    settings.beginGroup("SendQueue");
+    return settings.value("lowWatermark", 1024 * 1024).toLongLong();
+}
+
+bool NymeaConfiguration::sendQueueDisconnectOnOverflow() const
+{
+    NymeaSettings settings(NymeaSettings::SettingsRoleGlobal);
+    settings.beginGroup("SendQueue");
+    return settings.value("disconnectOnOverflow", false).toBool();
+}
+
+int NymeaConfiguration::ioThreadCount() const
+{
+    NymeaSettings settings(NymeaSettings::SettingsRoleGlobal);
+    settings.beginGroup("IOThreads");
+    return settings.value("threadCount", 2).toInt();
+}
+
+int NymeaConfiguration::tlsSessionCacheSize() const
+{
+    NymeaSettings settings(NymeaSettings::SettingsRoleGlobal);
+    settings.beginGroup("TLS");
+    return settings.value("sessionCacheSize", 256).toInt();
+}
+
+int NymeaConfiguration::tlsSessionLifetime() const
+{
+    NymeaSettings settings(NymeaSettings::SettingsRoleGlobal);
+    settings.beginGroup("TLS");
+    return settings.value("sessionLifetime", 3600).toInt();
+}
+
+bool NymeaConfiguration::tlsSessionTickets() const
+{
+    NymeaSettings settings(NymeaSettings::SettingsRoleGlobal);
+    settings.beginGroup("TLS");
+    return settings.value("sessionTickets", true).toBool();
+}
+
+int NymeaConfiguration::httpMaxRequestLineSize() const
+{
+    NymeaSettings settings(NymeaSettings::SettingsRoleGlobal);
+    settings.beginGroup("HttpLimits");
+    return settings.value("maxRequestLineSize", 8 * 1024).toInt();
+}
+
+int NymeaConfiguration::httpMaxHeaderSize() const
+{
+    NymeaSettings settings(NymeaSettings::SettingsRoleGlobal);
+    settings.beginGroup("HttpLimits");
+    return settings.value("maxHeaderSize", 16 * 1024).toInt();
+}
+
+int NymeaConfiguration::httpMaxHeaderCount() const
+{
+    NymeaSettings settings(NymeaSettings::SettingsRoleGlobal);
+    settings.beginGroup("HttpLimits");
+    return settings.value("maxHeaderCount", 100).toInt();
+}
+
+qint64 NymeaConfiguration::httpMaxBodySize() const
+{
+    NymeaSettings settings(NymeaSettings::SettingsRoleGlobal);
+    settings.beginGroup("HttpLimits");
+    return settings.value("maxBodySize", 1024 * 1024).toLongLong();
+}
+
 QString NymeaConfiguration::sslCertificate() const
 {
     NymeaSettings settings(NymeaSettings::SettingsRoleGlobal);
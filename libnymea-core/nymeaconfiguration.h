@@ -31,6 +31,8 @@
 #ifndef NYMEACONFIGURATION_H
 #define NYMEACONFIGURATION_H
 
+#include "typeutils.h"
+
 #include <QHostAddress>
 #include <QObject>
 #include <QLocale>
@@ -181,6 +183,35 @@ public:
     QString logDBPassword() const;
     int logDBMaxEntries() const;
 
+    // Thing setup
+    int thingSetupConcurrency() const;
+    QHash<PluginId, int> thingSetupPluginConcurrency() const;
+    int thingSetupRetries() const;
+    int thingSetupRetryInterval() const;
+
+    // Rule actions
+    int ruleActionConcurrency() const;
+    QHash<PluginId, int> ruleActionPluginConcurrency() const;
+
+    // Outgoing data of JSON-RPC clients
+    qint64 sendQueueHighWatermark() const;
+    qint64 sendQueueLowWatermark() const;
+    bool sendQueueDisconnectOnOverflow() const;
+
+    // Socket I/O of JSON-RPC transports
+    int ioThreadCount() const;
+
+    // TLS sessions of the SSL enabled servers
+    int tlsSessionCacheSize() const;
+    int tlsSessionLifetime() const;
+    bool tlsSessionTickets() const;
+
+    // Limits for the requests of the web servers
+    int httpMaxRequestLineSize() const;
+    int httpMaxHeaderSize() const;
+    int httpMaxHeaderCount() const;
+    qint64 httpMaxBodySize() const;
+
 private:
     QHash<QString, ServerConfiguration> m_tcpServerConfigs;
     QHash<QString, WebServerConfiguration> m_webServerConfigs;
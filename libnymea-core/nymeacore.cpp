@@ -33,6 +33,7 @@
 #include "platform/platform.h"
 #include "jsonrpc/jsonrpcserverimplementation.h"
 #include "ruleengine/ruleengine.h"
+#include "ruleengine/ruleactionexecutor.h"
 #include "nymeasettings.h"
 #include "tagging/tagsstorage.h"
 #include "platform/platform.h"
@@ -43,6 +44,7 @@
 #include "jsonrpc/scriptshandler.h"
 
 #include "integrations/thingmanagerimplementation.h"
+#include "integrations/thingsetupscheduler.h"
 #include "integrations/thing.h"
 #include "integrations/thingactioninfo.h"
 #include "integrations/browseractioninfo.h"
@@ -50,6 +52,7 @@
 #include "cloud/cloudmanager.h"
 #include "cloud/cloudnotifications.h"
 #include "cloud/cloudtransport.h"
+#include "startuptracer.h"
 
 #include <networkmanager.h>
 
@@ -60,6 +63,10 @@ namespace nymeaserver {
 
 NymeaCore* NymeaCore::s_instance = nullptr;
 
+// Events caused by rule actions are processed one after the other. A chain of events
+// caused by one originating event is cut off at this depth to break rule loops.
+static const int maxCascadeDepth = 16;
+
 /*! Returns a pointer to the single \l{NymeaCore} instance. */
 NymeaCore *NymeaCore::instance()
 {
@@ -78,12 +85,16 @@ NymeaCore::NymeaCore(QObject *parent) :
 
 void NymeaCore::init() {
     qCDebug(dcApplication()) << "Initializing NymeaCore";
+    StartupTraceScope initTrace("NymeaCore::init", "core");
 
     qCDebug(dcPlatform()) << "Loading platform abstraction";
     m_platform = new Platform(this);
 
     qCDebug(dcApplication()) << "Loading nymea configurations" << NymeaSettings(NymeaSettings::SettingsRoleGlobal).fileName();
-    m_configuration = new NymeaConfiguration(this);
+    {
+        StartupTraceScope trace("Load configuration", "core");
+        m_configuration = new NymeaConfiguration(this);
+    }
 
     qCDebug(dcApplication()) << "Creating Time Manager";
     // Migration path: nymea < 0.18 doesn't use system time zone but stores its own time zone in the config
@@ -96,23 +107,63 @@ void NymeaCore::init() {
     m_timeManager = new TimeManager(this);
 
     qCDebug(dcApplication) << "Creating Log Engine";
-    m_logger = new LogEngine(m_configuration->logDBDriver(), m_configuration->logDBName(), m_configuration->logDBHost(), m_configuration->logDBUser(), m_configuration->logDBPassword(), m_configuration->logDBMaxEntries(), this);
+    {
+        StartupTraceScope trace("Create LogEngine", "core");
+        m_logger = new LogEngine(m_configuration->logDBDriver(), m_configuration->logDBName(), m_configuration->logDBHost(), m_configuration->logDBUser(), m_configuration->logDBPassword(), m_configuration->logDBMaxEntries(), this);
+    }
 
     qCDebug(dcApplication()) << "Creating User Manager";
-    m_userManager = new UserManager(NymeaSettings::settingsPath() + "/user-db.sqlite", this);
+    {
+        StartupTraceScope trace("Create UserManager", "core");
+        m_userManager = new UserManager(NymeaSettings::settingsPath() + "/user-db.sqlite", this);
+    }
 
     qCDebug(dcApplication) << "Creating Server Manager";
-    m_serverManager = new ServerManager(m_platform, m_configuration, this);
+    {
+        StartupTraceScope trace("Start servers", "core");
+        m_serverManager = new ServerManager(m_platform, m_configuration, this);
+    }
 
     qCDebug(dcApplication) << "Creating Hardware Manager";
-    m_hardwareManager = new HardwareManagerImplementation(m_platform, m_serverManager->mqttBroker(), this);
+    {
+        StartupTraceScope trace("Create HardwareManager", "core");
+        m_hardwareManager = new HardwareManagerImplementation(m_platform, m_serverManager->mqttBroker(), this);
+    }
 
     qCDebug(dcApplication) << "Creating Thing Manager (locale:" << m_configuration->locale() << ")";
-    m_thingManager = new ThingManagerImplementation(m_hardwareManager, m_configuration->locale(), this);
+    {
+        StartupTraceScope trace("Create ThingManager", "core");
+        m_thingManager = new ThingManagerImplementation(m_hardwareManager, m_configuration->locale(), this);
+    }
+
+    ThingSetupScheduler *setupScheduler = m_thingManager->setupScheduler();
+    setupScheduler->setMaxConcurrentSetups(m_configuration->thingSetupConcurrency());
+    QHash<PluginId, int> pluginConcurrency = m_configuration->thingSetupPluginConcurrency();
+    foreach (const PluginId &pluginId, pluginConcurrency.keys()) {
+        setupScheduler->setMaxConcurrentSetups(pluginId, pluginConcurrency.value(pluginId));
+    }
+    setupScheduler->setRetryPolicy(m_configuration->thingSetupRetries(), m_configuration->thingSetupRetryInterval());
+    connect(setupScheduler, &ThingSetupScheduler::ready, this, [](){
+        StartupTracer::instance()->addInstant("Things ready", "core");
+    });
 
     qCDebug(dcApplication) << "Creating Rule Engine";
     m_ruleEngine = new RuleEngine(this);
 
+    m_ruleActionExecutor = new RuleActionExecutor(m_thingManager, this);
+    m_ruleActionExecutor->setMaxConcurrentActions(m_configuration->ruleActionConcurrency());
+    QHash<PluginId, int> ruleActionConcurrency = m_configuration->ruleActionPluginConcurrency();
+    foreach (const PluginId &pluginId, ruleActionConcurrency.keys()) {
+        m_ruleActionExecutor->setMaxConcurrentActions(pluginId, ruleActionConcurrency.value(pluginId));
+    }
+    connect(m_ruleActionExecutor, &RuleActionExecutor::actionExecuted, this, [this](const Action &action, Thing::ThingError status){
+        if (status == Thing::ThingErrorNoError) {
+            m_logger->logAction(action);
+        } else {
+            m_logger->logAction(action, Logging::LoggingLevelAlert, status);
+        }
+    });
+
     qCDebug(dcApplication()) << "Creating Script Engine";
     m_scriptEngine = new ScriptEngine(m_thingManager, this);
     m_serverManager->jsonServer()->registerHandler(new ScriptsHandler(m_scriptEngine, m_scriptEngine));
@@ -128,10 +179,16 @@ void NymeaCore::init() {
     m_debugServerHandler = new DebugServerHandler(this);
 
     qCDebug(dcApplication) << "Creating Cloud Manager";
-    m_cloudManager = new CloudManager(m_configuration, m_networkManager, this);
+    {
+        StartupTraceScope trace("Create CloudManager", "core");
+        m_cloudManager = new CloudManager(m_configuration, m_networkManager, this);
+    }
 
     qCDebug(dcApplication()) << "Loading experiences";
-    m_experienceManager = new ExperienceManager(m_thingManager, m_serverManager->jsonServer(), this);
+    {
+        StartupTraceScope trace("Load experiences", "core");
+        m_experienceManager = new ExperienceManager(m_thingManager, m_serverManager->jsonServer(), this);
+    }
 
 
     CloudNotifications *cloudNotifications = m_cloudManager->createNotificationsPlugin();
@@ -155,6 +212,7 @@ void NymeaCore::init() {
     connect(m_ruleEngine, &RuleEngine::ruleAdded, this, &NymeaCore::ruleAdded);
     connect(m_ruleEngine, &RuleEngine::ruleRemoved, this, &NymeaCore::ruleRemoved);
     connect(m_ruleEngine, &RuleEngine::ruleConfigurationChanged, this, &NymeaCore::ruleConfigurationChanged);
+    connect(m_ruleEngine, &RuleEngine::rulesTriggered, this, &NymeaCore::onRulesTriggered);
 
     connect(m_timeManager, &TimeManager::dateTimeChanged, this, &NymeaCore::onDateTimeChanged);
 
@@ -505,13 +563,7 @@ void NymeaCore::executeRuleActions(const QList<RuleAction> ruleActions)
     }
 
     foreach (const Action &action, actions) {
-        qCDebug(dcRuleEngine) << "Executing action" << action.actionTypeId() << action.params();
-        ThingActionInfo *info = executeAction(action);
-        connect(info, &ThingActionInfo::finished, this, [info](){
-            if (info->status() != Thing::ThingErrorNoError) {
-                qCWarning(dcRuleEngine) << "Error executing action:" << info->status() << info->displayMessage();
-            }
-        });
+        m_ruleActionExecutor->execute(action, m_currentEventDepth);
     }
 
     foreach (const BrowserAction &browserAction, browserActions) {
@@ -550,6 +602,28 @@ RuleEngine *NymeaCore::ruleEngine() const
     return m_ruleEngine;
 }
 
+RuleActionExecutor *NymeaCore::ruleActionExecutor() const
+{
+    return m_ruleActionExecutor;
+}
+
+/*! Returns statistics about the event processing queue, e.g. how many events have been coalesced or
+    dropped because they exceeded the maximum cascade depth. */
+QVariantMap NymeaCore::eventQueueStatistics() const
+{
+    QVariantMap statistics;
+    statistics.insert("processed", m_processedEvents);
+    statistics.insert("coalesced", m_coalescedEvents);
+    statistics.insert("dropped", m_droppedEvents);
+    statistics.insert("drainCycles", m_drainCycles);
+    statistics.insert("pending", m_eventQueue.count());
+    statistics.insert("maxQueueLength", m_maxEventQueueLength);
+    statistics.insert("maxCascadeSize", m_maxCascadeSize);
+    statistics.insert("maxDepth", m_maxEventDepth);
+    statistics.insert("maxCascadeDepth", maxCascadeDepth);
+    return statistics;
+}
+
 ScriptEngine *NymeaCore::scriptEngine() const
 {
     return m_scriptEngine;
@@ -560,6 +634,11 @@ TimeManager *NymeaCore::timeManager() const
     return m_timeManager;
 }
 
+HardwareManager *NymeaCore::hardwareManager() const
+{
+    return m_hardwareManager;
+}
+
 ServerManager *NymeaCore::serverManager() const
 {
     return m_serverManager;
@@ -697,15 +776,69 @@ void NymeaCore::gotEvent(const Event &event)
     m_logger->logEvent(event);
     emit eventTriggered(event);
 
-    QList<RuleAction> actions;
-    QList<RuleAction> eventBasedActions;
-    foreach (const Rule &rule, m_ruleEngine->evaluateEvent(event)) {
-        if (m_executingRules.contains(rule.id())) {
-            qCWarning(dcRuleEngine()) << "WARNING: Loop detected in rule execution for rule" << rule.id() << rule.name();
-            break;
+    // Events emitted while executing a rule action are caused by the event which caused that action,
+    // even if the action had to wait for the thing. Other events emitted while processing the queue
+    // are caused by the event currently being processed.
+    int depth = 0;
+    if (m_ruleActionExecutor->dispatchingCascadeDepth() >= 0) {
+        depth = m_ruleActionExecutor->dispatchingCascadeDepth() + 1;
+    } else if (m_drainingEvents) {
+        depth = m_currentEventDepth + 1;
+    }
+    if (depth > maxCascadeDepth) {
+        qCWarning(dcRuleEngine()) << "WARNING: Loop detected in rule execution. Not evaluating event" << event.eventTypeId().toString() << "of thing" << event.thingId().toString() << "in cascade depth" << depth;
+        m_droppedEvents++;
+        return;
+    }
+
+    // Only the latest value of a state matters if it changed again before the rules have seen it
+    if (event.isStateChangeEvent()) {
+        for (int i = 0; i < m_eventQueue.count(); i++) {
+            QueuedEvent &queuedEvent = m_eventQueue[i];
+            if (queuedEvent.event.isStateChangeEvent() && queuedEvent.event.thingId() == event.thingId() && queuedEvent.event.eventTypeId() == event.eventTypeId()) {
+                queuedEvent.event = event;
+                queuedEvent.depth = qMax(queuedEvent.depth, depth);
+                m_coalescedEvents++;
+                return;
+            }
         }
-        m_executingRules.append(rule.id());
+    }
 
+    QueuedEvent queuedEvent;
+    queuedEvent.event = event;
+    queuedEvent.depth = depth;
+    m_eventQueue.enqueue(queuedEvent);
+    m_maxEventQueueLength = qMax(m_maxEventQueueLength, m_eventQueue.count());
+
+    if (!m_drainingEvents) {
+        drainEventQueue();
+    }
+}
+
+void NymeaCore::drainEventQueue()
+{
+    m_drainingEvents = true;
+    m_drainCycles++;
+    int cascadeSize = 0;
+    while (!m_eventQueue.isEmpty()) {
+        QueuedEvent queuedEvent = m_eventQueue.dequeue();
+        m_currentEventDepth = queuedEvent.depth;
+        m_maxEventDepth = qMax(m_maxEventDepth, queuedEvent.depth);
+        m_processedEvents++;
+        cascadeSize++;
+        onRulesTriggered(m_ruleEngine->evaluateEvent(queuedEvent.event), queuedEvent.event);
+    }
+    m_maxCascadeSize = qMax(m_maxCascadeSize, cascadeSize);
+    m_currentEventDepth = 0;
+    m_drainingEvents = false;
+}
+
+void NymeaCore::onRulesTriggered(const QList<Rule> &rules, const Event &event)
+{
+    QList<RuleAction> actions;
+    QList<RuleAction> eventBasedActions;
+    foreach (const Rule &rule, rules) {
+        int dispatched = actions.count() + eventBasedActions.count();
         // Event based
         if (!rule.eventDescriptors().isEmpty()) {
             m_logger->logRuleTriggered(rule);
@@ -735,6 +868,7 @@ void NymeaCore::gotEvent(const Event &event)
                 actions.append(rule.exitActions());
             }
         }
+        m_ruleEngine->countActionDispatches(rule.id(), actions.count() + eventBasedActions.count() - dispatched);
     }
 
     // Set action params, depending on the event value
@@ -758,13 +892,19 @@ void NymeaCore::gotEvent(const Event &event)
     }
 
     executeRuleActions(actions);
-    m_executingRules.clear();
 }
 
 void NymeaCore::onDateTimeChanged(const QDateTime &dateTime)
 {
+    // Called every second, the rule engine only returns the time based rules whose next transition is due
+    QList<Rule> dueRules = m_ruleEngine->evaluateTime(dateTime);
+    if (dueRules.isEmpty()) {
+        return;
+    }
+
     QList<RuleAction> actions;
-    foreach (const Rule &rule, m_ruleEngine->evaluateTime(dateTime)) {
+    foreach (const Rule &rule, dueRules) {
+        int dispatched = actions.count();
         // TimeEvent based
         if (!rule.timeDescriptor().timeEventItems().isEmpty()) {
             m_logger->logRuleTriggered(rule);
@@ -783,6 +923,7 @@ void NymeaCore::onDateTimeChanged(const QDateTime &dateTime)
                 actions.append(rule.exitActions());
             }
         }
+        m_ruleEngine->countActionDispatches(rule.id(), actions.count() - dispatched);
     }
     executeRuleActions(actions);
 }
@@ -853,12 +994,17 @@ void NymeaCore::onThingDisappeared(const ThingId &thingId)
 
 void NymeaCore::thingManagerLoaded()
 {
-    m_ruleEngine->init();
+    {
+        StartupTraceScope trace("RuleEngine::init", "core");
+        m_ruleEngine->init();
+    }
     // Evaluate rules on current time
     onDateTimeChanged(m_timeManager->currentDateTime());
 
     emit initialized();
 
+    StartupTracer::instance()->finishStartup();
+
     // Do some houskeeping...
     qCDebug(dcApplication()) << "Starting housekeeping...";
     QDateTime startTime = QDateTime::currentDateTime();
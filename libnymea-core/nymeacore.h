@@ -49,6 +49,7 @@
 #include "debugserverhandler.h"
 
 #include <QObject>
+#include <QQueue>
 
 class Thing;
 
@@ -66,6 +67,7 @@ class System;
 class ExperienceManager;
 class ScriptEngine;
 class CloudManager;
+class RuleActionExecutor;
 
 class NymeaCore : public QObject
 {
@@ -96,8 +98,11 @@ public:
     JsonRPCServerImplementation *jsonRPCServer() const;
     ThingManager *thingManager() const;
     RuleEngine *ruleEngine() const;
+    RuleActionExecutor *ruleActionExecutor() const;
+    QVariantMap eventQueueStatistics() const;
     ScriptEngine *scriptEngine() const;
     TimeManager *timeManager() const;
+    HardwareManager *hardwareManager() const;
     ServerManager *serverManager() const;
     BluetoothServer *bluetoothServer() const;
     NetworkManager *networkManager() const;
@@ -137,6 +142,7 @@ private:
     ServerManager *m_serverManager;
     ThingManagerImplementation *m_thingManager;
     RuleEngine *m_ruleEngine;
+    RuleActionExecutor *m_ruleActionExecutor;
     ScriptEngine *m_scriptEngine;
     LogEngine *m_logger;
     TimeManager *m_timeManager;
@@ -150,10 +156,27 @@ private:
     System *m_system;
     ExperienceManager *m_experienceManager;
 
-    QList<RuleId> m_executingRules;
+    struct QueuedEvent {
+        Event event;
+        int depth = 0;
+    };
+    QQueue<QueuedEvent> m_eventQueue;
+    bool m_drainingEvents = false;
+    int m_currentEventDepth = 0;
+
+    quint64 m_processedEvents = 0;
+    quint64 m_coalescedEvents = 0;
+    quint64 m_droppedEvents = 0;
+    quint64 m_drainCycles = 0;
+    int m_maxEventDepth = 0;
+    int m_maxEventQueueLength = 0;
+    int m_maxCascadeSize = 0;
+
+    void drainEventQueue();
 
 private slots:
     void gotEvent(const Event &event);
+    void onRulesTriggered(const QList<Rule> &rules, const Event &event);
     void onDateTimeChanged(const QDateTime &dateTime);
     void onThingDisappeared(const ThingId &thingId);
     void thingManagerLoaded();
@@ -113,7 +113,7 @@ bool Rule::timeActive() const
 }
 
 /*! Returns the \l{TimeDescriptor} or this Rule. */
-TimeDescriptor Rule::timeDescriptor() const
+const TimeDescriptor &Rule::timeDescriptor() const
 {
     return m_timeDescriptor;
 }
@@ -125,7 +125,7 @@ void Rule::setTimeDescriptor(const TimeDescriptor &timeDescriptor)
 }
 
 /*! Returns the StateEvaluator that needs to evaluate successfully in order for this to Rule apply. */
-StateEvaluator Rule::stateEvaluator() const
+const StateEvaluator &Rule::stateEvaluator() const
 {
     return m_stateEvaluator;
 }
@@ -137,7 +137,7 @@ void Rule::setStateEvaluator(const StateEvaluator &stateEvaluator)
 }
 
 /*! Returns the \l{EventDescriptor} for this Rule.*/
-EventDescriptors Rule::eventDescriptors() const
+const EventDescriptors &Rule::eventDescriptors() const
 {
     return m_eventDescriptors;
 }
@@ -68,13 +68,13 @@ public:
     bool statesActive() const;
     bool timeActive() const;
 
-    TimeDescriptor timeDescriptor() const;
+    const TimeDescriptor &timeDescriptor() const;
     void setTimeDescriptor(const TimeDescriptor &timeDescriptor);
 
-    StateEvaluator stateEvaluator() const;
+    const StateEvaluator &stateEvaluator() const;
     void setStateEvaluator(const StateEvaluator &stateEvaluator);
 
-    EventDescriptors eventDescriptors() const;
+    const EventDescriptors &eventDescriptors() const;
     void setEventDescriptors(const EventDescriptors &eventDescriptors);
 
     RuleActions actions() const;
@@ -0,0 +1,290 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* Copyright 2013 - 2020, nymea GmbH
+* Contact: contact@nymea.io
+*
+* This file is part of nymea.
+* This project including source code and documentation is protected by
+* copyright law, and remains the property of nymea GmbH. All rights, including
+* reproduction, publication, editing and translation, are reserved. The use of
+* this project is subject to the terms of a license agreement to be concluded
+* with nymea GmbH in accordance with the terms of use of nymea GmbH, available
+* under https://nymea.io/license
+*
+* GNU General Public License Usage
+* Alternatively, this project may be redistributed and/or modified under the
+* terms of the GNU General Public License as published by the Free Software
+* Foundation, GNU version 3. This project is distributed in the hope that it
+* will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+* of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+* Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with
+* this project. If not, see <https://www.gnu.org/licenses/>.
+*
+* For any further details and any questions please contact us under
+* contact@nymea.io or see our FAQ/Licensing Information on
+* https://nymea.io/license/faq
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+/*!
+    \class nymeaserver::RuleActionExecutor
+    \brief Executes the actions of rules with per thing ordering and per plugin limits.
+
+    \ingroup rules
+    \inmodule core
+
+    Rules may trigger many actions at once, often on things which are all handled by the same
+    gateway. Instead of passing all of them to the plugins at the same time, the RuleActionExecutor
+    queues them and only runs one action per thing at a time, in the order they have been queued.
+    Additionally, no more than \l{maxConcurrentActions()} actions will be running per plugin.
+
+    If an action setting a writable state is queued for a thing which still has a pending action
+    for the same state, the pending one is replaced, given it would be superseded by the new one
+    anyways. All other actions are executed once for each time they have been queued.
+
+    \sa RuleEngine, RuleAction
+*/
+
+/*! \fn void nymeaserver::RuleActionExecutor::actionExecuted(const Action &action, Thing::ThingError status, const QString &displayMessage, qint64 latency);
+    This signal is emitted when the execution of the given \a action has finished with the given
+    \a status and \a displayMessage. The \a latency is the time in milliseconds since the action
+    has been queued.
+*/
+
+#include "ruleactionexecutor.h"
+#include "loggingcategories.h"
+
+#include "integrations/thingmanager.h"
+#include "integrations/thingactioninfo.h"
+#include "integrations/integrationplugin.h"
+
+namespace nymeaserver {
+
+RuleActionExecutor::RuleActionExecutor(ThingManager *thingManager, QObject *parent) :
+    QObject(parent),
+    m_thingManager(thingManager)
+{
+    m_clock.start();
+}
+
+/*! Returns the default number of concurrent actions per plugin. 0 means unlimited. */
+int RuleActionExecutor::maxConcurrentActions() const
+{
+    return m_maxConcurrentActions;
+}
+
+/*! Sets the default number of concurrent actions per plugin to \a maxConcurrentActions. 0 means unlimited. */
+void RuleActionExecutor::setMaxConcurrentActions(int maxConcurrentActions)
+{
+    m_maxConcurrentActions = qMax(0, maxConcurrentActions);
+    m_queueChanged = true;
+    processQueue();
+}
+
+/*! Returns the number of concurrent actions for the plugin with the given \a pluginId. 0 means unlimited. */
+int RuleActionExecutor::maxConcurrentActions(const PluginId &pluginId) const
+{
+    return m_pluginLimits.value(pluginId, m_maxConcurrentActions);
+}
+
+/*! Overrides the number of concurrent actions for the plugin with the given \a pluginId. 0 means unlimited,
+    a negative value restores the default. */
+void RuleActionExecutor::setMaxConcurrentActions(const PluginId &pluginId, int maxConcurrentActions)
+{
+    if (maxConcurrentActions < 0) {
+        m_pluginLimits.remove(pluginId);
+    } else {
+        m_pluginLimits.insert(pluginId, maxConcurrentActions);
+    }
+    m_queueChanged = true;
+    processQueue();
+}
+
+/*! Queues the given \a action for execution. If the thing and its plugin are idle, the action is
+    passed to the plugin before this method returns.
+
+    The \a cascadeDepth of the event which caused this action is handed back through
+    dispatchingCascadeDepth() while the action is passed to the plugin, so events emitted by the
+    plugin in response continue that cascade even if the action had to wait in the queue.
+*/
+void RuleActionExecutor::execute(const Action &action, int cascadeDepth)
+{
+    Entry entry;
+    entry.action = action;
+    entry.queuedAt = m_clock.elapsed();
+    entry.cascadeDepth = cascadeDepth;
+
+    // Only actions setting a writable state can be superseded, the last value wins for those.
+    // Any other action, like a notification or a button press, must be executed every time.
+    bool stateAction = false;
+    Thing *thing = m_thingManager->findConfiguredThing(action.thingId());
+    if (thing) {
+        entry.pluginId = thing->pluginId();
+        stateAction = thing->thingClass().stateTypes().findById(StateTypeId(action.actionTypeId().toString())).writable();
+    }
+
+    // A pending action setting the same state is replaced in place to keep the order of the thing's actions
+    bool superseded = false;
+    for (int i = 0; stateAction && i < m_queue.count(); i++) {
+        const Entry &pending = m_queue.at(i);
+        if (pending.action.thingId() == action.thingId() && pending.action.actionTypeId() == action.actionTypeId()) {
+            qCDebug(dcRuleEngine()) << "Replacing superseded action" << pending.action.actionTypeId() << "for thing" << action.thingId() << "params" << pending.action.params() << "with" << action.params();
+            m_statistics[pending.pluginId].superseded++;
+            m_queuedPerPlugin[pending.pluginId]--;
+            m_queue[i] = entry;
+            superseded = true;
+            break;
+        }
+    }
+
+    if (!superseded) {
+        m_queue.append(entry);
+    }
+    int queued = ++m_queuedPerPlugin[entry.pluginId];
+    PluginStatistics &statistics = m_statistics[entry.pluginId];
+    statistics.maxQueued = qMax(statistics.maxQueued, queued);
+
+    m_queueChanged = true;
+    processQueue();
+}
+
+/*! Returns the cascade depth of the action currently being passed to its plugin or -1 if no
+    action is being dispatched right now.
+
+    \sa execute()
+*/
+int RuleActionExecutor::dispatchingCascadeDepth() const
+{
+    return m_dispatchingCascadeDepth;
+}
+
+/*! Returns the number of actions waiting to be executed. */
+int RuleActionExecutor::pendingActions() const
+{
+    return m_queue.count();
+}
+
+/*! Returns the number of actions currently being executed by the plugins. */
+int RuleActionExecutor::runningActions() const
+{
+    return m_runningActions.count();
+}
+
+/*! Returns the number of pending, running, executed, failed and superseded actions as well as
+    the average and maximum latencies per plugin. */
+QVariantMap RuleActionExecutor::statistics() const
+{
+    QVariantMap plugins;
+    foreach (const PluginId &pluginId, m_statistics.keys()) {
+        const PluginStatistics &statistics = m_statistics[pluginId];
+        int finished = statistics.executed + statistics.failed;
+
+        QVariantMap pluginMap;
+        pluginMap.insert("maxConcurrentActions", maxConcurrentActions(pluginId));
+        pluginMap.insert("pending", m_queuedPerPlugin.value(pluginId));
+        pluginMap.insert("running", m_runningPerPlugin.value(pluginId));
+        pluginMap.insert("maxPending", statistics.maxQueued);
+        pluginMap.insert("executed", statistics.executed);
+        pluginMap.insert("failed", statistics.failed);
+        pluginMap.insert("superseded", statistics.superseded);
+        pluginMap.insert("averageLatency", finished > 0 ? statistics.totalLatency / finished : 0);
+        pluginMap.insert("maxLatency", statistics.maxLatency);
+
+        IntegrationPlugin *plugin = pluginId.isNull() ? nullptr : m_thingManager->plugin(pluginId);
+        pluginMap.insert("pluginId", pluginId.toString());
+        plugins.insert(plugin ? plugin->pluginName() : pluginId.toString(), pluginMap);
+    }
+
+    QVariantMap ret;
+    ret.insert("maxConcurrentActions", m_maxConcurrentActions);
+    ret.insert("pending", m_queue.count());
+    ret.insert("running", m_runningActions.count());
+    ret.insert("plugins", plugins);
+    return ret;
+}
+
+void RuleActionExecutor::processQueue()
+{
+    // Plugins may emit events synchronously while executing an action, which may queue
+    // further actions. Those are picked up by the outermost call.
+    if (m_processing) {
+        return;
+    }
+    m_processing = true;
+    while (m_queueChanged) {
+        m_queueChanged = false;
+        while (dispatchPending()) { }
+    }
+    m_processing = false;
+}
+
+bool RuleActionExecutor::dispatchPending()
+{
+    // Things which already have an earlier action waiting in the queue must not be overtaken
+    QSet<ThingId> blockedThings = m_busyThings;
+
+    for (int i = 0; i < m_queue.count(); i++) {
+        const Entry &entry = m_queue.at(i);
+        ThingId thingId = entry.action.thingId();
+        if (blockedThings.contains(thingId)) {
+            continue;
+        }
+        blockedThings.insert(thingId);
+
+        int limit = maxConcurrentActions(entry.pluginId);
+        if (limit > 0 && m_runningPerPlugin.value(entry.pluginId) >= limit) {
+            continue;
+        }
+
+        Entry dispatched = m_queue.takeAt(i);
+        m_queuedPerPlugin[dispatched.pluginId]--;
+        m_runningPerPlugin[dispatched.pluginId]++;
+        m_busyThings.insert(thingId);
+
+        qCDebug(dcRuleEngine()) << "Executing action" << dispatched.action.actionTypeId() << dispatched.action.params();
+        int previousCascadeDepth = m_dispatchingCascadeDepth;
+        m_dispatchingCascadeDepth = dispatched.cascadeDepth;
+        ThingActionInfo *info = m_thingManager->executeAction(dispatched.action);
+        m_dispatchingCascadeDepth = previousCascadeDepth;
+        m_runningActions.insert(info, dispatched);
+        connect(info, &ThingActionInfo::finished, this, &RuleActionExecutor::onActionFinished);
+
+        // The queue may have been modified while the plugin was executing the action
+        return true;
+    }
+    return false;
+}
+
+void RuleActionExecutor::onActionFinished()
+{
+    ThingActionInfo *info = qobject_cast<ThingActionInfo *>(sender());
+    if (!m_runningActions.contains(info)) {
+        return;
+    }
+
+    Entry entry = m_runningActions.take(info);
+    m_runningPerPlugin[entry.pluginId]--;
+    m_busyThings.remove(entry.action.thingId());
+
+    qint64 latency = m_clock.elapsed() - entry.queuedAt;
+    PluginStatistics &statistics = m_statistics[entry.pluginId];
+    statistics.totalLatency += latency;
+    statistics.maxLatency = qMax(statistics.maxLatency, latency);
+
+    if (info->status() == Thing::ThingErrorNoError) {
+        statistics.executed++;
+        qCDebug(dcRuleEngine()) << "Rule action" << entry.action.actionTypeId() << "for thing" << entry.action.thingId() << "finished in" << latency << "ms";
+    } else {
+        statistics.failed++;
+        qCWarning(dcRuleEngine()) << "Error executing rule action" << entry.action.actionTypeId() << "for thing" << entry.action.thingId() << ":" << info->status() << info->displayMessage() << "after" << latency << "ms";
+    }
+
+    emit actionExecuted(info->action(), info->status(), info->displayMessage(), latency);
+
+    m_queueChanged = true;
+    processQueue();
+}
+
+}
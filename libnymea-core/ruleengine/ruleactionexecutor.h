@@ -0,0 +1,115 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* Copyright 2013 - 2020, nymea GmbH
+* Contact: contact@nymea.io
+*
+* This file is part of nymea.
+* This project including source code and documentation is protected by
+* copyright law, and remains the property of nymea GmbH. All rights, including
+* reproduction, publication, editing and translation, are reserved. The use of
+* this project is subject to the terms of a license agreement to be concluded
+* with nymea GmbH in accordance with the terms of use of nymea GmbH, available
+* under https://nymea.io/license
+*
+* GNU General Public License Usage
+* Alternatively, this project may be redistributed and/or modified under the
+* terms of the GNU General Public License as published by the Free Software
+* Foundation, GNU version 3. This project is distributed in the hope that it
+* will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+* of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+* Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with
+* this project. If not, see <https://www.gnu.org/licenses/>.
+*
+* For any further details and any questions please contact us under
+* contact@nymea.io or see our FAQ/Licensing Information on
+* https://nymea.io/license/faq
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef RULEACTIONEXECUTOR_H
+#define RULEACTIONEXECUTOR_H
+
+#include "typeutils.h"
+#include "types/action.h"
+#include "integrations/thing.h"
+
+#include <QObject>
+#include <QHash>
+#include <QSet>
+#include <QVariantMap>
+#include <QElapsedTimer>
+
+class ThingManager;
+class ThingActionInfo;
+
+namespace nymeaserver {
+
+class RuleActionExecutor : public QObject
+{
+    Q_OBJECT
+public:
+    explicit RuleActionExecutor(ThingManager *thingManager, QObject *parent = nullptr);
+
+    int maxConcurrentActions() const;
+    void setMaxConcurrentActions(int maxConcurrentActions);
+
+    int maxConcurrentActions(const PluginId &pluginId) const;
+    void setMaxConcurrentActions(const PluginId &pluginId, int maxConcurrentActions);
+
+    void execute(const Action &action, int cascadeDepth = 0);
+    int dispatchingCascadeDepth() const;
+
+    int pendingActions() const;
+    int runningActions() const;
+
+    QVariantMap statistics() const;
+
+signals:
+    void actionExecuted(const Action &action, Thing::ThingError status, const QString &displayMessage, qint64 latency);
+
+private slots:
+    void processQueue();
+    void onActionFinished();
+
+private:
+    struct Entry {
+        Action action;
+        PluginId pluginId;
+        qint64 queuedAt = 0;
+        int cascadeDepth = 0;
+    };
+
+    struct PluginStatistics {
+        int executed = 0;
+        int failed = 0;
+        int superseded = 0;
+        int maxQueued = 0;
+        qint64 totalLatency = 0;
+        qint64 maxLatency = 0;
+    };
+
+    bool dispatchPending();
+
+    ThingManager *m_thingManager = nullptr;
+
+    int m_maxConcurrentActions = 0;
+    QHash<PluginId, int> m_pluginLimits;
+
+    QList<Entry> m_queue;
+    QHash<ThingActionInfo *, Entry> m_runningActions;
+    QSet<ThingId> m_busyThings;
+    QHash<PluginId, int> m_runningPerPlugin;
+    QHash<PluginId, int> m_queuedPerPlugin;
+    QHash<PluginId, PluginStatistics> m_statistics;
+
+    QElapsedTimer m_clock;
+    bool m_processing = false;
+    bool m_queueChanged = false;
+    int m_dispatchingCascadeDepth = -1;
+};
+
+}
+
+#endif // RULEACTIONEXECUTOR_H
@@ -54,6 +54,11 @@
     Will be emitted whenever a \l{Rule} changed his enable/disable status.
     The parameter \a rule holds the changed rule.*/
 
+/*! \fn void nymeaserver::RuleEngine::rulesTriggered(const QList<Rule> &rules, const Event &event)
+    Will be emitted whenever \a rules are triggered or change their active state outside of \l{evaluateEvent()},
+    because an \a event or a state change has been delayed by a \l{TriggerFilter}. For state changes the
+    \a event is invalid.*/
+
 /*! \enum nymeaserver::RuleEngine::RuleError
     \value RuleErrorNoError
         No error happened. Everything is fine.
@@ -110,6 +115,9 @@
 
 
 #include "ruleengine.h"
+#include "rulesnapshot.h"
+#include "triggerfilters.h"
+#include "statethresholdindex.h"
 #include "nymeacore.h"
 #include "loggingcategories.h"
 #include "time/calendaritem.h"
@@ -126,20 +134,41 @@
 #include <QStringList>
 #include <QStandardPaths>
 #include <QCoreApplication>
+#include <QtConcurrent/QtConcurrent>
+#include <QFile>
+#include <QElapsedTimer>
 
 namespace nymeaserver {
 
+// Matching a rule is often cheaper than reading the clock, so only every 16th evaluation of a rule is timed
+static const int costSamplingInterval = 16;
+
 /*! Constructs the RuleEngine with the given \a parent. Although it wouldn't harm to have multiple RuleEngines, there is one
     instance available from \l{NymeaCore}. This one should be used instead of creating multiple ones.
  */
 RuleEngine::RuleEngine(QObject *parent) :
     QObject(parent)
 {
+    m_triggerFilters = new TriggerFilters(this);
+    connect(m_triggerFilters, &TriggerFilters::rulesDue, this, &RuleEngine::evaluateTriggerFilters);
+
+    // Numeric thresholds are compared right when the state changes, before the state change event is evaluated
+    m_stateThresholds.reset(new StateThresholdIndex(NymeaCore::instance()->thingManager()));
+    connect(NymeaCore::instance()->thingManager(), &ThingManager::thingStateChanged, this, &RuleEngine::onThingStateChanged);
+
+    // Start parsing the rule snapshot right away, it will be ready by the time init() is called
+    QString snapshotFileName = RuleSnapshot::fileName();
+    m_snapshotLoader = QtConcurrent::run([this, snapshotFileName](){
+        return RuleSnapshot::load(snapshotFileName, &m_snapshotRules);
+    });
 }
 
 /*! Destructor of the \l{RuleEngine}. */
 RuleEngine::~RuleEngine()
 {
+    // Make sure pending changes hit the disk
+    writeSnapshot();
+    m_snapshotLoader.waitForFinished();
 }
 
 /*! Ask the Engine to evaluate all the rules for the given \a event.
@@ -165,50 +194,51 @@ QList<Rule> RuleEngine::evaluateEvent(const Event &event)
         qCDebug(dcRuleEngineDebug).nospace().noquote() << "Evaluate event: " << thing->name() << " - " << eventType.name() << " (ThingId:" << thing->id().toString() << ", EventTypeId:" << eventType.id().toString() << ")" << endl << "     " << event.params();
     }
 
+    // Rules are only copied once they are triggered, the evaluation itself only updates their runtime state
     QList<Rule> rules;
-    foreach (const RuleId &id, ruleIds()) {
-        Rule rule = m_rules.value(id);
+    QElapsedTimer timer;
+    for (int i = 0; i < m_rules.count(); i++) {
+        const Rule &rule = m_rules.at(i);
         if (!rule.enabled()) {
             qCDebug(dcRuleEngineDebug()).nospace().noquote() << "Skipping rule " << rule.name() << " (" << rule.id().toString() << ") "  << " because it is disabled.";
             continue;
         }
 
+        RuleCost &cost = m_ruleCosts[i];
+        bool timed = cost.evaluations++ % costSamplingInterval == 0;
+
         // If we have a state based on this event
         if (containsState(rule.stateEvaluator(), event)) {
-            rule.setStatesActive(rule.stateEvaluator().evaluate());
-            m_rules[rule.id()] = rule;
+            if (timed)
+                timer.start();
+            setRuleState(i, RuleStateStatesActive, rule.stateEvaluator().evaluate(m_triggerFilters, rule.id(), m_stateThresholds.data()));
+            if (timed)
+                cost.stateEvaluationTime += timer.nsecsElapsed() * costSamplingInterval;
+            cost.stateEvaluations++;
         }
 
         // If this rule does not base on an event, evaluate the rule
         if (rule.eventDescriptors().isEmpty() && rule.timeDescriptor().timeEventItems().isEmpty() && !rule.stateEvaluator().isEmpty()) {
-            if (rule.timeActive() && rule.statesActive()) {
-                if (!m_activeRules.contains(rule.id())) {
-                    qCDebug(dcRuleEngine).nospace().noquote() << "Rule " << rule.name() << " (" << rule.id().toString() << ") active.";
-                    rule.setActive(true);
-                    m_rules[rule.id()] = rule;
-                    m_activeRules.append(rule.id());
-                    rules.append(rule);
-                }
-            } else {
-                if (m_activeRules.contains(rule.id())) {
-                    qCDebug(dcRuleEngine).nospace().noquote() << "Rule " << rule.name() << " (" << rule.id().toString() << ") inactive.";
-                    rule.setActive(false);
-                    m_rules[rule.id()] = rule;
-                    m_activeRules.removeAll(rule.id());
-                    rules.append(rule);
-                }
+            if (updateRuleActive(i)) {
+                cost.matches++;
+                rules.append(ruleWithState(i));
             }
         } else {
             // Event based rule
-            if (containsEvent(rule, event, thing->thingClassId())) {
+            if (timed)
+                timer.start();
+            bool matching = containsEvent(rule, event, thing->thingClassId());
+            if (timed)
+                cost.eventMatchingTime += timer.nsecsElapsed() * costSamplingInterval;
+            if (matching) {
+                cost.matches++;
                 qCDebug(dcRuleEngineDebug()).nospace().noquote() << "Rule " << rule.name() << " (" << rule.id().toString() << ") contains event";
-                if (rule.statesActive() && rule.timeActive()) {
+                if (ruleState(i, RuleStateStatesActive) && ruleTimeActive(i)) {
                     qCDebug(dcRuleEngine).nospace().noquote() << "Rule " << rule.name() << " (" + rule.id().toString() << ") contains event and all states match.";
-                    rules.append(rule);
                 } else {
                     qCDebug(dcRuleEngine).nospace().noquote() << "Rule " << rule.name() << " (" + rule.id().toString() << ") contains event but state are not matching.";
-                    rules.append(rule);
                 }
+                rules.append(ruleWithState(i));
             }
         }
     }
@@ -220,6 +250,9 @@ QList<Rule> RuleEngine::evaluateEvent(const Event &event)
     This will search all the \l{Rule}{Rules} triggered by the given \a dateTime
     and evaluate their \l{CalendarItem}{CalendarItems} and \l{TimeEventItem}{TimeEventItems}.
     It will return a list of all \l{Rule}{Rules} that are triggered or change its active state.
+
+    Only rules whose next time transition has been reached are evaluated, all other time based
+    rules can not change and are skipped. This keeps calling this method every second cheap.
 */
 QList<Rule> RuleEngine::evaluateTime(const QDateTime &dateTime)
 {
@@ -229,14 +262,44 @@ QList<Rule> RuleEngine::evaluateTime(const QDateTime &dateTime)
         m_lastEvaluationTime = m_lastEvaluationTime.addSecs(-1);
     }
 
+    // If the time jumped backwards the schedule is not valid any more, reevaluate all time based rules
+    if (dateTime < m_lastEvaluationTime) {
+        qCDebug(dcRuleEngine()) << "Time jumped backwards. Reevaluating all time based rules.";
+        m_timeSchedule.clear();
+        m_scheduledTimeRules.clear();
+        m_pendingTimeRules.clear();
+        foreach (const Rule &rule, m_rules) {
+            if (rule.enabled() && !rule.timeDescriptor().isEmpty()) {
+                m_pendingTimeRules.append(rule.id());
+            }
+        }
+    }
+
+    QList<RuleId> dueRules = m_pendingTimeRules;
+    m_pendingTimeRules.clear();
+    while (!m_timeSchedule.isEmpty() && m_timeSchedule.firstKey() <= dateTime) {
+        QMultiMap<QDateTime, RuleId>::iterator it = m_timeSchedule.begin();
+        RuleId ruleId = it.value();
+        m_timeSchedule.erase(it);
+        m_scheduledTimeRules.remove(ruleId);
+        if (!dueRules.contains(ruleId)) {
+            dueRules.append(ruleId);
+        }
+    }
+
     QList<Rule> rules;
 
-    foreach (const Rule &r, m_rules.values()) {
-        Rule rule = m_rules.value(r.id());
+    foreach (const RuleId &ruleId, dueRules) {
+        int index = m_ruleIndexes.value(ruleId, -1);
+        if (index < 0)
+            continue;
+
+        const Rule &rule = m_rules.at(index);
         if (!rule.enabled()) {
             qCDebug(dcRuleEngineDebug()) << "Skipping rule" + rule.name() + "because it is disabled";
             continue;
         }
+        m_ruleCosts[index].evaluations++;
 
         // If no timeDescriptor, do nothing
         if (rule.timeDescriptor().isEmpty())
@@ -244,27 +307,12 @@ QList<Rule> RuleEngine::evaluateTime(const QDateTime &dateTime)
 
         // Check if this rule is based on calendarItems
         if (!rule.timeDescriptor().calendarItems().isEmpty()) {
-            rule.setTimeActive(rule.timeDescriptor().evaluate(m_lastEvaluationTime, dateTime));
-            m_rules[rule.id()] = rule;
+            setRuleState(index, RuleStateTimeActive, rule.timeDescriptor().evaluate(m_lastEvaluationTime, dateTime));
 
             if (rule.timeDescriptor().timeEventItems().isEmpty() && rule.eventDescriptors().isEmpty()) {
-
-                if (rule.timeActive() && rule.statesActive()) {
-                    if (!m_activeRules.contains(rule.id())) {
-                        qCDebug(dcRuleEngine) << "Rule" << rule.id().toString() << "active.";
-                        rule.setActive(true);
-                        m_rules[rule.id()] = rule;
-                        m_activeRules.append(rule.id());
-                        rules.append(rule);
-                    }
-                } else {
-                    if (m_activeRules.contains(rule.id())) {
-                        qCDebug(dcRuleEngine) << "Rule" << rule.id().toString() << "inactive.";
-                        rule.setActive(false);
-                        m_rules[rule.id()] = rule;
-                        m_activeRules.removeAll(rule.id());
-                        rules.append(rule);
-                    }
+                if (updateRuleActive(index)) {
+                    m_ruleCosts[index].matches++;
+                    rules.append(ruleWithState(index));
                 }
             }
         }
@@ -273,11 +321,14 @@ QList<Rule> RuleEngine::evaluateTime(const QDateTime &dateTime)
         // If we have timeEvent items
         if (!rule.timeDescriptor().timeEventItems().isEmpty()) {
             bool valid = rule.timeDescriptor().evaluate(m_lastEvaluationTime, dateTime);
-            if (valid && rule.timeActive()) {
+            if (valid && ruleTimeActive(index)) {
                 qCDebug(dcRuleEngine) << "Rule" << rule.id() << "time event triggert.";
-                rules.append(rule);
+                m_ruleCosts[index].matches++;
+                rules.append(ruleWithState(index));
             }
         }
+
+        scheduleTimeRule(rule, dateTime);
     }
 
     m_lastEvaluationTime = dateTime;
@@ -345,6 +396,11 @@ RuleEngine::RuleError RuleEngine::addRule(const Rule &rule, bool fromEdit)
                 return RuleErrorEventTypeNotFound;
             }
         }
+
+        if (eventDescriptor.filter().hysteresis() < 0) {
+            qCWarning(dcRuleEngine()) << "Cannot create rule. The hysteresis of an event descriptor must not be negative.";
+            return RuleErrorInvalidParameter;
+        }
     }
 
     // Check state evaluator
@@ -412,7 +468,7 @@ RuleEngine::RuleError RuleEngine::addRule(const Rule &rule, bool fromEdit)
     }
 
     appendRule(rule);
-    saveRule(rule);
+    saveRules();
 
     if (!fromEdit)
         emit ruleAdded(rule);
@@ -461,19 +517,26 @@ RuleEngine::RuleError RuleEngine::editRule(const Rule &rule)
     return RuleErrorNoError;
 }
 
-/*! Returns a list of all \l{Rule}{Rules} loaded in this Engine.
-    Be aware that this does not necessarily reflect the order of the rules in the engine.
-    Use ruleIds() if you need the correct order.
-*/
+/*! Returns a list of all \l{Rule}{Rules} loaded in this Engine in the order they have been added. */
 QList<Rule> RuleEngine::rules() const
 {
-    return m_rules.values();
+    QList<Rule> rules;
+    rules.reserve(m_rules.count());
+    for (int i = 0; i < m_rules.count(); i++) {
+        rules.append(ruleWithState(i));
+    }
+    return rules;
 }
 
 /*! Returns a list of all ruleIds loaded in this Engine. */
 QList<RuleId> RuleEngine::ruleIds() const
 {
-    return m_ruleIds;
+    QList<RuleId> ruleIds;
+    ruleIds.reserve(m_rules.count());
+    foreach (const Rule &rule, m_rules) {
+        ruleIds.append(rule.id());
+    }
+    return ruleIds;
 }
 
 /*! Removes the \l{Rule} with the given \a ruleId from the Engine.
@@ -483,19 +546,17 @@ QList<RuleId> RuleEngine::ruleIds() const
 */
 RuleEngine::RuleError RuleEngine::removeRule(const RuleId &ruleId, bool fromEdit)
 {
-    int index = m_ruleIds.indexOf(ruleId);
+    int index = m_ruleIndexes.value(ruleId, -1);
     if (index < 0) {
         return RuleErrorRuleNotFound;
     }
 
-    m_ruleIds.takeAt(index);
-    m_rules.remove(ruleId);
-    m_activeRules.removeAll(ruleId);
+    removeRuleAt(index);
+    unscheduleTimeRule(ruleId);
+    m_triggerFilters->clear(ruleId);
+    m_stateThresholds->removeRule(ruleId);
 
-    NymeaSettings settings(NymeaSettings::SettingsRoleRules);
-    settings.beginGroup(ruleId.toString());
-    settings.remove("");
-    settings.endGroup();
+    saveRules();
 
     if (!fromEdit)
         emit ruleRemoved(ruleId);
@@ -512,19 +573,22 @@ RuleEngine::RuleError RuleEngine::removeRule(const RuleId &ruleId, bool fromEdit
 */
 RuleEngine::RuleError RuleEngine::enableRule(const RuleId &ruleId)
 {
-    if (!m_rules.contains(ruleId)) {
+    int index = m_ruleIndexes.value(ruleId, -1);
+    if (index < 0) {
         qCWarning(dcRuleEngine) << "Rule not found. Can't enable it";
         return RuleErrorRuleNotFound;
     }
 
-    Rule rule = m_rules.value(ruleId);
+    Rule &rule = m_rules[index];
     if (rule.enabled())
         return RuleErrorNoError;
 
     rule.setEnabled(true);
-    m_rules[ruleId] = rule;
-    saveRule(rule);
-    emit ruleConfigurationChanged(rule);
+    if (!rule.timeDescriptor().isEmpty() && !m_pendingTimeRules.contains(ruleId)) {
+        m_pendingTimeRules.append(ruleId);
+    }
+    saveRules();
+    emit ruleConfigurationChanged(ruleWithState(index));
 
     NymeaCore::instance()->logEngine()->logRuleEnabledChanged(rule, true);
     qCDebug(dcRuleEngine()) << "Rule" << rule.name() << rule.id() << "enabled.";
@@ -538,19 +602,21 @@ RuleEngine::RuleError RuleEngine::enableRule(const RuleId &ruleId)
 */
 RuleEngine::RuleError RuleEngine::disableRule(const RuleId &ruleId)
 {
-    if (!m_rules.contains(ruleId)) {
+    int index = m_ruleIndexes.value(ruleId, -1);
+    if (index < 0) {
         qCWarning(dcRuleEngine) << "Rule not found. Can't disable it";
         return RuleErrorRuleNotFound;
     }
 
-    Rule rule = m_rules.value(ruleId);
+    Rule &rule = m_rules[index];
     if (!rule.enabled())
         return RuleErrorNoError;
 
     rule.setEnabled(false);
-    m_rules[ruleId] = rule;
-    saveRule(rule);
-    emit ruleConfigurationChanged(rule);
+    unscheduleTimeRule(ruleId);
+    m_triggerFilters->clear(ruleId);
+    saveRules();
+    emit ruleConfigurationChanged(ruleWithState(index));
 
     NymeaCore::instance()->logEngine()->logRuleEnabledChanged(rule, false);
     qCDebug(dcRuleEngine()) << "Rule" << rule.name() << rule.id() << "disabled.";
@@ -565,12 +631,13 @@ RuleEngine::RuleError RuleEngine::disableRule(const RuleId &ruleId)
 RuleEngine::RuleError RuleEngine::executeActions(const RuleId &ruleId)
 {
     // check if rule exists
-    if (!m_rules.contains(ruleId)) {
+    int index = m_ruleIndexes.value(ruleId, -1);
+    if (index < 0) {
         qCWarning(dcRuleEngine) << "Not executing rule actions: Rule not found.";
         return RuleErrorRuleNotFound;
     }
 
-    Rule rule = m_rules.value(ruleId);
+    Rule rule = ruleWithState(index);
 
     // check if rule is executable
     if (!rule.executable()) {
@@ -587,6 +654,7 @@ RuleEngine::RuleError RuleEngine::executeActions(const RuleId &ruleId)
     }
 
     qCDebug(dcRuleEngine) << "Executing rule actions of rule" << rule.name() << rule.id();
+    m_ruleCosts[index].actionDispatches += rule.actions().count();
     NymeaCore::instance()->logEngine()->logRuleActionsExecuted(rule);
     NymeaCore::instance()->executeRuleActions(rule.actions());
     return RuleErrorNoError;
@@ -600,12 +668,13 @@ RuleEngine::RuleError RuleEngine::executeActions(const RuleId &ruleId)
 RuleEngine::RuleError RuleEngine::executeExitActions(const RuleId &ruleId)
 {
     // check if rule exits
-    if (!m_rules.contains(ruleId)) {
+    int index = m_ruleIndexes.value(ruleId, -1);
+    if (index < 0) {
         qCWarning(dcRuleEngine) << "Not executing rule exit actions: rule not found.";
         return RuleErrorRuleNotFound;
     }
 
-    Rule rule = m_rules.value(ruleId);
+    Rule rule = ruleWithState(index);
 
     // check if rule is executable
     if (!rule.executable()) {
@@ -619,6 +688,7 @@ RuleEngine::RuleError RuleEngine::executeExitActions(const RuleId &ruleId)
     }
 
     qCDebug(dcRuleEngine) << "Executing rule exit actions of rule" << rule.name() << rule.id();
+    m_ruleCosts[index].actionDispatches += rule.exitActions().count();
     NymeaCore::instance()->logEngine()->logRuleExitActionsExecuted(rule);
     NymeaCore::instance()->executeRuleActions(rule.exitActions());
     return RuleErrorNoError;
@@ -626,10 +696,11 @@ RuleEngine::RuleError RuleEngine::executeExitActions(const RuleId &ruleId)
 
 Rule RuleEngine::findRule(const RuleId &ruleId)
 {
-    if (!m_rules.contains(ruleId))
+    int index = m_ruleIndexes.value(ruleId, -1);
+    if (index < 0)
         return Rule();
 
-    return m_rules.value(ruleId);
+    return ruleWithState(index);
 }
 
 QList<RuleId> RuleEngine::findRules(const ThingId &thingId) const
@@ -720,12 +791,55 @@ QList<ThingId> RuleEngine::thingsInRules() const
     return tmp;
 }
 
+/*! Returns the evaluation cost counters of all rules in the order of ruleIds().
+
+    For each rule this contains how often it has been evaluated and matched, how many of its actions have
+    been dispatched and the time in microseconds spent in matching events and evaluating its states. The
+    times are estimated by timing every 16th evaluation of a rule only.
+    The counters are kept in memory only and start over when a rule is edited or nymead is restarted.
+
+    \sa ruleStatistics(const RuleId &ruleId)
+*/
+QVariantList RuleEngine::ruleStatistics() const
+{
+    QVariantList statistics;
+    for (int i = 0; i < m_rules.count(); i++) {
+        statistics.append(packRuleCost(i));
+    }
+    return statistics;
+}
+
+/*! Returns the evaluation cost counters of the rule with the given \a ruleId or an empty map
+    if there is no such rule.
+
+    \sa ruleStatistics()
+*/
+QVariantMap RuleEngine::ruleStatistics(const RuleId &ruleId) const
+{
+    int index = m_ruleIndexes.value(ruleId, -1);
+    if (index < 0)
+        return QVariantMap();
+
+    return packRuleCost(index);
+}
+
+/*! Adds \a count dispatched actions to the statistics of the rule with the given \a ruleId. */
+void RuleEngine::countActionDispatches(const RuleId &ruleId, int count)
+{
+    int index = m_ruleIndexes.value(ruleId, -1);
+    if (index < 0)
+        return;
+
+    m_ruleCosts[index].actionDispatches += count;
+}
+
 void RuleEngine::removeThingFromRule(const RuleId &id, const ThingId &thingId)
 {
-    if (!m_rules.contains(id))
+    int index = m_ruleIndexes.value(id, -1);
+    if (index < 0)
         return;
 
-    Rule rule = m_rules.value(id);
+    Rule rule = m_rules.at(index);
 
     // remove thing from eventDescriptors
     QList<EventDescriptor> eventDescriptors = rule.eventDescriptors();
@@ -779,16 +893,15 @@ void RuleEngine::removeThingFromRule(const RuleId &id, const ThingId &thingId)
         exitActions.takeAt(removeIndexes.takeLast());
     }
 
-    // remove the rule from settings
-    NymeaSettings settings(NymeaSettings::SettingsRoleRules);
-    settings.beginGroup(id.toString());
-    settings.remove("");
-    settings.endGroup();
+    saveRules();
 
     if (actions.isEmpty() && exitActions.isEmpty()) {
         // The rule doesn't have any actions any more and is useless at this point... let's remove it altogether
         qCDebug(dcRuleEngine()) << "Rule" << rule.name() << "(" + rule.id().toString() + ")" << "does not have any actions any more. Removing it.";
-        m_rules.take(id);
+        removeRuleAt(index);
+        unscheduleTimeRule(id);
+        m_triggerFilters->clear(id);
+        m_stateThresholds->removeRule(id);
         emit ruleRemoved(id);
         return;
     }
@@ -801,97 +914,162 @@ void RuleEngine::removeThingFromRule(const RuleId &id, const ThingId &thingId)
     newRule.setTimeDescriptor(rule.timeDescriptor());
     newRule.setActions(actions);
     newRule.setExitActions(exitActions);
-    m_rules[id] = newRule;
+    m_rules[index] = newRule;
+
+    // The time state and the filters of the new rule need to be evaluated again
+    unscheduleTimeRule(id);
+    m_triggerFilters->clear(id);
+    m_stateThresholds->addRule(id, newRule.stateEvaluator());
+    if (!newRule.timeDescriptor().isEmpty()) {
+        m_pendingTimeRules.append(id);
+    }
 
     // save it
-    saveRule(newRule);
+    saveRules();
     emit ruleConfigurationChanged(newRule);
 }
 
 bool RuleEngine::containsEvent(const Rule &rule, const Event &event, const ThingClassId &thingClassId)
 {
-    foreach (const EventDescriptor &eventDescriptor, rule.eventDescriptors()) {
-        // If this is a thing based rule, eventTypeId and thingId must match
-        if (eventDescriptor.type() == EventDescriptor::TypeThing) {
-            if (eventDescriptor.eventTypeId() != event.eventTypeId() ||  eventDescriptor.thingId() != event.thingId()) {
-                continue;
-            }
+    bool triggered = false;
+    EventDescriptors eventDescriptors = rule.eventDescriptors();
+    for (int i = 0; i < eventDescriptors.count(); i++) {
+        const EventDescriptor &eventDescriptor = eventDescriptors.at(i);
+        if (!describesEvent(eventDescriptor, event, thingClassId)) {
+            continue;
         }
 
-        // If this is a interface based rule, the thing must implement the interface
-        if (eventDescriptor.type() == EventDescriptor::TypeInterface) {
-            ThingClass dc = NymeaCore::instance()->thingManager()->findThingClass(thingClassId);
-            if (!dc.interfaces().contains(eventDescriptor.interface())) {
-                // ThingClass for this event doesn't implement the interface for this eventDescriptor
-                continue;
+        // Ok, either thing/eventTypeId or interface/interfaceEvent are matching. Compare the paramdescriptor
+        TriggerFilter filter = eventDescriptor.filter();
+        if (!filter.isValid()) {
+            if (matchesParamDescriptors(eventDescriptor.paramDescriptors(), event, thingClassId)) {
+                triggered = true;
             }
+            continue;
+        }
 
-            EventType et = dc.eventTypes().findById(event.eventTypeId());
-            if (et.name() != eventDescriptor.interfaceEvent()) {
-                // The fired event name does not match with the eventDescriptor's interfaceEvent
-                continue;
+        // A value leaving the range again within the debounce time cancels the delayed trigger
+        bool matching = matchesParamDescriptors(eventDescriptor.paramDescriptors(), event, thingClassId);
+        if (!matching && m_triggerFilters->cancelEvent(rule.id(), i, event)) {
+            qCDebug(dcRuleEngineDebug()) << "Rule" << rule.name() << "event descriptor" << i << "no longer matching, delayed trigger cancelled.";
+            if (filter.hysteresis() > 0) {
+                m_triggerFilters->setEventArmed(rule.id(), i, true);
             }
+            continue;
         }
 
-        // Ok, either thing/eventTypeId or interface/interfaceEvent are matching. Compare the paramdescriptor
-        bool allOK = true;
-        foreach (const ParamDescriptor &paramDescriptor, eventDescriptor.paramDescriptors()) {
-            QVariant paramValue;
-            if (!paramDescriptor.paramTypeId().isNull()) {
-                paramValue = event.param(paramDescriptor.paramTypeId()).value();
-            } else {
-                if (paramDescriptor.paramName().isEmpty()) {
-                    qWarning(dcRuleEngine()) << "ParamDescriptor invalid. Either paramTypeId or paramName are required";
-                    allOK = false;
-                    continue;
-                }
-                ThingClass dc = NymeaCore::instance()->thingManager()->findThingClass(thingClassId);
-                EventType et = dc.eventTypes().findById(event.eventTypeId());
-                ParamType pt = et.paramTypes().findByName(paramDescriptor.paramName());
-                paramValue = event.param(pt.id()).value();
+        if (filter.hysteresis() > 0 && !m_triggerFilters->eventArmed(rule.id(), i)) {
+            // Triggered before, wait for the value to fall back beyond the hysteresis
+            QList<ParamDescriptor> relaxedParamDescriptors;
+            foreach (ParamDescriptor paramDescriptor, eventDescriptor.paramDescriptors()) {
+                paramDescriptor.setValue(TriggerFilters::relaxedThreshold(paramDescriptor.value(), paramDescriptor.operatorType(), filter.hysteresis()));
+                relaxedParamDescriptors.append(paramDescriptor);
             }
-
-            switch (paramDescriptor.operatorType()) {
-            case Types::ValueOperatorEquals:
-                if (paramValue != paramDescriptor.value()) {
-                    allOK = false;
-                }
-                break;
-            case Types::ValueOperatorNotEquals:
-                if (paramValue == paramDescriptor.value()) {
-                    allOK = false;
-                }
-                break;
-            case Types::ValueOperatorGreater:
-                if (event.param(paramDescriptor.paramTypeId()).value() <= paramDescriptor.value()) {
-                    allOK = false;
-                }
-                break;
-            case Types::ValueOperatorGreaterOrEqual:
-                if (event.param(paramDescriptor.paramTypeId()).value() < paramDescriptor.value()) {
-                    allOK = false;
-                }
-                break;
-            case Types::ValueOperatorLess:
-                if (event.param(paramDescriptor.paramTypeId()).value() >= paramDescriptor.value()) {
-                    allOK = false;
-                }
-                break;
-            case Types::ValueOperatorLessOrEqual:
-                if (event.param(paramDescriptor.paramTypeId()).value() < paramDescriptor.value()) {
-                    allOK = false;
-                }
-                break;
+            if (!matchesParamDescriptors(relaxedParamDescriptors, event, thingClassId)) {
+                qCDebug(dcRuleEngineDebug()) << "Rule" << rule.name() << "event descriptor" << i << "armed again.";
+                m_triggerFilters->setEventArmed(rule.id(), i, true);
             }
+            continue;
         }
-        // All matching!
-        if (allOK) {
-            return true;
+
+        if (!matching) {
+            continue;
+        }
+
+        if (filter.hysteresis() > 0) {
+            m_triggerFilters->setEventArmed(rule.id(), i, false);
+        }
+        if (m_triggerFilters->filterEvent(rule.id(), i, filter, event)) {
+            triggered = true;
         }
     }
 
-    qCDebug(dcRuleEngineDebug()) << "Rule" << rule.name() << "does not match event descriptors";
-    return false;
+    if (!triggered) {
+        qCDebug(dcRuleEngineDebug()) << "Rule" << rule.name() << "does not match event descriptors";
+    }
+    return triggered;
+}
+
+bool RuleEngine::describesEvent(const EventDescriptor &eventDescriptor, const Event &event, const ThingClassId &thingClassId)
+{
+    // If this is a thing based rule, eventTypeId and thingId must match
+    if (eventDescriptor.type() == EventDescriptor::TypeThing) {
+        if (eventDescriptor.eventTypeId() != event.eventTypeId() ||  eventDescriptor.thingId() != event.thingId()) {
+            return false;
+        }
+    }
+
+    // If this is a interface based rule, the thing must implement the interface
+    if (eventDescriptor.type() == EventDescriptor::TypeInterface) {
+        ThingClass dc = NymeaCore::instance()->thingManager()->findThingClass(thingClassId);
+        if (!dc.interfaces().contains(eventDescriptor.interface())) {
+            // ThingClass for this event doesn't implement the interface for this eventDescriptor
+            return false;
+        }
+
+        EventType et = dc.eventTypes().findById(event.eventTypeId());
+        if (et.name() != eventDescriptor.interfaceEvent()) {
+            // The fired event name does not match with the eventDescriptor's interfaceEvent
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool RuleEngine::matchesParamDescriptors(const QList<ParamDescriptor> &paramDescriptors, const Event &event, const ThingClassId &thingClassId)
+{
+    bool allOK = true;
+    foreach (const ParamDescriptor &paramDescriptor, paramDescriptors) {
+        QVariant paramValue;
+        if (!paramDescriptor.paramTypeId().isNull()) {
+            paramValue = event.param(paramDescriptor.paramTypeId()).value();
+        } else {
+            if (paramDescriptor.paramName().isEmpty()) {
+                qWarning(dcRuleEngine()) << "ParamDescriptor invalid. Either paramTypeId or paramName are required";
+                allOK = false;
+                continue;
+            }
+            ThingClass dc = NymeaCore::instance()->thingManager()->findThingClass(thingClassId);
+            EventType et = dc.eventTypes().findById(event.eventTypeId());
+            ParamType pt = et.paramTypes().findByName(paramDescriptor.paramName());
+            paramValue = event.param(pt.id()).value();
+        }
+
+        switch (paramDescriptor.operatorType()) {
+        case Types::ValueOperatorEquals:
+            if (paramValue != paramDescriptor.value()) {
+                allOK = false;
+            }
+            break;
+        case Types::ValueOperatorNotEquals:
+            if (paramValue == paramDescriptor.value()) {
+                allOK = false;
+            }
+            break;
+        case Types::ValueOperatorGreater:
+            if (event.param(paramDescriptor.paramTypeId()).value() <= paramDescriptor.value()) {
+                allOK = false;
+            }
+            break;
+        case Types::ValueOperatorGreaterOrEqual:
+            if (event.param(paramDescriptor.paramTypeId()).value() < paramDescriptor.value()) {
+                allOK = false;
+            }
+            break;
+        case Types::ValueOperatorLess:
+            if (event.param(paramDescriptor.paramTypeId()).value() >= paramDescriptor.value()) {
+                allOK = false;
+            }
+            break;
+        case Types::ValueOperatorLessOrEqual:
+            if (event.param(paramDescriptor.paramTypeId()).value() < paramDescriptor.value()) {
+                allOK = false;
+            }
+            break;
+        }
+    }
+    return allOK;
 }
 
 bool RuleEngine::containsState(const StateEvaluator &stateEvaluator, const Event &stateChangeEvent)
@@ -1098,170 +1276,193 @@ QVariant::Type RuleEngine::getEventParamType(const EventTypeId &eventTypeId, con
 
 void RuleEngine::appendRule(const Rule &rule)
 {
-    Rule newRule = rule;
-    newRule.setStatesActive(newRule.stateEvaluator().evaluate());
-    qCDebug(dcRuleEngine()) << "Adding Rule:" << newRule;
-    m_rules.insert(rule.id(), newRule);
-    m_ruleIds.append(rule.id());
+    qCDebug(dcRuleEngine()) << "Adding Rule:" << rule;
+    m_stateThresholds->addRule(rule.id(), rule.stateEvaluator());
+
+    int index = m_rules.count();
+    m_ruleIndexes.insert(rule.id(), index);
+    m_rules.append(rule);
+    m_ruleStates.append(0);
+    m_ruleCosts.append(RuleCost());
+    setRuleState(index, RuleStateTimeActive, rule.m_timeActive);
+    setRuleState(index, RuleStateActive, rule.active());
+    setRuleState(index, RuleStateStatesActive, rule.stateEvaluator().evaluate(m_triggerFilters, rule.id(), m_stateThresholds.data()));
+
+    // Time based rules get evaluated on the next time change and scheduled from there on
+    if (rule.enabled() && !rule.timeDescriptor().isEmpty()) {
+        m_pendingTimeRules.append(rule.id());
+    }
 }
 
-void RuleEngine::saveRule(const Rule &rule)
+void RuleEngine::removeRuleAt(int index)
 {
-    NymeaSettings settings(NymeaSettings::SettingsRoleRules);
-    settings.beginGroup(rule.id().toString());
-    settings.setValue("name", rule.name());
-    settings.setValue("enabled", rule.enabled());
-    settings.setValue("executable", rule.executable());
-
-    // Save timeDescriptor
-    settings.beginGroup("timeDescriptor");
-    if (!rule.timeDescriptor().isEmpty()) {
-        settings.beginGroup("calendarItems");
-        for (int i = 0; i < rule.timeDescriptor().calendarItems().count(); i++) {
-            settings.beginGroup("CalendarItem-" + QString::number(i));
-
-            const CalendarItem &calendarItem = rule.timeDescriptor().calendarItems().at(i);
-            if (calendarItem.dateTime().isValid())
-                settings.setValue("dateTime", calendarItem.dateTime().toTime_t());
+    m_ruleIndexes.remove(m_rules.at(index).id());
+    m_rules.remove(index);
+    m_ruleStates.remove(index);
+    m_ruleCosts.remove(index);
+    for (int i = index; i < m_rules.count(); i++) {
+        m_ruleIndexes[m_rules.at(i).id()] = i;
+    }
+}
 
-            if (calendarItem.startTime().isValid())
-                settings.setValue("startTime", calendarItem.startTime().toString("hh:mm"));
+bool RuleEngine::ruleState(int index, RuleStateFlag flag) const
+{
+    return m_ruleStates.at(index) & flag;
+}
 
-            settings.setValue("duration", calendarItem.duration());
-            settings.setValue("mode", calendarItem.repeatingOption().mode());
+void RuleEngine::setRuleState(int index, RuleStateFlag flag, bool on)
+{
+    if (on) {
+        m_ruleStates[index] |= flag;
+    } else {
+        m_ruleStates[index] &= ~flag;
+    }
+}
 
-            // Save weekDays
-            settings.beginWriteArray("weekDays");
-            for (int i = 0; i < calendarItem.repeatingOption().weekDays().count(); ++i) {
-                settings.setArrayIndex(i);
-                settings.setValue("weekDay", calendarItem.repeatingOption().weekDays().at(i));
-            }
-            settings.endArray();
+bool RuleEngine::ruleTimeActive(int index) const
+{
+    // Rules without calendar items are always active in time, see Rule::timeActive()
+    if (m_rules.at(index).timeDescriptor().calendarItems().isEmpty())
+        return true;
 
-            // Save monthDays
-            settings.beginWriteArray("monthDays");
-            for (int i = 0; i < calendarItem.repeatingOption().monthDays().count(); ++i) {
-                settings.setArrayIndex(i);
-                settings.setValue("monthDay", calendarItem.repeatingOption().monthDays().at(i));
-            }
-            settings.endArray();
+    return ruleState(index, RuleStateTimeActive);
+}
 
-            settings.endGroup();
-        }
-        settings.endGroup();
+/* Updates the active state of the state based rule at the given index from its time and states state.
+   Returns true if the rule became active or inactive. */
+bool RuleEngine::updateRuleActive(int index)
+{
+    bool active = ruleTimeActive(index) && ruleState(index, RuleStateStatesActive);
+    if (active == ruleState(index, RuleStateActive))
+        return false;
+
+    const Rule &rule = m_rules.at(index);
+    qCDebug(dcRuleEngine).nospace().noquote() << "Rule " << rule.name() << " (" << rule.id().toString() << ") " << (active ? "active." : "inactive.");
+    setRuleState(index, RuleStateActive, active);
+    return true;
+}
 
-        settings.beginGroup("timeEventItems");
-        for (int i = 0; i < rule.timeDescriptor().timeEventItems().count(); i++) {
-            settings.beginGroup("TimeEventItem-" + QString::number(i));
-            const TimeEventItem &timeEventItem = rule.timeDescriptor().timeEventItems().at(i);
+QVariantMap RuleEngine::packRuleCost(int index) const
+{
+    const RuleCost &cost = m_ruleCosts.at(index);
+    QVariantMap statistics;
+    statistics.insert("ruleId", m_rules.at(index).id().toString());
+    statistics.insert("name", m_rules.at(index).name());
+    statistics.insert("evaluations", cost.evaluations);
+    statistics.insert("matches", cost.matches);
+    statistics.insert("stateEvaluations", cost.stateEvaluations);
+    statistics.insert("eventMatchingTime", cost.eventMatchingTime / 1000);
+    statistics.insert("stateEvaluationTime", cost.stateEvaluationTime / 1000);
+    statistics.insert("actionDispatches", cost.actionDispatches);
+    return statistics;
+}
 
-            if (timeEventItem.dateTime().isValid())
-                settings.setValue("dateTime", timeEventItem.dateTime().toTime_t());
+/* Returns a copy of the rule at the given index carrying its current runtime state. */
+Rule RuleEngine::ruleWithState(int index) const
+{
+    Rule rule = m_rules.at(index);
+    rule.setStatesActive(ruleState(index, RuleStateStatesActive));
+    rule.setTimeActive(ruleState(index, RuleStateTimeActive));
+    rule.setActive(ruleState(index, RuleStateActive));
+    return rule;
+}
 
-            if (timeEventItem.time().isValid())
-                settings.setValue("time", timeEventItem.time().toString("hh:mm"));
+void RuleEngine::onThingStateChanged(Thing *thing, const StateTypeId &stateTypeId, const QVariant &value)
+{
+    m_stateThresholds->updateState(thing->id(), stateTypeId, value);
+}
 
-            settings.setValue("mode", timeEventItem.repeatingOption().mode());
+void RuleEngine::evaluateTriggerFilters(const QList<RuleId> &ruleIds)
+{
+    // Collect everything first, executing the triggered rules may change the rules in the engine
+    QList<QPair<Rule, Event> > triggered;
+    foreach (const RuleId &ruleId, ruleIds) {
+        int index = m_ruleIndexes.value(ruleId, -1);
+        if (index < 0) {
+            continue;
+        }
+        const Rule &rule = m_rules.at(index);
+        if (!rule.enabled()) {
+            continue;
+        }
 
-            // Save weekDays
-            settings.beginWriteArray("weekDays");
-            for (int i = 0; i < timeEventItem.repeatingOption().weekDays().count(); ++i) {
-                settings.setArrayIndex(i);
-                settings.setValue("weekDay", timeEventItem.repeatingOption().weekDays().at(i));
-            }
-            settings.endArray();
+        RuleCost &cost = m_ruleCosts[index];
+        bool timed = cost.evaluations++ % costSamplingInterval == 0;
+        if (!rule.stateEvaluator().isEmpty()) {
+            QElapsedTimer timer;
+            if (timed)
+                timer.start();
+            setRuleState(index, RuleStateStatesActive, rule.stateEvaluator().evaluate(m_triggerFilters, rule.id(), m_stateThresholds.data()));
+            if (timed)
+                cost.stateEvaluationTime += timer.nsecsElapsed() * costSamplingInterval;
+            cost.stateEvaluations++;
+        }
 
-            // Save monthDays
-            settings.beginWriteArray("monthDays");
-            for (int i = 0; i < timeEventItem.repeatingOption().monthDays().count(); ++i) {
-                settings.setArrayIndex(i);
-                settings.setValue("monthDay", timeEventItem.repeatingOption().monthDays().at(i));
+        // State based rules may change their active state once a delayed state change took effect
+        if (rule.eventDescriptors().isEmpty() && rule.timeDescriptor().timeEventItems().isEmpty() && !rule.stateEvaluator().isEmpty()) {
+            if (updateRuleActive(index)) {
+                cost.matches++;
+                triggered.append(qMakePair(ruleWithState(index), Event()));
             }
-            settings.endArray();
+            continue;
+        }
 
-            settings.endGroup();
+        foreach (const Event &event, m_triggerFilters->takeDueEvents(rule.id())) {
+            qCDebug(dcRuleEngine).nospace().noquote() << "Rule " << rule.name() << " (" << rule.id().toString() << ") triggered by debounced event.";
+            cost.matches++;
+            triggered.append(qMakePair(ruleWithState(index), event));
         }
-        settings.endGroup();
     }
-    settings.endGroup();
-
-    // Save Events / EventDescriptors
-    settings.beginGroup("events");
-    for (int i = 0; i < rule.eventDescriptors().count(); i++) {
-        const EventDescriptor &eventDescriptor = rule.eventDescriptors().at(i);
-        settings.beginGroup("EventDescriptor-" + QString::number(i));
-        settings.setValue("thingId", eventDescriptor.thingId().toString());
-        settings.setValue("eventTypeId", eventDescriptor.eventTypeId().toString());
-        settings.setValue("interface", eventDescriptor.interface());
-        settings.setValue("interfaceEvent", eventDescriptor.interfaceEvent());
-
-        foreach (const ParamDescriptor &paramDescriptor, eventDescriptor.paramDescriptors()) {
-            if (!paramDescriptor.paramTypeId().isNull()) {
-                settings.beginGroup("ParamDescriptor-" + paramDescriptor.paramTypeId().toString());
-            } else {
-                settings.beginGroup("ParamDescriptor-" + paramDescriptor.paramName());
-            }
-            settings.setValue("valueType", static_cast<int>(paramDescriptor.value().type()));
-            settings.setValue("value", paramDescriptor.value());
-            settings.setValue("operator", paramDescriptor.operatorType());
-            settings.endGroup();
-        }
-        settings.endGroup();
+
+    for (int i = 0; i < triggered.count(); i++) {
+        emit rulesTriggered(QList<Rule>() << triggered.at(i).first, triggered.at(i).second);
     }
-    settings.endGroup();
+}
 
-    // Save StateEvaluator
-    rule.stateEvaluator().dumpToSettings(settings, "stateEvaluator");
+void RuleEngine::scheduleTimeRule(const Rule &rule, const QDateTime &dateTime)
+{
+    unscheduleTimeRule(rule.id());
 
-    // Save ruleActions
-    settings.beginGroup("ruleActions");
-    saveRuleActions(&settings, rule.actions());
-    settings.endGroup();
+    QDateTime nextTransition = rule.timeDescriptor().nextTransition(dateTime);
+    if (!nextTransition.isValid()) {
+        qCDebug(dcRuleEngineDebug()) << "Rule" << rule.name() << rule.id().toString() << "will not change its time state any more.";
+        return;
+    }
 
-    // Save ruleExitActions
-    settings.beginGroup("ruleExitActions");
-    saveRuleActions(&settings, rule.exitActions());
-    settings.endGroup();
-    qCDebug(dcRuleEngineDebug()) << "Saved rule to config:" << rule;
+    m_timeSchedule.insert(nextTransition, rule.id());
+    m_scheduledTimeRules.insert(rule.id(), nextTransition);
 }
 
-void RuleEngine::saveRuleActions(NymeaSettings *settings, const QList<RuleAction> &ruleActions)
+void RuleEngine::unscheduleTimeRule(const RuleId &ruleId)
 {
-    int i = 0;
-    foreach (const RuleAction &action, ruleActions) {
-        settings->beginGroup(QString::number(i));
-        if (action.type() == RuleAction::TypeThing) {
-            settings->setValue("thingId", action.thingId().toString());
-            settings->setValue("actionTypeId", action.actionTypeId().toString());
-        } else if (action.type() == RuleAction::TypeBrowser) {
-            settings->setValue("thingId", action.thingId().toString());
-            settings->setValue("browserItemId", action.browserItemId());
-        } else if (action.type() == RuleAction::TypeInterface){
-            settings->setValue("interface", action.interface());
-            settings->setValue("interfaceAction", action.interfaceAction());
-        } else {
-            Q_ASSERT_X(false, "RuleEngine::saveRule", "Unhandled rule action type.");
-        }
-        foreach (const RuleActionParam &param, action.ruleActionParams()) {
-            if (!param.paramTypeId().isNull()) {
-                settings->beginGroup("RuleActionParam-" + param.paramTypeId().toString());
-            } else {
-                settings->beginGroup("RuleActionParam-" + param.paramName());
-            }
-            settings->setValue("valueType", static_cast<int>(param.value().type()));
-            settings->setValue("value", param.value());
-            if (param.isEventBased()) {
-                settings->setValue("eventTypeId", param.eventTypeId().toString());
-                settings->setValue("eventParamTypeId", param.eventParamTypeId());
-            } else if (param.isStateBased()) {
-                settings->setValue("stateThingId", param.stateThingId().toString());
-                settings->setValue("stateTypeId", param.stateTypeId());
-            }
-            settings->endGroup();
-        }
-        i++;
-        settings->endGroup();
+    m_pendingTimeRules.removeAll(ruleId);
+    if (m_scheduledTimeRules.contains(ruleId)) {
+        m_timeSchedule.remove(m_scheduledTimeRules.take(ruleId), ruleId);
+    }
+}
+
+void RuleEngine::saveRules()
+{
+    // Coalesce all changes happening in the same event loop pass into one write
+    if (m_snapshotDirty) {
+        return;
     }
+    m_snapshotDirty = true;
+    QMetaObject::invokeMethod(this, "writeSnapshot", Qt::QueuedConnection);
+}
+
+void RuleEngine::writeSnapshot()
+{
+    if (!m_snapshotDirty || m_snapshotBroken) {
+        return;
+    }
+    m_snapshotDirty = false;
+
+    QList<Rule> rules;
+    foreach (const Rule &rule, m_rules) {
+        rules.append(rule);
+    }
+    RuleSnapshot::save(RuleSnapshot::fileName(), rules);
 }
 
 QList<RuleAction> RuleEngine::loadRuleActions(NymeaSettings *settings)
@@ -1341,8 +1542,69 @@ QList<RuleAction> RuleEngine::loadRuleActions(NymeaSettings *settings)
 
 void RuleEngine::init()
 {
+    // The snapshot loader has been started in the constructor
+    bool loaded = m_snapshotLoader.result();
+    QList<Rule> rules = m_snapshotRules;
+    m_snapshotRules.clear();
+
+    QString snapshotFileName = RuleSnapshot::fileName();
+    QString rulesConfigFileName = NymeaSettings(NymeaSettings::SettingsRoleRules).fileName();
+    if (loaded) {
+        qCDebug(dcRuleEngine()) << "Loaded" << rules.count() << "rules from" << snapshotFileName;
+    } else if (QFile::exists(snapshotFileName)) {
+        // Keep the broken snapshot aside, saving rules must never replace it with an empty rule set
+        qCWarning(dcRuleEngine()) << "Unable to load the rules from" << snapshotFileName << "Moving it to" << snapshotFileName + ".corrupt";
+        QFile::remove(snapshotFileName + ".corrupt");
+        if (!QFile::rename(snapshotFileName, snapshotFileName + ".corrupt")) {
+            qCWarning(dcRuleEngine()) << "Unable to move the broken rule snapshot aside. Rules will not be saved.";
+            m_snapshotBroken = true;
+        }
+
+        // Recover the rules from the last imported rules.conf, if there is no newer one to import anyways
+        if (NymeaSettings(NymeaSettings::SettingsRoleRules).childGroups().isEmpty() && QFile::exists(rulesConfigFileName + ".imported")) {
+            qCWarning(dcRuleEngine()) << "Restoring the rules from" << rulesConfigFileName + ".imported";
+            QFile::remove(rulesConfigFileName);
+            QFile::copy(rulesConfigFileName + ".imported", rulesConfigFileName);
+        }
+    }
+
+    // rules.conf is only used to import rules from nymea versions before the snapshot was introduced,
+    // or rules restored from a backup. Imported rules replace snapshot rules with the same id.
+    if (!NymeaSettings(NymeaSettings::SettingsRoleRules).childGroups().isEmpty()) {
+        QList<Rule> importedRules = importRules();
+        foreach (const Rule &importedRule, importedRules) {
+            int index = -1;
+            for (int i = 0; i < rules.count(); i++) {
+                if (rules.at(i).id() == importedRule.id()) {
+                    index = i;
+                    break;
+                }
+            }
+            if (index >= 0) {
+                rules.replace(index, importedRule);
+            } else {
+                rules.append(importedRule);
+            }
+        }
+
+        if (!m_snapshotBroken && RuleSnapshot::save(snapshotFileName, rules)) {
+            // Keep the old file around as a backup, but don't import it again
+            QFile::remove(rulesConfigFileName + ".imported");
+            QFile::rename(rulesConfigFileName, rulesConfigFileName + ".imported");
+            qCInfo(dcRuleEngine()) << "Imported" << importedRules.count() << "rules from" << rulesConfigFileName;
+        }
+    }
+
+    foreach (const Rule &rule, rules) {
+        appendRule(rule);
+    }
+}
+
+QList<Rule> RuleEngine::importRules()
+{
+    QList<Rule> rules;
     NymeaSettings settings(NymeaSettings::SettingsRoleRules);
-    qCDebug(dcRuleEngine) << "Loading rules from" << settings.fileName();
+    qCDebug(dcRuleEngine) << "Importing rules from" << settings.fileName();
     foreach (const QString &idString, settings.childGroups()) {
         settings.beginGroup(idString);
 
@@ -1524,11 +1786,10 @@ void RuleEngine::init()
         rule.setExitActions(exitActions);
         rule.setEnabled(enabled);
         rule.setExecutable(executable);
-        rule.setStatesActive(rule.stateEvaluator().evaluate());
-        appendRule(rule);
+        rules.append(rule);
         settings.endGroup();
     }
-
+    return rules;
 }
 
 }
@@ -38,11 +38,20 @@
 
 #include <QObject>
 #include <QList>
+#include <QVector>
 #include <QUuid>
+#include <QMultiMap>
 #include <QSettings>
+#include <QFuture>
+#include <QScopedPointer>
+
+class Thing;
 
 namespace nymeaserver {
 
+class TriggerFilters;
+class StateThresholdIndex;
+
 class RuleEngine : public QObject
 {
     Q_OBJECT
@@ -105,13 +114,25 @@ public:
 
     void removeThingFromRule(const RuleId &id, const ThingId &thingId);
 
+    QVariantList ruleStatistics() const;
+    QVariantMap ruleStatistics(const RuleId &ruleId) const;
+    void countActionDispatches(const RuleId &ruleId, int count);
+
 signals:
     void ruleAdded(const Rule &rule);
     void ruleRemoved(const RuleId &ruleId);
     void ruleConfigurationChanged(const Rule &rule);
+    void rulesTriggered(const QList<Rule> &rules, const Event &event);
+
+private slots:
+    void writeSnapshot();
+    void evaluateTriggerFilters(const QList<RuleId> &ruleIds);
+    void onThingStateChanged(Thing *thing, const StateTypeId &stateTypeId, const QVariant &value);
 
 private:
     bool containsEvent(const Rule &rule, const Event &event, const ThingClassId &thingClassId);
+    bool describesEvent(const EventDescriptor &eventDescriptor, const Event &event, const ThingClassId &thingClassId);
+    bool matchesParamDescriptors(const QList<ParamDescriptor> &paramDescriptors, const Event &event, const ThingClassId &thingClassId);
     bool containsState(const StateEvaluator &stateEvaluator, const Event &stateChangeEvent);
 
     RuleError checkRuleAction(const RuleAction &ruleAction, const Rule &rule);
@@ -121,16 +142,53 @@ private:
     QVariant::Type getEventParamType(const EventTypeId &eventTypeId, const ParamTypeId &paramTypeId);
 
     void appendRule(const Rule &rule);
-    void saveRule(const Rule &rule);
-    void saveRuleActions(NymeaSettings *settings, const QList<RuleAction> &ruleActions);
+    void removeRuleAt(int index);
+    void saveRules();
+
+    enum RuleStateFlag {
+        RuleStateStatesActive = 0x01,
+        RuleStateTimeActive = 0x02,
+        RuleStateActive = 0x04
+    };
+    bool ruleState(int index, RuleStateFlag flag) const;
+    void setRuleState(int index, RuleStateFlag flag, bool on);
+    bool ruleTimeActive(int index) const;
+    bool updateRuleActive(int index);
+    Rule ruleWithState(int index) const;
+
+    struct RuleCost {
+        quint64 evaluations = 0;
+        quint64 matches = 0;
+        quint64 stateEvaluations = 0;
+        qint64 eventMatchingTime = 0; // ns spent in containsEvent(), estimated from sampled calls
+        qint64 stateEvaluationTime = 0; // ns spent in StateEvaluator::evaluate(), estimated from sampled calls
+        quint64 actionDispatches = 0;
+    };
+    QVariantMap packRuleCost(int index) const;
+
+    void scheduleTimeRule(const Rule &rule, const QDateTime &dateTime);
+    void unscheduleTimeRule(const RuleId &ruleId);
+    QList<Rule> importRules();
     QList<RuleAction> loadRuleActions(NymeaSettings *settings);
 
 private:
-    QList<RuleId> m_ruleIds; // Keeping a list of RuleIds to keep sorting order...
-    QHash<RuleId, Rule> m_rules; // ...but use a Hash for faster finding
-    QList<RuleId> m_activeRules;
+    QVector<Rule> m_rules; // Rule configurations in their sorting order...
+    QVector<quint8> m_ruleStates; // ...their runtime state (RuleStateFlags) at the same index...
+    QHash<RuleId, int> m_ruleIndexes; // ...and the index of each rule for faster finding
+    QVector<RuleCost> m_ruleCosts; // Evaluation cost counters, also at the same index
 
     QDateTime m_lastEvaluationTime;
+    QMultiMap<QDateTime, RuleId> m_timeSchedule; // next transition | time based rule
+    QHash<RuleId, QDateTime> m_scheduledTimeRules; // time based rule | next transition
+    QList<RuleId> m_pendingTimeRules; // time based rules to be evaluated on the next time change
+
+    TriggerFilters *m_triggerFilters = nullptr;
+    QScopedPointer<StateThresholdIndex> m_stateThresholds;
+
+    QFuture<bool> m_snapshotLoader;
+    QList<Rule> m_snapshotRules;
+    bool m_snapshotDirty = false;
+    bool m_snapshotBroken = false;
 };
 
 }
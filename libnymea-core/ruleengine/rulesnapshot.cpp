@@ -0,0 +1,403 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* Copyright 2013 - 2020, nymea GmbH
+* Contact: contact@nymea.io
+*
+* This file is part of nymea.
+* This project including source code and documentation is protected by
+* copyright law, and remains the property of nymea GmbH. All rights, including
+* reproduction, publication, editing and translation, are reserved. The use of
+* this project is subject to the terms of a license agreement to be concluded
+* with nymea GmbH in accordance with the terms of use of nymea GmbH, available
+* under https://nymea.io/license
+*
+* GNU General Public License Usage
+* Alternatively, this project may be redistributed and/or modified under the
+* terms of the GNU General Public License as published by the Free Software
+* Foundation, GNU version 3. This project is distributed in the hope that it
+* will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+* of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+* Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with
+* this project. If not, see <https://www.gnu.org/licenses/>.
+*
+* For any further details and any questions please contact us under
+* contact@nymea.io or see our FAQ/Licensing Information on
+* https://nymea.io/license/faq
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+/*!
+    \class nymeaserver::RuleSnapshot
+    \brief Stores all rules in a single binary file.
+
+    \ingroup rules
+    \inmodule core
+
+    The rule snapshot is the storage format of the \l{RuleEngine}. In contrast to the nested groups of the
+    rules.conf file, which need a QSettings lookup for every node of a rule, the snapshot is a flat
+    QDataStream which is written and read in one pass. It does not depend on any other component of
+    nymea, so it is safe to load it in a worker thread.
+
+    The file starts with a magic number and a format version. Snapshots with an unknown version are
+    rejected, in which case the rules need to be imported again from rules.conf. Version 2 added the
+    \l{TriggerFilter} of event and state descriptors, version 1 snapshots are still loaded.
+*/
+
+#include "rulesnapshot.h"
+#include "nymeasettings.h"
+#include "loggingcategories.h"
+
+#include <QFile>
+#include <QSaveFile>
+#include <QDataStream>
+#include <QDebug>
+
+namespace nymeaserver {
+
+static const quint32 snapshotMagic = 0x6e52554c; // "nRUL"
+static const quint32 snapshotVersion = 2;
+
+static void writeRepeatingOption(QDataStream &stream, const RepeatingOption &repeatingOption)
+{
+    stream << static_cast<qint32>(repeatingOption.mode()) << repeatingOption.weekDays() << repeatingOption.monthDays();
+}
+
+static RepeatingOption readRepeatingOption(QDataStream &stream)
+{
+    qint32 mode;
+    QList<int> weekDays;
+    QList<int> monthDays;
+    stream >> mode >> weekDays >> monthDays;
+    return RepeatingOption(static_cast<RepeatingOption::RepeatingMode>(mode), weekDays, monthDays);
+}
+
+static void writeTimeDescriptor(QDataStream &stream, const TimeDescriptor &timeDescriptor)
+{
+    stream << static_cast<quint32>(timeDescriptor.calendarItems().count());
+    foreach (const CalendarItem &calendarItem, timeDescriptor.calendarItems()) {
+        stream << calendarItem.dateTime() << calendarItem.startTime() << static_cast<quint32>(calendarItem.duration());
+        writeRepeatingOption(stream, calendarItem.repeatingOption());
+    }
+
+    stream << static_cast<quint32>(timeDescriptor.timeEventItems().count());
+    foreach (const TimeEventItem &timeEventItem, timeDescriptor.timeEventItems()) {
+        stream << timeEventItem.dateTime() << timeEventItem.time();
+        writeRepeatingOption(stream, timeEventItem.repeatingOption());
+    }
+}
+
+static TimeDescriptor readTimeDescriptor(QDataStream &stream)
+{
+    quint32 count;
+
+    CalendarItems calendarItems;
+    stream >> count;
+    for (quint32 i = 0; i < count && stream.status() == QDataStream::Ok; i++) {
+        QDateTime dateTime;
+        QTime startTime;
+        quint32 duration;
+        stream >> dateTime >> startTime >> duration;
+
+        CalendarItem calendarItem;
+        calendarItem.setDateTime(dateTime);
+        calendarItem.setStartTime(startTime);
+        calendarItem.setDuration(duration);
+        calendarItem.setRepeatingOption(readRepeatingOption(stream));
+        calendarItems.append(calendarItem);
+    }
+
+    TimeEventItems timeEventItems;
+    stream >> count;
+    for (quint32 i = 0; i < count && stream.status() == QDataStream::Ok; i++) {
+        QDateTime dateTime;
+        QTime time;
+        stream >> dateTime >> time;
+
+        TimeEventItem timeEventItem;
+        timeEventItem.setDateTime(dateTime);
+        timeEventItem.setTime(time);
+        timeEventItem.setRepeatingOption(readRepeatingOption(stream));
+        timeEventItems.append(timeEventItem);
+    }
+
+    TimeDescriptor timeDescriptor;
+    timeDescriptor.setCalendarItems(calendarItems);
+    timeDescriptor.setTimeEventItems(timeEventItems);
+    return timeDescriptor;
+}
+
+static void writeTriggerFilter(QDataStream &stream, const TriggerFilter &filter)
+{
+    stream << static_cast<quint32>(filter.debounce()) << static_cast<quint32>(filter.throttle()) << filter.hysteresis();
+}
+
+static TriggerFilter readTriggerFilter(QDataStream &stream, quint32 version)
+{
+    if (version < 2) {
+        return TriggerFilter();
+    }
+    quint32 debounce, throttle;
+    double hysteresis;
+    stream >> debounce >> throttle >> hysteresis;
+    return TriggerFilter(debounce, throttle, hysteresis);
+}
+
+static void writeEventDescriptors(QDataStream &stream, const EventDescriptors &eventDescriptors)
+{
+    stream << static_cast<quint32>(eventDescriptors.count());
+    foreach (const EventDescriptor &eventDescriptor, eventDescriptors) {
+        stream << QUuid(eventDescriptor.eventTypeId()) << QUuid(eventDescriptor.thingId());
+        stream << eventDescriptor.interface() << eventDescriptor.interfaceEvent();
+        stream << static_cast<quint32>(eventDescriptor.paramDescriptors().count());
+        foreach (const ParamDescriptor &paramDescriptor, eventDescriptor.paramDescriptors()) {
+            stream << QUuid(paramDescriptor.paramTypeId()) << paramDescriptor.paramName();
+            stream << paramDescriptor.value() << static_cast<qint32>(paramDescriptor.operatorType());
+        }
+        writeTriggerFilter(stream, eventDescriptor.filter());
+    }
+}
+
+static EventDescriptors readEventDescriptors(QDataStream &stream, quint32 version)
+{
+    EventDescriptors eventDescriptors;
+    quint32 count;
+    stream >> count;
+    for (quint32 i = 0; i < count && stream.status() == QDataStream::Ok; i++) {
+        QUuid eventTypeId, thingId;
+        QString interface, interfaceEvent;
+        stream >> eventTypeId >> thingId >> interface >> interfaceEvent;
+
+        QList<ParamDescriptor> paramDescriptors;
+        quint32 paramCount;
+        stream >> paramCount;
+        for (quint32 j = 0; j < paramCount && stream.status() == QDataStream::Ok; j++) {
+            QUuid paramTypeId;
+            QString paramName;
+            QVariant value;
+            qint32 operatorType;
+            stream >> paramTypeId >> paramName >> value >> operatorType;
+
+            ParamDescriptor paramDescriptor = !paramTypeId.isNull() ? ParamDescriptor(ParamTypeId(paramTypeId), value) : ParamDescriptor(paramName, value);
+            paramDescriptor.setOperatorType(static_cast<Types::ValueOperator>(operatorType));
+            paramDescriptors.append(paramDescriptor);
+        }
+
+        EventDescriptor eventDescriptor = !eventTypeId.isNull() ? EventDescriptor(EventTypeId(eventTypeId), ThingId(thingId), paramDescriptors) : EventDescriptor(interface, interfaceEvent, paramDescriptors);
+        eventDescriptor.setFilter(readTriggerFilter(stream, version));
+        eventDescriptors.append(eventDescriptor);
+    }
+    return eventDescriptors;
+}
+
+static void writeStateEvaluator(QDataStream &stream, const StateEvaluator &stateEvaluator)
+{
+    const StateDescriptor &stateDescriptor = stateEvaluator.stateDescriptor();
+    stream << QUuid(stateDescriptor.stateTypeId()) << QUuid(stateDescriptor.thingId());
+    stream << stateDescriptor.interface() << stateDescriptor.interfaceState();
+    stream << stateDescriptor.stateValue() << static_cast<qint32>(stateDescriptor.operatorType());
+    writeTriggerFilter(stream, stateDescriptor.filter());
+    stream << static_cast<qint32>(stateEvaluator.operatorType());
+
+    stream << static_cast<quint32>(stateEvaluator.childEvaluators().count());
+    foreach (const StateEvaluator &childEvaluator, stateEvaluator.childEvaluators()) {
+        writeStateEvaluator(stream, childEvaluator);
+    }
+}
+
+static StateEvaluator readStateEvaluator(QDataStream &stream, quint32 version, int depth = 0)
+{
+    QUuid stateTypeId, thingId;
+    QString interface, interfaceState;
+    QVariant stateValue;
+    qint32 valueOperator, stateOperator;
+    quint32 childCount;
+    stream >> stateTypeId >> thingId >> interface >> interfaceState >> stateValue >> valueOperator;
+    TriggerFilter filter = readTriggerFilter(stream, version);
+    stream >> stateOperator >> childCount;
+
+    StateDescriptor stateDescriptor;
+    if (!thingId.isNull() && !stateTypeId.isNull()) {
+        stateDescriptor = StateDescriptor(StateTypeId(stateTypeId), ThingId(thingId), stateValue, static_cast<Types::ValueOperator>(valueOperator));
+    } else {
+        stateDescriptor = StateDescriptor(interface, interfaceState, stateValue, static_cast<Types::ValueOperator>(valueOperator));
+    }
+    stateDescriptor.setFilter(filter);
+
+    StateEvaluator stateEvaluator(stateDescriptor);
+    stateEvaluator.setOperatorType(static_cast<Types::StateOperator>(stateOperator));
+
+    // Guard against corrupt files sending us into an endless recursion
+    if (depth > 64) {
+        stream.setStatus(QDataStream::ReadCorruptData);
+        return stateEvaluator;
+    }
+
+    for (quint32 i = 0; i < childCount && stream.status() == QDataStream::Ok; i++) {
+        stateEvaluator.appendEvaluator(readStateEvaluator(stream, version, depth + 1));
+    }
+    return stateEvaluator;
+}
+
+static void writeRuleActions(QDataStream &stream, const RuleActions &ruleActions)
+{
+    stream << static_cast<quint32>(ruleActions.count());
+    foreach (const RuleAction &ruleAction, ruleActions) {
+        stream << QUuid(ruleAction.thingId()) << QUuid(ruleAction.actionTypeId()) << ruleAction.browserItemId();
+        stream << ruleAction.interface() << ruleAction.interfaceAction();
+        stream << static_cast<quint32>(ruleAction.ruleActionParams().count());
+        foreach (const RuleActionParam &param, ruleAction.ruleActionParams()) {
+            stream << QUuid(param.paramTypeId()) << param.paramName() << param.value();
+            stream << QUuid(param.eventTypeId()) << QUuid(param.eventParamTypeId());
+            stream << QUuid(param.stateThingId()) << QUuid(param.stateTypeId());
+        }
+    }
+}
+
+static RuleActions readRuleActions(QDataStream &stream)
+{
+    RuleActions ruleActions;
+    quint32 count;
+    stream >> count;
+    for (quint32 i = 0; i < count && stream.status() == QDataStream::Ok; i++) {
+        QUuid thingId, actionTypeId;
+        QString browserItemId, interface, interfaceAction;
+        stream >> thingId >> actionTypeId >> browserItemId >> interface >> interfaceAction;
+
+        RuleActionParams params;
+        quint32 paramCount;
+        stream >> paramCount;
+        for (quint32 j = 0; j < paramCount && stream.status() == QDataStream::Ok; j++) {
+            QUuid paramTypeId, eventTypeId, eventParamTypeId, stateThingId, stateTypeId;
+            QString paramName;
+            QVariant value;
+            stream >> paramTypeId >> paramName >> value >> eventTypeId >> eventParamTypeId >> stateThingId >> stateTypeId;
+
+            RuleActionParam param = !paramTypeId.isNull() ? RuleActionParam(ParamTypeId(paramTypeId), value) : RuleActionParam(paramName, value);
+            param.setEventTypeId(EventTypeId(eventTypeId));
+            param.setEventParamTypeId(ParamTypeId(eventParamTypeId));
+            param.setStateThingId(ThingId(stateThingId));
+            param.setStateTypeId(StateTypeId(stateTypeId));
+            params.append(param);
+        }
+
+        RuleAction ruleAction;
+        ruleAction.setThingId(ThingId(thingId));
+        ruleAction.setActionTypeId(ActionTypeId(actionTypeId));
+        ruleAction.setBrowserItemId(browserItemId);
+        ruleAction.setInterface(interface);
+        ruleAction.setInterfaceAction(interfaceAction);
+        ruleAction.setRuleActionParams(params);
+        ruleActions.append(ruleAction);
+    }
+    return ruleActions;
+}
+
+/*! Returns the path of the rule snapshot file. */
+QString RuleSnapshot::fileName()
+{
+    return NymeaSettings::settingsPath() + "/rules.snapshot";
+}
+
+/*! Writes the given \a rules to the snapshot file \a fileName. The file is replaced atomically, so a
+    crash while saving never leaves a half written snapshot behind. Returns false if writing failed. */
+bool RuleSnapshot::save(const QString &fileName, const QList<Rule> &rules)
+{
+    QSaveFile file(fileName);
+    if (!file.open(QFile::WriteOnly)) {
+        qCWarning(dcRuleEngine()) << "Unable to open rule snapshot" << fileName << "for writing:" << file.errorString();
+        return false;
+    }
+
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_5_6);
+    stream << snapshotMagic << snapshotVersion;
+    stream << static_cast<quint32>(rules.count());
+    foreach (const Rule &rule, rules) {
+        stream << QUuid(rule.id()) << rule.name() << rule.enabled() << rule.executable();
+        writeTimeDescriptor(stream, rule.timeDescriptor());
+        writeEventDescriptors(stream, rule.eventDescriptors());
+        writeStateEvaluator(stream, rule.stateEvaluator());
+        writeRuleActions(stream, rule.actions());
+        writeRuleActions(stream, rule.exitActions());
+    }
+
+    if (stream.status() != QDataStream::Ok || !file.commit()) {
+        qCWarning(dcRuleEngine()) << "Error writing rule snapshot" << fileName << file.errorString();
+        return false;
+    }
+    qCDebug(dcRuleEngineDebug()) << "Saved" << rules.count() << "rules to" << fileName;
+    return true;
+}
+
+/*! Loads the rules stored in the snapshot file \a fileName into \a rules. Returns false if the file
+    does not exist or could not be read, in which case \a rules is left untouched. This method does
+    not access anything but the given file and can be called from any thread. */
+bool RuleSnapshot::load(const QString &fileName, QList<Rule> *rules)
+{
+    QFile file(fileName);
+    if (!file.exists()) {
+        return false;
+    }
+    if (!file.open(QFile::ReadOnly)) {
+        qCWarning(dcRuleEngine()) << "Unable to open rule snapshot" << fileName << "for reading:" << file.errorString();
+        return false;
+    }
+
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_5_6);
+
+    quint32 magic, version;
+    stream >> magic >> version;
+    if (magic != snapshotMagic || version < 1 || version > snapshotVersion) {
+        qCWarning(dcRuleEngine()) << "Rule snapshot" << fileName << "has an unsupported format. Ignoring it.";
+        return false;
+    }
+
+    QList<Rule> loadedRules;
+    quint32 count;
+    stream >> count;
+    for (quint32 i = 0; i < count && stream.status() == QDataStream::Ok; i++) {
+        QUuid id;
+        QString name;
+        bool enabled, executable;
+        stream >> id >> name >> enabled >> executable;
+
+        Rule rule;
+        rule.setId(RuleId(id));
+        rule.setName(name);
+        rule.setEnabled(enabled);
+        rule.setExecutable(executable);
+        rule.setTimeDescriptor(readTimeDescriptor(stream));
+        rule.setEventDescriptors(readEventDescriptors(stream, version));
+        rule.setStateEvaluator(readStateEvaluator(stream, version));
+        rule.setActions(readRuleActions(stream));
+        rule.setExitActions(readRuleActions(stream));
+        loadedRules.append(rule);
+    }
+
+    if (stream.status() != QDataStream::Ok) {
+        qCWarning(dcRuleEngine()) << "Rule snapshot" << fileName << "is corrupt. Ignoring it.";
+        return false;
+    }
+
+    *rules = loadedRules;
+    return true;
+}
+
+/*! Returns a human readable dump of the given \a rules. The snapshot itself is a binary file, this
+    is used wherever the rules need to be inspected, e.g. by the debug interface. */
+QByteArray RuleSnapshot::toText(const QList<Rule> &rules)
+{
+    QString text;
+    {
+        QDebug debug(&text);
+        foreach (const Rule &rule, rules) {
+            debug << rule << endl;
+        }
+    }
+    return text.toUtf8();
+}
+
+}
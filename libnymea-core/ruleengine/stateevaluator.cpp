@@ -30,6 +30,8 @@
 
 
 #include "stateevaluator.h"
+#include "triggerfilters.h"
+#include "statethresholdindex.h"
 #include "nymeacore.h"
 #include "integrations/thingmanager.h"
 #include "loggingcategories.h"
@@ -87,74 +89,169 @@ void StateEvaluator::setOperatorType(Types::StateOperator operatorType)
 
 bool StateEvaluator::evaluate() const
 {
+    int index = 0;
+    return evaluate(nullptr, RuleId(), &index);
+}
+
+/*! Evaluates this StateEvaluator like \l{evaluate()}, but passes the results of all state descriptors
+    having a \l{TriggerFilter} through the given \a filters of the rule with the given \a ruleId. If the
+    tree contains filtered descriptors, all child evaluators are evaluated in order to keep the filter
+    states up to date, otherwise the evaluation stops as soon as the result is known.
+
+    If \a thresholds is given, descriptors compiled into the \l{StateThresholdIndex} use the precomputed
+    result instead of comparing the state values again. */
+bool StateEvaluator::evaluate(TriggerFilters *filters, const RuleId &ruleId, const StateThresholdIndex *thresholds) const
+{
+    // Without filtered descriptors there are no filter states to keep up to date
+    if (filters && !hasFilters()) {
+        filters = nullptr;
+    }
+    int index = 0;
+    return evaluate(filters, thresholds, ruleId, &index);
+}
+
+bool StateEvaluator::evaluate(TriggerFilters *filters, const StateThresholdIndex *thresholds, const RuleId &ruleId, int *index) const
+{
+    // Filter states need to see every descriptor, so only stop early without filters
+    bool exhaustive = filters != nullptr;
+
     qCDebug(dcRuleEngineDebug()) << "StateEvaluator:" << this << "Evaluating: Operator type" << m_operatorType << "Valid descriptor:" << m_stateDescriptor.isValid() << "Childs:" << m_childEvaluators.count();
+    int descriptorIndex = (*index)++;
     bool descriptorMatching = true;
     if (m_stateDescriptor.isValid()) {
-        descriptorMatching = false;
-        if (m_stateDescriptor.type() == StateDescriptor::TypeThing) {
-            Thing *thing = NymeaCore::instance()->thingManager()->findConfiguredThing(m_stateDescriptor.thingId());
-            if (thing) {
-                ThingClass thingClass = NymeaCore::instance()->thingManager()->findThingClass(thing->thingClassId());
-                if (thing->hasState(m_stateDescriptor.stateTypeId())) {
-                    if (m_stateDescriptor == thing->state(m_stateDescriptor.stateTypeId())) {
-                        qCDebug(dcRuleEngineDebug()) << "StateEvaluator:" << this << "State" << thing->name() << thingClass.stateTypes().findById(m_stateDescriptor.stateTypeId()).name() << (descriptorMatching ? "is" : "not") << "matching:" << m_stateDescriptor.stateValue() << m_stateDescriptor.operatorType() << thing->stateValue(m_stateDescriptor.stateTypeId());
-                        descriptorMatching = true;
-                    }
-                } else {
-                    qCWarning(dcRuleEngine) << "StateEvaluator:" << this << "Thing found, but it does not appear to have such a state!";
-                }
-            } else {
-                qCWarning(dcRuleEngine) << "StateEvaluator:" << this << "Thing not existing!";
-            }
-        } else { // interface
-            foreach (Thing* thing, NymeaCore::instance()->thingManager()->configuredThings()) {
-                ThingClass thingClass = NymeaCore::instance()->thingManager()->findThingClass(thing->thingClassId());
-                if (!thingClass.isValid()) {
-                    qCWarning(dcRuleEngine()) << "Could not find ThingClass for Thing" << thing->name() << thing->id();
-                    continue;
-                }
-                if (thingClass.interfaces().contains(m_stateDescriptor.interface())) {
-                    StateType stateType = thingClass.stateTypes().findByName(m_stateDescriptor.interfaceState());
-                    State state = thing->state(stateType.id());
-                    // As the StateDescriptor can't compare on it's own against interfaces, generate custom one, matching the device
-                    StateDescriptor temporaryDescriptor(stateType.id(), thing->id(), m_stateDescriptor.stateValue(), m_stateDescriptor.operatorType());
-                    if (temporaryDescriptor == state) {
-                        descriptorMatching = true;
-                        break;
-                    }
-                }
-            }
+        TriggerFilter filter = m_stateDescriptor.filter();
+        bool filtered = filters && filter.isValid();
+
+        // Once matching, the threshold moves back by the hysteresis
+        StateDescriptor stateDescriptor = m_stateDescriptor;
+        if (filtered && filters->stateMatching(ruleId, descriptorIndex)) {
+            stateDescriptor.setStateValue(TriggerFilters::relaxedThreshold(stateDescriptor.stateValue(), stateDescriptor.operatorType(), filter.hysteresis()));
+        }
+
+        int compiledResult = thresholds ? thresholds->result(ruleId, descriptorIndex) : -1;
+        descriptorMatching = compiledResult >= 0 ? compiledResult == 1 : matches(stateDescriptor);
+        if (filtered) {
+            descriptorMatching = filters->filterState(ruleId, descriptorIndex, filter, descriptorMatching);
         }
     }
 
     if (m_operatorType == Types::StateOperatorOr) {
-        if (m_stateDescriptor.isValid() && descriptorMatching) {
+        bool result = m_stateDescriptor.isValid() && descriptorMatching;
+        if (result) {
             qCDebug(dcRuleEngineDebug()) << "StateEvaluator:" << this << "Descriptor is matching. Operator is OR => Evaluation result: true";
-            return true;
+            if (!exhaustive) {
+                skipChildren(0, index);
+                return true;
+            }
         }
-        foreach (const StateEvaluator &stateEvaluator, m_childEvaluators) {
-            if (stateEvaluator.evaluate()) {
+        for (int i = 0; i < m_childEvaluators.count(); i++) {
+            if (m_childEvaluators.at(i).evaluate(filters, thresholds, ruleId, index) && !result) {
                 qCDebug(dcRuleEngineDebug()) << "StateEvaluator:" << this << "Child evaluator evaluated to true. Operator is OR => Evaluation result: true";
-                return true;
+                result = true;
+                if (!exhaustive) {
+                    skipChildren(i + 1, index);
+                    return true;
+                }
             }
         }
-        qCDebug(dcRuleEngineDebug()) << "StateEvaluator:" << this << "No child evaluator evaluated to true => Evaluation result: false";
-        return false;
+        if (!result) {
+            qCDebug(dcRuleEngineDebug()) << "StateEvaluator:" << this << "No child evaluator evaluated to true => Evaluation result: false";
+        }
+        return result;
     }
 
-    if (!descriptorMatching) {
+    bool result = descriptorMatching;
+    if (!result) {
         qCDebug(dcRuleEngineDebug()) << "StateEvaluator:" << this << "StateDescriptor not matching and operator is AND => Evaluation result: false";
-        return false;
+        if (!exhaustive) {
+            skipChildren(0, index);
+            return false;
+        }
     }
 
-    foreach (const StateEvaluator &stateEvaluator, m_childEvaluators) {
-        if (!stateEvaluator.evaluate()) {
+    for (int i = 0; i < m_childEvaluators.count(); i++) {
+        if (!m_childEvaluators.at(i).evaluate(filters, thresholds, ruleId, index) && result) {
             qCDebug(dcRuleEngineDebug()) << "StateEvaluator:" << this << "Child evaluator not matching => Evaluation result: false";
+            result = false;
+            if (!exhaustive) {
+                skipChildren(i + 1, index);
+                return false;
+            }
+        }
+    }
+    if (result) {
+        qCDebug(dcRuleEngineDebug()) << "StateEvaluator:" << this << "StateDescriptor and all child evaluators matching => Evaluation result: true";
+    }
+    return result;
+}
+
+bool StateEvaluator::hasFilters() const
+{
+    if (m_stateDescriptor.isValid() && m_stateDescriptor.filter().isValid()) {
+        return true;
+    }
+    foreach (const StateEvaluator &stateEvaluator, m_childEvaluators) {
+        if (stateEvaluator.hasFilters()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+int StateEvaluator::descriptorCount() const
+{
+    int count = 1;
+    foreach (const StateEvaluator &stateEvaluator, m_childEvaluators) {
+        count += stateEvaluator.descriptorCount();
+    }
+    return count;
+}
+
+// Advances the pre-order \a index past the children not evaluated, so the following
+// descriptors keep the index they have been compiled with.
+void StateEvaluator::skipChildren(int from, int *index) const
+{
+    for (int i = from; i < m_childEvaluators.count(); i++) {
+        *index += m_childEvaluators.at(i).descriptorCount();
+    }
+}
+
+bool StateEvaluator::matches(const StateDescriptor &stateDescriptor) const
+{
+    if (stateDescriptor.type() == StateDescriptor::TypeThing) {
+        Thing *thing = NymeaCore::instance()->thingManager()->findConfiguredThing(stateDescriptor.thingId());
+        if (!thing) {
+            qCWarning(dcRuleEngine) << "StateEvaluator:" << this << "Thing not existing!";
             return false;
         }
+        if (!thing->hasState(stateDescriptor.stateTypeId())) {
+            qCWarning(dcRuleEngine) << "StateEvaluator:" << this << "Thing found, but it does not appear to have such a state!";
+            return false;
+        }
+        bool matching = stateDescriptor == thing->state(stateDescriptor.stateTypeId());
+        ThingClass thingClass = NymeaCore::instance()->thingManager()->findThingClass(thing->thingClassId());
+        qCDebug(dcRuleEngineDebug()) << "StateEvaluator:" << this << "State" << thing->name() << thingClass.stateTypes().findById(stateDescriptor.stateTypeId()).name() << (matching ? "is" : "not") << "matching:" << stateDescriptor.stateValue() << stateDescriptor.operatorType() << thing->stateValue(stateDescriptor.stateTypeId());
+        return matching;
     }
-    qCDebug(dcRuleEngineDebug()) << "StateEvaluator:" << this << "StateDescriptor and all child evaluators matching => Evaluation result: true";
-    return true;
+
+    // interface
+    foreach (Thing* thing, NymeaCore::instance()->thingManager()->configuredThings()) {
+        ThingClass thingClass = NymeaCore::instance()->thingManager()->findThingClass(thing->thingClassId());
+        if (!thingClass.isValid()) {
+            qCWarning(dcRuleEngine()) << "Could not find ThingClass for Thing" << thing->name() << thing->id();
+            continue;
+        }
+        if (thingClass.interfaces().contains(stateDescriptor.interface())) {
+            StateType stateType = thingClass.stateTypes().findByName(stateDescriptor.interfaceState());
+            State state = thing->state(stateType.id());
+            // As the StateDescriptor can't compare on it's own against interfaces, generate custom one, matching the device
+            StateDescriptor temporaryDescriptor(stateType.id(), thing->id(), stateDescriptor.stateValue(), stateDescriptor.operatorType());
+            if (temporaryDescriptor == state) {
+                return true;
+            }
+        }
+    }
+    return false;
 }
 
 bool StateEvaluator::containsThing(const ThingId &thingId) const
@@ -192,31 +289,6 @@ QList<ThingId> StateEvaluator::containedThings() const
     return ret;
 }
 
-void StateEvaluator::dumpToSettings(NymeaSettings &settings, const QString &groupName) const
-{
-    settings.beginGroup(groupName);
-
-    settings.beginGroup("stateDescriptor");
-    settings.setValue("stateTypeId", m_stateDescriptor.stateTypeId().toString());
-    settings.setValue("thingId", m_stateDescriptor.thingId().toString());
-    settings.setValue("interface", m_stateDescriptor.interface());
-    settings.setValue("interfaceState", m_stateDescriptor.interfaceState());
-    settings.setValue("value", m_stateDescriptor.stateValue());
-    settings.setValue("valueType", (int)m_stateDescriptor.stateValue().type());
-    settings.setValue("operator", m_stateDescriptor.operatorType());
-    settings.endGroup();
-
-    settings.setValue("operator", m_operatorType);
-
-    settings.beginGroup("childEvaluators");
-    for (int i = 0; i < m_childEvaluators.count(); i++) {
-        m_childEvaluators.at(i).dumpToSettings(settings, "stateEvaluator-" + QString::number(i));
-    }
-    settings.endGroup();
-
-    settings.endGroup();
-}
-
 StateEvaluator StateEvaluator::loadFromSettings(NymeaSettings &settings, const QString &groupName)
 {
     settings.beginGroup(groupName);
@@ -266,6 +338,11 @@ StateEvaluator StateEvaluator::loadFromSettings(NymeaSettings &settings, const Q
 bool StateEvaluator::isValid() const
 {
     if (m_stateDescriptor.isValid()) {
+        if (m_stateDescriptor.filter().hysteresis() < 0) {
+            qCWarning(dcRuleEngine) << "The hysteresis of a state descriptor must not be negative!";
+            return false;
+        }
+
         if (m_stateDescriptor.type() == StateDescriptor::TypeThing) {
             Thing *thing = NymeaCore::instance()->thingManager()->findConfiguredThing(m_stateDescriptor.thingId());
             if (!thing) {
@@ -40,6 +40,8 @@ class NymeaSettings;
 
 namespace nymeaserver {
 class StateEvaluator;
+class TriggerFilters;
+class StateThresholdIndex;
 
 class StateEvaluators: public QList<StateEvaluator>
 {
@@ -73,18 +75,24 @@ public:
     void setOperatorType(Types::StateOperator operatorType);
 
     bool evaluate() const;
+    bool evaluate(TriggerFilters *filters, const RuleId &ruleId, const StateThresholdIndex *thresholds = nullptr) const;
     bool containsThing(const ThingId &thingId) const;
 
     void removeThing(const ThingId &thingId);
     QList<ThingId> containedThings() const;
 
-    void dumpToSettings(NymeaSettings &settings, const QString &groupName) const;
     static StateEvaluator loadFromSettings(NymeaSettings &settings, const QString &groupPrefix);
 
     bool isValid() const;
     bool isEmpty() const;
 
 private:
+    bool evaluate(TriggerFilters *filters, const StateThresholdIndex *thresholds, const RuleId &ruleId, int *index) const;
+    bool matches(const StateDescriptor &stateDescriptor) const;
+    bool hasFilters() const;
+    int descriptorCount() const;
+    void skipChildren(int from, int *index) const;
+
     StateDescriptor m_stateDescriptor;
 
     QList<StateEvaluator> m_childEvaluators;
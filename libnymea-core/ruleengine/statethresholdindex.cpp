@@ -0,0 +1,267 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* Copyright 2013 - 2020, nymea GmbH
+* Contact: contact@nymea.io
+*
+* This file is part of nymea.
+* This project including source code and documentation is protected by
+* copyright law, and remains the property of nymea GmbH. All rights, including
+* reproduction, publication, editing and translation, are reserved. The use of
+* this project is subject to the terms of a license agreement to be concluded
+* with nymea GmbH in accordance with the terms of use of nymea GmbH, available
+* under https://nymea.io/license
+*
+* GNU General Public License Usage
+* Alternatively, this project may be redistributed and/or modified under the
+* terms of the GNU General Public License as published by the Free Software
+* Foundation, GNU version 3. This project is distributed in the hope that it
+* will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+* of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+* Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with
+* this project. If not, see <https://www.gnu.org/licenses/>.
+*
+* For any further details and any questions please contact us under
+* contact@nymea.io or see our FAQ/Licensing Information on
+* https://nymea.io/license/faq
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+/*!
+    \class nymeaserver::StateThresholdIndex
+    \brief Compiled numeric state thresholds of all rules.
+
+    \ingroup rules
+    \inmodule core
+
+    Comparing a \l{StateDescriptor} against a \l{State} converts both values to a common QVariant type
+    for each check. With many threshold rules on the same sensor this dominates the evaluation of a
+    state change.
+
+    The StateThresholdIndex compiles all state descriptors of a rule which compare a numeric state of
+    a thing with a greater or less operator. The thresholds are kept as plain doubles in one contiguous
+    array per state and operator. When the state changes, \l{updateState()} compares the new value
+    against all thresholds of that state in a single loop and stores the results. The \l{StateEvaluator}
+    then picks up the result for those descriptors instead of comparing the values again.
+
+    Descriptors are identified by the id of their rule and their index within the rule, the same way
+    the \l{TriggerFilters} identify them. Descriptors with a \l{TriggerFilter} are not compiled.
+*/
+
+#include "statethresholdindex.h"
+#include "stateevaluator.h"
+#include "integrations/thingmanager.h"
+#include "loggingcategories.h"
+
+namespace nymeaserver {
+
+/*! Constructs an empty StateThresholdIndex looking up things in the given \a thingManager. */
+StateThresholdIndex::StateThresholdIndex(ThingManager *thingManager) :
+    m_thingManager(thingManager)
+{
+
+}
+
+/*! Compiles all numeric thresholds of the given \a stateEvaluator of the rule with the given \a ruleId.
+    The results are initialized with the current state values. */
+void StateThresholdIndex::addRule(const RuleId &ruleId, const StateEvaluator &stateEvaluator)
+{
+    removeRule(ruleId);
+    int index = 0;
+    compile(ruleId, stateEvaluator, &index);
+}
+
+/*! Removes all compiled thresholds of the rule with the given \a ruleId. */
+void StateThresholdIndex::removeRule(const RuleId &ruleId)
+{
+    if (!m_locations.contains(ruleId)) {
+        return;
+    }
+
+    QList<StateKey> keys;
+    foreach (const Location &location, m_locations.take(ruleId)) {
+        if (!keys.contains(location.key)) {
+            keys.append(location.key);
+        }
+    }
+
+    // Compact the arrays and move the locations of all other rules along
+    foreach (const StateKey &key, keys) {
+        Thresholds &thresholds = m_thresholds[key];
+        int remaining = 0;
+        for (int group = 0; group < GroupCount; group++) {
+            int position = 0;
+            for (int i = 0; i < thresholds.references[group].count(); i++) {
+                Reference reference = thresholds.references[group].at(i);
+                if (reference.ruleId == ruleId) {
+                    continue;
+                }
+                thresholds.values[group][position] = thresholds.values[group].at(i);
+                thresholds.results[group][position] = thresholds.results[group].at(i);
+                thresholds.references[group][position] = reference;
+                m_locations[reference.ruleId][reference.index].position = position;
+                position++;
+            }
+            thresholds.values[group].resize(position);
+            thresholds.results[group].resize(position);
+            thresholds.references[group].resize(position);
+            remaining += position;
+        }
+        if (remaining == 0) {
+            m_thresholds.remove(key);
+        }
+    }
+}
+
+/*! Compares the new \a value of the state with the given \a stateTypeId of the thing with the given
+    \a thingId against all compiled thresholds watching this state. */
+void StateThresholdIndex::updateState(const ThingId &thingId, const StateTypeId &stateTypeId, const QVariant &value)
+{
+    QHash<StateKey, Thresholds>::iterator it = m_thresholds.find(StateKey(thingId, stateTypeId));
+    if (it == m_thresholds.end()) {
+        return;
+    }
+
+    double rawValue = value.toDouble();
+    for (int group = 0; group < GroupCount; group++) {
+        int count = it->values[group].count();
+        if (count > 0) {
+            compare(static_cast<Group>(group), it->values[group].constData(), it->results[group].data(), count, rawValue);
+        }
+    }
+}
+
+/*! Returns the compiled result of the state descriptor with the given \a index in the rule with the
+    given \a ruleId. Returns 1 if it is matching, 0 if not, and -1 if the descriptor is not compiled. */
+int StateThresholdIndex::result(const RuleId &ruleId, int index) const
+{
+    QHash<RuleId, QHash<int, Location> >::const_iterator ruleIt = m_locations.constFind(ruleId);
+    if (ruleIt == m_locations.constEnd()) {
+        return -1;
+    }
+    QHash<int, Location>::const_iterator it = ruleIt->constFind(index);
+    if (it == ruleIt->constEnd()) {
+        return -1;
+    }
+    QHash<StateKey, Thresholds>::const_iterator thresholdsIt = m_thresholds.constFind(it->key);
+    if (thresholdsIt == m_thresholds.constEnd()) {
+        return -1;
+    }
+    return thresholdsIt->results[it->group].at(it->position);
+}
+
+/*! Returns the number of compiled thresholds of all rules. */
+int StateThresholdIndex::thresholdCount() const
+{
+    int count = 0;
+    foreach (const QHash<int, Location> &locations, m_locations) {
+        count += locations.count();
+    }
+    return count;
+}
+
+void StateThresholdIndex::compile(const RuleId &ruleId, const StateEvaluator &stateEvaluator, int *index)
+{
+    // Same pre-order numbering as StateEvaluator::evaluate()
+    int descriptorIndex = (*index)++;
+    foreach (const StateEvaluator &childEvaluator, stateEvaluator.childEvaluators()) {
+        compile(ruleId, childEvaluator, index);
+    }
+
+    const StateDescriptor &stateDescriptor = stateEvaluator.stateDescriptor();
+    if (!stateDescriptor.isValid() || stateDescriptor.type() != StateDescriptor::TypeThing || stateDescriptor.filter().isValid()) {
+        return;
+    }
+
+    Group group;
+    switch (stateDescriptor.operatorType()) {
+    case Types::ValueOperatorGreater:
+        group = GroupGreater;
+        break;
+    case Types::ValueOperatorGreaterOrEqual:
+        group = GroupGreaterOrEqual;
+        break;
+    case Types::ValueOperatorLess:
+        group = GroupLess;
+        break;
+    case Types::ValueOperatorLessOrEqual:
+        group = GroupLessOrEqual;
+        break;
+    default:
+        // Equality is fuzzy for doubles in QVariant, leave that to the StateDescriptor
+        return;
+    }
+
+    Thing *thing = m_thingManager->findConfiguredThing(stateDescriptor.thingId());
+    if (!thing || !thing->hasState(stateDescriptor.stateTypeId())) {
+        return;
+    }
+    QVariant stateValue = thing->stateValue(stateDescriptor.stateTypeId());
+    switch (stateValue.type()) {
+    case QVariant::Int:
+    case QVariant::UInt:
+    case QVariant::LongLong:
+    case QVariant::ULongLong:
+    case QVariant::Double:
+        break;
+    default:
+        return;
+    }
+
+    // Convert the threshold the same way StateDescriptor does when comparing against the state
+    QVariant threshold = stateDescriptor.stateValue();
+    if (!threshold.canConvert(stateValue.type()) || !threshold.convert(stateValue.type())) {
+        return;
+    }
+
+    StateKey key(stateDescriptor.thingId(), stateDescriptor.stateTypeId());
+    Thresholds &thresholds = m_thresholds[key];
+    Location location;
+    location.key = key;
+    location.group = group;
+    location.position = thresholds.values[group].count();
+
+    Reference reference;
+    reference.ruleId = ruleId;
+    reference.index = descriptorIndex;
+
+    quint8 result;
+    double value = threshold.toDouble();
+    compare(group, &value, &result, 1, stateValue.toDouble());
+
+    thresholds.values[group].append(value);
+    thresholds.results[group].append(result);
+    thresholds.references[group].append(reference);
+    m_locations[ruleId].insert(descriptorIndex, location);
+}
+
+void StateThresholdIndex::compare(Group group, const double *values, quint8 *results, int count, double value)
+{
+    switch (group) {
+    case GroupGreater:
+        for (int i = 0; i < count; i++) {
+            results[i] = value > values[i];
+        }
+        break;
+    case GroupGreaterOrEqual:
+        for (int i = 0; i < count; i++) {
+            results[i] = value >= values[i];
+        }
+        break;
+    case GroupLess:
+        for (int i = 0; i < count; i++) {
+            results[i] = value < values[i];
+        }
+        break;
+    case GroupLessOrEqual:
+        for (int i = 0; i < count; i++) {
+            results[i] = value <= values[i];
+        }
+        break;
+    case GroupCount:
+        break;
+    }
+}
+
+}
@@ -0,0 +1,99 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* Copyright 2013 - 2020, nymea GmbH
+* Contact: contact@nymea.io
+*
+* This file is part of nymea.
+* This project including source code and documentation is protected by
+* copyright law, and remains the property of nymea GmbH. All rights, including
+* reproduction, publication, editing and translation, are reserved. The use of
+* this project is subject to the terms of a license agreement to be concluded
+* with nymea GmbH in accordance with the terms of use of nymea GmbH, available
+* under https://nymea.io/license
+*
+* GNU General Public License Usage
+* Alternatively, this project may be redistributed and/or modified under the
+* terms of the GNU General Public License as published by the Free Software
+* Foundation, GNU version 3. This project is distributed in the hope that it
+* will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+* of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+* Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with
+* this project. If not, see <https://www.gnu.org/licenses/>.
+*
+* For any further details and any questions please contact us under
+* contact@nymea.io or see our FAQ/Licensing Information on
+* https://nymea.io/license/faq
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef STATETHRESHOLDINDEX_H
+#define STATETHRESHOLDINDEX_H
+
+#include "typeutils.h"
+
+#include <QHash>
+#include <QPair>
+#include <QVector>
+#include <QVariant>
+
+class ThingManager;
+
+namespace nymeaserver {
+
+class StateEvaluator;
+
+class StateThresholdIndex
+{
+public:
+    explicit StateThresholdIndex(ThingManager *thingManager);
+
+    void addRule(const RuleId &ruleId, const StateEvaluator &stateEvaluator);
+    void removeRule(const RuleId &ruleId);
+
+    void updateState(const ThingId &thingId, const StateTypeId &stateTypeId, const QVariant &value);
+
+    int result(const RuleId &ruleId, int index) const;
+    int thresholdCount() const;
+
+private:
+    typedef QPair<ThingId, StateTypeId> StateKey;
+
+    // One array per compare operator, so the compare loops run without any branches
+    enum Group {
+        GroupGreater,
+        GroupGreaterOrEqual,
+        GroupLess,
+        GroupLessOrEqual,
+        GroupCount
+    };
+
+    struct Reference {
+        RuleId ruleId;
+        int index;
+    };
+
+    struct Thresholds {
+        QVector<double> values[GroupCount];
+        QVector<quint8> results[GroupCount];
+        QVector<Reference> references[GroupCount];
+    };
+
+    struct Location {
+        StateKey key;
+        int group;
+        int position;
+    };
+
+    void compile(const RuleId &ruleId, const StateEvaluator &stateEvaluator, int *index);
+    static void compare(Group group, const double *values, quint8 *results, int count, double value);
+
+    ThingManager *m_thingManager = nullptr;
+    QHash<StateKey, Thresholds> m_thresholds;
+    QHash<RuleId, QHash<int, Location> > m_locations;
+};
+
+}
+
+#endif // STATETHRESHOLDINDEX_H
@@ -0,0 +1,283 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* Copyright 2013 - 2020, nymea GmbH
+* Contact: contact@nymea.io
+*
+* This file is part of nymea.
+* This project including source code and documentation is protected by
+* copyright law, and remains the property of nymea GmbH. All rights, including
+* reproduction, publication, editing and translation, are reserved. The use of
+* this project is subject to the terms of a license agreement to be concluded
+* with nymea GmbH in accordance with the terms of use of nymea GmbH, available
+* under https://nymea.io/license
+*
+* GNU General Public License Usage
+* Alternatively, this project may be redistributed and/or modified under the
+* terms of the GNU General Public License as published by the Free Software
+* Foundation, GNU version 3. This project is distributed in the hope that it
+* will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+* of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+* Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with
+* this project. If not, see <https://www.gnu.org/licenses/>.
+*
+* For any further details and any questions please contact us under
+* contact@nymea.io or see our FAQ/Licensing Information on
+* https://nymea.io/license/faq
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+/*!
+    \class nymeaserver::TriggerFilters
+    \brief Keeps track of the \l{TriggerFilter}{TriggerFilters} of all rules.
+
+    \ingroup rules
+    \inmodule core
+
+    The \l{RuleEngine} consults the TriggerFilters whenever an \l{EventDescriptor} or
+    \l{StateDescriptor} with a \l{TriggerFilter} is matched. Descriptors are identified by the id
+    of their rule and their index within the rule. Triggers delayed by a debounce or throttle time
+    are kept here, and the \l{rulesDue()} signal is emitted once they need to be evaluated again.
+    A single timer is used for all rules, running until the earliest deadline.
+*/
+
+/*! \fn void nymeaserver::TriggerFilters::rulesDue(const QList<RuleId> &ruleIds);
+    This signal is emitted when delayed events or state changes of the rules with the given
+    \a ruleIds are due.
+*/
+
+#include "triggerfilters.h"
+#include "loggingcategories.h"
+
+#include <QTimer>
+
+namespace nymeaserver {
+
+TriggerFilters::TriggerFilters(QObject *parent) :
+    QObject(parent)
+{
+    m_timer = new QTimer(this);
+    m_timer->setSingleShot(true);
+    m_timer->setTimerType(Qt::PreciseTimer);
+    connect(m_timer, &QTimer::timeout, this, &TriggerFilters::onTimeout);
+    m_clock.start();
+}
+
+/*! Filters the given \a event matching the event descriptor with the given \a index in the rule
+    with the given \a ruleId. Returns true if the rule should be triggered right away. Events delayed
+    by the debounce time of the given \a filter are returned by \l{takeDueEvents()} later. */
+bool TriggerFilters::filterEvent(const RuleId &ruleId, int index, const TriggerFilter &filter, const Event &event)
+{
+    EventFilterState &state = m_eventStates[ruleId][index];
+    qint64 now = m_clock.elapsed();
+    qint64 throttleEnd = state.lastTrigger >= 0 ? state.lastTrigger + filter.throttle() : 0;
+
+    if (filter.debounce() == 0) {
+        if (now < throttleEnd) {
+            qCDebug(dcRuleEngineDebug()) << "Event" << event.eventTypeId().toString() << "for rule" << ruleId.toString() << "throttled.";
+            return false;
+        }
+        state.lastTrigger = now;
+        return true;
+    }
+
+    // Every matching event restarts the debounce time, the last one wins
+    state.pending = true;
+    state.pendingEvent = event;
+    state.deadline = qMax(now + filter.debounce(), throttleEnd);
+    schedule(ruleId, state.deadline);
+    return false;
+}
+
+/*! Cancels the delayed event of the event descriptor with the given \a index in the rule with the
+    given \a ruleId if it has been emitted by the same thing and event type as the given \a event, which
+    no longer matches the descriptor. Returns true if a delayed event has been cancelled. */
+bool TriggerFilters::cancelEvent(const RuleId &ruleId, int index, const Event &event)
+{
+    QHash<RuleId, QHash<int, EventFilterState> >::iterator it = m_eventStates.find(ruleId);
+    if (it == m_eventStates.end() || !it->contains(index)) {
+        return false;
+    }
+
+    EventFilterState &state = (*it)[index];
+    if (!state.pending || state.pendingEvent.thingId() != event.thingId() || state.pendingEvent.eventTypeId() != event.eventTypeId()) {
+        return false;
+    }
+
+    // The deadline stays scheduled, takeDueEvents() skips states which are not pending
+    state.pending = false;
+    return true;
+}
+
+/*! Returns false if the event descriptor with the given \a index in the rule with the given \a ruleId
+    has triggered and its value did not yet fall back beyond the hysteresis. */
+bool TriggerFilters::eventArmed(const RuleId &ruleId, int index) const
+{
+    return m_eventStates.value(ruleId).value(index).armed;
+}
+
+/*! Sets whether the event descriptor with the given \a index in the rule with the given \a ruleId
+    may trigger again to \a armed. */
+void TriggerFilters::setEventArmed(const RuleId &ruleId, int index, bool armed)
+{
+    m_eventStates[ruleId][index].armed = armed;
+}
+
+/*! Returns the events of the rule with the given \a ruleId whose debounce time has passed. */
+QList<Event> TriggerFilters::takeDueEvents(const RuleId &ruleId)
+{
+    QList<Event> events;
+    if (!m_eventStates.contains(ruleId)) {
+        return events;
+    }
+
+    qint64 now = m_clock.elapsed();
+    QHash<int, EventFilterState> &states = m_eventStates[ruleId];
+    foreach (int index, states.keys()) {
+        EventFilterState &state = states[index];
+        if (!state.pending) {
+            continue;
+        }
+        if (state.deadline > now) {
+            schedule(ruleId, state.deadline);
+            continue;
+        }
+        state.pending = false;
+        state.lastTrigger = now;
+        events.append(state.pendingEvent);
+    }
+    return events;
+}
+
+/*! Returns the filtered matching result of the state descriptor with the given \a index in the rule
+    with the given \a ruleId, as returned by the last call to \l{filterState()}. */
+bool TriggerFilters::stateMatching(const RuleId &ruleId, int index) const
+{
+    return m_stateStates.value(ruleId).value(index).matching;
+}
+
+/*! Filters the \a matching result of the state descriptor with the given \a index in the rule with
+    the given \a ruleId. Changes of the result only take effect once they persisted for the debounce
+    time of the given \a filter and the throttle time has passed since the last change. Returns the
+    filtered result. */
+bool TriggerFilters::filterState(const RuleId &ruleId, int index, const TriggerFilter &filter, bool matching)
+{
+    QHash<int, StateFilterState> &states = m_stateStates[ruleId];
+    if (!states.contains(index)) {
+        // The initial state is taken over as is
+        StateFilterState state;
+        state.matching = matching;
+        states.insert(index, state);
+        return matching;
+    }
+
+    StateFilterState &state = states[index];
+    if (matching == state.matching) {
+        state.pending = false;
+        return state.matching;
+    }
+
+    qint64 now = m_clock.elapsed();
+    if (!state.pending) {
+        state.pending = true;
+        state.pendingSince = now;
+    }
+
+    qint64 due = state.pendingSince + filter.debounce();
+    if (state.lastChange >= 0) {
+        due = qMax(due, state.lastChange + filter.throttle());
+    }
+    if (now < due) {
+        schedule(ruleId, due);
+        return state.matching;
+    }
+
+    state.matching = matching;
+    state.pending = false;
+    state.lastChange = now;
+    return state.matching;
+}
+
+/*! Drops all filter states and delayed triggers of the rule with the given \a ruleId. */
+void TriggerFilters::clear(const RuleId &ruleId)
+{
+    m_eventStates.remove(ruleId);
+    m_stateStates.remove(ruleId);
+
+    QMultiMap<qint64, RuleId>::iterator it = m_deadlines.begin();
+    while (it != m_deadlines.end()) {
+        if (it.value() == ruleId) {
+            it = m_deadlines.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+/*! Returns the given \a threshold moved back by the given \a hysteresis according to the \a operatorType.
+    Thresholds of other than the greater and less operators, and non numeric thresholds are returned unchanged. */
+QVariant TriggerFilters::relaxedThreshold(const QVariant &threshold, Types::ValueOperator operatorType, double hysteresis)
+{
+    bool ok = false;
+    double value = threshold.toDouble(&ok);
+    if (!ok || qFuzzyIsNull(hysteresis)) {
+        return threshold;
+    }
+
+    switch (operatorType) {
+    case Types::ValueOperatorGreater:
+    case Types::ValueOperatorGreaterOrEqual:
+        return value - hysteresis;
+    case Types::ValueOperatorLess:
+    case Types::ValueOperatorLessOrEqual:
+        return value + hysteresis;
+    default:
+        return threshold;
+    }
+}
+
+void TriggerFilters::onTimeout()
+{
+    qint64 now = m_clock.elapsed();
+    QList<RuleId> dueRules;
+    while (!m_deadlines.isEmpty() && m_deadlines.firstKey() <= now) {
+        RuleId ruleId = m_deadlines.take(m_deadlines.firstKey());
+        if (!dueRules.contains(ruleId)) {
+            dueRules.append(ruleId);
+        }
+    }
+
+    if (!m_deadlines.isEmpty()) {
+        m_timer->start(static_cast<int>(m_deadlines.firstKey() - now));
+    }
+
+    if (!dueRules.isEmpty()) {
+        emit rulesDue(dueRules);
+    }
+}
+
+void TriggerFilters::schedule(const RuleId &ruleId, qint64 deadline)
+{
+    // One entry per rule is enough, everything which isn't due yet is scheduled again when it fires
+    QMultiMap<qint64, RuleId>::iterator it = m_deadlines.begin();
+    while (it != m_deadlines.end() && it.key() <= deadline) {
+        if (it.value() == ruleId) {
+            return;
+        }
+        ++it;
+    }
+    while (it != m_deadlines.end()) {
+        if (it.value() == ruleId) {
+            it = m_deadlines.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    m_deadlines.insert(deadline, ruleId);
+
+    qint64 now = m_clock.elapsed();
+    m_timer->start(static_cast<int>(qMax<qint64>(0, m_deadlines.firstKey() - now)));
+}
+
+}
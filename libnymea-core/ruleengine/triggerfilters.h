@@ -0,0 +1,100 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* Copyright 2013 - 2020, nymea GmbH
+* Contact: contact@nymea.io
+*
+* This file is part of nymea.
+* This project including source code and documentation is protected by
+* copyright law, and remains the property of nymea GmbH. All rights, including
+* reproduction, publication, editing and translation, are reserved. The use of
+* this project is subject to the terms of a license agreement to be concluded
+* with nymea GmbH in accordance with the terms of use of nymea GmbH, available
+* under https://nymea.io/license
+*
+* GNU General Public License Usage
+* Alternatively, this project may be redistributed and/or modified under the
+* terms of the GNU General Public License as published by the Free Software
+* Foundation, GNU version 3. This project is distributed in the hope that it
+* will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+* of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+* Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with
+* this project. If not, see <https://www.gnu.org/licenses/>.
+*
+* For any further details and any questions please contact us under
+* contact@nymea.io or see our FAQ/Licensing Information on
+* https://nymea.io/license/faq
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef TRIGGERFILTERS_H
+#define TRIGGERFILTERS_H
+
+#include "typeutils.h"
+#include "types/event.h"
+#include "types/triggerfilter.h"
+
+#include <QObject>
+#include <QHash>
+#include <QMultiMap>
+#include <QElapsedTimer>
+
+class QTimer;
+
+namespace nymeaserver {
+
+class TriggerFilters : public QObject
+{
+    Q_OBJECT
+public:
+    explicit TriggerFilters(QObject *parent = nullptr);
+
+    bool filterEvent(const RuleId &ruleId, int index, const TriggerFilter &filter, const Event &event);
+    bool cancelEvent(const RuleId &ruleId, int index, const Event &event);
+    bool eventArmed(const RuleId &ruleId, int index) const;
+    void setEventArmed(const RuleId &ruleId, int index, bool armed);
+    QList<Event> takeDueEvents(const RuleId &ruleId);
+
+    bool stateMatching(const RuleId &ruleId, int index) const;
+    bool filterState(const RuleId &ruleId, int index, const TriggerFilter &filter, bool matching);
+
+    void clear(const RuleId &ruleId);
+
+    static QVariant relaxedThreshold(const QVariant &threshold, Types::ValueOperator operatorType, double hysteresis);
+
+signals:
+    void rulesDue(const QList<RuleId> &ruleIds);
+
+private slots:
+    void onTimeout();
+
+private:
+    struct EventFilterState {
+        bool armed = true;
+        bool pending = false;
+        qint64 lastTrigger = -1;
+        qint64 deadline = 0;
+        Event pendingEvent;
+    };
+
+    struct StateFilterState {
+        bool matching = false;
+        bool pending = false;
+        qint64 pendingSince = 0;
+        qint64 lastChange = -1;
+    };
+
+    void schedule(const RuleId &ruleId, qint64 deadline);
+
+    QHash<RuleId, QHash<int, EventFilterState> > m_eventStates;
+    QHash<RuleId, QHash<int, StateFilterState> > m_stateStates;
+    QMultiMap<qint64, RuleId> m_deadlines;
+
+    QTimer *m_timer = nullptr;
+    QElapsedTimer m_clock;
+};
+
+}
+
+#endif // TRIGGERFILTERS_H
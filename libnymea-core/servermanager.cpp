@@ -49,6 +49,7 @@
 #include "platform/platform.h"
 #include "platform/platformzeroconfcontroller.h"
 #include "version.h"
+#include "startuptracer.h"
 
 #include "jsonrpc/jsonrpcserverimplementation.h"
 #include "servers/mocktcpserver.h"
@@ -57,6 +58,8 @@
 #include "servers/webserver.h"
 #include "servers/bluetoothserver.h"
 #include "servers/mqttbroker.h"
+#include "servers/iothreadpool.h"
+#include "servers/tlssessioncache.h"
 
 #include "network/zeroconf/zeroconfservicepublisher.h"
 
@@ -92,6 +95,7 @@ ServerManager::ServerManager(Platform *platform, NymeaConfiguration *configurati
             qCWarning(dcServerManager()) << "Using fallback self-signed SSL certificate:" << fallbackCertificateFileName;
         } else {
             qCDebug(dcServerManager()) << "Generating self signed certificates...";
+            StartupTraceScope trace("Generate SSL certificate", "core");
             CertificateGenerator::generate(fallbackCertificateFileName, fallbackKeyFileName);
             if (loadCertificate(fallbackKeyFileName, fallbackCertificateFileName)) {
                 qCWarning(dcServerManager()) << "Using newly created self-signed SSL certificate:" << fallbackCertificateFileName;
@@ -108,15 +112,29 @@ ServerManager::ServerManager(Platform *platform, NymeaConfiguration *configurati
         }
     }
 
+    TlsSessionCache::Settings tlsSessionSettings;
+    tlsSessionSettings.cacheSize = configuration->tlsSessionCacheSize();
+    tlsSessionSettings.lifetime = configuration->tlsSessionLifetime();
+    tlsSessionSettings.sessionTickets = configuration->tlsSessionTickets();
+    m_tlsSessionCache = new TlsSessionCache(tlsSessionSettings, this);
+    m_sslConfiguration = m_tlsSessionCache->serverConfiguration(m_sslConfiguration);
+
     // Interfaces
-    m_jsonServer = new JsonRPCServerImplementation(m_sslConfiguration, this);
+    {
+        StartupTraceScope trace("Create JSON-RPC server", "core");
+        m_jsonServer = new JsonRPCServerImplementation(m_sslConfiguration, this);
+    }
 
     // Transports
+    m_ioThreadPool = new IOThreadPool(configuration->ioThreadCount(), this);
+
     MockTcpServer *tcpServer = new MockTcpServer(this);
     m_jsonServer->registerTransportInterface(tcpServer, true);
     tcpServer->startServer();
     foreach (const ServerConfiguration &config, configuration->tcpServerConfigurations()) {
-        TcpServer *tcpServer = new TcpServer(config, m_sslConfiguration, this);
+        TcpServer *tcpServer = new TcpServer(config, m_sslConfiguration, m_ioThreadPool, this);
+        tcpServer->setSendQueueLimits(sendQueueLimits(configuration));
+        tcpServer->setTlsSessionCache(m_tlsSessionCache);
         m_jsonServer->registerTransportInterface(tcpServer, config.authenticationEnabled);
         m_tcpServers.insert(config.id, tcpServer);
         if (tcpServer->startServer()) {
@@ -125,7 +143,9 @@ ServerManager::ServerManager(Platform *platform, NymeaConfiguration *configurati
     }
 
     foreach (const ServerConfiguration &config, configuration->webSocketServerConfigurations()) {
-        WebSocketServer *webSocketServer = new WebSocketServer(config, m_sslConfiguration, this);
+        WebSocketServer *webSocketServer = new WebSocketServer(config, m_sslConfiguration, m_ioThreadPool, this);
+        webSocketServer->setSendQueueLimits(sendQueueLimits(configuration));
+        webSocketServer->setTlsSessionCache(m_tlsSessionCache);
         m_jsonServer->registerTransportInterface(webSocketServer, config.authenticationEnabled);
         m_webSocketServers.insert(config.id, webSocketServer);
         if (webSocketServer->startServer()) {
@@ -139,12 +159,12 @@ ServerManager::ServerManager(Platform *platform, NymeaConfiguration *configurati
         m_bluetoothServer->startServer();
     }
 
+    m_httpRequestLimits.maxRequestLineSize = configuration->httpMaxRequestLineSize();
+    m_httpRequestLimits.maxHeaderSize = configuration->httpMaxHeaderSize();
+    m_httpRequestLimits.maxHeaderCount = configuration->httpMaxHeaderCount();
+    m_httpRequestLimits.maxBodySize = configuration->httpMaxBodySize();
     foreach (const WebServerConfiguration &config, configuration->webServerConfigurations()) {
-        WebServer *webServer = new WebServer(config, m_sslConfiguration, this);
-        m_webServers.insert(config.id, webServer);
-        if (webServer->startServer()) {
-            registerZeroConfService(config, "http", "_http._tcp");
-        }
+        startWebServer(config);
     }
 
     m_mqttBroker = new MqttBroker(this);
@@ -167,6 +187,21 @@ ServerManager::ServerManager(Platform *platform, NymeaConfiguration *configurati
     connect(configuration, &NymeaConfiguration::mqttPolicyRemoved, this, &ServerManager::mqttPolicyRemoved);
 }
 
+/*! Destroys the \l{ServerManager}. The transports are shut down before the I/O threads serving their sockets. */
+ServerManager::~ServerManager()
+{
+    qDeleteAll(m_tcpServers);
+    m_tcpServers.clear();
+    qDeleteAll(m_webSocketServers);
+    m_webSocketServers.clear();
+    foreach (WebServer *webServer, m_webServers) {
+        // Deleted by its I/O thread once that finishes
+        QMetaObject::invokeMethod(webServer, "stopServer", IOThreadPool::blockingConnectionType(webServer));
+        webServer->deleteLater();
+    }
+    m_webServers.clear();
+}
+
 /*! Returns the pointer to the created \l{JsonRPCServer} in this \l{ServerManager}. */
 JsonRPCServerImplementation *ServerManager::jsonServer() const
 {
@@ -190,6 +225,27 @@ MqttBroker *ServerManager::mqttBroker() const
     return m_mqttBroker;
 }
 
+/*! Returns the state of the outgoing data queues of all clients connected to the JSON-RPC servers. */
+QVariantMap ServerManager::clientStatistics() const
+{
+    QVariantMap statistics;
+    foreach (const QString &id, m_tcpServers.keys()) {
+        statistics.insert("tcp:" + id, m_tcpServers.value(id)->clientStatistics());
+    }
+    foreach (const QString &id, m_webSocketServers.keys()) {
+        statistics.insert("ws:" + id, m_webSocketServers.value(id)->clientStatistics());
+    }
+    statistics.insert("ioThreads", m_ioThreadPool->statistics());
+    statistics.insert("tls", m_tlsSessionCache->statistics());
+    return statistics;
+}
+
+/*! Returns the pool of threads serving the sockets of the JSON-RPC transports. */
+IOThreadPool *ServerManager::ioThreadPool() const
+{
+    return m_ioThreadPool;
+}
+
 void ServerManager::tcpServerConfigurationChanged(const QString &id)
 {
     ServerConfiguration config = NymeaCore::instance()->configuration()->tcpServerConfigurations().value(id);
@@ -201,7 +257,9 @@ void ServerManager::tcpServerConfigurationChanged(const QString &id)
         server->setConfiguration(config);
     } else {
         qDebug(dcServerManager()) << "Received a TCP Server config change event but don't have a TCP Server instance for it. Creating new Server instance.";
-        server = new TcpServer(config, m_sslConfiguration, this);
+        server = new TcpServer(config, m_sslConfiguration, m_ioThreadPool, this);
+        server->setSendQueueLimits(sendQueueLimits(NymeaCore::instance()->configuration()));
+        server->setTlsSessionCache(m_tlsSessionCache);
         m_tcpServers.insert(config.id, server);
     }
     m_jsonServer->registerTransportInterface(server, config.authenticationEnabled);
@@ -234,7 +292,9 @@ void ServerManager::webSocketServerConfigurationChanged(const QString &id)
         server->setConfiguration(config);
     } else {
         qDebug(dcServerManager()) << "Received a WebSocket Server config change event but don't have a WebSocket Server instance for it. Creating new instance.";
-        server = new WebSocketServer(config, m_sslConfiguration, this);
+        server = new WebSocketServer(config, m_sslConfiguration, m_ioThreadPool, this);
+        server->setSendQueueLimits(sendQueueLimits(NymeaCore::instance()->configuration()));
+        server->setTlsSessionCache(m_tlsSessionCache);
         m_webSocketServers.insert(server->configuration().id, server);
     }
     m_jsonServer->registerTransportInterface(server, config.authenticationEnabled);
@@ -259,20 +319,13 @@ void ServerManager::webSocketServerConfigurationRemoved(const QString &id)
 void ServerManager::webServerConfigurationChanged(const QString &id)
 {
     WebServerConfiguration config = NymeaCore::instance()->configuration()->webServerConfigurations().value(id);
-    WebServer *server = m_webServers.value(id);
-    if (server) {
+    if (m_webServers.contains(id)) {
         qDebug(dcServerManager()) << "Restarting Web server for" << config.address << config.port << "SSL" << (config.sslEnabled ? "enabled" : "disabled") << "Authentication" << (config.authenticationEnabled ? "enabled" : "disabled");
-        unregisterZeroConfService(id, "http");
-        server->stopServer();
-        server->reconfigureServer(config);
+        stopWebServer(id);
     } else {
         qDebug(dcServerManager()) << "Received a Web Server config change event but don't have a Web Server instance for it. Creating new WebServer instance on" << config.address.toString() << config.port << "(SSL:" << config.sslEnabled << ")";
-        server = new WebServer(config, m_sslConfiguration, this);
-        m_webServers.insert(config.id, server);
-    }
-    if (server->startServer()) {
-        registerZeroConfService(config, "http", "_http._tcp");
     }
+    startWebServer(config);
 }
 
 void ServerManager::webServerConfigurationRemoved(const QString &id)
@@ -281,10 +334,7 @@ void ServerManager::webServerConfigurationRemoved(const QString &id)
         qWarning(dcServerManager()) << "Received a Web Server config removed event but don't have a Web Server instance for it.";
         return;
     }
-    WebServer *server = m_webServers.take(id);
-    unregisterZeroConfService(id, "http");
-    server->stopServer();
-    server->deleteLater();
+    stopWebServer(id);
 }
 
 void ServerManager::mqttServerConfigurationChanged(const QString &id)
@@ -315,6 +365,39 @@ void ServerManager::mqttPolicyRemoved(const QString &clientId)
     m_mqttBroker->removePolicy(clientId);
 }
 
+SendQueue::Limits ServerManager::sendQueueLimits(NymeaConfiguration *configuration) const
+{
+    SendQueue::Limits limits;
+    limits.highWatermark = configuration->sendQueueHighWatermark();
+    limits.lowWatermark = qMin(configuration->sendQueueLowWatermark(), limits.highWatermark);
+    limits.overflowPolicy = configuration->sendQueueDisconnectOnOverflow() ? SendQueue::OverflowPolicyDisconnect : SendQueue::OverflowPolicyDropNotifications;
+    return limits;
+}
+
+void ServerManager::startWebServer(const WebServerConfiguration &config)
+{
+    // The web server is served by an I/O thread, it only calls back into the core for the debug interface
+    WebServer *webServer = new WebServer(config, m_sslConfiguration);
+    webServer->setRequestLimits(m_httpRequestLimits);
+    webServer->setTlsSessionCache(m_tlsSessionCache);
+    m_ioThreadPool->assignThread(webServer);
+    m_webServers.insert(config.id, webServer);
+
+    bool listening = false;
+    QMetaObject::invokeMethod(webServer, "startServer", IOThreadPool::blockingConnectionType(webServer), Q_RETURN_ARG(bool, listening));
+    if (listening) {
+        registerZeroConfService(config, "http", "_http._tcp");
+    }
+}
+
+void ServerManager::stopWebServer(const QString &id)
+{
+    WebServer *webServer = m_webServers.take(id);
+    unregisterZeroConfService(id, "http");
+    QMetaObject::invokeMethod(webServer, "stopServer", IOThreadPool::blockingConnectionType(webServer));
+    webServer->deleteLater();
+}
+
 bool ServerManager::registerZeroConfService(const ServerConfiguration &configuration, const QString &serverType, const QString &serviceType)
 {
     // Note: reversed order
@@ -374,7 +457,7 @@ void ServerManager::setServerName(const QString &serverName)
 
     foreach (WebServer *webServer, m_webServers.values()) {
         unregisterZeroConfService(webServer->configuration().id, "http");
-        webServer->setServerName(serverName);
+        QMetaObject::invokeMethod(webServer, "setServerName", Qt::QueuedConnection, Q_ARG(QString, serverName));
         registerZeroConfService(webServer->configuration(), "http", "_http._tcp");
     }
 
@@ -35,6 +35,8 @@
 
 #include "loggingcategories.h"
 #include "nymeaconfiguration.h"
+#include "servers/sendqueue.h"
+#include "servers/httprequestparser.h"
 
 #include <QSslConfiguration>
 #include <QSslKey>
@@ -50,6 +52,8 @@ class WebSocketServer;
 class WebServer;
 class BluetoothServer;
 class MqttBroker;
+class IOThreadPool;
+class TlsSessionCache;
 
 class MockTcpServer;
 
@@ -58,6 +62,7 @@ class ServerManager : public QObject
     Q_OBJECT
 public:
     explicit ServerManager(Platform *platform, NymeaConfiguration *configuration, QObject *parent = nullptr);
+    ~ServerManager() override;
 
     // Interfaces
     JsonRPCServerImplementation *jsonServer() const;
@@ -68,6 +73,9 @@ public:
 
     MqttBroker *mqttBroker() const;
 
+    QVariantMap clientStatistics() const;
+    IOThreadPool *ioThreadPool() const;
+
 private slots:
     void tcpServerConfigurationChanged(const QString &id);
     void tcpServerConfigurationRemoved(const QString &id);
@@ -81,6 +89,9 @@ private slots:
     void mqttPolicyRemoved(const QString &clientId);
 
 private:
+    SendQueue::Limits sendQueueLimits(NymeaConfiguration *configuration) const;
+    void startWebServer(const WebServerConfiguration &config);
+    void stopWebServer(const QString &id);
     bool registerZeroConfService(const ServerConfiguration &configuration, const QString &serverType, const QString &serviceType);
     void unregisterZeroConfService(const QString &configId, const QString &serverType);
 
@@ -95,6 +106,9 @@ private:
     QHash<QString, WebSocketServer*> m_webSocketServers;
     QHash<QString, WebServer*> m_webServers;
     MockTcpServer *m_mockTcpServer;
+    IOThreadPool *m_ioThreadPool = nullptr;
+    TlsSessionCache *m_tlsSessionCache = nullptr;
+    HttpRequestParser::Limits m_httpRequestLimits;
 
     MqttBroker *m_mqttBroker;
 
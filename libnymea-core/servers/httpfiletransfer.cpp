@@ -0,0 +1,228 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* Copyright 2013 - 2020, nymea GmbH
+* Contact: contact@nymea.io
+*
+* This file is part of nymea.
+* This project including source code and documentation is protected by
+* copyright law, and remains the property of nymea GmbH. All rights, including
+* reproduction, publication, editing and translation, are reserved. The use of
+* this project is subject to the terms of a license agreement to be concluded
+* with nymea GmbH in accordance with the terms of use of nymea GmbH, available
+* under https://nymea.io/license
+*
+* GNU General Public License Usage
+* Alternatively, this project may be redistributed and/or modified under the
+* terms of the GNU General Public License as published by the Free Software
+* Foundation, GNU version 3. This project is distributed in the hope that it
+* will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+* of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+* Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with
+* this project. If not, see <https://www.gnu.org/licenses/>.
+*
+* For any further details and any questions please contact us under
+* contact@nymea.io or see our FAQ/Licensing Information on
+* https://nymea.io/license/faq
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+/*!
+    \class nymeaserver::HttpFileTransfer
+    \brief Streams a file as body of a HTTP reply to a client connection of the \l{WebServer}.
+
+    \ingroup server
+    \inmodule core
+
+    Files like the log database can be hundreds of megabytes big. Instead of loading them into memory,
+    the transfer hands them to the socket in chunks and only continues once the socket has written most
+    of the pending data, so the memory used per download stays in the range of a few chunks and the
+    event loop is never blocked for long.
+
+    On Linux, plain TCP connections use sendfile(2), which copies the file to the socket within the
+    kernel. Whenever the kernel send buffer is full, one chunk is written through the socket instead,
+    which makes Qt notify the transfer once the connection is writable again. Encrypted connections
+    always read the file in chunks, since the data has to be encrypted by the socket.
+
+    \sa HttpReply::setFileBody()
+*/
+
+/*! \fn void nymeaserver::HttpFileTransfer::dataSent(qint64 bytes);
+    This signal is emitted whenever \a bytes of the file have been handed to the socket.
+*/
+
+/*! \fn void nymeaserver::HttpFileTransfer::finished(bool success);
+    This signal is emitted once the whole range of the file has been handed to the socket or the
+    transfer failed. If \a success is false, the client did not receive the announced amount of data
+    and the connection must be closed.
+*/
+
+#include "httpfiletransfer.h"
+#include "loggingcategories.h"
+
+#ifdef Q_OS_LINUX
+#include <sys/sendfile.h>
+#include <errno.h>
+#include <string.h>
+#endif
+
+namespace nymeaserver {
+
+const qint64 HttpFileTransfer::chunkSize;
+
+/*! Constructs a HttpFileTransfer sending \a length bytes of the file \a fileName, starting at \a offset, to the given \a socket. */
+HttpFileTransfer::HttpFileTransfer(QSslSocket *socket, const QString &fileName, qint64 offset, qint64 length, QObject *parent) :
+    QObject(parent),
+    m_socket(socket),
+    m_file(fileName),
+    m_position(offset),
+    m_remaining(length),
+    m_length(length)
+{
+    connect(m_socket, &QSslSocket::bytesWritten, this, &HttpFileTransfer::sendNextChunks);
+    connect(m_socket, &QSslSocket::encryptedBytesWritten, this, &HttpFileTransfer::sendNextChunks);
+}
+
+/*! Returns the socket this transfer writes to. */
+QSslSocket *HttpFileTransfer::socket() const
+{
+    return m_socket;
+}
+
+/*! Returns the name of the transferred file. */
+QString HttpFileTransfer::fileName() const
+{
+    return m_file.fileName();
+}
+
+/*! Returns the number of bytes handed to the socket so far. */
+qint64 HttpFileTransfer::bytesSent() const
+{
+    return m_length - m_remaining;
+}
+
+/*! Returns the number of bytes this transfer sends in total. */
+qint64 HttpFileTransfer::length() const
+{
+    return m_length;
+}
+
+/*! Opens the file for reading. Returns false if the file can not be read, in which case the transfer can not be started. */
+bool HttpFileTransfer::open()
+{
+    if (!m_file.open(QFile::ReadOnly)) {
+        qCWarning(dcWebServer()) << "Could not open" << m_file.fileName() << "for sending:" << m_file.errorString();
+        return false;
+    }
+
+#ifdef Q_OS_LINUX
+    m_sendFile = !m_socket->isEncrypted() && m_socket->mode() == QSslSocket::UnencryptedMode;
+#endif
+    return true;
+}
+
+/*! Starts sending the file. The file must have been opened with \l{open()} before. */
+void HttpFileTransfer::start()
+{
+    qCDebug(dcWebServer()) << "Start sending" << m_length << "bytes of" << m_file.fileName() << "from position" << m_position << (m_sendFile ? "using sendfile" : "");
+    sendNextChunks();
+}
+
+qint64 HttpFileTransfer::pendingBytes() const
+{
+    return m_socket->bytesToWrite() + m_socket->encryptedBytesToWrite();
+}
+
+qint64 HttpFileTransfer::sendFileChunk(qint64 maxSize)
+{
+#ifdef Q_OS_LINUX
+    forever {
+        off_t offset = m_position;
+        ssize_t sent = ::sendfile(static_cast<int>(m_socket->socketDescriptor()), m_file.handle(), &offset, static_cast<size_t>(maxSize));
+        if (sent >= 0) {
+            return sent;
+        }
+
+        if (errno == EINTR) {
+            continue;
+        }
+
+        if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            qCWarning(dcWebServer()) << "Could not use sendfile for" << m_file.fileName() << strerror(errno) << "Falling back to buffered writes.";
+            m_sendFile = false;
+        }
+        return 0;
+    }
+#else
+    Q_UNUSED(maxSize)
+    return 0;
+#endif
+}
+
+void HttpFileTransfer::finish(bool success)
+{
+    if (m_finished)
+        return;
+
+    m_finished = true;
+    m_file.close();
+    emit finished(success);
+}
+
+void HttpFileTransfer::sendNextChunks()
+{
+    if (m_finished || !m_file.isOpen())
+        return;
+
+    while (m_remaining > 0 && pendingBytes() < chunkSize) {
+        if (m_socket->state() != QAbstractSocket::ConnectedState) {
+            finish(false);
+            return;
+        }
+
+        qint64 chunk = qMin(m_remaining, chunkSize);
+        qint64 sent = 0;
+
+        // sendfile bypasses the write buffer of the socket, make sure everything in there went out before
+        if (m_sendFile && pendingBytes() == 0) {
+            sent = sendFileChunk(chunk);
+            if (sent > 0) {
+                m_position += sent;
+                m_remaining -= sent;
+                emit dataSent(sent);
+                continue;
+            }
+        }
+
+        // The kernel buffer is full or the data needs to be encrypted. Write one chunk through
+        // the socket, Qt will let us know once the connection is able to take more data.
+        if (!m_file.seek(m_position)) {
+            qCWarning(dcWebServer()) << "Could not seek to position" << m_position << "in" << m_file.fileName();
+            finish(false);
+            return;
+        }
+
+        QByteArray data = m_file.read(chunk);
+        if (data.isEmpty()) {
+            qCWarning(dcWebServer()) << "Could not read from" << m_file.fileName() << "at position" << m_position << "The file might have been truncated.";
+            finish(false);
+            return;
+        }
+
+        if (m_socket->write(data) != data.size()) {
+            finish(false);
+            return;
+        }
+
+        m_position += data.size();
+        m_remaining -= data.size();
+        emit dataSent(data.size());
+    }
+
+    if (m_remaining == 0) {
+        qCDebug(dcWebServer()) << "Finished sending" << m_file.fileName();
+        finish(true);
+    }
+}
+
+}
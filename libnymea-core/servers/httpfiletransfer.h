@@ -0,0 +1,79 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* Copyright 2013 - 2020, nymea GmbH
+* Contact: contact@nymea.io
+*
+* This file is part of nymea.
+* This project including source code and documentation is protected by
+* copyright law, and remains the property of nymea GmbH. All rights, including
+* reproduction, publication, editing and translation, are reserved. The use of
+* this project is subject to the terms of a license agreement to be concluded
+* with nymea GmbH in accordance with the terms of use of nymea GmbH, available
+* under https://nymea.io/license
+*
+* GNU General Public License Usage
+* Alternatively, this project may be redistributed and/or modified under the
+* terms of the GNU General Public License as published by the Free Software
+* Foundation, GNU version 3. This project is distributed in the hope that it
+* will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+* of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+* Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with
+* this project. If not, see <https://www.gnu.org/licenses/>.
+*
+* For any further details and any questions please contact us under
+* contact@nymea.io or see our FAQ/Licensing Information on
+* https://nymea.io/license/faq
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#ifndef HTTPFILETRANSFER_H
+#define HTTPFILETRANSFER_H
+
+#include <QObject>
+#include <QFile>
+#include <QSslSocket>
+
+namespace nymeaserver {
+
+class HttpFileTransfer : public QObject
+{
+    Q_OBJECT
+public:
+    explicit HttpFileTransfer(QSslSocket *socket, const QString &fileName, qint64 offset, qint64 length, QObject *parent = nullptr);
+
+    QSslSocket *socket() const;
+    QString fileName() const;
+
+    qint64 bytesSent() const;
+    qint64 length() const;
+
+    bool open();
+    void start();
+
+signals:
+    void dataSent(qint64 bytes);
+    void finished(bool success);
+
+private:
+    static const qint64 chunkSize = 64 * 1024;
+
+    QSslSocket *m_socket = nullptr;
+    QFile m_file;
+    qint64 m_position = 0;
+    qint64 m_remaining = 0;
+    qint64 m_length = 0;
+    bool m_sendFile = false;
+    bool m_finished = false;
+
+    qint64 pendingBytes() const;
+    qint64 sendFileChunk(qint64 maxSize);
+    void finish(bool success);
+
+private slots:
+    void sendNextChunks();
+};
+
+}
+
+#endif // HTTPFILETRANSFER_H
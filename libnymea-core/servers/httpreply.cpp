@@ -55,8 +55,12 @@
         The resource was accepted.
     \value NoContent
         The request has no content but it was expected.
+    \value PartialContent
+        The reply contains only the requested range of the resource.
     \value Found
         The resource was found.
+    \value NotModified
+        The resource has not been modified since the version cached by the client.
     \value PermanentRedirect
         The resource redirects permanent to given url.
     \value BadRequest
@@ -71,6 +75,14 @@
         The request method timed out. Default timeout = 5s.
     \value Conflict
         The request resource conflicts with an other.
+    \value PayloadTooLarge
+        The body of the request exceeds the allowed size.
+    \value UriTooLong
+        The request line exceeds the allowed size.
+    \value RangeNotSatisfiable
+        The requested range lies outside of the resource.
+    \value RequestHeaderFieldsTooLarge
+        The header of the request exceeds the allowed size or number of fields.
     \value InternalServerError
         There was an internal server error.
     \value NotImplemented
@@ -147,6 +159,8 @@
 #include "version.h"
 
 #include <QDateTime>
+#include <QFileInfo>
+#include <QLocale>
 #include <QPair>
 #include <QDebug>
 
@@ -168,12 +182,11 @@ HttpReply::HttpReply(QObject *parent) :
     // set known headers
     setHeader(HttpReply::ContentTypeHeader, "text/plain; charset=\"utf-8\";");
     setHeader(HttpHeaderType::ServerHeader, "nymea/" + QByteArray(NYMEA_VERSION_STRING));
-    setHeader(HttpHeaderType::DateHeader, NymeaCore::instance()->timeManager()->currentDateTime().toString("ddd, dd MMM yyyy hh:mm:ss").toUtf8());
+    setHeader(HttpHeaderType::DateHeader, currentHttpDate());
     setHeader(HttpHeaderType::CacheControlHeader, "no-cache");
     setHeader(HttpHeaderType::ConnectionHeader, "Keep-Alive");
     setRawHeader("Access-Control-Allow-Origin","*");
     setRawHeader("Keep-Alive", QString("timeout=%1, max=50").arg(m_timeout).toUtf8());
-    packReply();
 }
 
 HttpReply::HttpReply(const HttpReply::HttpStatusCode &statusCode, const HttpReply::Type &type, QObject *parent):
@@ -191,12 +204,11 @@ HttpReply::HttpReply(const HttpReply::HttpStatusCode &statusCode, const HttpRepl
     // set known / default headers
     setHeader(HttpReply::ContentTypeHeader, "text/plain; charset=\"utf-8\";");
     setHeader(HttpHeaderType::ServerHeader, "nymea/" + QByteArray(NYMEA_VERSION_STRING));
-    setHeader(HttpHeaderType::DateHeader, NymeaCore::instance()->timeManager()->currentDateTime().toString("ddd, dd MMM yyyy hh:mm:ss").toUtf8());
+    setHeader(HttpHeaderType::DateHeader, currentHttpDate());
     setHeader(HttpHeaderType::CacheControlHeader, "no-cache");
     setHeader(HttpHeaderType::ConnectionHeader, "Keep-Alive");
     setRawHeader("Access-Control-Allow-Origin","*");
     setRawHeader("Keep-Alive", QString("timeout=%1, max=50").arg(m_timeout).toUtf8());
-    packReply();
 }
 
 HttpReply *HttpReply::createSuccessReply()
@@ -224,7 +236,6 @@ void HttpReply::setHttpStatusCode(const HttpReply::HttpStatusCode &statusCode)
 {
     m_statusCode = statusCode;
     m_reasonPhrase = getHttpReasonPhrase(m_statusCode);
-    packReply();
 }
 
 /*! Returns the status code of this \l{HttpReply}.*/
@@ -251,7 +262,6 @@ HttpReply::Type HttpReply::type() const
 void HttpReply::setClientId(const QUuid &clientId)
 {
     m_clientId = clientId;
-    packReply();
 }
 
 /*! Returns the clientId of this \l{HttpReply}.*/
@@ -263,9 +273,9 @@ QUuid HttpReply::clientId() const
 /*! Set the payload of this \l{HttpReply} to the given \a data.*/
 void HttpReply::setPayload(const QByteArray &data)
 {
+    m_fileName.clear();
     m_payload = data;
     setHeader(HttpHeaderType::ContentLenghtHeader, QByteArray::number(data.length()));
-    packReply();
 }
 
 /*! Returns the payload of this \l{HttpReply}.*/
@@ -274,6 +284,51 @@ QByteArray HttpReply::payload() const
     return m_payload;
 }
 
+/*! Sets the body of this \l{HttpReply} to \a length bytes of the file with the given \a fileName, starting at \a offset.
+    If \a length is negative, the file is sent until its end. The file is not loaded into memory, the \l{WebServer}
+    streams it to the client once the header has been sent. Setting a payload afterwards replaces the file body.
+
+    \sa setPayload(), hasFileBody()
+*/
+void HttpReply::setFileBody(const QString &fileName, qint64 offset, qint64 length)
+{
+    if (length < 0) {
+        length = qMax(QFileInfo(fileName).size() - offset, Q_INT64_C(0));
+    }
+
+    m_payload.clear();
+    m_fileName = fileName;
+    m_fileOffset = offset;
+    m_fileLength = length;
+    setHeader(HttpHeaderType::ContentLenghtHeader, QByteArray::number(length));
+}
+
+/*! Returns true if the body of this \l{HttpReply} will be streamed from a file.
+    \sa setFileBody()
+*/
+bool HttpReply::hasFileBody() const
+{
+    return !m_fileName.isEmpty();
+}
+
+/*! Returns the name of the file streamed as body of this \l{HttpReply}. */
+QString HttpReply::fileName() const
+{
+    return m_fileName;
+}
+
+/*! Returns the position in the file where the body of this \l{HttpReply} starts. */
+qint64 HttpReply::fileOffset() const
+{
+    return m_fileOffset;
+}
+
+/*! Returns the number of bytes of the file sent as body of this \l{HttpReply}. */
+qint64 HttpReply::fileLength() const
+{
+    return m_fileLength;
+}
+
 /*! This method appends a raw header to the header list of this \l{HttpReply}.
     The Header will be set to \a headerType : \a value.
 */
@@ -284,7 +339,6 @@ void HttpReply::setRawHeader(const QByteArray headerType, const QByteArray &valu
         m_rawHeaderList.remove(headerType);
     }
     m_rawHeaderList.insert(headerType, value);
-    packReply();
 }
 
 /*! This method appends a known header to the header list of this \l{HttpReply}.
@@ -329,7 +383,7 @@ bool HttpReply::closeConnection() const
 /*! Returns true if the raw header and the payload of this \l{HttpReply} is empty.*/
 bool HttpReply::isEmpty() const
 {
-    return m_rawHeader.isEmpty() && m_payload.isEmpty() && m_rawHeaderList.isEmpty();
+    return m_rawHeader.isEmpty() && m_payload.isEmpty() && m_fileName.isEmpty() && m_rawHeaderList.isEmpty();
 }
 
 /*! Clears all data of this \l{HttpReply}. */
@@ -340,9 +394,12 @@ void HttpReply::clear()
     m_statusCode = Ok;
     m_rawHeader.clear();
     m_payload.clear();
+    m_fileName.clear();
     m_rawHeaderList.clear();
 }
+
 /*! Packs the whole reply data of this \l{HttpReply}. The data can be accessed with \l{HttpReply::data()}.
+    The setters don't pack the reply, this needs to be done once before sending it.
     \sa data()
 */
 void HttpReply::packReply()
@@ -389,9 +446,15 @@ QByteArray HttpReply::getHttpReasonPhrase(const HttpReply::HttpStatusCode &statu
     case NoContent:
         response = QString("No Content").toUtf8();
         break;
+    case PartialContent:
+        response = QString("Partial Content").toUtf8();
+        break;
     case Found:
         response = QString("Found").toUtf8();
         break;
+    case NotModified:
+        response = QString("Not Modified").toUtf8();
+        break;
     case PermanentRedirect:
         response = QString("Permanent Redirect").toUtf8();
         break;
@@ -413,6 +476,18 @@ QByteArray HttpReply::getHttpReasonPhrase(const HttpReply::HttpStatusCode &statu
     case Conflict:
         response = QString("Conflict").toUtf8();
         break;
+    case PayloadTooLarge:
+        response = QString("Payload Too Large").toUtf8();
+        break;
+    case UriTooLong:
+        response = QString("URI Too Long").toUtf8();
+        break;
+    case RangeNotSatisfiable:
+        response = QString("Range Not Satisfiable").toUtf8();
+        break;
+    case RequestHeaderFieldsTooLarge:
+        response = QString("Request Header Fields Too Large").toUtf8();
+        break;
     case InternalServerError:
         response = QString("Internal Server Error").toUtf8();
         break;
@@ -472,6 +547,28 @@ QByteArray HttpReply::getHeaderType(const HttpReply::HttpHeaderType &headerType)
     return header;
 }
 
+/*! Returns the given \a dateTime formatted as HTTP date (RFC 7231), e.g. "Sun, 06 Nov 1994 08:49:37 GMT". */
+QByteArray HttpReply::httpDate(const QDateTime &dateTime)
+{
+    return QLocale::c().toString(dateTime.toUTC(), "ddd, dd MMM yyyy hh:mm:ss").toLatin1() + " GMT";
+}
+
+/*! Returns the current time formatted as HTTP date. The value is formatted only once per second. */
+QByteArray HttpReply::currentHttpDate()
+{
+    // Replies are created in the I/O threads of the web servers as well, each thread keeps its own cache
+    static thread_local qint64 cachedSecond = -1;
+    static thread_local QByteArray cachedDate;
+
+    QDateTime now = NymeaCore::instance()->timeManager()->currentDateTime();
+    qint64 second = now.toMSecsSinceEpoch() / 1000;
+    if (second != cachedSecond) {
+        cachedSecond = second;
+        cachedDate = httpDate(now);
+    }
+    return cachedDate;
+}
+
 /*! Starts the timer for an async \l{HttpReply}.
  *
  *  \sa finished()
@@ -492,7 +589,11 @@ QDebug operator<<(QDebug debug, HttpReply *httpReply)
 {
     debug.nospace() << "HttpReply(" << httpReply->clientId().toString() << ")" << endl;
     debug << qUtf8Printable(httpReply->rawHeader());
-    debug << qUtf8Printable(httpReply->payload());
+    if (httpReply->hasFileBody()) {
+        debug.nospace() << "<" << httpReply->fileLength() << " bytes of " << httpReply->fileName() << ">";
+    } else {
+        debug << qUtf8Printable(httpReply->payload());
+    }
     return debug.space();
 }
 
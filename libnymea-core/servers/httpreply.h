@@ -36,6 +36,7 @@
 #include <QHash>
 #include <QTimer>
 #include <QUuid>
+#include <QDateTime>
 
 // Note: RFC 7231 HTTP/1.1 Semantics and Content -> http://tools.ietf.org/html/rfc7231
 
@@ -51,7 +52,9 @@ public:
         Created                 = 201,
         Accepted                = 202,
         NoContent               = 204,
+        PartialContent          = 206,
         Found                   = 302,
+        NotModified             = 304,
         PermanentRedirect       = 308,
         BadRequest              = 400,
         Forbidden               = 403,
@@ -59,6 +62,10 @@ public:
         MethodNotAllowed        = 405,
         RequestTimeout          = 408,
         Conflict                = 409,
+        PayloadTooLarge         = 413,
+        UriTooLong              = 414,
+        RangeNotSatisfiable     = 416,
+        RequestHeaderFieldsTooLarge = 431,
         InternalServerError     = 500,
         NotImplemented          = 501,
         BadGateway              = 502,
@@ -104,6 +111,12 @@ public:
     void setPayload(const QByteArray &data);
     QByteArray payload() const;
 
+    void setFileBody(const QString &fileName, qint64 offset = 0, qint64 length = -1);
+    bool hasFileBody() const;
+    QString fileName() const;
+    qint64 fileOffset() const;
+    qint64 fileLength() const;
+
     void setRawHeader(const QByteArray headerType, const QByteArray &value);
     void setHeader(const HttpHeaderType &headerType, const QByteArray &value);
     QHash<QByteArray, QByteArray> rawHeaderList() const;
@@ -121,6 +134,9 @@ public:
 
     bool timedOut() const;
 
+    static QByteArray httpDate(const QDateTime &dateTime);
+    static QByteArray currentHttpDate();
+
 private:
     HttpStatusCode m_statusCode;
     QByteArray m_reasonPhrase;
@@ -131,6 +147,10 @@ private:
     QByteArray m_payload;
     QByteArray m_data;
 
+    QString m_fileName;
+    qint64 m_fileOffset = 0;
+    qint64 m_fileLength = 0;
+
     QHash<QByteArray, QByteArray> m_rawHeaderList;
 
     bool m_closeConnection;
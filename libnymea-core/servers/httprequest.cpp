@@ -36,6 +36,7 @@
   \inmodule core
 
   This class holds the header and the payload data of a network request from a client to the \l{WebServer}.
+  Requests are created by the \l{HttpRequestParser} of the client connection.
 
   \note RFC 7231 HTTP/1.1 Semantics and Content -> \l{http://tools.ietf.org/html/rfc7231}{http://tools.ietf.org/html/rfc7231}
 
@@ -67,30 +68,17 @@
 #include "loggingcategories.h"
 
 #include <QUrlQuery>
+#include <QLocale>
 
 namespace nymeaserver {
 
 /*! Construct an empty \l{HttpRequest}. */
 HttpRequest::HttpRequest() :
-    m_rawData(QByteArray()),
-    m_valid(false),
-    m_isComplete(false)
+    m_method(Unhandled),
+    m_valid(false)
 {
 }
 
-/*! Construct a \l{HttpRequest} with the given \a rawData. The \a rawData will be parsed in this constructor. You can check
-    if the data is valid with \l{isValid()}. You can check if the request is complete with \l{isComplete}.
-
-    \sa isValid(), isComplete()
-*/
-HttpRequest::HttpRequest(QByteArray rawData) :
-    m_rawData(rawData),
-    m_valid(false),
-    m_isComplete(false)
-{
-    validate();
-}
-
 /*! Returns the raw header of this request.*/
 QByteArray HttpRequest::rawHeader() const
 {
@@ -103,6 +91,18 @@ QHash<QByteArray, QByteArray> HttpRequest::rawHeaderList() const
     return m_rawHeaderList;
 }
 
+/*! Returns the value of the header with the given \a headerName. Header names are compared case insensitive. */
+QByteArray HttpRequest::header(const QByteArray &headerName) const
+{
+    QByteArray name = headerName.toLower();
+    foreach (const QByteArray &key, m_rawHeaderList.keys()) {
+        if (key.toLower() == name) {
+            return m_rawHeaderList.value(key);
+        }
+    }
+    return QByteArray();
+}
+
 /*! Returns the \l{RequestMethod} of this request.
 
   \sa RequestMethod
@@ -148,114 +148,20 @@ bool HttpRequest::isValid() const
     return m_valid;
 }
 
-/*! Returns true if this \l{HttpRequest} is complete. A HTTP request is complete if "Content-Length" header value matches the actual payload size. Bigger packages will be sent in multiple TCP packages. */
-bool HttpRequest::isComplete() const
-{
-    return m_isComplete;
-}
-
 /*! Returns true if this \l{HttpRequest} has a payload.*/
 bool HttpRequest::hasPayload() const
 {
     return !m_payload.isEmpty();
 }
 
-/*! Appends the given \a data to the current raw data of this \l{HttpRequest}.
- *  This method will be used if a \l{HttpRequest} is not complete yet.
- *
- *  \sa isComplete()
+/*! Parses the given HTTP date (RFC 7231), e.g. "Sun, 06 Nov 1994 08:49:37 GMT". Returns an invalid
+    QDateTime if \a httpDate is not formatted as such.
 */
-void HttpRequest::appendData(const QByteArray &data)
+QDateTime HttpRequest::parseHttpDate(const QByteArray &httpDate)
 {
-    m_rawData.append(data);
-    validate();
-}
-
-void HttpRequest::validate()
-{
-    m_isComplete = true; m_valid = false;
-
-    // Parese the HTTP request. The request is invalid, until the end of the parse process.
-    if (m_rawData.isEmpty())
-        return;
-
-    // split the data into header and payload
-    int headerEndIndex = m_rawData.indexOf("\r\n\r\n");
-    if (headerEndIndex < 0) {
-        qCWarning(dcWebServer()) << "Could not parse end of HTTP header (empty line between header and body):" << m_rawData;
-        return;
-    }
-
-    m_rawHeader = m_rawData.left(headerEndIndex);
-    m_payload = m_rawData.right(m_rawData.length() - headerEndIndex).simplified();
-
-    // parse status line
-    QStringList headerLines = QString(m_rawHeader).split(QRegExp("\r\n"));
-    QString statusLine = headerLines.takeFirst();
-    QStringList statusLineTokens = statusLine.split(QRegExp("[ \r\n][ \r\n]*"));
-    if (statusLineTokens.count() != 3) {
-        qCWarning(dcWebServer()) << "Could not parse HTTP status line:" << statusLine;
-        return;
-    }
-
-    // verify http version
-    m_httpVersion = statusLineTokens.at(2).toUtf8().simplified();
-    if (!m_httpVersion.contains("HTTP")) {
-        qCWarning(dcWebServer()) << "Unknown HTTP version:" << m_httpVersion;
-        return;
-    }
-    m_methodString = statusLineTokens.at(0).simplified();
-    m_method = getRequestMethodType(m_methodString);
-
-    m_url = QUrl("http://example.com" + statusLineTokens.at(1).simplified());
-
-    if (m_url.hasQuery())
-        m_urlQuery = QUrlQuery(m_url.query());
-
-    // verify header formating
-    foreach (const QString &line, headerLines) {
-        if (!line.contains(":")) {
-            qCWarning(dcWebServer()) << "Invalid HTTP header:" << line;
-            return;
-        }
-        int index = line.indexOf(":");
-        QByteArray key = line.left(index).toUtf8().simplified();
-        QByteArray value = line.right(line.count() - index - 1).toUtf8().simplified();
-        m_rawHeaderList.insert(key, value);
-    }
-
-    // check User-Agent
-    if (!m_rawHeaderList.contains("User-Agent"))
-        qCWarning(dcWebServer()) << "User-Agent header is missing";
-
-
-    // verify content length with actual payload
-    if (m_rawHeaderList.contains("Content-Length")) {
-        bool ok = false;
-        int contentLength = m_rawHeaderList.value("Content-Length").toInt(&ok);
-        if (!ok) {
-            qCWarning(dcWebServer()) << "Could not parse Content-Length.";
-            return;
-        }
-        // check if we have all data
-        if (m_payload.size() < contentLength) {
-            qCDebug(dcWebServer()) << "Request incomplete:";
-            qCDebug(dcWebServer()) << "   -> Content-Length:" << contentLength;
-            qCDebug(dcWebServer()) << "   -> Payload size  :" << payload().size();
-            m_isComplete = false;
-            return;
-        }
-        // check if the content length bigger than header Content-Length
-        if (m_payload.size() > contentLength) {
-            qCWarning(dcWebServer()) << "Payload size greater than header Content-Length:";
-            qCWarning(dcWebServer()) << "   -> Content-Length:" << contentLength;
-            qCWarning(dcWebServer()) << "   -> Payload size  :" << payload().size();
-            m_isComplete = true;
-            return;
-        }
-
-    }
-    m_valid = true;
+    QDateTime dateTime = QLocale::c().toDateTime(QString::fromLatin1(httpDate.trimmed()), "ddd, dd MMM yyyy hh:mm:ss 'GMT'");
+    dateTime.setTimeSpec(Qt::UTC);
+    return dateTime;
 }
 
 HttpRequest::RequestMethod HttpRequest::getRequestMethodType(const QString &methodString)
@@ -35,6 +35,7 @@
 #include <QUrlQuery>
 #include <QString>
 #include <QHash>
+#include <QDateTime>
 
 namespace nymeaserver {
 
@@ -51,10 +52,10 @@ public:
     };
 
     HttpRequest();
-    HttpRequest(QByteArray rawData);
 
     QByteArray rawHeader() const;
     QHash<QByteArray, QByteArray> rawHeaderList() const;
+    QByteArray header(const QByteArray &headerName) const;
 
     RequestMethod method() const;
     QString methodString() const;
@@ -66,13 +67,13 @@ public:
     QByteArray payload() const;
 
     bool isValid() const;
-    bool isComplete() const;
     bool hasPayload() const;
 
-    void appendData(const QByteArray &data);
+    static QDateTime parseHttpDate(const QByteArray &httpDate);
 
 private:
-    QByteArray m_rawData;
+    friend class HttpRequestParser;
+
     QByteArray m_rawHeader;
     QHash<QByteArray, QByteArray> m_rawHeaderList;
 
@@ -86,13 +87,14 @@ private:
     QByteArray m_payload;
 
     bool m_valid;
-    bool m_isComplete;
 
-    void validate();
-    RequestMethod getRequestMethodType(const QString &methodString);
+    static RequestMethod getRequestMethodType(const QString &methodString);
 };
 
 QDebug operator<< (QDebug debug, const HttpRequest &httpRequest);
 
 }
+
+Q_DECLARE_METATYPE(nymeaserver::HttpRequest)
+
 #endif // HTTPREQUEST_H
@@ -0,0 +1,478 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* Copyright 2013 - 2020, nymea GmbH
+* Contact: contact@nymea.io
+*
+* This file is part of nymea.
+* This project including source code and documentation is protected by
+* copyright law, and remains the property of nymea GmbH. All rights, including
+* reproduction, publication, editing and translation, are reserved. The use of
+* this project is subject to the terms of a license agreement to be concluded
+* with nymea GmbH in accordance with the terms of use of nymea GmbH, available
+* under https://nymea.io/license
+*
+* GNU General Public License Usage
+* Alternatively, this project may be redistributed and/or modified under the
+* terms of the GNU General Public License as published by the Free Software
+* Foundation, GNU version 3. This project is distributed in the hope that it
+* will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+* of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+* Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with
+* this project. If not, see <https://www.gnu.org/licenses/>.
+*
+* For any further details and any questions please contact us under
+* contact@nymea.io or see our FAQ/Licensing Information on
+* https://nymea.io/license/faq
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+/*!
+    \class nymeaserver::HttpRequestParser
+    \brief Incrementally parses the HTTP requests received on a connection of the \l{WebServer}.
+
+    \ingroup server
+    \inmodule core
+
+    Every connection of the \l{WebServer} owns one parser. Received data is appended to the parser with
+    \l{addData()} and \l{parse()} continues where the previous call stopped: request line, header fields
+    and the body, which is delimited either by the Content-Length header or by the chunked transfer coding
+    (RFC 7230). Data following a complete request is kept for the next one, so pipelined requests are
+    returned one after another.
+
+    The parser enforces the configured \l{Limits}. A request line, header or buffered body exceeding them
+    fails the parser with 414, 431 or 413 respectively. Once the header of a request is complete, a body
+    device can be set, in which case the body is written to the device as it arrives and neither buffered
+    nor limited in size.
+
+    After an error the parser can not be used any more, the framing of the connection is lost and the
+    connection should be closed after replying with \l{errorStatusCode()}.
+*/
+
+/*! \enum nymeaserver::HttpRequestParser::Result
+
+    \value NeedMoreData
+        The available data has been parsed, the request is not complete yet.
+    \value HeaderComplete
+        The request line and header of a request have been parsed. The \l{request()} can be inspected
+        and a body device can be set before parsing the body.
+    \value RequestComplete
+        A request has been parsed completely and can be taken with \l{takeRequest()}.
+    \value Error
+        The data is not a valid HTTP request or exceeds the limits.
+*/
+
+#include "httprequestparser.h"
+#include "loggingcategories.h"
+
+namespace nymeaserver {
+
+static bool isTokenCharacter(char character)
+{
+    if ((character >= 'a' && character <= 'z') || (character >= 'A' && character <= 'Z') || (character >= '0' && character <= '9'))
+        return true;
+
+    static const QByteArray specialCharacters("!#$%&'*+-.^_`|~");
+    return specialCharacters.contains(character);
+}
+
+static bool isToken(const QByteArray &data)
+{
+    if (data.isEmpty())
+        return false;
+
+    foreach (char character, data) {
+        if (!isTokenCharacter(character)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*! Constructs a HttpRequestParser enforcing the given \a limits. */
+HttpRequestParser::HttpRequestParser(const Limits &limits) :
+    m_limits(limits)
+{
+
+}
+
+/*! Returns the limits of this parser. */
+HttpRequestParser::Limits HttpRequestParser::limits() const
+{
+    return m_limits;
+}
+
+/*! Appends the received \a data to the buffer of this parser. */
+void HttpRequestParser::addData(const QByteArray &data)
+{
+    m_buffer.append(data);
+}
+
+/*! Returns the number of received bytes which have not been parsed yet. */
+int HttpRequestParser::bufferSize() const
+{
+    return m_buffer.size() - m_position;
+}
+
+/*! Parses the buffered data and returns how far the current request got.
+
+    \sa Result
+*/
+HttpRequestParser::Result HttpRequestParser::parse()
+{
+    if (m_state == StateError)
+        return Error;
+
+    if (m_state == StateComplete) {
+        m_request = HttpRequest();
+        m_headerSize = 0;
+        m_headerCount = 0;
+        m_bodySize = 0;
+        m_bodyDevice = nullptr;
+        m_state = StateRequestLine;
+    }
+
+    forever {
+        QByteArray line;
+        switch (m_state) {
+        case StateRequestLine: {
+            // Empty lines and white space between pipelined requests are ignored
+            while (m_position < m_buffer.size() && (m_buffer.at(m_position) == '\r' || m_buffer.at(m_position) == '\n' || m_buffer.at(m_position) == ' ' || m_buffer.at(m_position) == '\t')) {
+                m_position++;
+            }
+
+            LineStatus status = readLine(&line, m_limits.maxRequestLineSize);
+            if (status == LineTooLong)
+                return fail(HttpReply::UriTooLong, "Request line exceeds " + QString::number(m_limits.maxRequestLineSize) + " bytes");
+
+            if (status == LineIncomplete) {
+                if (!verifyPartialRequestLine())
+                    return fail(HttpReply::BadRequest, "Invalid request line " + QString::fromUtf8(m_buffer.mid(m_position, 64)));
+
+                compact();
+                return NeedMoreData;
+            }
+
+            if (!parseRequestLine(line))
+                return Error;
+
+            m_state = StateHeaders;
+            break;
+        }
+        case StateHeaders: {
+            LineStatus status = readLine(&line, m_limits.maxHeaderSize - m_headerSize);
+            if (status == LineTooLong)
+                return fail(HttpReply::RequestHeaderFieldsTooLarge, "Header exceeds " + QString::number(m_limits.maxHeaderSize) + " bytes");
+
+            if (status == LineIncomplete) {
+                compact();
+                return NeedMoreData;
+            }
+
+            m_headerSize += line.size() + 2;
+            if (line.isEmpty()) {
+                if (!processHeader())
+                    return Error;
+
+                return HeaderComplete;
+            }
+
+            if (!parseHeaderLine(line))
+                return Error;
+
+            break;
+        }
+        case StateBody:
+        case StateChunkData: {
+            if (m_remaining > 0) {
+                int available = m_buffer.size() - m_position;
+                if (available == 0) {
+                    compact();
+                    return NeedMoreData;
+                }
+
+                if (!appendBody(static_cast<int>(qMin<qint64>(available, m_remaining))))
+                    return Error;
+            }
+
+            if (m_remaining == 0) {
+                if (m_state == StateChunkData) {
+                    m_state = StateChunkDataEnd;
+                } else {
+                    m_state = StateComplete;
+                    m_request.m_valid = true;
+                    return RequestComplete;
+                }
+            }
+            break;
+        }
+        case StateChunkSize: {
+            LineStatus status = readLine(&line, m_limits.maxRequestLineSize);
+            if (status == LineTooLong)
+                return fail(HttpReply::BadRequest, "Chunk size line too long");
+
+            if (status == LineIncomplete) {
+                compact();
+                return NeedMoreData;
+            }
+
+            // Chunk extensions are ignored
+            QByteArray sizeString = line.split(';').first().trimmed();
+            bool ok = false;
+            qint64 size = sizeString.toLongLong(&ok, 16);
+            if (!ok || size < 0 || sizeString.size() > 15)
+                return fail(HttpReply::BadRequest, "Invalid chunk size " + QString::fromUtf8(sizeString));
+
+            if (size == 0) {
+                m_state = StateTrailers;
+            } else {
+                m_remaining = size;
+                m_state = StateChunkData;
+            }
+            break;
+        }
+        case StateChunkDataEnd: {
+            LineStatus status = readLine(&line, 2);
+            if (status == LineIncomplete) {
+                compact();
+                return NeedMoreData;
+            }
+
+            if (status == LineTooLong || !line.isEmpty())
+                return fail(HttpReply::BadRequest, "Chunk data exceeds the chunk size");
+
+            m_state = StateChunkSize;
+            break;
+        }
+        case StateTrailers: {
+            // Trailer fields are not used, they only count towards the header size
+            LineStatus status = readLine(&line, m_limits.maxHeaderSize - m_headerSize);
+            if (status == LineTooLong)
+                return fail(HttpReply::RequestHeaderFieldsTooLarge, "Trailer exceeds the header size limit");
+
+            if (status == LineIncomplete) {
+                compact();
+                return NeedMoreData;
+            }
+
+            m_headerSize += line.size() + 2;
+            if (line.isEmpty()) {
+                m_state = StateComplete;
+                m_request.m_valid = true;
+                return RequestComplete;
+            }
+            break;
+        }
+        case StateComplete:
+            return RequestComplete;
+        case StateError:
+            return Error;
+        }
+    }
+}
+
+/*! Returns the request currently being parsed. */
+HttpRequest HttpRequestParser::request() const
+{
+    return m_request;
+}
+
+/*! Returns the completely parsed request and starts parsing the next one with the following call of \l{parse()}. */
+HttpRequest HttpRequestParser::takeRequest()
+{
+    HttpRequest request = m_request;
+    if (m_state == StateComplete) {
+        m_request = HttpRequest();
+    }
+    return request;
+}
+
+/*! Makes the parser write the body of the current request to the given \a bodyDevice instead of the payload
+    of the request. This is only possible after \l{parse()} returned HeaderComplete. The device must stay valid
+    until the request is complete.
+*/
+void HttpRequestParser::setBodyDevice(QIODevice *bodyDevice)
+{
+    m_bodyDevice = bodyDevice;
+}
+
+/*! Returns the status code to reply with after \l{parse()} failed. */
+HttpReply::HttpStatusCode HttpRequestParser::errorStatusCode() const
+{
+    return m_errorStatusCode;
+}
+
+/*! Returns a description of the error after \l{parse()} failed. */
+QString HttpRequestParser::errorString() const
+{
+    return m_errorString;
+}
+
+HttpRequestParser::LineStatus HttpRequestParser::readLine(QByteArray *line, int maxSize)
+{
+    int end = m_buffer.indexOf('\n', m_position);
+    if (end < 0) {
+        return m_buffer.size() - m_position > maxSize ? LineTooLong : LineIncomplete;
+    }
+
+    int length = end - m_position;
+    if (length > 0 && m_buffer.at(end - 1) == '\r') {
+        length--;
+    }
+
+    if (length > maxSize)
+        return LineTooLong;
+
+    *line = m_buffer.mid(m_position, length);
+    m_position = end + 1;
+    return LineComplete;
+}
+
+void HttpRequestParser::compact()
+{
+    if (m_position == 0)
+        return;
+
+    m_buffer.remove(0, m_position);
+    m_position = 0;
+}
+
+bool HttpRequestParser::parseRequestLine(const QByteArray &line)
+{
+    QList<QByteArray> tokens = line.split(' ');
+    if (tokens.count() != 3 || !isToken(tokens.at(0)) || tokens.at(1).isEmpty()) {
+        fail(HttpReply::BadRequest, "Invalid request line " + QString::fromUtf8(line));
+        return false;
+    }
+
+    if (!tokens.at(2).startsWith("HTTP/")) {
+        fail(HttpReply::BadRequest, "Unknown HTTP version " + QString::fromUtf8(tokens.at(2)));
+        return false;
+    }
+
+    m_request.m_rawHeader = line;
+    m_request.m_methodString = QString::fromUtf8(tokens.at(0));
+    m_request.m_method = HttpRequest::getRequestMethodType(m_request.m_methodString);
+    m_request.m_httpVersion = tokens.at(2);
+    m_request.m_url = QUrl("http://example.com" + QString::fromUtf8(tokens.at(1)));
+    if (m_request.m_url.hasQuery()) {
+        m_request.m_urlQuery = QUrlQuery(m_request.m_url.query());
+    }
+    return true;
+}
+
+bool HttpRequestParser::verifyPartialRequestLine() const
+{
+    // Reject garbage early instead of waiting for a line break which might never come
+    QList<QByteArray> tokens = m_buffer.mid(m_position).split(' ');
+    if (tokens.count() > 3)
+        return false;
+
+    if (tokens.count() > 1 && !isToken(tokens.at(0)))
+        return false;
+
+    if (tokens.count() == 3) {
+        QByteArray version = tokens.at(2);
+        return version.startsWith("HTTP/") || QByteArray("HTTP/").startsWith(version);
+    }
+    return true;
+}
+
+bool HttpRequestParser::parseHeaderLine(const QByteArray &line)
+{
+    if (line.startsWith(' ') || line.startsWith('\t')) {
+        fail(HttpReply::BadRequest, "Obsolete line folding in header");
+        return false;
+    }
+
+    int index = line.indexOf(':');
+    QByteArray name = line.left(index);
+    if (index <= 0 || !isToken(name)) {
+        fail(HttpReply::BadRequest, "Invalid HTTP header " + QString::fromUtf8(line));
+        return false;
+    }
+
+    if (++m_headerCount > m_limits.maxHeaderCount) {
+        fail(HttpReply::RequestHeaderFieldsTooLarge, "More than " + QString::number(m_limits.maxHeaderCount) + " header fields");
+        return false;
+    }
+
+    QByteArray value = line.mid(index + 1).trimmed();
+    if (m_request.m_rawHeaderList.contains(name)) {
+        value = m_request.m_rawHeaderList.value(name) + ", " + value;
+    }
+    m_request.m_rawHeaderList.insert(name, value);
+    m_request.m_rawHeader.append("\r\n" + line);
+    return true;
+}
+
+bool HttpRequestParser::processHeader()
+{
+    if (m_request.header("User-Agent").isEmpty())
+        qCWarning(dcWebServer()) << "User-Agent header is missing";
+
+    QByteArray transferEncoding = m_request.header("Transfer-Encoding");
+    QByteArray contentLength = m_request.header("Content-Length");
+
+    if (!transferEncoding.isEmpty()) {
+        // Both framings at once is a classic way to smuggle requests
+        if (!contentLength.isEmpty()) {
+            fail(HttpReply::BadRequest, "Request has a Content-Length and a Transfer-Encoding header");
+            return false;
+        }
+
+        if (transferEncoding.trimmed().toLower() != "chunked") {
+            fail(HttpReply::NotImplemented, "Unsupported Transfer-Encoding " + QString::fromUtf8(transferEncoding));
+            return false;
+        }
+
+        m_state = StateChunkSize;
+        return true;
+    }
+
+    m_remaining = 0;
+    if (!contentLength.isEmpty()) {
+        bool ok = false;
+        m_remaining = contentLength.toLongLong(&ok);
+        if (!ok || m_remaining < 0) {
+            fail(HttpReply::BadRequest, "Could not parse Content-Length " + QString::fromUtf8(contentLength));
+            return false;
+        }
+    }
+
+    m_state = StateBody;
+    return true;
+}
+
+bool HttpRequestParser::appendBody(int size)
+{
+    if (m_bodyDevice) {
+        if (m_bodyDevice->write(m_buffer.constData() + m_position, size) != size) {
+            fail(HttpReply::InternalServerError, "Could not write request body: " + m_bodyDevice->errorString());
+            return false;
+        }
+    } else {
+        if (m_bodySize + size > m_limits.maxBodySize) {
+            fail(HttpReply::PayloadTooLarge, "Body exceeds " + QString::number(m_limits.maxBodySize) + " bytes");
+            return false;
+        }
+        m_request.m_payload.append(m_buffer.constData() + m_position, size);
+    }
+
+    m_position += size;
+    m_bodySize += size;
+    m_remaining -= size;
+    return true;
+}
+
+HttpRequestParser::Result HttpRequestParser::fail(HttpReply::HttpStatusCode statusCode, const QString &errorString)
+{
+    m_state = StateError;
+    m_errorStatusCode = statusCode;
+    m_errorString = errorString;
+    m_buffer.clear();
+    m_position = 0;
+    return Error;
+}
+
+}
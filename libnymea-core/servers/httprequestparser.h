@@ -0,0 +1,127 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* Copyright 2013 - 2020, nymea GmbH
+* Contact: contact@nymea.io
+*
+* This file is part of nymea.
+* This project including source code and documentation is protected by
+* copyright law, and remains the property of nymea GmbH. All rights, including
+* reproduction, publication, editing and translation, are reserved. The use of
+* this project is subject to the terms of a license agreement to be concluded
+* with nymea GmbH in accordance with the terms of use of nymea GmbH, available
+* under https://nymea.io/license
+*
+* GNU General Public License Usage
+* Alternatively, this project may be redistributed and/or modified under the
+* terms of the GNU General Public License as published by the Free Software
+* Foundation, GNU version 3. This project is distributed in the hope that it
+* will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+* of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+* Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with
+* this project. If not, see <https://www.gnu.org/licenses/>.
+*
+* For any further details and any questions please contact us under
+* contact@nymea.io or see our FAQ/Licensing Information on
+* https://nymea.io/license/faq
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#ifndef HTTPREQUESTPARSER_H
+#define HTTPREQUESTPARSER_H
+
+#include <QByteArray>
+#include <QIODevice>
+#include <QString>
+
+#include "httprequest.h"
+#include "httpreply.h"
+
+namespace nymeaserver {
+
+class HttpRequestParser
+{
+public:
+    class Limits {
+    public:
+        int maxRequestLineSize = 8 * 1024;
+        int maxHeaderSize = 16 * 1024;
+        int maxHeaderCount = 100;
+        qint64 maxBodySize = 1024 * 1024;
+    };
+
+    enum Result {
+        NeedMoreData,
+        HeaderComplete,
+        RequestComplete,
+        Error
+    };
+
+    explicit HttpRequestParser(const Limits &limits = Limits());
+
+    Limits limits() const;
+
+    void addData(const QByteArray &data);
+    int bufferSize() const;
+
+    Result parse();
+
+    HttpRequest request() const;
+    HttpRequest takeRequest();
+
+    void setBodyDevice(QIODevice *bodyDevice);
+
+    HttpReply::HttpStatusCode errorStatusCode() const;
+    QString errorString() const;
+
+private:
+    enum State {
+        StateRequestLine,
+        StateHeaders,
+        StateBody,
+        StateChunkSize,
+        StateChunkData,
+        StateChunkDataEnd,
+        StateTrailers,
+        StateComplete,
+        StateError
+    };
+
+    enum LineStatus {
+        LineComplete,
+        LineIncomplete,
+        LineTooLong
+    };
+
+    Limits m_limits;
+    State m_state = StateRequestLine;
+
+    // Received data, everything before m_position has been parsed already
+    QByteArray m_buffer;
+    int m_position = 0;
+
+    HttpRequest m_request;
+    int m_headerSize = 0;
+    int m_headerCount = 0;
+    qint64 m_remaining = 0;
+    qint64 m_bodySize = 0;
+    QIODevice *m_bodyDevice = nullptr;
+
+    HttpReply::HttpStatusCode m_errorStatusCode = HttpReply::BadRequest;
+    QString m_errorString;
+
+    LineStatus readLine(QByteArray *line, int maxSize);
+    void compact();
+
+    bool parseRequestLine(const QByteArray &line);
+    bool verifyPartialRequestLine() const;
+    bool parseHeaderLine(const QByteArray &line);
+    bool processHeader();
+    bool appendBody(int size);
+
+    Result fail(HttpReply::HttpStatusCode statusCode, const QString &errorString);
+};
+
+}
+
+#endif // HTTPREQUESTPARSER_H
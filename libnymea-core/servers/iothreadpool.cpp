@@ -0,0 +1,131 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* Copyright 2013 - 2020, nymea GmbH
+* Contact: contact@nymea.io
+*
+* This file is part of nymea.
+* This project including source code and documentation is protected by
+* copyright law, and remains the property of nymea GmbH. All rights, including
+* reproduction, publication, editing and translation, are reserved. The use of
+* this project is subject to the terms of a license agreement to be concluded
+* with nymea GmbH in accordance with the terms of use of nymea GmbH, available
+* under https://nymea.io/license
+*
+* GNU General Public License Usage
+* Alternatively, this project may be redistributed and/or modified under the
+* terms of the GNU General Public License as published by the Free Software
+* Foundation, GNU version 3. This project is distributed in the hope that it
+* will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+* of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+* Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with
+* this project. If not, see <https://www.gnu.org/licenses/>.
+*
+* For any further details and any questions please contact us under
+* contact@nymea.io or see our FAQ/Licensing Information on
+* https://nymea.io/license/faq
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+/*!
+    \class nymeaserver::IOThreadPool
+    \brief Provides the threads which perform the socket I/O of the JSON-RPC transports and the web servers.
+
+    \ingroup server
+    \inmodule core
+
+    TLS handshakes, WebSocket framing and JSON decoding would otherwise run on the main thread, next to
+    the rule engine and the plugins. A burst of reconnecting clients, each of them doing a full TLS
+    handshake, would stall event processing for seconds.
+
+    Transports move the objects owning their sockets to one of the threads of this pool and exchange
+    data with them using queued connections only. Each object is assigned to the thread which currently
+    serves the least objects. With a thread count of 0 the objects stay on the main thread.
+*/
+
+#include "iothreadpool.h"
+#include "jsonpacketreader.h"
+#include "loggingcategories.h"
+
+#include <QVariantMap>
+
+namespace nymeaserver {
+
+/*! Constructs an IOThreadPool with \a threadCount threads and the given \a parent. */
+IOThreadPool::IOThreadPool(int threadCount, QObject *parent) :
+    QObject(parent)
+{
+    qRegisterMetaType<JsonPacket>();
+
+    for (int i = 0; i < threadCount; i++) {
+        QThread *thread = new QThread(this);
+        thread->setObjectName(QString("nymea I/O %1").arg(i));
+        thread->start();
+        m_threads.append(thread);
+        m_objectCount.insert(thread, 0);
+    }
+    qCDebug(dcServerManager()) << "Started" << threadCount << "I/O threads";
+}
+
+/*! Stops all threads of this pool. Objects which have been scheduled for deletion are deleted before the threads finish. */
+IOThreadPool::~IOThreadPool()
+{
+    foreach (QThread *thread, m_threads) {
+        thread->quit();
+    }
+    foreach (QThread *thread, m_threads) {
+        thread->wait();
+    }
+}
+
+/*! Returns the number of threads in this pool. */
+int IOThreadPool::threadCount() const
+{
+    return m_threads.count();
+}
+
+/*! Moves the given \a object to the thread serving the least objects. The \a object must not have a parent.
+    If this pool has no threads, the \a object stays in the current thread.
+*/
+void IOThreadPool::assignThread(QObject *object)
+{
+    if (m_threads.isEmpty()) {
+        return;
+    }
+
+    QThread *thread = m_threads.first();
+    foreach (QThread *candidate, m_threads) {
+        if (m_objectCount.value(candidate) < m_objectCount.value(thread)) {
+            thread = candidate;
+        }
+    }
+
+    m_objectCount[thread]++;
+    connect(object, &QObject::destroyed, this, [this, thread](){
+        m_objectCount[thread]--;
+    });
+    object->moveToThread(thread);
+}
+
+/*! Returns the number of objects served by each thread of this pool. */
+QVariantList IOThreadPool::statistics() const
+{
+    QVariantList threads;
+    foreach (QThread *thread, m_threads) {
+        QVariantMap entry;
+        entry.insert("name", thread->objectName());
+        entry.insert("objects", m_objectCount.value(thread));
+        threads.append(entry);
+    }
+    return threads;
+}
+
+/*! Returns the connection type to invoke a method of \a object and wait for its result. Waiting on a queued
+    connection would dead lock if the \a object lives in the current thread.
+*/
+Qt::ConnectionType IOThreadPool::blockingConnectionType(QObject *object)
+{
+    return object->thread() == QThread::currentThread() ? Qt::DirectConnection : Qt::BlockingQueuedConnection;
+}
+
+}
@@ -0,0 +1,112 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* Copyright 2013 - 2020, nymea GmbH
+* Contact: contact@nymea.io
+*
+* This file is part of nymea.
+* This project including source code and documentation is protected by
+* copyright law, and remains the property of nymea GmbH. All rights, including
+* reproduction, publication, editing and translation, are reserved. The use of
+* this project is subject to the terms of a license agreement to be concluded
+* with nymea GmbH in accordance with the terms of use of nymea GmbH, available
+* under https://nymea.io/license
+*
+* GNU General Public License Usage
+* Alternatively, this project may be redistributed and/or modified under the
+* terms of the GNU General Public License as published by the Free Software
+* Foundation, GNU version 3. This project is distributed in the hope that it
+* will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+* of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+* Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with
+* this project. If not, see <https://www.gnu.org/licenses/>.
+*
+* For any further details and any questions please contact us under
+* contact@nymea.io or see our FAQ/Licensing Information on
+* https://nymea.io/license/faq
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+/*!
+    \class nymeaserver::JsonPacketReader
+    \brief Splits the data stream of a JSON-RPC client into decoded packets.
+
+    \ingroup server
+    \inmodule core
+
+    Clients send JSON objects separated by a newline, while a single read from the socket may contain a
+    fragment of a packet or several packets at once. The reader buffers incomplete data and decodes
+    each complete packet into a \l{JsonPacket}. Transports run the reader on their I/O threads, so
+    the core thread only receives packets which are already decoded.
+
+    If the buffer grows beyond \l{maxBufferSize} without containing a complete packet, the client is
+    expected to be dropped.
+*/
+
+/*!
+    \class nymeaserver::JsonPacket
+    \brief Holds a single decoded JSON-RPC packet.
+
+    \ingroup server
+    \inmodule core
+*/
+
+#include "jsonpacketreader.h"
+
+#include <QJsonDocument>
+#include <QJsonParseError>
+
+namespace nymeaserver {
+
+/*! Returns true if the packet could be decoded. */
+bool JsonPacket::isValid() const
+{
+    return error.isEmpty();
+}
+
+/*! Decodes the given \a data into a JsonPacket. */
+JsonPacket JsonPacket::parse(const QByteArray &data)
+{
+    JsonPacket packet;
+    QJsonParseError error;
+    QJsonDocument jsonDoc = QJsonDocument::fromJson(data, &error);
+    if (error.error != QJsonParseError::NoError) {
+        packet.data = data;
+        packet.error = error.errorString();
+        return packet;
+    }
+    packet.message = jsonDoc.toVariant().toMap();
+    return packet;
+}
+
+/*! Appends the given \a data to the buffer and returns all complete packets. */
+QList<JsonPacket> JsonPacketReader::read(const QByteArray &data)
+{
+    QList<JsonPacket> packets;
+    m_buffer.append(data);
+    int splitIndex = m_buffer.indexOf("}\n{");
+    while (splitIndex > -1) {
+        packets.append(JsonPacket::parse(m_buffer.left(splitIndex + 1)));
+        m_buffer.remove(0, splitIndex + 2);
+        splitIndex = m_buffer.indexOf("}\n{");
+    }
+    if (m_buffer.trimmed().endsWith("}")) {
+        packets.append(JsonPacket::parse(m_buffer));
+        m_buffer.clear();
+    }
+    return packets;
+}
+
+/*! Returns the size of the data which is not yet part of a complete packet. */
+int JsonPacketReader::bufferSize() const
+{
+    return m_buffer.size();
+}
+
+/*! Discards any buffered data. */
+void JsonPacketReader::clear()
+{
+    m_buffer.clear();
+}
+
+}
@@ -0,0 +1,72 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* Copyright 2013 - 2020, nymea GmbH
+* Contact: contact@nymea.io
+*
+* This file is part of nymea.
+* This project including source code and documentation is protected by
+* copyright law, and remains the property of nymea GmbH. All rights, including
+* reproduction, publication, editing and translation, are reserved. The use of
+* this project is subject to the terms of a license agreement to be concluded
+* with nymea GmbH in accordance with the terms of use of nymea GmbH, available
+* under https://nymea.io/license
+*
+* GNU General Public License Usage
+* Alternatively, this project may be redistributed and/or modified under the
+* terms of the GNU General Public License as published by the Free Software
+* Foundation, GNU version 3. This project is distributed in the hope that it
+* will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+* of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+* Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with
+* this project. If not, see <https://www.gnu.org/licenses/>.
+*
+* For any further details and any questions please contact us under
+* contact@nymea.io or see our FAQ/Licensing Information on
+* https://nymea.io/license/faq
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#ifndef JSONPACKETREADER_H
+#define JSONPACKETREADER_H
+
+#include <QByteArray>
+#include <QList>
+#include <QMetaType>
+#include <QString>
+#include <QVariantMap>
+
+namespace nymeaserver {
+
+class JsonPacket
+{
+public:
+    QVariantMap message;
+    // The raw data and the parser error if the packet is not valid JSON
+    QByteArray data;
+    QString error;
+
+    bool isValid() const;
+
+    static JsonPacket parse(const QByteArray &data);
+};
+
+class JsonPacketReader
+{
+public:
+    static const int maxBufferSize = 10 * 1024;
+
+    QList<JsonPacket> read(const QByteArray &data);
+
+    int bufferSize() const;
+    void clear();
+
+private:
+    QByteArray m_buffer;
+};
+
+}
+
+Q_DECLARE_METATYPE(nymeaserver::JsonPacket)
+
+#endif // JSONPACKETREADER_H
@@ -46,12 +46,12 @@ public:
             qCDebug(dcMqtt) << "Accepting client" << clientId << ". Server configuration does not require authentication.";
             return Mqtt::ConnectReturnCodeAccepted;
         }
-        if (!m_broker->m_policies.contains(clientId)) {
+        QHash<QString, MqttPolicy>::const_iterator policy = m_broker->m_policies.constFind(clientId);
+        if (policy == m_broker->m_policies.constEnd()) {
             qCDebug(dcMqtt) << "Rejecting client" << clientId << ". No policy for this client installed.";
             return Mqtt::ConnectReturnCodeIdentifierRejected;
         }
-        MqttPolicy policy = m_broker->m_policies.value(clientId);
-        if (policy.username != username || policy.password != password) {
+        if (policy->username != username || policy->password != password) {
             qCDebug(dcMqtt) << "Rejecting client" << clientId << ". Bad username or password.";
             return Mqtt::ConnectReturnCodeBadUsernameOrPassword;
         }
@@ -63,56 +63,22 @@ public:
         if (!m_broker->m_configs.value(serverAddressId).authenticationEnabled) {
             return true;
         }
-        if (!m_broker->m_policies.contains(clientId)) {
+        QHash<QString, MqttBroker::CompiledPolicy>::const_iterator policy = m_broker->m_compiledPolicies.constFind(clientId);
+        if (policy == m_broker->m_compiledPolicies.constEnd()) {
             return false;
         }
-        MqttPolicy policy = m_broker->m_policies.value(clientId);
-        return matchPolicy(policy.allowedSubscribeTopicFilters, topicFilter);
+        return policy->allowedSubscribeTopics.matches(topicFilter);
     }
 
     bool authorizePublish(int serverAddressId, const QString &clientId, const QString &topic) override {
         if (!m_broker->m_configs.value(serverAddressId).authenticationEnabled) {
             return true;
         }
-        if (!m_broker->m_policies.contains(clientId)) {
+        QHash<QString, MqttBroker::CompiledPolicy>::const_iterator policy = m_broker->m_compiledPolicies.constFind(clientId);
+        if (policy == m_broker->m_compiledPolicies.constEnd()) {
             return false;
         }
-        MqttPolicy policy = m_broker->m_policies.value(clientId);
-        return matchPolicy(policy.allowedPublishTopicFilters, topic);
-    }
-
-    bool matchPolicy(const QStringList &policies, const QString &topic) {
-        foreach (const QString &policyFilter, policies) {
-            QStringList policyParts = policyFilter.split('/');
-            QStringList topicParts = topic.split('/');
-            if (topicParts.count() < policyParts.count() - 1) {
-                // Nope... actual topic is shorter than filter
-                continue;
-            }
-            bool bad = false;
-            for (int i = 0; i < policyParts.length(); i++) {
-                if (policyParts.at(i) == QStringLiteral("+")) {
-                    continue;
-                }
-                if (policyParts.at(i) == QStringLiteral("#")) {
-                    continue;
-                }
-                if (policyParts.at(i) == topicParts.at(i)) {
-                    continue;
-                }
-                // Nope... this part does neither match nor is covered by a wildcard in the policy
-                bad = true;
-            }
-            if (bad) {
-                continue;
-            }
-            if (policyParts.count() == topicParts.count() || policyFilter.endsWith('#')) {
-                // OK, either the policy is matching or the topicFilter is longer as the policy and policy ends with #
-                return true;
-            }
-        }
-        // Nope... none of the policies matched...
-        return false;
+        return policy->allowedPublishTopics.matches(topic);
     }
 
 private:
@@ -200,6 +166,11 @@ MqttPolicy MqttBroker::policy(const QString &clientId)
 
 void MqttBroker::updatePolicy(const MqttPolicy &policy)
 {
+    CompiledPolicy compiledPolicy;
+    compiledPolicy.allowedPublishTopics = MqttTopicTrie(policy.allowedPublishTopicFilters);
+    compiledPolicy.allowedSubscribeTopics = MqttTopicTrie(policy.allowedSubscribeTopicFilters);
+    m_compiledPolicies.insert(policy.clientId, compiledPolicy);
+
     if (m_policies.contains(policy.clientId)) {
         m_policies[policy.clientId] = policy;
         qCDebug(dcMqtt) << "Policy for client" << policy.clientId << "updated.";
@@ -227,6 +198,7 @@ bool MqttBroker::removePolicy(const QString &clientId)
         }
 
         qCDebug(dcMqtt) << "Policy for client" << clientId << "removed";
+        m_compiledPolicies.remove(clientId);
         emit policyRemoved(m_policies.take(clientId));
         return true;
     }
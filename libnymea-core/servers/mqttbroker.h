@@ -37,6 +37,7 @@
 
 #include "nymea-mqtt/mqtt.h"
 #include "nymeaconfiguration.h"
+#include "mqtttopictrie.h"
 
 class MqttServer;
 
@@ -88,6 +89,14 @@ private:
     QHash<int, ServerConfiguration> m_configs;
     QHash<QString, MqttPolicy> m_policies;
 
+    // Allowed topic filters of the policies, precompiled for the authorizer
+    class CompiledPolicy {
+    public:
+        MqttTopicTrie allowedPublishTopics;
+        MqttTopicTrie allowedSubscribeTopics;
+    };
+    QHash<QString, CompiledPolicy> m_compiledPolicies;
+
 
     friend class NymeaMqttAuthorizer;
 };
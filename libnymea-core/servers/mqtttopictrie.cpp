@@ -0,0 +1,177 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* Copyright 2013 - 2020, nymea GmbH
+* Contact: contact@nymea.io
+*
+* This file is part of nymea.
+* This project including source code and documentation is protected by
+* copyright law, and remains the property of nymea GmbH. All rights, including
+* reproduction, publication, editing and translation, are reserved. The use of
+* this project is subject to the terms of a license agreement to be concluded
+* with nymea GmbH in accordance with the terms of use of nymea GmbH, available
+* under https://nymea.io/license
+*
+* GNU General Public License Usage
+* Alternatively, this project may be redistributed and/or modified under the
+* terms of the GNU General Public License as published by the Free Software
+* Foundation, GNU version 3. This project is distributed in the hope that it
+* will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+* of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+* Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with
+* this project. If not, see <https://www.gnu.org/licenses/>.
+*
+* For any further details and any questions please contact us under
+* contact@nymea.io or see our FAQ/Licensing Information on
+* https://nymea.io/license/faq
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+/*!
+    \class nymeaserver::MqttTopicTrie
+    \brief Matches MQTT topics against a set of topic filters.
+
+    \ingroup server
+    \inmodule core
+
+    The allowed topic filters of a \l{MqttPolicy} are compiled into a trie of topic levels once, when the
+    policy is installed. Matching a topic then walks the trie level by level, following the literal level
+    and the single level wildcard (\tt{+}) branches, without splitting the topic or allocating memory.
+
+    A multi level wildcard (\tt{#}) as last level matches the parent level and everything below it. A
+    \tt{#} in the middle of a filter matches exactly one level, like \tt{+}. Topic filters which are matched
+    against the trie, for example when authorizing a subscription, are compared level by level, so the
+    wildcards of the matched filter only match the same wildcard in the trie.
+*/
+
+#include "mqtttopictrie.h"
+
+namespace nymeaserver {
+
+/*! Constructs an empty MqttTopicTrie which matches no topic. */
+MqttTopicTrie::MqttTopicTrie()
+{
+    m_nodes.append(Node());
+}
+
+/*! Constructs a MqttTopicTrie matching the given \a topicFilters. */
+MqttTopicTrie::MqttTopicTrie(const QStringList &topicFilters) :
+    MqttTopicTrie()
+{
+    foreach (const QString &topicFilter, topicFilters) {
+        addTopicFilter(topicFilter);
+    }
+}
+
+/*! Adds the given \a topicFilter to the trie. */
+void MqttTopicTrie::addTopicFilter(const QString &topicFilter)
+{
+    QStringList levels = topicFilter.split('/');
+    int nodeIndex = 0;
+    for (int i = 0; i < levels.count(); i++) {
+        const QString &level = levels.at(i);
+        if (level == QStringLiteral("#") && i == levels.count() - 1) {
+            m_nodes[nodeIndex].multiLevelEnd = true;
+            return;
+        }
+
+        if (level == QStringLiteral("+") || level == QStringLiteral("#")) {
+            if (m_nodes.at(nodeIndex).singleLevelChild < 0) {
+                int childIndex = m_nodes.count();
+                m_nodes.append(Node());
+                m_nodes[nodeIndex].singleLevelChild = childIndex;
+            }
+            nodeIndex = m_nodes.at(nodeIndex).singleLevelChild;
+        } else {
+            nodeIndex = addChild(nodeIndex, level);
+        }
+    }
+    m_nodes[nodeIndex].filterEnd = true;
+}
+
+/*! Removes all topic filters. */
+void MqttTopicTrie::clear()
+{
+    m_nodes.clear();
+    m_nodes.append(Node());
+}
+
+/*! Returns true if no topic filter has been added. */
+bool MqttTopicTrie::isEmpty() const
+{
+    return m_nodes.count() == 1 && !m_nodes.first().filterEnd && !m_nodes.first().multiLevelEnd;
+}
+
+/*! Returns true if the given \a topic is matched by any of the topic filters. */
+bool MqttTopicTrie::matches(const QString &topic) const
+{
+    return matches(0, topic, 0);
+}
+
+int MqttTopicTrie::findChild(int nodeIndex, const QStringRef &level) const
+{
+    const QVector<QPair<QString, int> > &children = m_nodes.at(nodeIndex).children;
+    int first = 0;
+    int last = children.count() - 1;
+    while (first <= last) {
+        int middle = (first + last) / 2;
+        int comparison = level.compare(children.at(middle).first);
+        if (comparison == 0)
+            return children.at(middle).second;
+
+        if (comparison < 0) {
+            last = middle - 1;
+        } else {
+            first = middle + 1;
+        }
+    }
+    return -1;
+}
+
+int MqttTopicTrie::addChild(int nodeIndex, const QString &level)
+{
+    int existing = findChild(nodeIndex, QStringRef(&level));
+    if (existing >= 0)
+        return existing;
+
+    int childIndex = m_nodes.count();
+    m_nodes.append(Node());
+
+    QVector<QPair<QString, int> > &children = m_nodes[nodeIndex].children;
+    int position = 0;
+    while (position < children.count() && children.at(position).first < level) {
+        position++;
+    }
+    children.insert(position, qMakePair(level, childIndex));
+    return childIndex;
+}
+
+bool MqttTopicTrie::matches(int nodeIndex, const QString &topic, int levelStart) const
+{
+    const Node &node = m_nodes.at(nodeIndex);
+
+    // A trailing multi level wildcard matches this level and anything below
+    if (node.multiLevelEnd)
+        return true;
+
+    // All levels of the topic consumed
+    if (levelStart < 0)
+        return node.filterEnd;
+
+    int levelEnd = topic.indexOf('/', levelStart);
+    int nextLevelStart = levelEnd < 0 ? -1 : levelEnd + 1;
+    if (levelEnd < 0) {
+        levelEnd = topic.length();
+    }
+
+    int childIndex = findChild(nodeIndex, topic.midRef(levelStart, levelEnd - levelStart));
+    if (childIndex >= 0 && matches(childIndex, topic, nextLevelStart))
+        return true;
+
+    if (node.singleLevelChild >= 0 && matches(node.singleLevelChild, topic, nextLevelStart))
+        return true;
+
+    return false;
+}
+
+}
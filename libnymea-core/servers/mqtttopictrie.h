@@ -0,0 +1,71 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* Copyright 2013 - 2020, nymea GmbH
+* Contact: contact@nymea.io
+*
+* This file is part of nymea.
+* This project including source code and documentation is protected by
+* copyright law, and remains the property of nymea GmbH. All rights, including
+* reproduction, publication, editing and translation, are reserved. The use of
+* this project is subject to the terms of a license agreement to be concluded
+* with nymea GmbH in accordance with the terms of use of nymea GmbH, available
+* under https://nymea.io/license
+*
+* GNU General Public License Usage
+* Alternatively, this project may be redistributed and/or modified under the
+* terms of the GNU General Public License as published by the Free Software
+* Foundation, GNU version 3. This project is distributed in the hope that it
+* will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+* of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+* Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with
+* this project. If not, see <https://www.gnu.org/licenses/>.
+*
+* For any further details and any questions please contact us under
+* contact@nymea.io or see our FAQ/Licensing Information on
+* https://nymea.io/license/faq
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#ifndef MQTTTOPICTRIE_H
+#define MQTTTOPICTRIE_H
+
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <QPair>
+
+namespace nymeaserver {
+
+class MqttTopicTrie
+{
+public:
+    MqttTopicTrie();
+    explicit MqttTopicTrie(const QStringList &topicFilters);
+
+    void addTopicFilter(const QString &topicFilter);
+    void clear();
+    bool isEmpty() const;
+
+    bool matches(const QString &topic) const;
+
+private:
+    class Node {
+    public:
+        // Literal levels sorted by name -> node index
+        QVector<QPair<QString, int> > children;
+        int singleLevelChild = -1;
+        bool filterEnd = false;
+        bool multiLevelEnd = false;
+    };
+
+    QVector<Node> m_nodes;
+
+    int findChild(int nodeIndex, const QStringRef &level) const;
+    int addChild(int nodeIndex, const QString &level);
+    bool matches(int nodeIndex, const QString &topic, int levelStart) const;
+};
+
+}
+
+#endif // MQTTTOPICTRIE_H
@@ -0,0 +1,255 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* Copyright 2013 - 2020, nymea GmbH
+* Contact: contact@nymea.io
+*
+* This file is part of nymea.
+* This project including source code and documentation is protected by
+* copyright law, and remains the property of nymea GmbH. All rights, including
+* reproduction, publication, editing and translation, are reserved. The use of
+* this project is subject to the terms of a license agreement to be concluded
+* with nymea GmbH in accordance with the terms of use of nymea GmbH, available
+* under https://nymea.io/license
+*
+* GNU General Public License Usage
+* Alternatively, this project may be redistributed and/or modified under the
+* terms of the GNU General Public License as published by the Free Software
+* Foundation, GNU version 3. This project is distributed in the hope that it
+* will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+* of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+* Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with
+* this project. If not, see <https://www.gnu.org/licenses/>.
+*
+* For any further details and any questions please contact us under
+* contact@nymea.io or see our FAQ/Licensing Information on
+* https://nymea.io/license/faq
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+/*!
+    \class nymeaserver::SendQueue
+    \brief Bounds the outgoing data of a single client connection.
+
+    \ingroup server
+    \inmodule core
+
+    Sockets buffer everything written to them in memory until the peer has received it. A client which
+    stops reading, e.g. a phone app put into the background or a client on a bad wireless connection,
+    would therefore make the memory usage of nymead grow without limit.
+
+    The SendQueue hands data to the socket only as long as less than the \l{Limits}{low watermark} is
+    in flight, that is written to the socket but not yet reported by its bytesWritten() signal. Any
+    further data waits in the queue where notifications with the same coalesce key replace each other,
+    so a slow client only receives the latest value of a state.
+
+    Once the pending data exceeds the \l{Limits}{high watermark}, the client is considered stalled and
+    the overflow policy applies: With \l{OverflowPolicyDropNotifications} coalescible notifications are
+    dropped until the pending data falls below the low watermark again, while replies are still queued.
+    If the pending data grows beyond twice the high watermark, or with \l{OverflowPolicyDisconnect} right
+    away, the \l{overflow()} signal is emitted and the transport is expected to drop the connection.
+*/
+
+/*! \enum nymeaserver::SendQueue::OverflowPolicy
+    \value OverflowPolicyDropNotifications
+        Drop coalescible notifications while the client is stalled.
+    \value OverflowPolicyDisconnect
+        Disconnect the client as soon as it is stalled.
+*/
+
+/*! \fn void nymeaserver::SendQueue::writeData(const QByteArray &data);
+    This signal is emitted when the given \a data should be written to the socket.
+*/
+
+/*! \fn void nymeaserver::SendQueue::stalledChanged(bool stalled);
+    This signal is emitted when the client connection becomes \a stalled or recovers.
+*/
+
+/*! \fn void nymeaserver::SendQueue::overflow();
+    This signal is emitted once when the queue exceeded its limits. No further data will be sent.
+*/
+
+#include "sendqueue.h"
+
+namespace nymeaserver {
+
+/*! Constructs a SendQueue with the given \a limits and \a parent. */
+SendQueue::SendQueue(const Limits &limits, QObject *parent) :
+    QObject(parent),
+    m_limits(limits)
+{
+
+}
+
+/*! Returns the limits of this queue. */
+SendQueue::Limits SendQueue::limits() const
+{
+    return m_limits;
+}
+
+/*! Sets the \a limits of this queue. */
+void SendQueue::setLimits(const SendQueue::Limits &limits)
+{
+    m_limits = limits;
+}
+
+/*! Sends the given \a data. If \a coalesceKey is not empty, the data is a notification which supersedes
+    a previous notification with the same key that has not been written to the socket yet and which may
+    be dropped if the client is stalled.
+*/
+void SendQueue::send(const QByteArray &data, const QString &coalesceKey)
+{
+    if (m_overflowed) {
+        return;
+    }
+
+    if (!coalesceKey.isEmpty() && m_coalesceIndex.contains(coalesceKey)) {
+        Message &queued = m_queue[static_cast<int>(m_coalesceIndex.value(coalesceKey) - m_headSequence)];
+        m_queuedBytes += data.size() - queued.data.size();
+        queued.data = data;
+        m_coalesced++;
+        return;
+    }
+
+    qint64 pending = pendingBytes() + data.size();
+    if (pending > m_limits.highWatermark) {
+        setStalled(true);
+        if (m_limits.overflowPolicy == OverflowPolicyDisconnect || pending > 2 * m_limits.highWatermark) {
+            m_overflowed = true;
+            emit overflow();
+            return;
+        }
+        if (!coalesceKey.isEmpty()) {
+            m_dropped++;
+            return;
+        }
+    }
+
+    if (m_queue.isEmpty() && m_inFlightBytes < m_limits.lowWatermark) {
+        write(data);
+        return;
+    }
+
+    Message message;
+    message.data = data;
+    message.coalesceKey = coalesceKey;
+    if (!coalesceKey.isEmpty()) {
+        m_coalesceIndex.insert(coalesceKey, m_headSequence + static_cast<quint64>(m_queue.count()));
+    }
+    m_queue.append(message);
+    m_queuedBytes += data.size();
+    m_maxPendingBytes = qMax(m_maxPendingBytes, pendingBytes());
+}
+
+/*! Call this when the socket reports that \a bytes have been written to the network. */
+void SendQueue::onBytesWritten(qint64 bytes)
+{
+    m_inFlightBytes = qMax(Q_INT64_C(0), m_inFlightBytes - bytes);
+
+    while (!m_queue.isEmpty() && m_inFlightBytes < m_limits.lowWatermark && !m_overflowed) {
+        Message message = m_queue.takeFirst();
+        if (!message.coalesceKey.isEmpty()) {
+            m_coalesceIndex.remove(message.coalesceKey);
+        }
+        m_headSequence++;
+        m_queuedBytes -= message.data.size();
+        write(message.data);
+    }
+
+    if (m_stalled && pendingBytes() < m_limits.lowWatermark) {
+        setStalled(false);
+    }
+}
+
+/*! Writes all queued data to the socket regardless of the watermarks, e.g. before closing the connection. */
+void SendQueue::flush()
+{
+    while (!m_queue.isEmpty()) {
+        Message message = m_queue.takeFirst();
+        m_headSequence++;
+        m_queuedBytes -= message.data.size();
+        write(message.data);
+    }
+    m_coalesceIndex.clear();
+}
+
+/*! Returns the number of bytes which have not been sent yet, including the ones in flight. */
+qint64 SendQueue::pendingBytes() const
+{
+    return m_inFlightBytes + m_queuedBytes;
+}
+
+/*! Returns the number of bytes which have been written to the socket but not been sent yet. */
+qint64 SendQueue::inFlightBytes() const
+{
+    return m_inFlightBytes;
+}
+
+/*! Returns the number of bytes waiting in the queue. */
+qint64 SendQueue::queuedBytes() const
+{
+    return m_queuedBytes;
+}
+
+/*! Returns the number of messages waiting in the queue. */
+int SendQueue::queuedMessages() const
+{
+    return m_queue.count();
+}
+
+/*! Returns true if the pending data exceeded the high watermark and did not drop below the low watermark since. */
+bool SendQueue::stalled() const
+{
+    return m_stalled;
+}
+
+/*! Returns true if the queue exceeded its limits and the connection should be dropped. */
+bool SendQueue::overflowed() const
+{
+    return m_overflowed;
+}
+
+/*! Returns the number of notifications dropped because the client was stalled. */
+int SendQueue::droppedMessages() const
+{
+    return m_dropped;
+}
+
+/*! Returns the number of notifications replaced by a newer notification with the same coalesce key. */
+int SendQueue::coalescedMessages() const
+{
+    return m_coalesced;
+}
+
+/*! Returns the current state and counters of this queue. */
+QVariantMap SendQueue::statistics() const
+{
+    QVariantMap statistics;
+    statistics.insert("inFlightBytes", m_inFlightBytes);
+    statistics.insert("queuedBytes", m_queuedBytes);
+    statistics.insert("queuedMessages", m_queue.count());
+    statistics.insert("maxPendingBytes", m_maxPendingBytes);
+    statistics.insert("stalled", m_stalled);
+    statistics.insert("droppedMessages", m_dropped);
+    statistics.insert("coalescedMessages", m_coalesced);
+    return statistics;
+}
+
+void SendQueue::write(const QByteArray &data)
+{
+    m_inFlightBytes += data.size();
+    m_maxPendingBytes = qMax(m_maxPendingBytes, pendingBytes());
+    emit writeData(data);
+}
+
+void SendQueue::setStalled(bool stalled)
+{
+    if (m_stalled == stalled) {
+        return;
+    }
+    m_stalled = stalled;
+    emit stalledChanged(stalled);
+}
+
+}
@@ -0,0 +1,112 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* Copyright 2013 - 2020, nymea GmbH
+* Contact: contact@nymea.io
+*
+* This file is part of nymea.
+* This project including source code and documentation is protected by
+* copyright law, and remains the property of nymea GmbH. All rights, including
+* reproduction, publication, editing and translation, are reserved. The use of
+* this project is subject to the terms of a license agreement to be concluded
+* with nymea GmbH in accordance with the terms of use of nymea GmbH, available
+* under https://nymea.io/license
+*
+* GNU General Public License Usage
+* Alternatively, this project may be redistributed and/or modified under the
+* terms of the GNU General Public License as published by the Free Software
+* Foundation, GNU version 3. This project is distributed in the hope that it
+* will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+* of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+* Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with
+* this project. If not, see <https://www.gnu.org/licenses/>.
+*
+* For any further details and any questions please contact us under
+* contact@nymea.io or see our FAQ/Licensing Information on
+* https://nymea.io/license/faq
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef SENDQUEUE_H
+#define SENDQUEUE_H
+
+#include <QObject>
+#include <QByteArray>
+#include <QHash>
+#include <QList>
+#include <QVariantMap>
+
+namespace nymeaserver {
+
+class SendQueue : public QObject
+{
+    Q_OBJECT
+public:
+    enum OverflowPolicy {
+        OverflowPolicyDropNotifications,
+        OverflowPolicyDisconnect
+    };
+    Q_ENUM(OverflowPolicy)
+
+    class Limits {
+    public:
+        qint64 highWatermark = 4 * 1024 * 1024;
+        qint64 lowWatermark = 1024 * 1024;
+        OverflowPolicy overflowPolicy = OverflowPolicyDropNotifications;
+    };
+
+    explicit SendQueue(const Limits &limits, QObject *parent = nullptr);
+
+    Limits limits() const;
+    void setLimits(const Limits &limits);
+
+    void send(const QByteArray &data, const QString &coalesceKey = QString());
+    void onBytesWritten(qint64 bytes);
+    void flush();
+
+    qint64 pendingBytes() const;
+    qint64 inFlightBytes() const;
+    qint64 queuedBytes() const;
+    int queuedMessages() const;
+    bool stalled() const;
+    bool overflowed() const;
+    int droppedMessages() const;
+    int coalescedMessages() const;
+
+    QVariantMap statistics() const;
+
+signals:
+    void writeData(const QByteArray &data);
+    void stalledChanged(bool stalled);
+    void overflow();
+
+private:
+    class Message {
+    public:
+        QByteArray data;
+        QString coalesceKey;
+    };
+
+    void write(const QByteArray &data);
+    void setStalled(bool stalled);
+
+    Limits m_limits;
+
+    QList<Message> m_queue;
+    // Sequence number of the first message in the queue, used to find queued messages by coalesce key
+    quint64 m_headSequence = 0;
+    QHash<QString, quint64> m_coalesceIndex;
+
+    qint64 m_inFlightBytes = 0;
+    qint64 m_queuedBytes = 0;
+    qint64 m_maxPendingBytes = 0;
+    bool m_stalled = false;
+    bool m_overflowed = false;
+    int m_dropped = 0;
+    int m_coalesced = 0;
+};
+
+}
+
+#endif // SENDQUEUE_H
@@ -0,0 +1,320 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* Copyright 2013 - 2020, nymea GmbH
+* Contact: contact@nymea.io
+*
+* This file is part of nymea.
+* This project including source code and documentation is protected by
+* copyright law, and remains the property of nymea GmbH. All rights, including
+* reproduction, publication, editing and translation, are reserved. The use of
+* this project is subject to the terms of a license agreement to be concluded
+* with nymea GmbH in accordance with the terms of use of nymea GmbH, available
+* under https://nymea.io/license
+*
+* GNU General Public License Usage
+* Alternatively, this project may be redistributed and/or modified under the
+* terms of the GNU General Public License as published by the Free Software
+* Foundation, GNU version 3. This project is distributed in the hope that it
+* will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+* of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+* Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with
+* this project. If not, see <https://www.gnu.org/licenses/>.
+*
+* For any further details and any questions please contact us under
+* contact@nymea.io or see our FAQ/Licensing Information on
+* https://nymea.io/license/faq
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+/*!
+    \class nymeaserver::StaticFileCache
+    \brief Caches the static files served by the \l{WebServer}.
+
+    \ingroup server
+    \inmodule core
+
+    The web interface consists of a few dozen files which are requested on every page load. The cache
+    keeps them in memory, keyed by their path and checked against the modification time and size of the
+    file on every lookup, together with the headers which only depend on the file: the content type, the
+    ETag and the Last-Modified date.
+
+    If a pre-compressed variant of a file exists next to it (\tt{file.br} or \tt{file.gz}) and is not
+    older than the file itself, it is cached as well and served to clients which accept the encoding.
+    Text based files without a pre-compressed gzip variant are deflated once when they are loaded.
+
+    Files bigger than the maximum file size are neither loaded nor kept in the cache. Their entries only
+    carry the headers and are marked as streamed, the \l{WebServer} sends them from disk. If the cache grows
+    beyond its maximum size, the least recently used files are dropped.
+*/
+
+/*! \enum nymeaserver::StaticFileCache::Encoding
+    \value EncodingIdentity
+        The file content as it is.
+    \value EncodingDeflate
+        The file content compressed with zlib (RFC 1950).
+    \value EncodingGzip
+        The content of the pre-compressed \tt{.gz} variant.
+    \value EncodingBrotli
+        The content of the pre-compressed \tt{.br} variant.
+*/
+
+#include "staticfilecache.h"
+#include "httpreply.h"
+#include "loggingcategories.h"
+
+#include <QFile>
+#include <QFileInfo>
+
+namespace nymeaserver {
+
+/*! Returns true if this entry holds a file. */
+bool StaticFileCache::Entry::isValid() const
+{
+    return !fileName.isEmpty();
+}
+
+/*! Returns the content of this entry in the given \a encoding. */
+QByteArray StaticFileCache::Entry::payload(Encoding encoding) const
+{
+    if (encoding == EncodingIdentity) {
+        return data;
+    }
+    return encodedData.value(encoding);
+}
+
+/*! Returns the ETag of this entry in the given \a encoding. Each encoding is a different representation and gets its own ETag. */
+QByteArray StaticFileCache::Entry::etagFor(Encoding encoding) const
+{
+    if (encoding == EncodingIdentity) {
+        return etag;
+    }
+    return etag.left(etag.length() - 1) + "-" + encodingName(encoding) + "\"";
+}
+
+/*! Constructs a StaticFileCache holding up to \a maxCacheSize bytes. Files bigger than \a maxFileSize are not cached. */
+StaticFileCache::StaticFileCache(qint64 maxCacheSize, qint64 maxFileSize) :
+    m_maxCacheSize(maxCacheSize),
+    m_maxFileSize(maxFileSize)
+{
+
+}
+
+/*! Returns the entry for the file with the given \a fileName. The file is loaded if it is not cached yet
+    or if it has been modified since it was cached. Returns an invalid entry if the file can not be read.
+*/
+StaticFileCache::Entry StaticFileCache::entry(const QString &fileName)
+{
+    QFileInfo fileInfo(fileName);
+    if (!fileInfo.exists() || !fileInfo.isReadable()) {
+        return Entry();
+    }
+
+    QDateTime lastModified = fileInfo.lastModified();
+    if (m_entries.contains(fileName)) {
+        const Entry &cached = m_entries[fileName];
+        if (cached.lastModified == lastModified && cached.size == fileInfo.size()) {
+            m_hits++;
+            m_lastUsed[fileName] = ++m_useCounter;
+            return cached;
+        }
+
+        qCDebug(dcWebServer()) << "File" << fileName << "changed on disk. Reloading it.";
+        foreach (const QByteArray &data, cached.encodedData) {
+            m_cacheSize -= data.size();
+        }
+        m_cacheSize -= cached.data.size();
+        m_entries.remove(fileName);
+        m_lastUsed.remove(fileName);
+    }
+
+    m_misses++;
+    if (fileInfo.size() > m_maxFileSize) {
+        Entry entry = describe(fileName, lastModified, fileInfo.size());
+        entry.streamed = true;
+        return entry;
+    }
+
+    Entry entry = load(fileName, lastModified, fileInfo.size());
+    if (!entry.isValid()) {
+        return entry;
+    }
+
+    m_entries.insert(fileName, entry);
+    m_lastUsed.insert(fileName, ++m_useCounter);
+    m_cacheSize += entry.data.size();
+    foreach (const QByteArray &data, entry.encodedData) {
+        m_cacheSize += data.size();
+    }
+    evict();
+    return entry;
+}
+
+/*! Drops all cached files. */
+void StaticFileCache::clear()
+{
+    m_entries.clear();
+    m_lastUsed.clear();
+    m_cacheSize = 0;
+}
+
+/*! Returns the number of bytes held by the cache. */
+qint64 StaticFileCache::cacheSize() const
+{
+    return m_cacheSize;
+}
+
+/*! Returns how many lookups have been served from the cache. */
+int StaticFileCache::hits() const
+{
+    return m_hits;
+}
+
+/*! Returns how many lookups had to load the file from disk. */
+int StaticFileCache::misses() const
+{
+    return m_misses;
+}
+
+/*! Returns the value of the Content-Type header for the file with the given \a fileName. */
+QByteArray StaticFileCache::contentType(const QString &fileName)
+{
+    static const QHash<QString, QByteArray> contentTypes = {
+        {"html", "text/html; charset=\"utf-8\";"},
+        {"css", "text/css; charset=\"utf-8\";"},
+        {"js", "text/javascript; charset=\"utf-8\";"},
+        {"json", "application/json"},
+        {"txt", "text/plain; charset=\"utf-8\";"},
+        {"xml", "text/xml"},
+        {"pdf", "application/pdf"},
+        {"ttf", "application/x-font-ttf"},
+        {"eot", "application/vnd.ms-fontobject"},
+        {"woff", "application/x-font-woff"},
+        {"woff2", "font/woff2"},
+        {"jpg", "image/jpeg"},
+        {"jpeg", "image/jpeg"},
+        {"png", "image/png"},
+        {"gif", "image/gif"},
+        {"ico", "image/x-icon"},
+        {"svg", "image/svg+xml; charset=\"utf-8\";"}
+    };
+    return contentTypes.value(QFileInfo(fileName).suffix().toLower(), "application/octet-stream");
+}
+
+/*! Returns the name of the given \a encoding as used in the Content-Encoding header. */
+QByteArray StaticFileCache::encodingName(Encoding encoding)
+{
+    switch (encoding) {
+    case EncodingDeflate:
+        return "deflate";
+    case EncodingGzip:
+        return "gzip";
+    case EncodingBrotli:
+        return "br";
+    case EncodingIdentity:
+        break;
+    }
+    return "identity";
+}
+
+/*! Returns the best encoding available for \a entry which is accepted according to the given Accept-Encoding header value \a acceptEncoding. */
+StaticFileCache::Encoding StaticFileCache::preferredEncoding(const Entry &entry, const QByteArray &acceptEncoding)
+{
+    QList<QByteArray> accepted;
+    foreach (const QByteArray &token, acceptEncoding.split(',')) {
+        QList<QByteArray> parameters = token.split(';');
+        QByteArray name = parameters.takeFirst().trimmed().toLower();
+        bool rejected = false;
+        foreach (const QByteArray &parameter, parameters) {
+            QByteArray trimmed = parameter.trimmed();
+            if (trimmed.startsWith("q=") && trimmed.mid(2).toDouble() <= 0) {
+                rejected = true;
+            }
+        }
+        if (!rejected) {
+            accepted.append(name);
+        }
+    }
+
+    QList<Encoding> preferences = {EncodingBrotli, EncodingGzip, EncodingDeflate};
+    foreach (Encoding encoding, preferences) {
+        if (entry.encodedData.contains(encoding) && accepted.contains(encodingName(encoding))) {
+            return encoding;
+        }
+    }
+    return EncodingIdentity;
+}
+
+StaticFileCache::Entry StaticFileCache::describe(const QString &fileName, const QDateTime &lastModified, qint64 size) const
+{
+    Entry entry;
+    entry.fileName = fileName;
+    entry.lastModified = lastModified;
+    entry.size = size;
+    entry.contentType = contentType(fileName);
+    entry.etag = "\"" + QByteArray::number(size, 16) + "-" + QByteArray::number(lastModified.toMSecsSinceEpoch(), 16) + "\"";
+    entry.lastModifiedHeader = HttpReply::httpDate(lastModified);
+    return entry;
+}
+
+StaticFileCache::Entry StaticFileCache::load(const QString &fileName, const QDateTime &lastModified, qint64 size) const
+{
+    QFile file(fileName);
+    if (!file.open(QFile::ReadOnly)) {
+        qCWarning(dcWebServer()) << "Could not open" << fileName << file.errorString();
+        return Entry();
+    }
+
+    qCDebug(dcWebServer()) << "Load file" << fileName;
+    Entry entry = describe(fileName, lastModified, size);
+    entry.data = file.readAll();
+
+    loadPrecompressed(entry, EncodingBrotli, ".br");
+    loadPrecompressed(entry, EncodingGzip, ".gz");
+
+    bool compressible = entry.contentType.startsWith("text/") || entry.contentType.contains("json") || entry.contentType.contains("svg");
+    if (compressible && !entry.encodedData.contains(EncodingGzip) && entry.data.size() > 1024) {
+        // qCompress() prepends the uncompressed size to the zlib stream
+        QByteArray compressed = qCompress(entry.data, 9).mid(4);
+        if (compressed.size() < entry.data.size()) {
+            entry.encodedData.insert(EncodingDeflate, compressed);
+        }
+    }
+    return entry;
+}
+
+void StaticFileCache::loadPrecompressed(Entry &entry, Encoding encoding, const QString &suffix) const
+{
+    QFileInfo fileInfo(entry.fileName + suffix);
+    if (!fileInfo.exists() || fileInfo.lastModified() < entry.lastModified) {
+        return;
+    }
+
+    QFile file(fileInfo.filePath());
+    if (!file.open(QFile::ReadOnly)) {
+        qCWarning(dcWebServer()) << "Could not open" << file.fileName() << file.errorString();
+        return;
+    }
+    entry.encodedData.insert(encoding, file.readAll());
+}
+
+void StaticFileCache::evict()
+{
+    while (m_cacheSize > m_maxCacheSize && !m_entries.isEmpty()) {
+        QString oldest = m_lastUsed.constBegin().key();
+        for (QHash<QString, quint64>::const_iterator it = m_lastUsed.constBegin(); it != m_lastUsed.constEnd(); ++it) {
+            if (it.value() < m_lastUsed.value(oldest)) {
+                oldest = it.key();
+            }
+        }
+
+        Entry entry = m_entries.take(oldest);
+        m_lastUsed.remove(oldest);
+        m_cacheSize -= entry.data.size();
+        foreach (const QByteArray &data, entry.encodedData) {
+            m_cacheSize -= data.size();
+        }
+    }
+}
+
+}
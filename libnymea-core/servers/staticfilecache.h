@@ -0,0 +1,102 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* Copyright 2013 - 2020, nymea GmbH
+* Contact: contact@nymea.io
+*
+* This file is part of nymea.
+* This project including source code and documentation is protected by
+* copyright law, and remains the property of nymea GmbH. All rights, including
+* reproduction, publication, editing and translation, are reserved. The use of
+* this project is subject to the terms of a license agreement to be concluded
+* with nymea GmbH in accordance with the terms of use of nymea GmbH, available
+* under https://nymea.io/license
+*
+* GNU General Public License Usage
+* Alternatively, this project may be redistributed and/or modified under the
+* terms of the GNU General Public License as published by the Free Software
+* Foundation, GNU version 3. This project is distributed in the hope that it
+* will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+* of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+* Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with
+* this project. If not, see <https://www.gnu.org/licenses/>.
+*
+* For any further details and any questions please contact us under
+* contact@nymea.io or see our FAQ/Licensing Information on
+* https://nymea.io/license/faq
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#ifndef STATICFILECACHE_H
+#define STATICFILECACHE_H
+
+#include <QByteArray>
+#include <QDateTime>
+#include <QHash>
+#include <QString>
+
+namespace nymeaserver {
+
+class StaticFileCache
+{
+public:
+    enum Encoding {
+        EncodingIdentity,
+        EncodingDeflate,
+        EncodingGzip,
+        EncodingBrotli
+    };
+
+    class Entry {
+    public:
+        QString fileName;
+        QDateTime lastModified;
+        qint64 size = 0;
+
+        QByteArray contentType;
+        QByteArray etag;
+        QByteArray lastModifiedHeader;
+
+        QByteArray data;
+        QHash<int, QByteArray> encodedData;
+        bool streamed = false;
+
+        bool isValid() const;
+        QByteArray payload(Encoding encoding) const;
+        QByteArray etagFor(Encoding encoding) const;
+    };
+
+    StaticFileCache(qint64 maxCacheSize = 16 * 1024 * 1024, qint64 maxFileSize = 2 * 1024 * 1024);
+
+    Entry entry(const QString &fileName);
+    void clear();
+
+    qint64 cacheSize() const;
+    int hits() const;
+    int misses() const;
+
+    static QByteArray contentType(const QString &fileName);
+    static QByteArray encodingName(Encoding encoding);
+    static Encoding preferredEncoding(const Entry &entry, const QByteArray &acceptEncoding);
+
+private:
+    Entry describe(const QString &fileName, const QDateTime &lastModified, qint64 size) const;
+    Entry load(const QString &fileName, const QDateTime &lastModified, qint64 size) const;
+    void loadPrecompressed(Entry &entry, Encoding encoding, const QString &suffix) const;
+    void evict();
+
+    qint64 m_maxCacheSize;
+    qint64 m_maxFileSize;
+    qint64 m_cacheSize = 0;
+
+    QHash<QString, Entry> m_entries;
+    QHash<QString, quint64> m_lastUsed;
+    quint64 m_useCounter = 0;
+
+    int m_hits = 0;
+    int m_misses = 0;
+};
+
+}
+
+#endif // STATICFILECACHE_H
@@ -30,34 +30,54 @@
 
 /*!
     \class nymeaserver::SslServer
-    \brief This class represents the SSL server for nymead.
+    \brief This class accepts the incoming connections of the \l{TcpServer}.
 
     \ingroup server
     \inmodule core
 
-    \inherits TcpServer
+    \inherits QTcpServer
 
-    The SSL server allows clients to connect to the JSON-RPC API over an encrypted SSL/TLS connection.
+    The SslServer only accepts connections. The sockets are set up by a \l{TcpServerConnection}
+    on one of the I/O threads.
 
     \sa WebSocketServer, TransportInterface, TcpServer
 */
 
-/*! \fn nymeaserver::SslServer::SslServer(bool sslEnabled, const QSslConfiguration &config, QObject *parent = nullptr)
-    Constructs a \l{SslServer} with the given \a sslEnabled, \a config and \a parent.
+/*! \fn nymeaserver::SslServer::SslServer(QObject *parent = nullptr)
+    Constructs a \l{SslServer} with the given \a parent.
 */
 
-/*! \fn void nymeaserver::SslServer::clientConnected(QSslSocket *socket);
-    This signal is emitted when a new SSL \a socket connected.
+/*! \fn void nymeaserver::SslServer::socketDescriptorAvailable(qintptr socketDescriptor);
+    This signal is emitted when a new connection with the given \a socketDescriptor has been accepted.
 */
 
-/*! \fn void nymeaserver::SslServer::clientDisconnected(QSslSocket *socket);
-    This signal is emitted when a \a socket disconnected.
+/*!
+    \class nymeaserver::TcpServerConnection
+    \brief This class owns the socket of a single client of the \l{TcpServer}.
+
+    \ingroup server
+    \inmodule core
+
+    The connection lives in an I/O thread of the \l{IOThreadPool}. It performs the SSL handshake, reads
+    the data from the socket and decodes it into \l{JsonPacket}{JsonPackets}. The \l{TcpServer} talks
+    to it exclusively through queued signals and slots.
 */
 
-/*! \fn void nymeaserver::SslServer::dataAvailable(QSslSocket *socket, const QByteArray &data);
-    This signal is emitted when \a data from \a socket is available.
+/*! \fn void nymeaserver::TcpServerConnection::connected(const QString &peerAddress);
+    This signal is emitted when the client from \a peerAddress is connected and, if enabled, the SSL handshake finished.
 */
 
+/*! \fn void nymeaserver::TcpServerConnection::disconnected();
+    This signal is emitted when the client disconnected.
+*/
+
+/*! \fn void nymeaserver::TcpServerConnection::packetAvailable(const nymeaserver::JsonPacket &packet);
+    This signal is emitted when a complete \a packet has been received.
+*/
+
+/*! \fn void nymeaserver::TcpServerConnection::bytesWritten(qint64 bytes);
+    This signal is emitted when \a bytes of the written data have been sent.
+*/
 
 /*!
     \class nymeaserver::TcpServer
@@ -81,12 +101,14 @@
 namespace nymeaserver {
 
 /*! Constructs a \l{TcpServer} with the given \a configuration, \a sslConfiguration and \a parent.
+ *  The client sockets are served by the threads of the given \a ioThreadPool.
  *
  *  \sa ServerManager
  */
-TcpServer::TcpServer(const ServerConfiguration &configuration, const QSslConfiguration &sslConfiguration, QObject *parent) :
+TcpServer::TcpServer(const ServerConfiguration &configuration, const QSslConfiguration &sslConfiguration, IOThreadPool *ioThreadPool, QObject *parent) :
     TransportInterface(configuration, parent),
     m_server(nullptr),
+    m_ioThreadPool(ioThreadPool),
     m_sslConfig(sslConfiguration)
 {
 }
@@ -96,6 +118,9 @@ TcpServer::~TcpServer()
 {
     qCDebug(dcTcpServer()) << "Shutting down \"TCP Server\"" << serverUrl().toString();
     stopServer();
+    foreach (TcpServerConnection *connection, m_connections) {
+        connection->deleteLater();
+    }
 }
 
 /*! Returns the URL of this server. */
@@ -114,38 +139,141 @@ void TcpServer::sendData(const QList<QUuid> &clients, const QByteArray &data)
 
 void TcpServer::terminateClientConnection(const QUuid &clientId)
 {
-    QTcpSocket *client = m_clientList.value(clientId);
-    if (client) {
-        client->close();
+    TcpServerConnection *connection = m_clientList.value(clientId);
+    if (connection) {
+        m_sendQueues.value(clientId)->flush();
+        QMetaObject::invokeMethod(connection, "close", Qt::QueuedConnection);
     }
 }
 
 /*! Sending \a data to the client with the given \a clientId.*/
 void TcpServer::sendData(const QUuid &clientId, const QByteArray &data)
 {
-    QTcpSocket *client = nullptr;
-    client = m_clientList.value(clientId);
-    if (client) {
+    SendQueue *sendQueue = m_sendQueues.value(clientId);
+    if (sendQueue) {
         qCDebug(dcTcpServerTraffic()) << "Sending to client" << clientId.toString() << data;
-        client->write(data + '\n');
+        sendQueue->send(data + '\n');
+    } else {
+        qCWarning(dcTcpServer()) << "Client" << clientId << "unknown to this transport";
+    }
+}
+
+/*! Sending the notification \a data to the client with the given \a clientId. If the client is not
+    able to keep up with receiving data, notifications with the same \a coalesceKey replace each other
+    or are dropped, depending on the \l{sendQueueLimits()}.
+*/
+void TcpServer::sendNotification(const QUuid &clientId, const QByteArray &data, const QString &coalesceKey)
+{
+    SendQueue *sendQueue = m_sendQueues.value(clientId);
+    if (sendQueue) {
+        qCDebug(dcTcpServerTraffic()) << "Sending notification to client" << clientId.toString() << data;
+        sendQueue->send(data + '\n', coalesceKey);
     } else {
         qCWarning(dcTcpServer()) << "Client" << clientId << "unknown to this transport";
     }
 }
 
-void TcpServer::onClientConnected(QSslSocket *socket)
+/*! Returns the limits for the outgoing data of each client. */
+SendQueue::Limits TcpServer::sendQueueLimits() const
+{
+    return m_sendQueueLimits;
+}
+
+/*! Sets the \a limits for the outgoing data of each client. */
+void TcpServer::setSendQueueLimits(const SendQueue::Limits &limits)
+{
+    m_sendQueueLimits = limits;
+    foreach (SendQueue *sendQueue, m_sendQueues) {
+        sendQueue->setLimits(limits);
+    }
+}
+
+/*! Sets the \a tlsSessionCache registering the handshakes of encrypted connections. */
+void TcpServer::setTlsSessionCache(TlsSessionCache *tlsSessionCache)
+{
+    m_tlsSessionCache = tlsSessionCache;
+}
+
+/*! Returns the state of the outgoing queues of all connected clients. */
+QVariantList TcpServer::clientStatistics() const
+{
+    QVariantList clients;
+    foreach (const QUuid &clientId, m_sendQueues.keys()) {
+        QVariantMap client = m_sendQueues.value(clientId)->statistics();
+        client.insert("clientId", clientId);
+        client.insert("address", m_clientAddresses.value(clientId));
+        clients.append(client);
+    }
+    return clients;
+}
+
+void TcpServer::onSocketDescriptorAvailable(qintptr socketDescriptor)
+{
+    TcpServerConnection *connection = new TcpServerConnection(socketDescriptor, configuration().sslEnabled, m_sslConfig, m_tlsSessionCache);
+    connect(connection, &TcpServerConnection::connected, this, [this, connection](const QString &peerAddress){
+        onClientConnected(connection, peerAddress);
+    });
+    connect(connection, &TcpServerConnection::disconnected, this, [this, connection](){
+        onClientDisconnected(connection);
+    });
+    connect(connection, &TcpServerConnection::packetAvailable, this, [this, connection](const JsonPacket &packet){
+        QUuid clientId = m_clientList.key(connection);
+        if (!clientId.isNull()) {
+            emit packetAvailable(clientId, packet);
+        }
+    });
+    m_connections.append(connection);
+
+    if (m_ioThreadPool) {
+        m_ioThreadPool->assignThread(connection);
+    }
+    QMetaObject::invokeMethod(connection, "start", Qt::QueuedConnection);
+}
+
+void TcpServer::onClientConnected(TcpServerConnection *connection, const QString &peerAddress)
 {
     QUuid clientId = QUuid::createUuid();
-    qCDebug(dcTcpServer()) << "New client connected:" << clientId.toString() << "(Remote address:" << socket->peerAddress().toString() << ")";
-    m_clientList.insert(clientId, socket);
+    qCDebug(dcTcpServer()) << "New client connected:" << clientId.toString() << "(Remote address:" << peerAddress << ")";
+    m_clientList.insert(clientId, connection);
+    m_clientAddresses.insert(clientId, peerAddress);
+
+    SendQueue *sendQueue = new SendQueue(m_sendQueueLimits, this);
+    m_sendQueues.insert(clientId, sendQueue);
+    connect(sendQueue, &SendQueue::writeData, connection, &TcpServerConnection::write);
+    connect(connection, &TcpServerConnection::bytesWritten, sendQueue, &SendQueue::onBytesWritten);
+    connect(sendQueue, &SendQueue::stalledChanged, this, [clientId, sendQueue](bool stalled){
+        if (stalled) {
+            qCWarning(dcTcpServer()) << "Client" << clientId.toString() << "does not keep up with receiving data." << sendQueue->pendingBytes() << "bytes pending.";
+        } else {
+            qCDebug(dcTcpServer()) << "Client" << clientId.toString() << "caught up receiving data." << sendQueue->droppedMessages() << "notifications dropped so far.";
+        }
+    });
+    connect(sendQueue, &SendQueue::overflow, this, [clientId, connection, sendQueue](){
+        qCWarning(dcTcpServer()) << "Outgoing data for client" << clientId.toString() << "exceeds" << sendQueue->pendingBytes() << "bytes. Dropping the connection.";
+        QMetaObject::invokeMethod(connection, "abort", Qt::QueuedConnection);
+    });
+
     emit clientConnected(clientId);
 }
 
-void TcpServer::onClientDisconnected(QSslSocket *socket)
+void TcpServer::onClientDisconnected(TcpServerConnection *connection)
 {
-    QUuid clientId = m_clientList.key(socket);
-    qCDebug(dcTcpServer()) << "Client disconnected:" << clientId.toString() << "(Remote address:" << socket->peerAddress().toString() << ")";
-    m_clientList.take(clientId);
+    m_connections.removeAll(connection);
+    connection->deleteLater();
+
+    // Connections which did not finish the handshake are not known to the JSON-RPC server
+    QUuid clientId = m_clientList.key(connection);
+    if (clientId.isNull()) {
+        return;
+    }
+
+    qCDebug(dcTcpServer()) << "Client disconnected:" << clientId.toString() << "(Remote address:" << m_clientAddresses.value(clientId) << ")";
+    m_clientList.remove(clientId);
+    m_clientAddresses.remove(clientId);
+    SendQueue *sendQueue = m_sendQueues.take(clientId);
+    if (sendQueue) {
+        sendQueue->deleteLater();
+    }
     emit clientDisconnected(clientId);
 }
 
@@ -156,14 +284,6 @@ void TcpServer::onError(QAbstractSocket::SocketError error)
     stopServer();
 }
 
-void TcpServer::onDataAvailable(QSslSocket * socket, const QByteArray &data)
-{
-    qCDebug(dcTcpServerTraffic()) << "Emitting data available";
-    QUuid clientId = m_clientList.key(socket);
-    emit dataAvailable(clientId, data);
-}
-
-
 /*! Returns true if this \l{TcpServer} could be reconfigured with the given \a config. */
 void TcpServer::reconfigureServer(const ServerConfiguration &config)
 {
@@ -191,7 +311,7 @@ void TcpServer::setServerName(const QString &serverName)
  */
 bool TcpServer::startServer()
 {
-    m_server = new SslServer(configuration().sslEnabled, m_sslConfig);
+    m_server = new SslServer();
     if(!m_server->listen(configuration().address, static_cast<quint16>(configuration().port))) {
         qCWarning(dcTcpServer()) << "Tcp server error: can not listen on" << configuration().address.toString() << configuration().port;
         delete m_server;
@@ -199,9 +319,7 @@ bool TcpServer::startServer()
         return false;
     }
 
-    connect(m_server, SIGNAL(clientConnected(QSslSocket *)), SLOT(onClientConnected(QSslSocket *)));
-    connect(m_server, SIGNAL(clientDisconnected(QSslSocket *)), SLOT(onClientDisconnected(QSslSocket *)));
-    connect(m_server, &SslServer::dataAvailable, this, &TcpServer::onDataAvailable);
+    connect(m_server, &SslServer::socketDescriptorAvailable, this, &TcpServer::onSocketDescriptorAvailable);
 
     qCDebug(dcTcpServer()) << "Started Tcp server" << serverUrl().toString();
 
@@ -220,55 +338,113 @@ bool TcpServer::stopServer()
     m_server->close();
     m_server->deleteLater();
     m_server = nullptr;
+
+    foreach (TcpServerConnection *connection, m_connections) {
+        QUuid clientId = m_clientList.key(connection);
+        if (clientId.isNull()) {
+            QMetaObject::invokeMethod(connection, "abort", Qt::QueuedConnection);
+        } else {
+            terminateClientConnection(clientId);
+        }
+    }
     return true;
 }
 
 /*! This method will be called if a new \a socketDescriptor is about to connect to this SslSocket. */
 void SslServer::incomingConnection(qintptr socketDescriptor)
 {
-    QSslSocket *sslSocket = new QSslSocket(this);
+    emit socketDescriptorAvailable(socketDescriptor);
+}
+
+/*! Constructs a TcpServerConnection for the given \a socketDescriptor. If \a sslEnabled is true, the
+    connection will be encrypted using the given \a config and the handshake is registered in the
+    \a tlsSessionCache. The socket is created in \l{start()}, after the connection has been moved to
+    its I/O thread.
+*/
+TcpServerConnection::TcpServerConnection(qintptr socketDescriptor, bool sslEnabled, const QSslConfiguration &config, TlsSessionCache *tlsSessionCache) :
+    QObject(nullptr),
+    m_socketDescriptor(socketDescriptor),
+    m_sslEnabled(sslEnabled),
+    m_config(config),
+    m_tlsSessionCache(tlsSessionCache)
+{
+
+}
+
+/*! Sets up the socket and starts the SSL handshake if enabled. */
+void TcpServerConnection::start()
+{
+    m_socket = new QSslSocket(this);
 
-    qCDebug(dcTcpServer()) << "New client socket connection:" << sslSocket;
+    qCDebug(dcTcpServer()) << "New client socket connection:" << m_socket;
 
-    connect(sslSocket, &QSslSocket::encrypted, [this, sslSocket](){ emit clientConnected(sslSocket); });
-    connect(sslSocket, &QSslSocket::readyRead, this, &SslServer::onSocketReadyRead);
-    connect(sslSocket, &QSslSocket::disconnected, this, &SslServer::onClientDisconnected);
+    connect(m_socket, &QSslSocket::encrypted, this, [this](){
+        if (m_tlsSessionCache) {
+            m_tlsSessionCache->handshakeFinished(m_socket);
+        }
+        emit connected(m_socket->peerAddress().toString());
+    });
+    connect(m_socket, &QSslSocket::readyRead, this, &TcpServerConnection::onReadyRead);
+    connect(m_socket, &QSslSocket::disconnected, this, &TcpServerConnection::disconnected);
     typedef void (QSslSocket:: *sslErrorsSignal)(const QList<QSslError> &);
-    connect(sslSocket, static_cast<sslErrorsSignal>(&QSslSocket::sslErrors), this, [](const QList<QSslError> &errors) {
+    connect(m_socket, static_cast<sslErrorsSignal>(&QSslSocket::sslErrors), this, [](const QList<QSslError> &errors) {
         qCWarning(dcTcpServer()) << "SSL Errors happened in the client connections:";
         foreach (const QSslError &error, errors) {
             qCWarning(dcTcpServer()) << "SSL Error:" << error.error() << error.errorString();
         }
     });
 
-    if (!sslSocket->setSocketDescriptor(socketDescriptor)) {
+    if (!m_socket->setSocketDescriptor(m_socketDescriptor)) {
         qCWarning(dcTcpServer()) << "Failed to set SSL socket descriptor.";
-        delete sslSocket;
+        emit disconnected();
         return;
     }
     if (m_sslEnabled) {
         qCDebug(dcTcpServer()) << "Starting SSL encryption";
-        sslSocket->setSslConfiguration(m_config);
-        sslSocket->startServerEncryption();
+        // For encrypted connections bytesWritten() is emitted once the data has been encrypted, not when it has been sent
+        connect(m_socket, &QSslSocket::encryptedBytesWritten, this, &TcpServerConnection::bytesWritten);
+        m_socket->setSslConfiguration(m_config);
+        m_socket->startServerEncryption();
+        if (m_tlsSessionCache) {
+            m_tlsSessionCache->setupSocket(m_socket);
+        }
     } else {
-        emit clientConnected(sslSocket);
+        connect(m_socket, &QSslSocket::bytesWritten, this, &TcpServerConnection::bytesWritten);
+        emit connected(m_socket->peerAddress().toString());
     }
 }
 
-void SslServer::onClientDisconnected()
+/*! Writes the given \a data to the socket. */
+void TcpServerConnection::write(const QByteArray &data)
 {
-    QSslSocket *socket = static_cast<QSslSocket*>(sender());
-    qCDebug(dcTcpServer()) << "Client socket disconnected:" << socket;
-    emit clientDisconnected(socket);
-    socket->deleteLater();
+    m_socket->write(data);
 }
 
-void SslServer::onSocketReadyRead()
+/*! Closes the socket once all pending data has been written. */
+void TcpServerConnection::close()
 {
-    QSslSocket *socket = static_cast<QSslSocket*>(sender());
-    QByteArray data = socket->readAll();
+    m_socket->close();
+}
+
+/*! Closes the socket immediately, discarding any pending data. */
+void TcpServerConnection::abort()
+{
+    m_socket->abort();
+}
+
+void TcpServerConnection::onReadyRead()
+{
+    QByteArray data = m_socket->readAll();
     qCDebug(dcTcpServerTraffic()) << "Reading socket data:" << data;
-    emit dataAvailable(socket, data);
+    foreach (const JsonPacket &packet, m_reader.read(data)) {
+        emit packetAvailable(packet);
+    }
+
+    if (m_reader.bufferSize() > JsonPacketReader::maxBufferSize) {
+        qCWarning(dcTcpServer()) << "Client buffer larger than 10KB and no valid data. Dropping client connection.";
+        m_reader.clear();
+        m_socket->close();
+    }
 }
 
 }
@@ -38,9 +38,14 @@
 #include <QUuid>
 #include <QTimer>
 #include <QSslConfiguration>
+#include <QSslSocket>
 #include <QDebug>
 
 #include "transportinterface.h"
+#include "sendqueue.h"
+#include "iothreadpool.h"
+#include "jsonpacketreader.h"
+#include "tlssessioncache.h"
 
 #include "loggingcategories.h"
 
@@ -50,57 +55,89 @@ class SslServer: public QTcpServer
 {
     Q_OBJECT
 public:
-    SslServer(bool sslEnabled, const QSslConfiguration &config, QObject *parent = nullptr):
-        QTcpServer(parent),
-        m_sslEnabled(sslEnabled),
-        m_config(config)
+    SslServer(QObject *parent = nullptr):
+        QTcpServer(parent)
     {
 
     }
 
 signals:
-    void clientConnected(QSslSocket *socket);
-    void clientDisconnected(QSslSocket *socket);
-    void dataAvailable(QSslSocket *socket, const QByteArray &data);
+    void socketDescriptorAvailable(qintptr socketDescriptor);
 
 protected:
     void incomingConnection(qintptr socketDescriptor) override;
+};
+
+class TcpServerConnection : public QObject
+{
+    Q_OBJECT
+public:
+    TcpServerConnection(qintptr socketDescriptor, bool sslEnabled, const QSslConfiguration &config, TlsSessionCache *tlsSessionCache = nullptr);
+
+public slots:
+    void start();
+    void write(const QByteArray &data);
+    void close();
+    void abort();
+
+signals:
+    void connected(const QString &peerAddress);
+    void disconnected();
+    void packetAvailable(const nymeaserver::JsonPacket &packet);
+    void bytesWritten(qint64 bytes);
 
 private slots:
-    void onClientDisconnected();
-    void onSocketReadyRead();
+    void onReadyRead();
 
 private:
+    qintptr m_socketDescriptor;
     bool m_sslEnabled = false;
     QSslConfiguration m_config;
+    TlsSessionCache *m_tlsSessionCache = nullptr;
+    QSslSocket *m_socket = nullptr;
+    JsonPacketReader m_reader;
 };
 
 class TcpServer : public TransportInterface
 {
     Q_OBJECT
 public:
-    explicit TcpServer(const ServerConfiguration &configuration, const QSslConfiguration &sslConfiguration, QObject *parent = nullptr);
+    explicit TcpServer(const ServerConfiguration &configuration, const QSslConfiguration &sslConfiguration, IOThreadPool *ioThreadPool = nullptr, QObject *parent = nullptr);
     ~TcpServer() override;
 
     QUrl serverUrl() const;
 
     void sendData(const QUuid &clientId, const QByteArray &data) override;
     void sendData(const QList<QUuid> &clients, const QByteArray &data) override;
+    void sendNotification(const QUuid &clientId, const QByteArray &data, const QString &coalesceKey = QString()) override;
 
     void terminateClientConnection(const QUuid &clientId) override;
 
+    SendQueue::Limits sendQueueLimits() const;
+    void setSendQueueLimits(const SendQueue::Limits &limits);
+
+    void setTlsSessionCache(TlsSessionCache *tlsSessionCache);
+
+    QVariantList clientStatistics() const override;
+
 private:
     QTimer *m_timer;
 
     SslServer * m_server;
-    QHash<QUuid, QTcpSocket *> m_clientList;
+    IOThreadPool *m_ioThreadPool = nullptr;
+    TlsSessionCache *m_tlsSessionCache = nullptr;
+    QList<TcpServerConnection *> m_connections;
+    QHash<QUuid, TcpServerConnection *> m_clientList;
+    QHash<QUuid, QString> m_clientAddresses;
+    QHash<QUuid, SendQueue *> m_sendQueues;
+    SendQueue::Limits m_sendQueueLimits;
 
     QSslConfiguration m_sslConfig;
 
 private slots:
-    void onClientConnected(QSslSocket *socket);
-    void onClientDisconnected(QSslSocket *socket);
-    void onDataAvailable(QSslSocket *socket, const QByteArray &data);
+    void onSocketDescriptorAvailable(qintptr socketDescriptor);
+    void onClientConnected(TcpServerConnection *connection, const QString &peerAddress);
+    void onClientDisconnected(TcpServerConnection *connection);
     void onError(QAbstractSocket::SocketError error);
 
 public slots:
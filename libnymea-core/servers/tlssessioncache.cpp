@@ -0,0 +1,292 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* Copyright 2013 - 2020, nymea GmbH
+* Contact: contact@nymea.io
+*
+* This file is part of nymea.
+* This project including source code and documentation is protected by
+* copyright law, and remains the property of nymea GmbH. All rights, including
+* reproduction, publication, editing and translation, are reserved. The use of
+* this project is subject to the terms of a license agreement to be concluded
+* with nymea GmbH in accordance with the terms of use of nymea GmbH, available
+* under https://nymea.io/license
+*
+* GNU General Public License Usage
+* Alternatively, this project may be redistributed and/or modified under the
+* terms of the GNU General Public License as published by the Free Software
+* Foundation, GNU version 3. This project is distributed in the hope that it
+* will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+* of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+* Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with
+* this project. If not, see <https://www.gnu.org/licenses/>.
+*
+* For any further details and any questions please contact us under
+* contact@nymea.io or see our FAQ/Licensing Information on
+* https://nymea.io/license/faq
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+/*!
+    \class nymeaserver::TlsSessionCache
+    \brief Shares TLS sessions between the connections of the SSL enabled transports.
+
+    \ingroup server
+    \inmodule core
+
+    Mobile clients reconnect frequently and a full TLS handshake is expensive on low end devices.
+    QSslSocket creates a separate OpenSSL context for every server socket, so a session negotiated on
+    one connection is unknown to the next one. The cache therefore installs a shared session store
+    and shared session ticket keys on the native context of every server socket, which allows clients
+    to resume their session on a new connection. It counts how many handshakes resumed a session
+    compared to full handshakes.
+
+    Sessions are identified by their session id. A session is forgotten once it has not been used
+    for the configured lifetime, or when the cache exceeds its size, in which case the least recently
+    used sessions are dropped first. Session tickets are valid for the same lifetime and can be
+    switched off in the \l{Settings}.
+
+    The cache is used by the I/O threads of all transports and is therefore thread safe.
+*/
+
+#include "tlssessioncache.h"
+#include "loggingcategories.h"
+
+#include <QDateTime>
+#include <QMutexLocker>
+
+#include <openssl/ssl.h>
+#include <openssl/rand.h>
+
+namespace nymeaserver {
+
+static const unsigned char sessionIdContext[] = "nymea";
+
+// Glue between the OpenSSL session callbacks and the cache installed on the context
+class TlsSessionCacheCallbacks
+{
+public:
+    static int contextIndex()
+    {
+        static int index = SSL_CTX_get_ex_new_index(0, nullptr, nullptr, nullptr, nullptr);
+        return index;
+    }
+
+    static TlsSessionCache *cache(SSL_CTX *context)
+    {
+        return static_cast<TlsSessionCache *>(SSL_CTX_get_ex_data(context, contextIndex()));
+    }
+
+    static QByteArray sessionId(const SSL_SESSION *session)
+    {
+        unsigned int length = 0;
+        const unsigned char *id = SSL_SESSION_get_id(session, &length);
+        return QByteArray(reinterpret_cast<const char *>(id), static_cast<int>(length));
+    }
+
+    static int newSession(SSL *ssl, SSL_SESSION *session)
+    {
+        TlsSessionCache *tlsSessionCache = cache(SSL_get_SSL_CTX(ssl));
+        int size = i2d_SSL_SESSION(session, nullptr);
+        if (tlsSessionCache && size > 0) {
+            QByteArray data(size, 0);
+            unsigned char *buffer = reinterpret_cast<unsigned char *>(data.data());
+            i2d_SSL_SESSION(session, &buffer);
+            tlsSessionCache->storeSession(sessionId(session), data);
+        }
+        // The session has been serialized, OpenSSL keeps its reference
+        return 0;
+    }
+
+#if OPENSSL_VERSION_NUMBER >= 0x10100000L
+    static SSL_SESSION *getSession(SSL *ssl, const unsigned char *id, int length, int *copy)
+#else
+    static SSL_SESSION *getSession(SSL *ssl, unsigned char *id, int length, int *copy)
+#endif
+    {
+        // The returned session is newly created and handed over to OpenSSL
+        *copy = 0;
+        TlsSessionCache *tlsSessionCache = cache(SSL_get_SSL_CTX(ssl));
+        if (!tlsSessionCache) {
+            return nullptr;
+        }
+        QByteArray data = tlsSessionCache->lookupSession(QByteArray(reinterpret_cast<const char *>(id), length));
+        if (data.isEmpty()) {
+            return nullptr;
+        }
+        const unsigned char *buffer = reinterpret_cast<const unsigned char *>(data.constData());
+        return d2i_SSL_SESSION(nullptr, &buffer, data.size());
+    }
+
+    static void removeSession(SSL_CTX *context, SSL_SESSION *session)
+    {
+        TlsSessionCache *tlsSessionCache = cache(context);
+        if (tlsSessionCache) {
+            tlsSessionCache->removeSession(sessionId(session));
+        }
+    }
+};
+
+/*! Constructs a TlsSessionCache with the given \a settings and \a parent. */
+TlsSessionCache::TlsSessionCache(const Settings &settings, QObject *parent) :
+    QObject(parent),
+    m_settings(settings)
+{
+    if (RAND_bytes(m_ticketKeys, sizeof(m_ticketKeys)) != 1) {
+        qCWarning(dcServerManager()) << "Could not create TLS session ticket keys. Session tickets disabled.";
+        m_settings.sessionTickets = false;
+    }
+}
+
+/*! Returns the settings of this cache. */
+TlsSessionCache::Settings TlsSessionCache::settings() const
+{
+    return m_settings;
+}
+
+/*! Returns a copy of the given \a sslConfiguration to be used for server sockets. */
+QSslConfiguration TlsSessionCache::serverConfiguration(const QSslConfiguration &sslConfiguration) const
+{
+    QSslConfiguration configuration = sslConfiguration;
+    configuration.setSslOption(QSsl::SslOptionDisableSessionTickets, !m_settings.sessionTickets);
+    return configuration;
+}
+
+/*! Installs the shared session store and session ticket keys on the native TLS context of the given
+    server \a socket. This must be called right after QSslSocket::startServerEncryption(), before the
+    socket processed the hello message of the client.
+*/
+void TlsSessionCache::setupSocket(QSslSocket *socket)
+{
+    SSL *ssl = static_cast<SSL *>(socket->sslHandle());
+    if (!ssl) {
+        qCWarning(dcServerManager()) << "No TLS context for socket" << socket << ". Sessions can't be resumed on this connection.";
+        return;
+    }
+
+    SSL_CTX *context = SSL_get_SSL_CTX(ssl);
+    SSL_CTX_set_ex_data(context, TlsSessionCacheCallbacks::contextIndex(), this);
+    // Only the shared store is used, the store of the socket's own context would never see a second connection
+    SSL_CTX_set_session_cache_mode(context, SSL_SESS_CACHE_SERVER | SSL_SESS_CACHE_NO_INTERNAL);
+    SSL_CTX_set_timeout(context, m_settings.lifetime);
+    SSL_CTX_sess_set_new_cb(context, TlsSessionCacheCallbacks::newSession);
+    SSL_CTX_sess_set_get_cb(context, TlsSessionCacheCallbacks::getSession);
+    SSL_CTX_sess_set_remove_cb(context, TlsSessionCacheCallbacks::removeSession);
+
+    // Sessions are only resumed within the same session id context. The SSL object already copied
+    // the one of the context when it was created.
+    SSL_CTX_set_session_id_context(context, sessionIdContext, sizeof(sessionIdContext) - 1);
+    SSL_set_session_id_context(ssl, sessionIdContext, sizeof(sessionIdContext) - 1);
+
+    if (m_settings.sessionTickets) {
+        SSL_CTX_set_tlsext_ticket_keys(context, m_ticketKeys, sizeof(m_ticketKeys));
+    }
+}
+
+/*! Registers the finished handshake of the given server \a socket. Returns true if the handshake
+    resumed a previous session.
+*/
+bool TlsSessionCache::handshakeFinished(QSslSocket *socket)
+{
+    SSL *ssl = static_cast<SSL *>(socket->sslHandle());
+    bool resumed = ssl && SSL_session_reused(ssl);
+
+    QMutexLocker locker(&m_mutex);
+    if (resumed) {
+        m_resumedHandshakes++;
+    } else {
+        m_fullHandshakes++;
+    }
+
+    qCDebug(dcServerManager()) << "TLS handshake finished:" << (resumed ? "resumed" : "full");
+    return resumed;
+}
+
+/*! Returns the number of full handshakes. */
+int TlsSessionCache::fullHandshakes() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_fullHandshakes;
+}
+
+/*! Returns the number of handshakes which resumed a previous session. */
+int TlsSessionCache::resumedHandshakes() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_resumedHandshakes;
+}
+
+/*! Returns the counters and settings of this cache. */
+QVariantMap TlsSessionCache::statistics() const
+{
+    QMutexLocker locker(&m_mutex);
+    QVariantMap statistics;
+    statistics.insert("fullHandshakes", m_fullHandshakes);
+    statistics.insert("resumedHandshakes", m_resumedHandshakes);
+    statistics.insert("cachedSessions", m_sessions.count());
+    statistics.insert("cacheSize", m_settings.cacheSize);
+    statistics.insert("lifetime", m_settings.lifetime);
+    statistics.insert("sessionTickets", m_settings.sessionTickets);
+    return statistics;
+}
+
+void TlsSessionCache::storeSession(const QByteArray &sessionId, const QByteArray &data)
+{
+    if (sessionId.isEmpty()) {
+        return;
+    }
+
+    QMutexLocker locker(&m_mutex);
+    qint64 now = QDateTime::currentMSecsSinceEpoch();
+    expireSessions(now);
+
+    CachedSession session;
+    session.data = data;
+    session.lastUsed = now;
+    m_sessions.insert(sessionId, session);
+
+    while (!m_sessions.isEmpty() && m_sessions.count() > m_settings.cacheSize) {
+        QHash<QByteArray, CachedSession>::iterator oldest = m_sessions.begin();
+        for (QHash<QByteArray, CachedSession>::iterator it = m_sessions.begin(); it != m_sessions.end(); ++it) {
+            if (it.value().lastUsed < oldest.value().lastUsed) {
+                oldest = it;
+            }
+        }
+        m_sessions.erase(oldest);
+    }
+}
+
+QByteArray TlsSessionCache::lookupSession(const QByteArray &sessionId)
+{
+    QMutexLocker locker(&m_mutex);
+    qint64 now = QDateTime::currentMSecsSinceEpoch();
+    expireSessions(now);
+
+    QHash<QByteArray, CachedSession>::iterator it = m_sessions.find(sessionId);
+    if (it == m_sessions.end()) {
+        return QByteArray();
+    }
+    it.value().lastUsed = now;
+    return it.value().data;
+}
+
+void TlsSessionCache::removeSession(const QByteArray &sessionId)
+{
+    QMutexLocker locker(&m_mutex);
+    m_sessions.remove(sessionId);
+}
+
+void TlsSessionCache::expireSessions(qint64 now)
+{
+    qint64 maxAge = static_cast<qint64>(m_settings.lifetime) * 1000;
+    QHash<QByteArray, CachedSession>::iterator it = m_sessions.begin();
+    while (it != m_sessions.end()) {
+        if (now - it.value().lastUsed > maxAge) {
+            it = m_sessions.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+}
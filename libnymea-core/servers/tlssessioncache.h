@@ -0,0 +1,93 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* Copyright 2013 - 2020, nymea GmbH
+* Contact: contact@nymea.io
+*
+* This file is part of nymea.
+* This project including source code and documentation is protected by
+* copyright law, and remains the property of nymea GmbH. All rights, including
+* reproduction, publication, editing and translation, are reserved. The use of
+* this project is subject to the terms of a license agreement to be concluded
+* with nymea GmbH in accordance with the terms of use of nymea GmbH, available
+* under https://nymea.io/license
+*
+* GNU General Public License Usage
+* Alternatively, this project may be redistributed and/or modified under the
+* terms of the GNU General Public License as published by the Free Software
+* Foundation, GNU version 3. This project is distributed in the hope that it
+* will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+* of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+* Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with
+* this project. If not, see <https://www.gnu.org/licenses/>.
+*
+* For any further details and any questions please contact us under
+* contact@nymea.io or see our FAQ/Licensing Information on
+* https://nymea.io/license/faq
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#ifndef TLSSESSIONCACHE_H
+#define TLSSESSIONCACHE_H
+
+#include <QObject>
+#include <QByteArray>
+#include <QHash>
+#include <QMutex>
+#include <QSslConfiguration>
+#include <QSslSocket>
+#include <QVariantMap>
+
+namespace nymeaserver {
+
+class TlsSessionCache : public QObject
+{
+    Q_OBJECT
+public:
+    class Settings {
+    public:
+        int cacheSize = 256;
+        int lifetime = 3600;
+        bool sessionTickets = true;
+    };
+
+    explicit TlsSessionCache(const Settings &settings, QObject *parent = nullptr);
+
+    Settings settings() const;
+
+    QSslConfiguration serverConfiguration(const QSslConfiguration &sslConfiguration) const;
+
+    void setupSocket(QSslSocket *socket);
+    bool handshakeFinished(QSslSocket *socket);
+
+    int fullHandshakes() const;
+    int resumedHandshakes() const;
+
+    QVariantMap statistics() const;
+
+private:
+    friend class TlsSessionCacheCallbacks;
+
+    class CachedSession {
+    public:
+        QByteArray data;
+        qint64 lastUsed = 0;
+    };
+
+    void storeSession(const QByteArray &sessionId, const QByteArray &data);
+    QByteArray lookupSession(const QByteArray &sessionId);
+    void removeSession(const QByteArray &sessionId);
+    void expireSessions(qint64 now);
+
+    Settings m_settings;
+    unsigned char m_ticketKeys[48];
+
+    mutable QMutex m_mutex;
+    QHash<QByteArray, CachedSession> m_sessions;
+    int m_fullHandshakes = 0;
+    int m_resumedHandshakes = 0;
+};
+
+}
+
+#endif // TLSSESSIONCACHE_H
@@ -56,6 +56,10 @@
 
     You can turn on the HTTPS server in the \tt WebServer section of the \tt /etc/nymea/nymead.conf file.
 
+    The web server lives in one of the threads of the \l{IOThreadPool}. Requests for the debug interface
+    and the server description need the core and are answered by a \l{WebServerCoreHandler} in the main
+    thread.
+
     \note For \tt HTTPS you need to have a certificate and configure it in the \tt SSL-configuration
     section of the \tt /etc/nymea/nymead.conf file.
 
@@ -86,6 +90,8 @@
 #include "nymeacore.h"
 #include "httpreply.h"
 #include "httprequest.h"
+#include "httpfiletransfer.h"
+#include "tlssessioncache.h"
 #include "debugserverhandler.h"
 #include "version.h"
 
@@ -115,6 +121,13 @@ WebServer::WebServer(const WebServerConfiguration &configuration, const QSslConf
     if (QCoreApplication::instance()->organizationName() == "nymea-test") {
         m_configuration.publicFolder = QCoreApplication::applicationDirPath();
     }
+
+    // Created in the core thread, it stays there when this server is moved to an I/O thread
+    qRegisterMetaType<HttpRequest>();
+    m_coreHandler = new WebServerCoreHandler(m_configuration);
+    connect(this, &WebServer::coreRequestReceived, m_coreHandler, &WebServerCoreHandler::processRequest, Qt::QueuedConnection);
+    connect(m_coreHandler, &WebServerCoreHandler::replyReady, this, &WebServer::onCoreReplyReady, Qt::QueuedConnection);
+
     qCDebug(dcWebServer()) << "Starting WebServer. Interface:" << m_configuration.address << "Port:" << m_configuration.port << "SSL:" << m_configuration.sslEnabled << "AUTH:" << m_configuration.authenticationEnabled << "Public folder:" << QDir(m_configuration.publicFolder).canonicalPath();
 }
 
@@ -124,6 +137,7 @@ WebServer::~WebServer()
     qCDebug(dcWebServer()) << "Shutting down \"Webserver\"" << serverUrl().toString();
 
     this->close();
+    m_coreHandler->deleteLater();
 }
 
 /*! Returns the server URL of this WebServer. */
@@ -146,11 +160,55 @@ void WebServer::sendHttpReply(HttpReply *reply)
         return;
     }
 
+    bool closeConnection = reply->closeConnection() || m_closingConnections.contains(socket);
+    if (closeConnection) {
+        reply->setHeader(HttpReply::ConnectionHeader, "close");
+    }
+
+    // File bodies are streamed once the header is out
+    HttpFileTransfer *transfer = nullptr;
+    if (reply->hasFileBody()) {
+        transfer = new HttpFileTransfer(socket, reply->fileName(), reply->fileOffset(), reply->fileLength(), this);
+        if (!transfer->open()) {
+            delete transfer;
+            transfer = nullptr;
+            reply->setHttpStatusCode(HttpReply::InternalServerError);
+            reply->setPayload(QByteArray());
+        }
+    }
+
     // send raw data
     reply->packReply();
     qCDebug(dcWebServerTraffic()) << "Send reply to" << socket->peerAddress().toString() << reply;
     qCDebug(dcWebServer()) << "Respond" << socket->peerAddress().toString() << reply->httpStatusCode() << reply->httpReasonPhrase();
     socket->write(reply->data());
+
+    if (transfer) {
+        if (closeConnection) {
+            m_closingConnections.insert(socket);
+        }
+        m_fileTransfers.insert(socket, transfer);
+        connect(transfer, &HttpFileTransfer::dataSent, this, &WebServer::onFileTransferDataSent);
+        connect(transfer, &HttpFileTransfer::finished, this, &WebServer::onFileTransferFinished);
+        transfer->start();
+        return;
+    }
+
+    if (closeConnection) {
+        socket->disconnectFromHost();
+    }
+}
+
+/*! Sets the \a limits for the requests of new connections. */
+void WebServer::setRequestLimits(const HttpRequestParser::Limits &limits)
+{
+    m_requestLimits = limits;
+}
+
+/*! Sets the \a tlsSessionCache registering the handshakes of encrypted connections. */
+void WebServer::setTlsSessionCache(TlsSessionCache *tlsSessionCache)
+{
+    m_tlsSessionCache = tlsSessionCache;
 }
 
 bool WebServer::verifyFile(QSslSocket *socket, const QString &fileName)
@@ -190,6 +248,133 @@ bool WebServer::verifyFile(QSslSocket *socket, const QString &fileName)
     return true;
 }
 
+bool WebServer::processFileRequest(QSslSocket *socket, const HttpRequest &request)
+{
+    QString path = fileName(request.url().path());
+    if (!verifyFile(socket, path))
+        return true;
+
+    StaticFileCache::Entry entry = m_staticFileCache.entry(path);
+    if (!entry.isValid())
+        return false;
+
+    StaticFileCache::Encoding encoding = StaticFileCache::preferredEncoding(entry, request.header("Accept-Encoding"));
+    QByteArray etag = entry.etagFor(encoding);
+
+    // Check if the client has this version of the file already
+    bool notModified = false;
+    QByteArray ifNoneMatch = request.header("If-None-Match");
+    if (!ifNoneMatch.isEmpty()) {
+        foreach (QByteArray candidate, ifNoneMatch.split(',')) {
+            candidate = candidate.trimmed();
+            if (candidate.startsWith("W/")) {
+                candidate = candidate.mid(2);
+            }
+            if (candidate == etag || candidate == "*") {
+                notModified = true;
+            }
+        }
+    } else if (!request.header("If-Modified-Since").isEmpty()) {
+        QDateTime modifiedSince = HttpRequest::parseHttpDate(request.header("If-Modified-Since"));
+        notModified = modifiedSince.isValid() && entry.lastModified.toMSecsSinceEpoch() / 1000 <= modifiedSince.toMSecsSinceEpoch() / 1000;
+    }
+
+    HttpReply *reply = HttpReply::createSuccessReply();
+    reply->setClientId(m_clientList.key(socket));
+    reply->setRawHeader("ETag", etag);
+    reply->setRawHeader("Last-Modified", entry.lastModifiedHeader);
+    if (!entry.encodedData.isEmpty()) {
+        reply->setRawHeader("Vary", "Accept-Encoding");
+    }
+
+    if (notModified) {
+        qCDebug(dcWebServer()) << "File" << path << "not modified";
+        reply->setHttpStatusCode(HttpReply::NotModified);
+        reply->setPayload(QByteArray());
+    } else {
+        reply->setHeader(HttpReply::ContentTypeHeader, entry.contentType);
+        if (encoding != StaticFileCache::EncodingIdentity) {
+            reply->setRawHeader("Content-Encoding", StaticFileCache::encodingName(encoding));
+        }
+        if (entry.streamed) {
+            reply->setFileBody(path, 0, entry.size);
+        } else {
+            reply->setPayload(entry.payload(encoding));
+        }
+        processRangeRequest(reply, request);
+    }
+
+    sendHttpReply(reply);
+    reply->deleteLater();
+    return true;
+}
+
+void WebServer::processRangeRequest(HttpReply *reply, const HttpRequest &request)
+{
+    // Ranges of encoded content would refer to the encoded bytes, only plain bodies are served partially
+    if (reply->httpStatusCode() != HttpReply::Ok || reply->rawHeaderList().contains("Content-Encoding"))
+        return;
+
+    reply->setRawHeader("Accept-Ranges", "bytes");
+
+    // Multiple ranges are not supported, the whole body is a valid answer to those (RFC 7233)
+    QByteArray range = request.header("Range").trimmed();
+    if (!range.startsWith("bytes=") || range.contains(','))
+        return;
+
+    // If-Range: the range only applies if the client still has the current version
+    QByteArray ifRange = request.header("If-Range").trimmed();
+    if (!ifRange.isEmpty() && ifRange != reply->rawHeaderList().value("ETag") && ifRange != reply->rawHeaderList().value("Last-Modified"))
+        return;
+
+    QList<QByteArray> bounds = range.mid(6).split('-');
+    if (bounds.count() != 2)
+        return;
+
+    qint64 size = reply->hasFileBody() ? reply->fileLength() : reply->payload().size();
+    QByteArray first = bounds.at(0).trimmed();
+    QByteArray last = bounds.at(1).trimmed();
+    bool firstValid = false;
+    bool lastValid = false;
+    qint64 start = first.toLongLong(&firstValid);
+    qint64 end = last.toLongLong(&lastValid);
+    bool satisfiable = true;
+
+    if (first.isEmpty()) {
+        // Suffix range, the last bytes of the body
+        if (!lastValid)
+            return;
+
+        satisfiable = end > 0 && size > 0;
+        start = qMax(size - end, Q_INT64_C(0));
+        end = size - 1;
+    } else {
+        if (!firstValid || (!last.isEmpty() && (!lastValid || end < start)))
+            return;
+
+        if (last.isEmpty() || end >= size) {
+            end = size - 1;
+        }
+        satisfiable = start < size;
+    }
+
+    if (!satisfiable) {
+        qCDebug(dcWebServer()) << "Range" << range << "not satisfiable for body of" << size << "bytes";
+        reply->setHttpStatusCode(HttpReply::RangeNotSatisfiable);
+        reply->setRawHeader("Content-Range", "bytes */" + QByteArray::number(size));
+        reply->setPayload(QByteArray());
+        return;
+    }
+
+    reply->setHttpStatusCode(HttpReply::PartialContent);
+    reply->setRawHeader("Content-Range", "bytes " + QByteArray::number(start) + "-" + QByteArray::number(end) + "/" + QByteArray::number(size));
+    if (reply->hasFileBody()) {
+        reply->setFileBody(reply->fileName(), reply->fileOffset() + start, end - start + 1);
+    } else {
+        reply->setPayload(reply->payload().mid(static_cast<int>(start), static_cast<int>(end - start + 1)));
+    }
+}
+
 QString WebServer::fileName(const QString &query)
 {
     QString fileName;
@@ -237,6 +422,9 @@ void WebServer::incomingConnection(qintptr socketDescriptor)
         return;
     }
 
+    // Data is only read while the connection is not busy with a previous request, don't buffer more than that
+    socket->setReadBufferSize(m_requestLimits.maxRequestLineSize + m_requestLimits.maxHeaderSize);
+
     // check webserver client
     bool existing = false;
     foreach (WebServerClient *client, m_webServerClients) {
@@ -262,6 +450,7 @@ void WebServer::incomingConnection(qintptr socketDescriptor)
     // append the new client to the client list
     QUuid clientId = QUuid::createUuid();
     m_clientList.insert(clientId, socket);
+    m_requestParsers.insert(socket, HttpRequestParser(m_requestLimits));
 
     qCDebug(dcWebServer()).noquote() << QString("Webserver client %1:%2 connected").arg(socket->peerAddress().toString()).arg(socket->peerPort());
 
@@ -270,6 +459,9 @@ void WebServer::incomingConnection(qintptr socketDescriptor)
         socket->setSslConfiguration(m_sslConfiguration);
         connect(socket, SIGNAL(encrypted()), this, SLOT(onEncrypted()));
         socket->startServerEncryption();
+        if (m_tlsSessionCache) {
+            m_tlsSessionCache->setupSocket(socket);
+        }
         // wait for encrypted connection before continue with this client
         return;
     }
@@ -286,7 +478,11 @@ void WebServer::readClient()
     if (!m_enabled)
         return;
 
-    QSslSocket *socket = qobject_cast<QSslSocket *>(sender());
+    processClientData(qobject_cast<QSslSocket *>(sender()));
+}
+
+void WebServer::processClientData(QSslSocket *socket)
+{
     QUuid clientId = m_clientList.key(socket);
 
     // Check client
@@ -296,35 +492,59 @@ void WebServer::readClient()
         return;
     }
 
-    // Read HTTP request
-    QByteArray data = socket->readAll();
+    // Further requests stay in the socket until the previous reply has been sent
+    if (isBusy(socket))
+        return;
 
-    HttpRequest request;
-    if (m_incompleteRequests.contains(socket)) {
-        qCDebug(dcWebServer()) << "Append data to incomlete request";
-        request = m_incompleteRequests.take(socket);
-        request.appendData(data);
-    } else {
-        request = HttpRequest(data);
+    // Data following the last request of a connection is dropped
+    if (m_closingConnections.contains(socket)) {
+        socket->readAll();
+        return;
     }
 
-    // Check if the request is complete
-    if (!request.isComplete()) {
-        m_incompleteRequests.insert(socket, request);
-        return;
+    HttpRequestParser &parser = m_requestParsers[socket];
+    parser.addData(socket->readAll());
+
+    HttpRequestParser::Result result = parser.parse();
+    while (result != HttpRequestParser::NeedMoreData) {
+        if (result == HttpRequestParser::Error) {
+            // The framing of the connection is lost, requests received along with the broken one are dropped as well
+            qCWarning(dcWebServer()) << "Got invalid request from" << socket->peerAddress().toString() << parser.errorString();
+            m_pendingRequests.remove(socket);
+            m_closingConnections.insert(socket);
+            HttpReply *reply = HttpReply::createErrorReply(parser.errorStatusCode());
+            reply->setClientId(clientId);
+            sendHttpReply(reply);
+            reply->deleteLater();
+            return;
+        }
+
+        if (result == HttpRequestParser::RequestComplete) {
+            m_pendingRequests[socket].append(parser.takeRequest());
+        }
+        result = parser.parse();
     }
 
-    qCDebug(dcWebServerTraffic()) << "Received request from" << clientId.toString() << socket->peerAddress().toString() << request;
+    processPendingRequests(socket);
+}
 
-    // Check if the request is valid
-    if (!request.isValid()) {
-        qCWarning(dcWebServer()) << "Got invalid request:" << request.url().path();
-        HttpReply *reply = HttpReply::createErrorReply(HttpReply::BadRequest);
-        reply->setClientId(clientId);
-        sendHttpReply(reply);
-        reply->deleteLater();
-        return;
+bool WebServer::isBusy(QSslSocket *socket) const
+{
+    return m_fileTransfers.contains(socket) || m_coreRequests.contains(socket);
+}
+
+void WebServer::processPendingRequests(QSslSocket *socket)
+{
+    // Pipelined requests are answered in order, one at a time
+    while (!isBusy(socket) && !m_closingConnections.contains(socket) && !m_pendingRequests.value(socket).isEmpty()) {
+        processRequest(socket, m_pendingRequests[socket].takeFirst());
     }
+}
+
+void WebServer::processRequest(QSslSocket *socket, const HttpRequest &request)
+{
+    QUuid clientId = m_clientList.key(socket);
+    qCDebug(dcWebServerTraffic()) << "Received request from" << clientId.toString() << socket->peerAddress().toString() << request;
 
     // Check HTTP version
     if (request.httpVersion() != "HTTP/1.1" && request.httpVersion() != "HTTP/1.0") {
@@ -338,6 +558,12 @@ void WebServer::readClient()
 
     qCDebug(dcWebServer()).noquote() << QString("Got valid request from %1:%2").arg(socket->peerAddress().toString()).arg(socket->peerPort()) << request.methodString() << request.url().path() << request.urlQuery().toString();
 
+    // HTTP/1.1 connections are persistent unless the client asks to close them, HTTP/1.0 connections only if the client asks to keep them
+    QByteArray connectionHeader = request.header("Connection").toLower();
+    if (connectionHeader.contains("close") || (request.httpVersion() == "HTTP/1.0" && !connectionHeader.contains("keep-alive"))) {
+        m_closingConnections.insert(socket);
+    }
+
     // Reset timout
     foreach (WebServerClient *webserverClient, m_webServerClients) {
         if (webserverClient->address() == socket->peerAddress()) {
@@ -365,56 +591,13 @@ void WebServer::readClient()
         return;
     }
 
-    // Check if this is a debug call
-    if (request.url().path().startsWith("/debug")) {
-        // Check if debug server is enabled
-        if (NymeaCore::instance()->configuration()->debugServerEnabled()) {
-            // Verify methods
-            if (request.method() != HttpRequest::Get && request.method() != HttpRequest::Options) {
-                HttpReply *reply = HttpReply::createErrorReply(HttpReply::MethodNotAllowed);
-                reply->setClientId(clientId);
-                reply->setHeader(HttpReply::AllowHeader, "GET, OPTIONS");
-                sendHttpReply(reply);
-                reply->deleteLater();
-                return;
-            }
-
-            qCDebug(dcDebugServer()) << "Request:" << request.url().toString();
-            HttpReply *reply = NymeaCore::instance()->debugServerHandler()->processDebugRequest(request.url().path(), request.urlQuery());
-            reply->setClientId(clientId);
-
-            // Handle async replies
-            if (reply->type() == HttpReply::TypeAsync) {
-                connect(reply, &HttpReply::finished, this, &WebServer::onAsyncReplyFinished);
-                reply->startWait();
-            } else {
-                sendHttpReply(reply);
-                reply->deleteLater();
-            }
-            return;
-        } else {
-            qCWarning(dcWebServer()) << "The debug server handler is disabled. You can enable it by adding \'debugServerEnabled=true\' in the \'nymead\' section of the nymead.conf file.";
-            HttpReply *reply = HttpReply::createErrorReply(HttpReply::NotFound);
-            reply->setClientId(clientId);
-            sendHttpReply(reply);
-            reply->deleteLater();
-            return;
-        }
-    }
-
-    // Check server.xml call
-    if (request.url().path() == "/server.xml" && request.method() == HttpRequest::Get) {
-        qCDebug(dcWebServer()) << "Server XML request call";
-        HttpReply *reply = HttpReply::createSuccessReply();
-        reply->setHeader(HttpReply::ContentTypeHeader, "text/xml");
-        reply->setPayload(createServerXmlDocument(socket->localAddress()));
-        reply->setClientId(clientId);
-        sendHttpReply(reply);
-        reply->deleteLater();
+    // The debug interface and the server description are answered in the core thread
+    if (request.url().path().startsWith("/debug") || (request.url().path() == "/server.xml" && request.method() == HttpRequest::Get)) {
+        m_coreRequests.insert(socket, request);
+        emit coreRequestReceived(clientId, request, socket->localAddress());
         return;
     }
 
-
     // Request for a file...
     if (request.method() == HttpRequest::Get) {
         // Check if the webinterface dir does exist, otherwise a filerequest is not relevant
@@ -428,44 +611,7 @@ void WebServer::readClient()
             return;
         }
 
-        QString path = fileName(request.url().path());
-        if (!verifyFile(socket, path))
-            return;
-
-        QFile file(path);
-        if (file.open(QFile::ReadOnly | QFile::Truncate)) {
-            qCDebug(dcWebServer()) << "Load file" << file.fileName();
-            HttpReply *reply = HttpReply::createSuccessReply();
-
-            // Check content type
-            if (file.fileName().endsWith(".html")) {
-                reply->setHeader(HttpReply::ContentTypeHeader, "text/html; charset=\"utf-8\";");
-            } else if (file.fileName().endsWith(".css")) {
-                reply->setHeader(HttpReply::ContentTypeHeader, "text/css; charset=\"utf-8\";");
-            } else if (file.fileName().endsWith(".pdf")) {
-                reply->setHeader(HttpReply::ContentTypeHeader, "application/pdf");
-            } else if (file.fileName().endsWith(".js")) {
-                reply->setHeader(HttpReply::ContentTypeHeader, "text/javascript; charset=\"utf-8\";");
-            } else if (file.fileName().endsWith(".ttf")) {
-                reply->setHeader(HttpReply::ContentTypeHeader, "application/x-font-ttf");
-            } else if (file.fileName().endsWith(".eot")) {
-                reply->setHeader(HttpReply::ContentTypeHeader, "application/vnd.ms-fontobject");
-            } else if (file.fileName().endsWith(".woff")) {
-                reply->setHeader(HttpReply::ContentTypeHeader, "application/x-font-woff");
-            } else if (file.fileName().endsWith(".jpg") || file.fileName().endsWith(".jpeg")) {
-                reply->setHeader(HttpReply::ContentTypeHeader, "image/jpeg");
-            } else if (file.fileName().endsWith(".png") || file.fileName().endsWith(".PNG")) {
-                reply->setHeader(HttpReply::ContentTypeHeader, "image/png");
-            } else if (file.fileName().endsWith(".ico")) {
-                reply->setHeader(HttpReply::ContentTypeHeader, "image/x-icon");
-            } else if (file.fileName().endsWith(".svg")) {
-                reply->setHeader(HttpReply::ContentTypeHeader, "image/svg+xml; charset=\"utf-8\";");
-            }
-
-            reply->setPayload(file.readAll());
-            reply->setClientId(clientId);
-            sendHttpReply(reply);
-            reply->deleteLater();
+        if (processFileRequest(socket, request)) {
             return;
         }
     }
@@ -500,7 +646,16 @@ void WebServer::onDisconnected()
     // clean up
     QUuid clientId = m_clientList.key(socket);
     m_clientList.remove(clientId);
-    m_incompleteRequests.remove(socket);
+    m_requestParsers.remove(socket);
+    m_pendingRequests.remove(socket);
+    m_coreRequests.remove(socket);
+    m_closingConnections.remove(socket);
+    HttpFileTransfer *transfer = m_fileTransfers.take(socket);
+    if (transfer) {
+        qCDebug(dcWebServer()) << "Client disconnected after receiving" << transfer->bytesSent() << "of" << transfer->length() << "bytes of" << transfer->fileName();
+        transfer->disconnect(this);
+        transfer->deleteLater();
+    }
     emit clientDisconnected(clientId);
 
     socket->deleteLater();
@@ -510,6 +665,9 @@ void WebServer::onEncrypted()
 {
     QSslSocket* socket = static_cast<QSslSocket *>(sender());
     qCDebug(dcWebServer()).noquote() << QString("Encrypted connection %1:%2 successfully established.").arg(socket->peerAddress().toString()).arg(socket->peerPort());
+    if (m_tlsSessionCache) {
+        m_tlsSessionCache->handshakeFinished(socket);
+    }
     connect(socket, SIGNAL(readyRead()), this, SLOT(readClient()));
     connect(socket, SIGNAL(disconnected()), this, SLOT(onDisconnected()));
     connect(socket, SIGNAL(error(QAbstractSocket::SocketError)), this, SLOT(onError(QAbstractSocket::SocketError)));
@@ -530,38 +688,59 @@ void WebServer::onError(QAbstractSocket::SocketError error)
     }
 }
 
-void WebServer::onAsyncReplyFinished()
+void WebServer::onCoreReplyReady(HttpReply *reply)
 {
-    HttpReply *reply = qobject_cast<HttpReply*>(sender());
-    qCDebug(dcWebServer()) << "Async reply finished";
-
-    // check if the reply timeouted
-    if (reply->timedOut()) {
-        reply->clear();
-        reply->setHttpStatusCode(HttpReply::GatewayTimeout);
+    QSslSocket *socket = m_clientList.value(reply->clientId());
+    if (!socket || !m_coreRequests.contains(socket)) {
+        qCDebug(dcWebServer()) << "Client disconnected before the reply was ready";
+        reply->deleteLater();
+        return;
     }
 
+    HttpRequest request = m_coreRequests.take(socket);
+    if (request.method() == HttpRequest::Get) {
+        processRangeRequest(reply, request);
+    }
     sendHttpReply(reply);
     reply->deleteLater();
+
+    if (!m_clientList.key(socket).isNull()) {
+        processClientData(socket);
+    }
 }
 
-/*! Set the configuration of this \l{WebServer} to the given \a config.
- *
- * \sa WebServerConfiguration
- */
-void WebServer::reconfigureServer(const WebServerConfiguration &config)
-{
-    if (m_configuration.address == config.address &&
-            m_configuration.port == config.port &&
-            m_configuration.sslEnabled == config.sslEnabled &&
-            m_configuration.authenticationEnabled == config.authenticationEnabled &&
-            m_configuration.publicFolder == config.publicFolder &&
-            isListening())
+void WebServer::onFileTransferDataSent()
+{
+    HttpFileTransfer *transfer = static_cast<HttpFileTransfer *>(sender());
+
+    // Big downloads take longer than the idle timeout of a connection
+    foreach (WebServerClient *webserverClient, m_webServerClients) {
+        if (webserverClient->address() == transfer->socket()->peerAddress()) {
+            webserverClient->resetTimout(transfer->socket());
+            break;
+        }
+    }
+}
+
+void WebServer::onFileTransferFinished(bool success)
+{
+    HttpFileTransfer *transfer = static_cast<HttpFileTransfer *>(sender());
+    QSslSocket *socket = transfer->socket();
+    m_fileTransfers.remove(socket);
+    transfer->deleteLater();
+
+    if (!success) {
+        qCWarning(dcWebServer()) << "Could not send" << transfer->fileName() << "completely. Closing the connection.";
+        socket->abort();
+        return;
+    }
+
+    if (m_closingConnections.contains(socket)) {
+        socket->disconnectFromHost();
         return;
+    }
 
-    stopServer();
-    m_configuration = config;
-    startServer();
+    processClientData(socket);
 }
 
 /*! Sets the server name to the given \a serverName. */
@@ -603,7 +782,77 @@ WebServerConfiguration WebServer::configuration() const
 }
 
 
-QByteArray WebServer::createServerXmlDocument(QHostAddress address)
+/*!
+    \class nymeaserver::WebServerCoreHandler
+    \brief Answers the requests of a \l{WebServer} which need the core.
+
+    \ingroup server
+    \inmodule core
+
+    The \l{WebServer} serves its clients from an I/O thread. The debug interface and the server
+    description access the core, so the \l{WebServer} hands these requests to its
+    \l{WebServerCoreHandler}, which lives in the main thread. Asynchronous replies of the debug
+    interface are only handed back once they are finished.
+
+    \sa WebServer, DebugServerHandler
+*/
+
+/*! \fn void nymeaserver::WebServerCoreHandler::replyReady(HttpReply *reply);
+    This signal is emitted when the \a reply for a request is complete.
+*/
+
+/*! Constructs a \l{WebServerCoreHandler} for the web server with the given \a configuration and \a parent. */
+WebServerCoreHandler::WebServerCoreHandler(const WebServerConfiguration &configuration, QObject *parent) :
+    QObject(parent),
+    m_configuration(configuration)
+{
+
+}
+
+/*! Answers the given \a request of the client with the given \a clientId, which has been received on \a localAddress. */
+void WebServerCoreHandler::processRequest(const QUuid &clientId, const HttpRequest &request, const QHostAddress &localAddress)
+{
+    HttpReply *reply = nullptr;
+    if (request.url().path().startsWith("/debug")) {
+        reply = processDebugRequest(request);
+    } else {
+        qCDebug(dcWebServer()) << "Server XML request call";
+        reply = HttpReply::createSuccessReply();
+        reply->setHeader(HttpReply::ContentTypeHeader, "text/xml");
+        reply->setPayload(createServerXmlDocument(localAddress));
+    }
+    reply->setClientId(clientId);
+
+    // Handle async replies
+    if (reply->type() == HttpReply::TypeAsync) {
+        connect(reply, &HttpReply::finished, this, &WebServerCoreHandler::onAsyncReplyFinished);
+        reply->startWait();
+        return;
+    }
+
+    emit replyReady(reply);
+}
+
+HttpReply *WebServerCoreHandler::processDebugRequest(const HttpRequest &request)
+{
+    // Check if debug server is enabled
+    if (!NymeaCore::instance()->configuration()->debugServerEnabled()) {
+        qCWarning(dcWebServer()) << "The debug server handler is disabled. You can enable it by adding \'debugServerEnabled=true\' in the \'nymead\' section of the nymead.conf file.";
+        return HttpReply::createErrorReply(HttpReply::NotFound);
+    }
+
+    // Verify methods
+    if (request.method() != HttpRequest::Get && request.method() != HttpRequest::Options) {
+        HttpReply *reply = HttpReply::createErrorReply(HttpReply::MethodNotAllowed);
+        reply->setHeader(HttpReply::AllowHeader, "GET, OPTIONS");
+        return reply;
+    }
+
+    qCDebug(dcDebugServer()) << "Request:" << request.url().toString();
+    return NymeaCore::instance()->debugServerHandler()->processDebugRequest(request.url().path(), request.urlQuery());
+}
+
+QByteArray WebServerCoreHandler::createServerXmlDocument(const QHostAddress &address)
 {
     QByteArray uuid = NymeaCore::instance()->configuration()->serverUuid().toString().remove(QRegExp("[{}]")).toUtf8();
 
@@ -755,6 +1004,22 @@ QByteArray WebServer::createServerXmlDocument(QHostAddress address)
     return data;
 }
 
+void WebServerCoreHandler::onAsyncReplyFinished()
+{
+    HttpReply *reply = qobject_cast<HttpReply*>(sender());
+    qCDebug(dcWebServer()) << "Async reply finished";
+    disconnect(reply, &HttpReply::finished, this, &WebServerCoreHandler::onAsyncReplyFinished);
+
+    // check if the reply timeouted
+    if (reply->timedOut()) {
+        reply->clear();
+        reply->setHttpStatusCode(HttpReply::GatewayTimeout);
+    }
+
+    emit replyReady(reply);
+}
+
+
 /*!
     \class nymeaserver::WebServerClient
     \brief This class represents a client the web server for nymead.
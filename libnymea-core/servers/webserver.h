@@ -35,6 +35,7 @@
 #include <QTcpServer>
 #include <QTcpSocket>
 #include <QHash>
+#include <QSet>
 #include <QDir>
 #include <QTimer>
 #include <QImage>
@@ -45,14 +46,18 @@
 #include <QSslKey>
 
 #include "nymeaconfiguration.h"
+#include "staticfilecache.h"
+#include "httprequestparser.h"
+#include "httprequest.h"
+#include "httpreply.h"
 
 // Note: Hypertext Transfer Protocol (HTTP/1.1) from the Internet Engineering Task Force (IETF):
 //       https://tools.ietf.org/html/rfc7231
 
 namespace nymeaserver {
 
-class HttpReply;
-class HttpRequest;
+class HttpFileTransfer;
+class TlsSessionCache;
 
 class WebServerClient : public QObject
 {
@@ -78,6 +83,29 @@ private slots:
 };
 
 
+class WebServerCoreHandler : public QObject
+{
+    Q_OBJECT
+public:
+    explicit WebServerCoreHandler(const WebServerConfiguration &configuration, QObject *parent = nullptr);
+
+public slots:
+    void processRequest(const QUuid &clientId, const HttpRequest &request, const QHostAddress &localAddress);
+
+signals:
+    void replyReady(HttpReply *reply);
+
+private:
+    WebServerConfiguration m_configuration;
+
+    HttpReply *processDebugRequest(const HttpRequest &request);
+    QByteArray createServerXmlDocument(const QHostAddress &address);
+
+private slots:
+    void onAsyncReplyFinished();
+};
+
+
 class WebServer : public QTcpServer
 {
     Q_OBJECT
@@ -89,23 +117,38 @@ public:
 
     void sendHttpReply(HttpReply *reply);
 
+    void setRequestLimits(const HttpRequestParser::Limits &limits);
+    void setTlsSessionCache(TlsSessionCache *tlsSessionCache);
+
 private:
     QHash<QUuid, QSslSocket *> m_clientList;
     QList<WebServerClient *> m_webServerClients;
-    QHash<QSslSocket *, HttpRequest> m_incompleteRequests;
+    QHash<QSslSocket *, HttpRequestParser> m_requestParsers;
+    QHash<QSslSocket *, QList<HttpRequest> > m_pendingRequests;
+    QHash<QSslSocket *, HttpRequest> m_coreRequests;
+    HttpRequestParser::Limits m_requestLimits;
+    QSet<QSslSocket *> m_closingConnections;
+    QHash<QSslSocket *, HttpFileTransfer *> m_fileTransfers;
+    StaticFileCache m_staticFileCache;
 
     QString m_serverName;
     WebServerConfiguration m_configuration;
     QSslConfiguration m_sslConfiguration;
+    TlsSessionCache *m_tlsSessionCache = nullptr;
+    WebServerCoreHandler *m_coreHandler = nullptr;
 
     bool m_enabled = false;
 
     bool verifyFile(QSslSocket *socket, const QString &fileName);
     QString fileName(const QString &query);
+    bool processFileRequest(QSslSocket *socket, const HttpRequest &request);
+    void processRangeRequest(HttpReply *reply, const HttpRequest &request);
+    void processClientData(QSslSocket *socket);
+    bool isBusy(QSslSocket *socket) const;
+    void processPendingRequests(QSslSocket *socket);
+    void processRequest(QSslSocket *socket, const HttpRequest &request);
 
-    QByteArray createServerXmlDocument(QHostAddress address);
     HttpReply *processIconRequest(const QString &fileName);
-    HttpReply *processDebugRequest(const QString &requestPath);
 
 protected:
     void incomingConnection(qintptr socketDescriptor) override;
@@ -114,16 +157,18 @@ signals:
     void httpRequestReady(const QUuid &clientId, const HttpRequest &httpRequest);
     void clientConnected(const QUuid &clientId);
     void clientDisconnected(const QUuid &clientId);
+    void coreRequestReceived(const QUuid &clientId, const HttpRequest &request, const QHostAddress &localAddress);
 
 private slots:
     void readClient();
     void onDisconnected();
     void onEncrypted();
     void onError(QAbstractSocket::SocketError error);
-    void onAsyncReplyFinished();
+    void onCoreReplyReady(HttpReply *reply);
+    void onFileTransferDataSent();
+    void onFileTransferFinished(bool success);
 
 public slots:
-    void reconfigureServer(const WebServerConfiguration &config);
     void setServerName(const QString &serverName);
     bool startServer();
     bool stopServer();
@@ -54,24 +54,44 @@
     \note For \tt wss you need to have a certificate and configure it in the \tt SSL-configuration
     section of the \tt /etc/nymea/nymead.conf file.
 
+    The sockets, including the TLS and WebSocket handshakes, are served by a \l{WebSocketServerWorker}
+    which lives in a thread of the \l{IOThreadPool}.
+
     \sa WebServer, TcpServer, TransportInterface
 */
 
+/*!
+    \class nymeaserver::WebSocketServerWorker
+    \brief This class owns the listening socket and the client sockets of a \l{WebSocketServer}.
+
+    \ingroup server
+    \inmodule core
+
+    The worker lives in an I/O thread of the \l{IOThreadPool}. It performs the handshakes, the
+    WebSocket framing and decodes the incoming messages into \l{JsonPacket}{JsonPackets}. The
+    \l{WebSocketServer} talks to it exclusively through queued signals and slots, clients are
+    identified by their client id.
+*/
+
 #include "nymeasettings.h"
 #include "nymeacore.h"
 #include "websocketserver.h"
+#include "tcpserver.h"
 #include "loggingcategories.h"
 
 #include <QSslConfiguration>
+#include <QTimer>
 
 namespace nymeaserver {
 
 /*! Constructs a \l{WebSocketServer} with the given \a configuration, \a sslConfiguration and \a parent.
+ *  The sockets are served by a thread of the given \a ioThreadPool.
  *
  *  \sa ServerManager, ServerConfiguration
  */
-WebSocketServer::WebSocketServer(const ServerConfiguration &configuration, const QSslConfiguration &sslConfiguration, QObject *parent) :
+WebSocketServer::WebSocketServer(const ServerConfiguration &configuration, const QSslConfiguration &sslConfiguration, IOThreadPool *ioThreadPool, QObject *parent) :
     TransportInterface(configuration, parent),
+    m_ioThreadPool(ioThreadPool),
     m_sslConfiguration(sslConfiguration),
     m_enabled(false)
 {
@@ -96,11 +116,10 @@ QUrl WebSocketServer::serverUrl() const
  */
 void WebSocketServer::sendData(const QUuid &clientId, const QByteArray &data)
 {
-    QWebSocket *client = nullptr;
-    client = m_clientList.value(clientId);
-    if (client) {
+    SendQueue *sendQueue = m_sendQueues.value(clientId);
+    if (sendQueue) {
         qCDebug(dcWebSocketServerTraffic()) << "Sending data to client" << data;
-        client->sendTextMessage(data + '\n');
+        sendQueue->send(data + '\n');
     } else {
         qCWarning(dcWebSocketServer()) << "Client" << clientId << "unknown to this transport";
     }
@@ -117,91 +136,121 @@ void WebSocketServer::sendData(const QList<QUuid> &clients, const QByteArray &da
     }
 }
 
-void WebSocketServer::terminateClientConnection(const QUuid &clientId)
+/*! Send the notification \a data to the client with the given \a clientId. If the client is not
+    able to keep up with receiving data, notifications with the same \a coalesceKey replace each other
+    or are dropped, depending on the \l{sendQueueLimits()}.
+*/
+void WebSocketServer::sendNotification(const QUuid &clientId, const QByteArray &data, const QString &coalesceKey)
 {
-    QWebSocket *client = m_clientList.value(clientId);
-    if (client) {
-        client->close();
+    SendQueue *sendQueue = m_sendQueues.value(clientId);
+    if (sendQueue) {
+        qCDebug(dcWebSocketServerTraffic()) << "Sending notification to client" << data;
+        sendQueue->send(data + '\n', coalesceKey);
+    } else {
+        qCWarning(dcWebSocketServer()) << "Client" << clientId << "unknown to this transport";
     }
 }
 
-void WebSocketServer::onClientConnected()
+void WebSocketServer::terminateClientConnection(const QUuid &clientId)
 {
-    // got a new client connected
-    QWebSocket *client = m_server->nextPendingConnection();
-
-    // check websocket version
-    if (client->version() != QWebSocketProtocol::Version13) {
-        qCWarning(dcWebSocketServer) << "Client with invalid protocol version" << client->version() << ". Rejecting.";
-        client->close(QWebSocketProtocol::CloseCodeProtocolError, QString("invalid protocol version: %1 != Supported Version 13").arg(client->version()));
-        delete client;
-        return;
+    SendQueue *sendQueue = m_sendQueues.value(clientId);
+    if (sendQueue) {
+        sendQueue->flush();
+        QMetaObject::invokeMethod(m_worker, "closeClient", Qt::QueuedConnection, Q_ARG(QUuid, clientId));
     }
+}
 
-    QUuid clientId = QUuid::createUuid();
-
-    qCDebug(dcWebSocketServer()) << "New client connected:" << clientId.toString() << "(Remote address:" << client->peerAddress().toString() << ")";
-
-    // append the new client to the client list
-    m_clientList.insert(clientId, client);
-
-    connect(client, SIGNAL(pong(quint64,QByteArray)), this, SLOT(onPing(quint64,QByteArray)));
-    connect(client, SIGNAL(binaryMessageReceived(QByteArray)), this, SLOT(onBinaryMessageReceived(QByteArray)));
-    connect(client, SIGNAL(textMessageReceived(QString)), this, SLOT(onTextMessageReceived(QString)));
-    connect(client, SIGNAL(error(QAbstractSocket::SocketError)), this, SLOT(onClientError(QAbstractSocket::SocketError)));
-    connect(client, SIGNAL(disconnected()), this, SLOT(onClientDisconnected()));
-
-    emit clientConnected(clientId);
+/*! Returns the limits for the outgoing data of each client. */
+SendQueue::Limits WebSocketServer::sendQueueLimits() const
+{
+    return m_sendQueueLimits;
 }
 
-void WebSocketServer::onClientDisconnected()
+/*! Sets the \a limits for the outgoing data of each client. */
+void WebSocketServer::setSendQueueLimits(const SendQueue::Limits &limits)
 {
-    QWebSocket *client = qobject_cast<QWebSocket *>(sender());
-    QUuid clientId = m_clientList.key(client);
-    qCDebug(dcWebSocketServer()) << "Client" << clientId.toString() << "disconnected. (Remote address:" << client->peerAddress().toString() << ")" ;
-    m_clientList.take(clientId)->deleteLater();
-    emit clientDisconnected(clientId);
+    m_sendQueueLimits = limits;
+    foreach (SendQueue *sendQueue, m_sendQueues) {
+        sendQueue->setLimits(limits);
+    }
 }
 
-void WebSocketServer::onBinaryMessageReceived(const QByteArray &data)
+/*! Sets the \a tlsSessionCache registering the handshakes of encrypted connections. */
+void WebSocketServer::setTlsSessionCache(TlsSessionCache *tlsSessionCache)
 {
-    QWebSocket *client = qobject_cast<QWebSocket *>(sender());
-    QUuid clientId = m_clientList.key(client);
-    qCDebug(dcWebSocketServerTraffic()) << "Binary message from" << clientId.toString() << ":" << data;
+    m_tlsSessionCache = tlsSessionCache;
 }
 
-void WebSocketServer::onTextMessageReceived(const QString &message)
+/*! Returns the state of the outgoing queues of all connected clients. */
+QVariantList WebSocketServer::clientStatistics() const
 {
-    QWebSocket *client = qobject_cast<QWebSocket *>(sender());
-    QUuid clientId = m_clientList.key(client);
-    qCDebug(dcWebSocketServerTraffic()) << "Text message from" << clientId.toString() << ":" << message;
-    emit dataAvailable(clientId, message.toUtf8());
+    QVariantList clients;
+    foreach (const QUuid &clientId, m_sendQueues.keys()) {
+        QVariantMap client = m_sendQueues.value(clientId)->statistics();
+        client.insert("clientId", clientId);
+        client.insert("address", m_clientAddresses.value(clientId));
+        clients.append(client);
+    }
+    return clients;
 }
 
-void WebSocketServer::onClientError(QAbstractSocket::SocketError error)
+void WebSocketServer::onClientConnected(const QUuid &clientId, const QString &peerAddress)
 {
-    QWebSocket *client = qobject_cast<QWebSocket *>(sender());
-    QUuid clientId = m_clientList.key(client);
-    qCWarning(dcWebSocketServer()) << "Client error from" << clientId.toString() << ":" << error << client->errorString();
+    qCDebug(dcWebSocketServer()) << "New client connected:" << clientId.toString() << "(Remote address:" << peerAddress << ")";
+
+    m_clientAddresses.insert(clientId, peerAddress);
+
+    SendQueue *sendQueue = new SendQueue(m_sendQueueLimits, this);
+    m_sendQueues.insert(clientId, sendQueue);
+    connect(sendQueue, &SendQueue::writeData, this, [this, clientId](const QByteArray &data){
+        QMetaObject::invokeMethod(m_worker, "sendData", Qt::QueuedConnection, Q_ARG(QUuid, clientId), Q_ARG(QByteArray, data));
+    });
+    connect(sendQueue, &SendQueue::stalledChanged, this, [clientId, sendQueue](bool stalled){
+        if (stalled) {
+            qCWarning(dcWebSocketServer()) << "Client" << clientId.toString() << "does not keep up with receiving data." << sendQueue->pendingBytes() << "bytes pending.";
+        } else {
+            qCDebug(dcWebSocketServer()) << "Client" << clientId.toString() << "caught up receiving data." << sendQueue->droppedMessages() << "notifications dropped so far.";
+        }
+    });
+    connect(sendQueue, &SendQueue::overflow, this, [this, clientId, sendQueue](){
+        qCWarning(dcWebSocketServer()) << "Outgoing data for client" << clientId.toString() << "exceeds" << sendQueue->pendingBytes() << "bytes. Dropping the connection.";
+        QMetaObject::invokeMethod(m_worker, "abortClient", Qt::QueuedConnection, Q_ARG(QUuid, clientId));
+    });
+
+    emit clientConnected(clientId);
 }
 
-void WebSocketServer::onServerError(QAbstractSocket::SocketError error)
+void WebSocketServer::onClientDisconnected(const QUuid &clientId)
 {
-    qCWarning(dcWebSocketServer()) << "Server error " << error << m_server->errorString();
+    SendQueue *sendQueue = m_sendQueues.take(clientId);
+    if (!sendQueue) {
+        // Already cleaned up when the server has been stopped
+        return;
+    }
+    qCDebug(dcWebSocketServer()) << "Client" << clientId.toString() << "disconnected. (Remote address:" << m_clientAddresses.take(clientId) << ")" ;
+    sendQueue->deleteLater();
+    emit clientDisconnected(clientId);
 }
 
-void WebSocketServer::onPing(quint64 elapsedTime, const QByteArray &payload)
+void WebSocketServer::onPacketAvailable(const QUuid &clientId, const JsonPacket &packet)
 {
-    QWebSocket *client = qobject_cast<QWebSocket *>(sender());
-    QUuid clientId = m_clientList.key(client);
-    qCDebug(dcWebSocketServer) << "Ping response from" << clientId.toString() << elapsedTime << payload;
+    if (m_sendQueues.contains(clientId)) {
+        emit packetAvailable(clientId, packet);
+    }
 }
 
+void WebSocketServer::onBytesWritten(const QUuid &clientId, qint64 bytes)
+{
+    SendQueue *sendQueue = m_sendQueues.value(clientId);
+    if (sendQueue) {
+        sendQueue->onBytesWritten(bytes);
+    }
+}
 
 /*! Returns true if this \l{WebSocketServer} could be reconfigured with the given \a config. */
 void WebSocketServer::reconfigureServer(const ServerConfiguration &config)
 {
-    if (configuration() == config && m_server->isListening()) {
+    if (configuration() == config && m_worker) {
         qCDebug(dcWebSocketServer()) << "Configuration unchanged. Not restarting the server.";
         return;
     }
@@ -228,17 +277,21 @@ void WebSocketServer::setServerName(const QString &serverName)
  */
 bool WebSocketServer::startServer()
 {
-    if (configuration().sslEnabled) {
-        m_server = new QWebSocketServer("nymea", QWebSocketServer::SecureMode, this);
-        m_server->setSslConfiguration(m_sslConfiguration);
-    } else {
-        m_server = new QWebSocketServer("nymea", QWebSocketServer::NonSecureMode, this);
+    m_worker = new WebSocketServerWorker(configuration(), m_sslConfiguration, m_tlsSessionCache);
+    connect(m_worker, &WebSocketServerWorker::clientConnected, this, &WebSocketServer::onClientConnected);
+    connect(m_worker, &WebSocketServerWorker::clientDisconnected, this, &WebSocketServer::onClientDisconnected);
+    connect(m_worker, &WebSocketServerWorker::packetAvailable, this, &WebSocketServer::onPacketAvailable);
+    connect(m_worker, &WebSocketServerWorker::bytesWritten, this, &WebSocketServer::onBytesWritten);
+    if (m_ioThreadPool) {
+        m_ioThreadPool->assignThread(m_worker);
     }
-    connect (m_server, &QWebSocketServer::newConnection, this, &WebSocketServer::onClientConnected);
-    connect (m_server, &QWebSocketServer::acceptError, this, &WebSocketServer::onServerError);
 
-    if (!m_server->listen(configuration().address, static_cast<quint16>(configuration().port))) {
+    bool listening = false;
+    QMetaObject::invokeMethod(m_worker, "listen", IOThreadPool::blockingConnectionType(m_worker), Q_RETURN_ARG(bool, listening));
+    if (!listening) {
         qCWarning(dcWebSocketServer()) << "Error listening on" << serverUrl().toString();
+        m_worker->deleteLater();
+        m_worker = nullptr;
         return false;
     }
 
@@ -251,17 +304,215 @@ bool WebSocketServer::startServer()
  * \sa TransportInterface::stopServer()
  */
 bool WebSocketServer::stopServer()
+{
+    if (m_worker) {
+        QMetaObject::invokeMethod(m_worker, "close", IOThreadPool::blockingConnectionType(m_worker));
+        m_worker->deleteLater();
+        m_worker = nullptr;
+    }
+
+    foreach (const QUuid &clientId, m_sendQueues.keys()) {
+        onClientDisconnected(clientId);
+    }
+    return true;
+}
+
+/*! Constructs a WebSocketServerWorker for the given \a configuration and \a sslConfiguration. The handshakes
+    of encrypted connections are registered in the \a tlsSessionCache.
+*/
+WebSocketServerWorker::WebSocketServerWorker(const ServerConfiguration &configuration, const QSslConfiguration &sslConfiguration, TlsSessionCache *tlsSessionCache) :
+    QObject(nullptr),
+    m_configuration(configuration),
+    m_sslConfiguration(sslConfiguration),
+    m_tlsSessionCache(tlsSessionCache)
+{
+
+}
+
+/*! Starts listening and returns true on success. */
+bool WebSocketServerWorker::listen()
+{
+    m_server = new QWebSocketServer("nymea", QWebSocketServer::NonSecureMode, this);
+    connect (m_server, &QWebSocketServer::newConnection, this, &WebSocketServerWorker::onClientConnected);
+    connect (m_server, &QWebSocketServer::acceptError, this, &WebSocketServerWorker::onServerError);
+
+    if (m_configuration.sslEnabled) {
+        // The TLS handshake is done here instead of in QWebSocketServer in order to share the sessions
+        // through the TlsSessionCache. Encrypted sockets are handed over to the websocket server.
+        m_sslServer = new SslServer(this);
+        connect(m_sslServer, &SslServer::socketDescriptorAvailable, this, &WebSocketServerWorker::onSocketDescriptorAvailable);
+        connect(m_sslServer, &SslServer::acceptError, this, &WebSocketServerWorker::onServerError);
+        return m_sslServer->listen(m_configuration.address, static_cast<quint16>(m_configuration.port));
+    }
+
+    return m_server->listen(m_configuration.address, static_cast<quint16>(m_configuration.port));
+}
+
+/*! Closes all client connections and stops listening. */
+void WebSocketServerWorker::close()
 {
     foreach (QWebSocket *client, m_clientList.values()) {
         client->close(QWebSocketProtocol::CloseCodeNormal, "Stop server");
     }
 
+    if (m_sslServer) {
+        m_sslServer->close();
+        delete m_sslServer;
+        m_sslServer = nullptr;
+    }
+
     if (m_server) {
         m_server->close();
         delete m_server;
         m_server = nullptr;
     }
-    return true;
+}
+
+/*! Sends the given \a data to the client with the given \a clientId. */
+void WebSocketServerWorker::sendData(const QUuid &clientId, const QByteArray &data)
+{
+    QWebSocket *client = m_clientList.value(clientId);
+    if (client) {
+        client->sendTextMessage(data);
+    }
+}
+
+/*! Closes the connection to the client with the given \a clientId. */
+void WebSocketServerWorker::closeClient(const QUuid &clientId)
+{
+    QWebSocket *client = m_clientList.value(clientId);
+    if (client) {
+        client->close();
+    }
+}
+
+/*! Closes the connection to the client with the given \a clientId immediately. */
+void WebSocketServerWorker::abortClient(const QUuid &clientId)
+{
+    QWebSocket *client = m_clientList.value(clientId);
+    if (client) {
+        client->abort();
+    }
+}
+
+void WebSocketServerWorker::onSocketDescriptorAvailable(qintptr socketDescriptor)
+{
+    QSslSocket *socket = new QSslSocket(this);
+    if (!socket->setSocketDescriptor(socketDescriptor)) {
+        qCWarning(dcWebSocketServer()) << "Failed to set SSL socket descriptor.";
+        delete socket;
+        return;
+    }
+
+    typedef void (QSslSocket:: *sslErrorsSignal)(const QList<QSslError> &);
+    connect(socket, static_cast<sslErrorsSignal>(&QSslSocket::sslErrors), this, [](const QList<QSslError> &errors) {
+        foreach (const QSslError &error, errors) {
+            qCWarning(dcWebSocketServer()) << "SSL Error:" << error.error() << error.errorString();
+        }
+    });
+    connect(socket, &QSslSocket::disconnected, this, [socket](){
+        qCDebug(dcWebSocketServer()) << "Client disconnected before the encryption has been established.";
+        socket->deleteLater();
+    });
+    connect(socket, &QSslSocket::encrypted, this, [this, socket](){
+        socket->disconnect(this);
+        if (m_tlsSessionCache) {
+            m_tlsSessionCache->handshakeFinished(socket);
+        }
+        // The websocket server takes the ownership of the socket
+        socket->setParent(nullptr);
+        m_server->handleConnection(socket);
+    });
+
+    socket->setSslConfiguration(m_sslConfiguration);
+    socket->startServerEncryption();
+    if (m_tlsSessionCache) {
+        m_tlsSessionCache->setupSocket(socket);
+    }
+}
+
+void WebSocketServerWorker::onClientConnected()
+{
+    // got a new client connected
+    QWebSocket *client = m_server->nextPendingConnection();
+
+    // check websocket version
+    if (client->version() != QWebSocketProtocol::Version13) {
+        qCWarning(dcWebSocketServer) << "Client with invalid protocol version" << client->version() << ". Rejecting.";
+        client->close(QWebSocketProtocol::CloseCodeProtocolError, QString("invalid protocol version: %1 != Supported Version 13").arg(client->version()));
+        delete client;
+        return;
+    }
+
+    QUuid clientId = QUuid::createUuid();
+
+    // append the new client to the client list
+    client->setParent(this);
+    m_clientList.insert(clientId, client);
+
+    connect(client, SIGNAL(pong(quint64,QByteArray)), this, SLOT(onPing(quint64,QByteArray)));
+    connect(client, SIGNAL(binaryMessageReceived(QByteArray)), this, SLOT(onBinaryMessageReceived(QByteArray)));
+    connect(client, SIGNAL(textMessageReceived(QString)), this, SLOT(onTextMessageReceived(QString)));
+    connect(client, SIGNAL(error(QAbstractSocket::SocketError)), this, SLOT(onClientError(QAbstractSocket::SocketError)));
+    connect(client, SIGNAL(disconnected()), this, SLOT(onClientDisconnected()));
+    connect(client, &QWebSocket::bytesWritten, this, [this, clientId](qint64 bytes){
+        emit bytesWritten(clientId, bytes);
+    });
+
+    emit clientConnected(clientId, client->peerAddress().toString());
+}
+
+void WebSocketServerWorker::onClientDisconnected()
+{
+    QWebSocket *client = qobject_cast<QWebSocket *>(sender());
+    QUuid clientId = m_clientList.key(client);
+    m_clientList.take(clientId)->deleteLater();
+    m_readers.remove(clientId);
+    emit clientDisconnected(clientId);
+}
+
+void WebSocketServerWorker::onBinaryMessageReceived(const QByteArray &data)
+{
+    QWebSocket *client = qobject_cast<QWebSocket *>(sender());
+    QUuid clientId = m_clientList.key(client);
+    qCDebug(dcWebSocketServerTraffic()) << "Binary message from" << clientId.toString() << ":" << data;
+}
+
+void WebSocketServerWorker::onTextMessageReceived(const QString &message)
+{
+    QWebSocket *client = qobject_cast<QWebSocket *>(sender());
+    QUuid clientId = m_clientList.key(client);
+    qCDebug(dcWebSocketServerTraffic()) << "Text message from" << clientId.toString() << ":" << message;
+
+    JsonPacketReader &reader = m_readers[clientId];
+    foreach (const JsonPacket &packet, reader.read(message.toUtf8())) {
+        emit packetAvailable(clientId, packet);
+    }
+
+    if (reader.bufferSize() > JsonPacketReader::maxBufferSize) {
+        qCWarning(dcWebSocketServer()) << "Client buffer larger than 10KB and no valid data. Dropping client connection.";
+        reader.clear();
+        client->close();
+    }
+}
+
+void WebSocketServerWorker::onClientError(QAbstractSocket::SocketError error)
+{
+    QWebSocket *client = qobject_cast<QWebSocket *>(sender());
+    QUuid clientId = m_clientList.key(client);
+    qCWarning(dcWebSocketServer()) << "Client error from" << clientId.toString() << ":" << error << client->errorString();
+}
+
+void WebSocketServerWorker::onServerError(QAbstractSocket::SocketError error)
+{
+    qCWarning(dcWebSocketServer()) << "Server error " << error << m_server->errorString();
+}
+
+void WebSocketServerWorker::onPing(quint64 elapsedTime, const QByteArray &payload)
+{
+    QWebSocket *client = qobject_cast<QWebSocket *>(sender());
+    QUuid clientId = m_clientList.key(client);
+    qCDebug(dcWebSocketServer) << "Ping response from" << clientId.toString() << elapsedTime << payload;
 }
 
 }
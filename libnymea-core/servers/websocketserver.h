@@ -37,37 +37,51 @@
 #include <QList>
 #include <QWebSocket>
 #include <QWebSocketServer>
+#include <QSslConfiguration>
 
 #include "transportinterface.h"
+#include "sendqueue.h"
+#include "iothreadpool.h"
+#include "jsonpacketreader.h"
+#include "tlssessioncache.h"
 
 // Note: WebSocket Protocol from the Internet Engineering Task Force (IETF) -> RFC6455 V13:
 //       http://tools.ietf.org/html/rfc6455
 
-class QSslConfiguration;
-
 namespace nymeaserver {
 
-class WebSocketServer : public TransportInterface
+class SslServer;
+
+class WebSocketServerWorker : public QObject
 {
     Q_OBJECT
 public:
-    explicit WebSocketServer(const ServerConfiguration &configuration, const QSslConfiguration &sslConfiguration, QObject *parent = nullptr);
-    ~WebSocketServer() override;
+    WebSocketServerWorker(const ServerConfiguration &configuration, const QSslConfiguration &sslConfiguration, TlsSessionCache *tlsSessionCache = nullptr);
 
-    QUrl serverUrl() const;
-
-    void sendData(const QUuid &clientId, const QByteArray &data) override;
-    void sendData(const QList<QUuid> &clients, const QByteArray &data) override;
+public slots:
+    bool listen();
+    void close();
+    void sendData(const QUuid &clientId, const QByteArray &data);
+    void closeClient(const QUuid &clientId);
+    void abortClient(const QUuid &clientId);
 
-    void terminateClientConnection(const QUuid &clientId) override;
+signals:
+    void clientConnected(const QUuid &clientId, const QString &peerAddress);
+    void clientDisconnected(const QUuid &clientId);
+    void packetAvailable(const QUuid &clientId, const nymeaserver::JsonPacket &packet);
+    void bytesWritten(const QUuid &clientId, qint64 bytes);
 
 private:
+    ServerConfiguration m_configuration;
+    QSslConfiguration m_sslConfiguration;
+    TlsSessionCache *m_tlsSessionCache = nullptr;
     QWebSocketServer *m_server = nullptr;
+    SslServer *m_sslServer = nullptr;
     QHash<QUuid, QWebSocket *> m_clientList;
-    QSslConfiguration m_sslConfiguration;
-    bool m_enabled;
+    QHash<QUuid, JsonPacketReader> m_readers;
 
 private slots:
+    void onSocketDescriptorAvailable(qintptr socketDescriptor);
     void onClientConnected();
     void onClientDisconnected();
     void onBinaryMessageReceived(const QByteArray &data);
@@ -75,6 +89,45 @@ private slots:
     void onClientError(QAbstractSocket::SocketError error);
     void onServerError(QAbstractSocket::SocketError error);
     void onPing(quint64 elapsedTime, const QByteArray & payload);
+};
+
+class WebSocketServer : public TransportInterface
+{
+    Q_OBJECT
+public:
+    explicit WebSocketServer(const ServerConfiguration &configuration, const QSslConfiguration &sslConfiguration, IOThreadPool *ioThreadPool = nullptr, QObject *parent = nullptr);
+    ~WebSocketServer() override;
+
+    QUrl serverUrl() const;
+
+    void sendData(const QUuid &clientId, const QByteArray &data) override;
+    void sendData(const QList<QUuid> &clients, const QByteArray &data) override;
+    void sendNotification(const QUuid &clientId, const QByteArray &data, const QString &coalesceKey = QString()) override;
+
+    void terminateClientConnection(const QUuid &clientId) override;
+
+    SendQueue::Limits sendQueueLimits() const;
+    void setSendQueueLimits(const SendQueue::Limits &limits);
+
+    void setTlsSessionCache(TlsSessionCache *tlsSessionCache);
+
+    QVariantList clientStatistics() const override;
+
+private:
+    WebSocketServerWorker *m_worker = nullptr;
+    IOThreadPool *m_ioThreadPool = nullptr;
+    TlsSessionCache *m_tlsSessionCache = nullptr;
+    QHash<QUuid, QString> m_clientAddresses;
+    QHash<QUuid, SendQueue *> m_sendQueues;
+    SendQueue::Limits m_sendQueueLimits;
+    QSslConfiguration m_sslConfiguration;
+    bool m_enabled;
+
+private slots:
+    void onClientConnected(const QUuid &clientId, const QString &peerAddress);
+    void onClientDisconnected(const QUuid &clientId);
+    void onPacketAvailable(const QUuid &clientId, const nymeaserver::JsonPacket &packet);
+    void onBytesWritten(const QUuid &clientId, qint64 bytes);
 
 public slots:
     void reconfigureServer(const ServerConfiguration &config);
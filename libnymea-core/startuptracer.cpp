@@ -0,0 +1,411 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* Copyright 2013 - 2020, nymea GmbH
+* Contact: contact@nymea.io
+*
+* This file is part of nymea.
+* This project including source code and documentation is protected by
+* copyright law, and remains the property of nymea GmbH. All rights, including
+* reproduction, publication, editing and translation, are reserved. The use of
+* this project is subject to the terms of a license agreement to be concluded
+* with nymea GmbH in accordance with the terms of use of nymea GmbH, available
+* under https://nymea.io/license
+*
+* GNU General Public License Usage
+* Alternatively, this project may be redistributed and/or modified under the
+* terms of the GNU General Public License as published by the Free Software
+* Foundation, GNU version 3. This project is distributed in the hope that it
+* will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+* of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+* Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with
+* this project. If not, see <https://www.gnu.org/licenses/>.
+*
+* For any further details and any questions please contact us under
+* contact@nymea.io or see our FAQ/Licensing Information on
+* https://nymea.io/license/faq
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+/*!
+    \class nymeaserver::StartupTracer
+    \brief Records an opt-in timeline of the nymead startup phases.
+
+    \ingroup core
+    \inmodule core
+
+    The StartupTracer collects timed spans for the expensive steps of the server startup, like
+    loading plugins, setting up configured things, loading rules or opening the log database.
+    Tracing is disabled by default and costs nothing beside a boolean check in that case. It can
+    be enabled using the \c --startup-trace command line option or the \c NYMEA_STARTUP_TRACE
+    environment variable.
+
+    The collected events are written in the Chrome trace event format, which can be opened in
+    \c chrome://tracing or \l{https://ui.perfetto.dev}{Perfetto}. A condensed summary is available
+    on the debug server at \c /debug/startup-trace.
+
+    \sa StartupTraceScope
+*/
+
+/*!
+    \class nymeaserver::StartupTraceScope
+    \brief Records a startup trace span for the lifetime of the scope.
+
+    \ingroup core
+    \inmodule core
+
+    Creating a StartupTraceScope begins a span on the \l{StartupTracer}, destroying it ends it again.
+    If the tracer is not enabled, this does nothing.
+*/
+
+#include "startuptracer.h"
+#include "loggingcategories.h"
+
+#include <QFile>
+#include <QTimer>
+#include <QThread>
+#include <QJsonDocument>
+#include <QCoreApplication>
+
+#include <algorithm>
+
+namespace nymeaserver {
+
+StartupTracer *StartupTracer::s_instance = nullptr;
+
+/*! Returns the single instance of the \l{StartupTracer}. */
+StartupTracer *StartupTracer::instance()
+{
+    if (!s_instance) {
+        s_instance = new StartupTracer(QCoreApplication::instance());
+    }
+    return s_instance;
+}
+
+StartupTracer::StartupTracer(QObject *parent) :
+    QObject(parent)
+{
+    m_clock.start();
+
+    m_writeTimer = new QTimer(this);
+    m_writeTimer->setSingleShot(true);
+    m_writeTimer->setInterval(1000);
+    connect(m_writeTimer, &QTimer::timeout, this, &StartupTracer::writeTraceFile);
+
+    QByteArray traceFileEnv = qgetenv("NYMEA_STARTUP_TRACE");
+    if (!traceFileEnv.isEmpty()) {
+        enable(traceFileEnv == "1" ? QString() : QString::fromUtf8(traceFileEnv));
+    }
+}
+
+/*! Returns true if startup tracing has been enabled. */
+bool StartupTracer::enabled() const
+{
+    return m_enabled;
+}
+
+/*! Enables startup tracing. If \a traceFile is not empty, the trace will be written to that file
+    once the startup has finished. The trace is always available on the debug server. */
+void StartupTracer::enable(const QString &traceFile)
+{
+    QMutexLocker locker(&m_mutex);
+    m_enabled = true;
+    if (!traceFile.isEmpty()) {
+        m_traceFile = traceFile;
+    }
+}
+
+/*! Returns the path of the file the trace gets written to. Empty if the trace is kept in memory only. */
+QString StartupTracer::traceFile() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_traceFile;
+}
+
+/*! Returns true once \l{finishStartup()} has been called. */
+bool StartupTracer::startupFinished() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_startupFinished;
+}
+
+/*! Returns the current trace timestamp in microseconds since the tracer has been created. */
+qint64 StartupTracer::timestamp() const
+{
+    return m_clock.nsecsElapsed() / 1000;
+}
+
+/*! Begins a new span with the given \a name and \a category and returns its id. The span needs to be
+    closed using \l{endSpan()}. Spans may be finished from any thread and in any order, which allows
+    tracing asynchronous operations like the setup of a thing. Returns 0 if tracing is disabled. */
+int StartupTracer::beginSpan(const QString &name, const QString &category, const QVariantMap &args)
+{
+    if (!m_enabled) {
+        return 0;
+    }
+
+    TraceEvent event;
+    event.name = name;
+    event.category = category;
+    event.timestamp = timestamp();
+    event.threadId = reinterpret_cast<quintptr>(QThread::currentThreadId());
+    event.args = args;
+
+    QMutexLocker locker(&m_mutex);
+    int spanId = m_nextSpanId++;
+    m_openSpans.insert(spanId, event);
+    return spanId;
+}
+
+/*! Ends the span with the given \a spanId. The given \a args will be added to the ones passed to \l{beginSpan()}. */
+void StartupTracer::endSpan(int spanId, const QVariantMap &args)
+{
+    if (!m_enabled || spanId == 0) {
+        return;
+    }
+
+    qint64 now = timestamp();
+
+    QMutexLocker locker(&m_mutex);
+    if (!m_openSpans.contains(spanId)) {
+        return;
+    }
+    TraceEvent event = m_openSpans.take(spanId);
+    event.duration = now - event.timestamp;
+    foreach (const QString &key, args.keys()) {
+        event.args.insert(key, args.value(key));
+    }
+    m_events.append(event);
+
+    if (m_startupFinished) {
+        scheduleWrite();
+    }
+}
+
+/*! Adds an already completed span with the given \a name and \a category, starting at \a startTimestamp
+    and lasting \a duration microseconds. */
+void StartupTracer::addSpan(const QString &name, const QString &category, qint64 startTimestamp, qint64 duration, const QVariantMap &args)
+{
+    if (!m_enabled) {
+        return;
+    }
+
+    TraceEvent event;
+    event.name = name;
+    event.category = category;
+    event.timestamp = startTimestamp;
+    event.duration = duration;
+    event.threadId = reinterpret_cast<quintptr>(QThread::currentThreadId());
+    event.args = args;
+
+    QMutexLocker locker(&m_mutex);
+    m_events.append(event);
+    if (m_startupFinished) {
+        scheduleWrite();
+    }
+}
+
+/*! Adds an instant event, marking a point in time of the startup, e.g. a milestone. */
+void StartupTracer::addInstant(const QString &name, const QString &category, const QVariantMap &args)
+{
+    if (!m_enabled) {
+        return;
+    }
+
+    TraceEvent event;
+    event.name = name;
+    event.category = category;
+    event.phase = 'i';
+    event.timestamp = timestamp();
+    event.threadId = reinterpret_cast<quintptr>(QThread::currentThreadId());
+    event.args = args;
+
+    QMutexLocker locker(&m_mutex);
+    m_events.append(event);
+    if (m_startupFinished) {
+        scheduleWrite();
+    }
+}
+
+/*! Marks the startup as finished and writes the trace file if one has been configured. Spans finishing
+    afterwards, e.g. things which take long to set up, will still be recorded and the file will be updated. */
+void StartupTracer::finishStartup()
+{
+    if (!m_enabled) {
+        return;
+    }
+
+    addInstant("Startup finished", "core");
+
+    m_mutex.lock();
+    m_startupFinished = true;
+    m_startupDuration = timestamp();
+    int pendingSpans = m_openSpans.count();
+    m_mutex.unlock();
+
+    qCInfo(dcApplication()) << "Startup finished after" << m_startupDuration / 1000 << "ms." << pendingSpans << "traced operations still pending.";
+    writeTraceFile();
+}
+
+/*! Returns the trace in the Chrome trace event JSON format. Spans which have not been finished yet are
+    reported with their duration so far and marked as pending. */
+QByteArray StartupTracer::traceJson() const
+{
+    qint64 now = timestamp();
+    qint64 pid = QCoreApplication::applicationPid();
+
+    QMutexLocker locker(&m_mutex);
+
+    QList<TraceEvent> events = m_events;
+    foreach (TraceEvent pendingEvent, m_openSpans) {
+        pendingEvent.duration = now - pendingEvent.timestamp;
+        pendingEvent.args.insert("pending", true);
+        events.append(pendingEvent);
+    }
+
+    QVariantList traceEvents;
+
+    QVariantMap processName;
+    processName.insert("name", "process_name");
+    processName.insert("ph", "M");
+    processName.insert("pid", pid);
+    processName.insert("args", QVariantMap({{"name", "nymead"}}));
+    traceEvents.append(processName);
+
+    foreach (const TraceEvent &event, events) {
+        QVariantMap traceEvent;
+        traceEvent.insert("name", event.name);
+        traceEvent.insert("cat", event.category);
+        traceEvent.insert("ph", QString(QLatin1Char(event.phase)));
+        traceEvent.insert("ts", event.timestamp);
+        if (event.phase == 'X') {
+            traceEvent.insert("dur", event.duration);
+        } else {
+            traceEvent.insert("s", "p");
+        }
+        traceEvent.insert("pid", pid);
+        traceEvent.insert("tid", event.threadId);
+        if (!event.args.isEmpty()) {
+            traceEvent.insert("args", event.args);
+        }
+        traceEvents.append(traceEvent);
+    }
+
+    QVariantMap trace;
+    trace.insert("traceEvents", traceEvents);
+    trace.insert("displayTimeUnit", "ms");
+    return QJsonDocument::fromVariant(trace).toJson(QJsonDocument::Compact);
+}
+
+/*! Returns a summary of the trace containing the overall startup time, the duration of the core
+    phases and the slowest plugins and things. All durations are in milliseconds. */
+QVariantMap StartupTracer::summary() const
+{
+    QVariantMap summary;
+    summary.insert("enabled", m_enabled);
+    if (!m_enabled) {
+        return summary;
+    }
+
+    QMutexLocker locker(&m_mutex);
+    summary.insert("startupFinished", m_startupFinished);
+    if (m_startupFinished) {
+        summary.insert("startupDuration", m_startupDuration / 1000.0);
+    }
+    summary.insert("traceFile", m_traceFile);
+    summary.insert("pendingSpans", m_openSpans.count());
+
+    QList<TraceEvent> phases;
+    QList<TraceEvent> plugins;
+    QList<TraceEvent> things;
+    QHash<QString, qint64> setupTimePerPlugin;
+    foreach (const TraceEvent &event, m_events) {
+        if (event.phase != 'X') {
+            continue;
+        }
+        if (event.category == "core") {
+            phases.append(event);
+        } else if (event.category == "plugin") {
+            plugins.append(event);
+        } else if (event.category == "thing") {
+            things.append(event);
+            setupTimePerPlugin[event.args.value("plugin").toString()] += event.duration;
+        }
+    }
+
+    auto byStart = [](const TraceEvent &a, const TraceEvent &b) { return a.timestamp < b.timestamp; };
+    auto byDuration = [](const TraceEvent &a, const TraceEvent &b) { return a.duration > b.duration; };
+    std::sort(phases.begin(), phases.end(), byStart);
+    std::sort(plugins.begin(), plugins.end(), byDuration);
+    std::sort(things.begin(), things.end(), byDuration);
+
+    auto toVariantList = [](const QList<TraceEvent> &events, int maxCount) {
+        QVariantList list;
+        for (int i = 0; i < events.count() && i < maxCount; i++) {
+            QVariantMap entry = events.at(i).args;
+            entry.insert("name", events.at(i).name);
+            entry.insert("category", events.at(i).category);
+            entry.insert("start", events.at(i).timestamp / 1000.0);
+            entry.insert("duration", events.at(i).duration / 1000.0);
+            list.append(entry);
+        }
+        return list;
+    };
+
+    summary.insert("phases", toVariantList(phases, phases.count()));
+    summary.insert("slowestPlugins", toVariantList(plugins, 10));
+    summary.insert("slowestThings", toVariantList(things, 10));
+
+    // Accumulated setup time of all things, per plugin
+    QVariantMap thingSetupPerPlugin;
+    foreach (const QString &pluginName, setupTimePerPlugin.keys()) {
+        thingSetupPerPlugin.insert(pluginName, setupTimePerPlugin.value(pluginName) / 1000.0);
+    }
+    summary.insert("thingSetupPerPlugin", thingSetupPerPlugin);
+    return summary;
+}
+
+void StartupTracer::scheduleWrite()
+{
+    // Called with the mutex locked, possibly from another thread
+    if (m_traceFile.isEmpty()) {
+        return;
+    }
+    QMetaObject::invokeMethod(m_writeTimer, "start", Qt::QueuedConnection);
+}
+
+void StartupTracer::writeTraceFile()
+{
+    QString fileName = traceFile();
+    if (fileName.isEmpty()) {
+        return;
+    }
+
+    QFile file(fileName);
+    if (!file.open(QFile::WriteOnly | QFile::Truncate)) {
+        qCWarning(dcApplication()) << "Unable to open startup trace file" << fileName << file.errorString();
+        return;
+    }
+    file.write(traceJson());
+    file.close();
+    qCDebug(dcApplication()) << "Startup trace written to" << fileName;
+}
+
+/*! Begins a span with the given \a name, \a category and \a args which ends when this object is destroyed. */
+StartupTraceScope::StartupTraceScope(const QString &name, const QString &category, const QVariantMap &args)
+{
+    StartupTracer *tracer = StartupTracer::instance();
+    if (tracer->enabled()) {
+        m_spanId = tracer->beginSpan(name, category, args);
+    }
+}
+
+StartupTraceScope::~StartupTraceScope()
+{
+    if (m_spanId != 0) {
+        StartupTracer::instance()->endSpan(m_spanId);
+    }
+}
+
+}
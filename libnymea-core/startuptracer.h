@@ -0,0 +1,111 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* Copyright 2013 - 2020, nymea GmbH
+* Contact: contact@nymea.io
+*
+* This file is part of nymea.
+* This project including source code and documentation is protected by
+* copyright law, and remains the property of nymea GmbH. All rights, including
+* reproduction, publication, editing and translation, are reserved. The use of
+* this project is subject to the terms of a license agreement to be concluded
+* with nymea GmbH in accordance with the terms of use of nymea GmbH, available
+* under https://nymea.io/license
+*
+* GNU General Public License Usage
+* Alternatively, this project may be redistributed and/or modified under the
+* terms of the GNU General Public License as published by the Free Software
+* Foundation, GNU version 3. This project is distributed in the hope that it
+* will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+* of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+* Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with
+* this project. If not, see <https://www.gnu.org/licenses/>.
+*
+* For any further details and any questions please contact us under
+* contact@nymea.io or see our FAQ/Licensing Information on
+* https://nymea.io/license/faq
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef STARTUPTRACER_H
+#define STARTUPTRACER_H
+
+#include <QObject>
+#include <QMutex>
+#include <QVariantMap>
+#include <QElapsedTimer>
+
+class QTimer;
+
+namespace nymeaserver {
+
+class StartupTracer : public QObject
+{
+    Q_OBJECT
+public:
+    static StartupTracer *instance();
+
+    bool enabled() const;
+    void enable(const QString &traceFile = QString());
+
+    QString traceFile() const;
+    bool startupFinished() const;
+
+    qint64 timestamp() const;
+
+    int beginSpan(const QString &name, const QString &category, const QVariantMap &args = QVariantMap());
+    void endSpan(int spanId, const QVariantMap &args = QVariantMap());
+    void addSpan(const QString &name, const QString &category, qint64 startTimestamp, qint64 duration, const QVariantMap &args = QVariantMap());
+    void addInstant(const QString &name, const QString &category, const QVariantMap &args = QVariantMap());
+
+    void finishStartup();
+
+    QByteArray traceJson() const;
+    QVariantMap summary() const;
+
+private:
+    explicit StartupTracer(QObject *parent = nullptr);
+
+    struct TraceEvent {
+        QString name;
+        QString category;
+        char phase = 'X';
+        qint64 timestamp = 0;
+        qint64 duration = 0;
+        quint64 threadId = 0;
+        QVariantMap args;
+    };
+
+    static StartupTracer *s_instance;
+
+    void scheduleWrite();
+    void writeTraceFile();
+
+    mutable QMutex m_mutex;
+    bool m_enabled = false;
+    bool m_startupFinished = false;
+    qint64 m_startupDuration = 0;
+    QString m_traceFile;
+    QElapsedTimer m_clock;
+    QTimer *m_writeTimer = nullptr;
+
+    int m_nextSpanId = 1;
+    QHash<int, TraceEvent> m_openSpans;
+    QList<TraceEvent> m_events;
+};
+
+class StartupTraceScope
+{
+public:
+    StartupTraceScope(const QString &name, const QString &category, const QVariantMap &args = QVariantMap());
+    ~StartupTraceScope();
+
+private:
+    Q_DISABLE_COPY(StartupTraceScope)
+    int m_spanId = 0;
+};
+
+}
+
+#endif // STARTUPTRACER_H
@@ -41,7 +41,7 @@
 */
 
 /*! \fn void nymeaserver::TimeManager::dateTimeChanged(const QDateTime &dateTime);
-    Will be emitted when the \a dateTime has changed.
+    Will be emitted when the \a dateTime has changed. This happens once per second.
 */
 
 #include "timemanager.h"
@@ -91,9 +91,10 @@ void TimeManager::timerEvent(QTimerEvent *event)
 
     emit tick();
 
-    // Minute based nymea time
+    // Second based nymea time. The rule engine only evaluates rules whose next time
+    // transition has been reached, so emitting this on every second is cheap.
     QDateTime now = QDateTime::currentDateTime();
-    if (m_lastEvent.time().minute() != now.time().minute()) {
+    if (m_lastEvent.toMSecsSinceEpoch() / 1000 != now.toMSecsSinceEpoch() / 1000) {
         m_lastEvent = now;
         emit dateTimeChanged(now.addSecs(m_overrideDifference));
     }
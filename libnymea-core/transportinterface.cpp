@@ -86,6 +86,13 @@
     \sa WebSocketServer, TcpServer, BluetoothServer
 */
 
+/*! \fn void nymeaserver::TransportInterface::packetAvailable(const QUuid &clientId, const nymeaserver::JsonPacket &packet);
+    This signal is emitted when a decoded \a packet from the client with the given \a clientId is available.
+    Transports which split and decode the incoming data on their I/O threads emit this signal instead of \l{dataAvailable()}.
+
+    \sa JsonPacketReader, IOThreadPool
+*/
+
 #include "transportinterface.h"
 #include "loggingcategories.h"
 
@@ -112,6 +119,24 @@ ServerConfiguration TransportInterface::configuration() const
     return m_config;
 }
 
+/*! Sends the notification \a data to the client with the given \a clientId. Notifications with a non empty
+    \a coalesceKey may be replaced by a later notification with the same key or dropped if the client can't
+    keep up with receiving them. The default implementation sends the data using sendData().
+*/
+void TransportInterface::sendNotification(const QUuid &clientId, const QByteArray &data, const QString &coalesceKey)
+{
+    Q_UNUSED(coalesceKey)
+    sendData(clientId, data);
+}
+
+/*! Returns a list of statistics about the connected clients, e.g. the size of their outgoing queues.
+    The default implementation returns an empty list.
+*/
+QVariantList TransportInterface::clientStatistics() const
+{
+    return QVariantList();
+}
+
 /*! Set the name of this TransportInterface to the given \a serverName. */
 void TransportInterface::setServerName(const QString &serverName)
 {
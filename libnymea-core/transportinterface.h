@@ -37,6 +37,7 @@
 #include <QUuid>
 
 #include "nymeaconfiguration.h"
+#include "servers/jsonpacketreader.h"
 
 namespace nymeaserver {
 
@@ -49,12 +50,15 @@ public:
 
     virtual void sendData(const QUuid &clientId, const QByteArray &data) = 0;
     virtual void sendData(const QList<QUuid> &clients, const QByteArray &data) = 0;
+    virtual void sendNotification(const QUuid &clientId, const QByteArray &data, const QString &coalesceKey = QString());
 
     virtual void terminateClientConnection(const QUuid &clientId) = 0;
 
     void setConfiguration(const ServerConfiguration &config);
     ServerConfiguration configuration() const;
 
+    virtual QVariantList clientStatistics() const;
+
 protected:
     QString m_serverName;
 
@@ -62,6 +66,7 @@ signals:
     void clientConnected(const QUuid &clientId);
     void clientDisconnected(const QUuid &clientId);
     void dataAvailable(const QUuid &clientId, const QByteArray &data);
+    void packetAvailable(const QUuid &clientId, const nymeaserver::JsonPacket &packet);
 
 public slots:
     virtual void setServerName(const QString &serverName);
@@ -41,6 +41,10 @@
     This class supports also blockwise transfere according to the \l{https://tools.ietf.org/html/draft-ietf-core-block-18}{IETF V18} specifications and
     observing resources according to the \l{https://tools.ietf.org/html/rfc7641}{RFC7641}.
 
+    Requests to different endpoints are processed concurrently and responses are matched to their request by message ID
+    and token. The number of simultaneous exchanges with a single endpoint is limited by \l{setNStart()}{NSTART}, further
+    requests to that endpoint are queued. Host name lookups are cached for a minute.
+
     \sa CoapReply, CoapRequest
 
     \section2 Example
@@ -86,11 +90,15 @@
 
 Q_LOGGING_CATEGORY(dcCoap, "Coap")
 
+// Successful host lookups are reused for this time (ms)
+static const qint64 hostCacheTimeout = 60000;
+
 /*! Constructs a Coap access manager with the given \a parent and \a port. */
 Coap::Coap(QObject *parent, const quint16 &port) :
-    QObject(parent),
-    m_reply(nullptr)
+    QObject(parent)
 {
+    m_clock.start();
+
     m_socket = new QUdpSocket(this);
 
     if (!m_socket->bind(QHostAddress::Any, port, QAbstractSocket::ShareAddress))
@@ -115,13 +123,7 @@ CoapReply *Coap::ping(const CoapRequest &request)
         return reply;
     }
 
-    // check if there is a request running
-    if (m_reply == 0) {
-        m_reply = reply;
-        lookupHost();
-    } else {
-        m_replyQueue.enqueue(reply);
-    }
+    startReply(reply);
 
     return reply;
 }
@@ -142,13 +144,7 @@ CoapReply *Coap::get(const CoapRequest &request)
         return reply;
     }
 
-    // check if there is a request running
-    if (m_reply == 0) {
-        m_reply = reply;
-        lookupHost();
-    } else {
-        m_replyQueue.enqueue(reply);
-    }
+    startReply(reply);
     return reply;
 }
 
@@ -169,13 +165,7 @@ CoapReply *Coap::put(const CoapRequest &request, const QByteArray &data)
         return reply;
     }
 
-    // check if there is a request running
-    if (m_reply == 0) {
-        m_reply = reply;
-        lookupHost();
-    } else {
-        m_replyQueue.enqueue(reply);
-    }
+    startReply(reply);
 
     return reply;
 }
@@ -197,13 +187,7 @@ CoapReply *Coap::post(const CoapRequest &request, const QByteArray &data)
         return reply;
     }
 
-    // check if there is a request running
-    if (m_reply == 0) {
-        m_reply = reply;
-        lookupHost();
-    } else {
-        m_replyQueue.enqueue(reply);
-    }
+    startReply(reply);
 
     return reply;
 }
@@ -224,13 +208,7 @@ CoapReply *Coap::deleteResource(const CoapRequest &request)
         return reply;
     }
 
-    // check if there is a request running
-    if (m_reply.isNull()) {
-        m_reply = reply;
-        lookupHost();
-    } else {
-        m_replyQueue.enqueue(reply);
-    }
+    startReply(reply);
 
     return reply;
 }
@@ -254,13 +232,7 @@ CoapReply *Coap::enableResourceNotifications(const CoapRequest &request)
         return reply;
     }
 
-    // check if there is a request running
-    if (m_reply.isNull()) {
-        m_reply = reply;
-        lookupHost();
-    } else {
-        m_replyQueue.enqueue(reply);
-    }
+    startReply(reply);
 
     return reply;
 }
@@ -285,21 +257,158 @@ CoapReply *Coap::disableNotifications(const CoapRequest &request)
         return reply;
     }
 
-    // check if there is a request running
-    if (m_reply == 0) {
-        m_reply = reply;
-        lookupHost();
-    } else {
-        m_replyQueue.enqueue(reply);
-    }
+    startReply(reply);
 
     return reply;
 }
 
-void Coap::lookupHost()
+/*! Returns the maximum number of simultaneous outstanding exchanges with a single endpoint (NSTART).
+ *  \sa setNStart() */
+int Coap::nstart() const
+{
+    return m_nstart;
+}
+
+/*! Sets the maximum number of simultaneous outstanding exchanges with a single endpoint to \a nstart.
+ *
+ *  Requests to different endpoints are always sent concurrently. Requests to the same endpoint are queued
+ *  until one of the outstanding exchanges with that endpoint finished. The default of 1 follows the
+ *  congestion control recommendation in \l{https://tools.ietf.org/html/rfc7252#section-4.7}{RFC7252 section 4.7}.
+ */
+void Coap::setNStart(int nstart)
 {
-    int lookupId = QHostInfo::lookupHost(m_reply->request().url().host(), this, SLOT(hostLookupFinished(QHostInfo)));
-    m_runningHostLookups.insert(lookupId, m_reply);
+    m_nstart = qMax(1, nstart);
+
+    foreach (const Endpoint &endpoint, m_queuedReplies.keys()) {
+        startQueuedReplies(endpoint);
+    }
+}
+
+void Coap::startReply(CoapReply *reply)
+{
+    // Make sure a deleted reply doesn't block the exchange slot of its endpoint
+    connect(reply, &CoapReply::destroyed, this, [this, reply](){
+        removeReply(reply);
+    });
+
+    // Replies are always started from the event loop, so the caller can connect to the reply signals first
+    QString host = reply->request().url().host();
+    QHostAddress hostAddress(host);
+    if (!hostAddress.isNull()) {
+        QTimer::singleShot(0, reply, [this, reply, hostAddress](){
+            hostResolved(reply, hostAddress, false);
+        });
+        return;
+    }
+
+    if (m_hostCache.contains(host)) {
+        CachedHost cachedHost = m_hostCache.value(host);
+        if (cachedHost.expiry > m_clock.elapsed()) {
+            QTimer::singleShot(0, reply, [this, reply, cachedHost](){
+                hostResolved(reply, cachedHost.address, true);
+            });
+            return;
+        }
+        m_hostCache.remove(host);
+    }
+
+    // Share a running lookup for the same host
+    QList<QPointer<CoapReply> > &waitingReplies = m_hostLookupReplies[host];
+    waitingReplies.append(reply);
+    if (waitingReplies.count() == 1) {
+        int lookupId = QHostInfo::lookupHost(host, this, SLOT(hostLookupFinished(QHostInfo)));
+        m_runningHostLookups.insert(lookupId, host);
+    }
+}
+
+void Coap::hostResolved(CoapReply *reply, const QHostAddress &hostAddress, bool lookedUp)
+{
+    reply->setPort(reply->request().url().port(5683));
+    reply->setHostAddress(hostAddress);
+    reply->m_lockedUp = lookedUp;
+    enqueueReply(reply);
+}
+
+void Coap::enqueueReply(CoapReply *reply)
+{
+    Endpoint endpoint(reply->hostAddress(), reply->port());
+    QList<CoapReply *> &activeReplies = m_activeReplies[endpoint];
+    if (activeReplies.count() >= m_nstart) {
+        qCDebug(dcCoap) << "Queueing request to" << reply->request().url().toString() << "until an exchange with" << QString("%1:%2").arg(endpoint.first.toString()).arg(endpoint.second) << "finished";
+        m_queuedReplies[endpoint].enqueue(reply);
+        return;
+    }
+
+    activeReplies.append(reply);
+    sendRequest(reply, reply->m_lockedUp);
+}
+
+void Coap::startQueuedReplies(const Endpoint &endpoint)
+{
+    while (m_queuedReplies.contains(endpoint) && m_activeReplies.value(endpoint).count() < m_nstart) {
+        QQueue<CoapReply *> &queue = m_queuedReplies[endpoint];
+        CoapReply *reply = queue.dequeue();
+        if (queue.isEmpty()) {
+            m_queuedReplies.remove(endpoint);
+        }
+        m_activeReplies[endpoint].append(reply);
+        sendRequest(reply, reply->m_lockedUp);
+    }
+}
+
+void Coap::removeReply(CoapReply *reply)
+{
+    QList<Endpoint> freedEndpoints;
+    foreach (const Endpoint &endpoint, m_activeReplies.keys()) {
+        QList<CoapReply *> &activeReplies = m_activeReplies[endpoint];
+        if (activeReplies.removeAll(reply) > 0) {
+            freedEndpoints.append(endpoint);
+        }
+        if (activeReplies.isEmpty()) {
+            m_activeReplies.remove(endpoint);
+        }
+    }
+    foreach (const Endpoint &endpoint, m_queuedReplies.keys()) {
+        QQueue<CoapReply *> &queue = m_queuedReplies[endpoint];
+        queue.removeAll(reply);
+        if (queue.isEmpty()) {
+            m_queuedReplies.remove(endpoint);
+        }
+    }
+    foreach (const Endpoint &endpoint, freedEndpoints) {
+        startQueuedReplies(endpoint);
+    }
+}
+
+quint16 Coap::createMessageId(const Endpoint &endpoint) const
+{
+    // Also skips the current ID of each exchange, so a block follow-up never reuses the ID of the previous block
+    QList<CoapReply *> endpointReplies = m_activeReplies.value(endpoint);
+    quint16 messageId = 0;
+    bool messageIdInUse = false;
+    do {
+        messageId = (quint16)qrand() % 65536;
+        messageIdInUse = false;
+        foreach (CoapReply *endpointReply, endpointReplies) {
+            messageIdInUse |= endpointReply->messageId() == messageId;
+        }
+    } while (messageIdInUse);
+    return messageId;
+}
+
+bool Coap::tokenInUse(const QByteArray &token) const
+{
+    if (m_observeResources.contains(token))
+        return true;
+
+    foreach (const QList<CoapReply *> &activeReplies, m_activeReplies) {
+        foreach (CoapReply *reply, activeReplies) {
+            if (reply->messageToken() == token) {
+                return true;
+            }
+        }
+    }
+    return false;
 }
 
 void Coap::sendRequest(CoapReply *reply, const bool &lookedUp)
@@ -307,8 +416,12 @@ void Coap::sendRequest(CoapReply *reply, const bool &lookedUp)
     CoapPdu pdu;
     pdu.setMessageType(reply->request().messageType());
     pdu.setStatusCode(reply->requestMethod());
-    pdu.createMessageId();
-    pdu.createToken();
+
+    // Message IDs must be unique per endpoint and tokens unique for all outstanding exchanges
+    pdu.setMessageId(createMessageId(Endpoint(reply->hostAddress(), reply->port())));
+    do {
+        pdu.createToken();
+    } while (tokenInUse(pdu.token()));
 
     // Add the options in correct order
     // Option number 3
@@ -396,26 +509,41 @@ void Coap::sendCoapPdu(const QHostAddress &hostAddress, const quint16 &port, con
 
 void Coap::processResponse(const CoapPdu &pdu, const QHostAddress &address, const quint16 &port)
 {
-    // if we are waiting for a reply response
-    if (m_reply) {
+    // if we are waiting for a reply response from this endpoint
+    QList<CoapReply *> endpointReplies = m_activeReplies.value(Endpoint(address, port));
+    if (!endpointReplies.isEmpty()) {
         qCDebug(dcCoap) << "<---" << QString("%1:%2").arg(address.toString()).arg(QString::number(port)) << pdu;
         if (!pdu.isValid()) {
             qCWarning(dcCoap) << "Got invalid PDU";
-            m_reply->setError(CoapReply::InvalidPduError);
-            m_reply->setFinished();
-            return;
+            CoapReply *reply = endpointReplies.count() == 1 ? endpointReplies.first() : nullptr;
+            foreach (CoapReply *endpointReply, endpointReplies) {
+                if (endpointReply->messageId() == pdu.messageId()) {
+                    reply = endpointReply;
+                }
+            }
+            if (reply) {
+                reply->setError(CoapReply::InvalidPduError);
+                reply->setFinished();
+                return;
+            }
         }
 
         // check if the message is a response to a reply (message id based check)
-        if (m_reply->messageId() == pdu.messageId()) {
-            processIdBasedResponse(m_reply, pdu);
-            return;
+        foreach (CoapReply *reply, endpointReplies) {
+            if (reply->messageId() == pdu.messageId()) {
+                processIdBasedResponse(reply, pdu);
+                return;
+            }
         }
+    }
 
-        // check if we know the message by token (message token based check)
-        if (m_reply->messageToken() == pdu.token()) {
-            processTokenBasedResponse(m_reply, pdu);
-            return;
+    // check if we know the message by token (message token based check)
+    foreach (const QList<CoapReply *> &activeReplies, m_activeReplies) {
+        foreach (CoapReply *reply, activeReplies) {
+            if (reply->messageToken() == pdu.token()) {
+                processTokenBasedResponse(reply, pdu);
+                return;
+            }
         }
     }
 
@@ -610,7 +738,7 @@ void Coap::processBlock1Response(CoapReply *reply, const CoapPdu &pdu)
     nextBlockRequest.setContentType(reply->request().contentType());
     nextBlockRequest.setMessageType(reply->request().messageType());
     nextBlockRequest.setStatusCode(reply->requestMethod());
-    nextBlockRequest.setMessageId(pdu.messageId() + 1);
+    nextBlockRequest.setMessageId(createMessageId(Endpoint(reply->hostAddress(), reply->port())));
     nextBlockRequest.setToken(pdu.token());
 
     // Add the options in correct order
@@ -665,7 +793,7 @@ void Coap::processBlock2Response(CoapReply *reply, const CoapPdu &pdu)
     nextBlockRequest.setContentType(reply->request().contentType());
     nextBlockRequest.setMessageType(reply->request().messageType());
     nextBlockRequest.setStatusCode(reply->requestMethod());
-    nextBlockRequest.setMessageId(pdu.messageId() + 1);
+    nextBlockRequest.setMessageId(createMessageId(Endpoint(reply->hostAddress(), reply->port())));
     nextBlockRequest.setToken(pdu.token());
 
     // Add the options in correct order
@@ -738,7 +866,7 @@ void Coap::processBlock2Notification(CoapReply *reply, const CoapPdu &pdu)
     nextBlockRequest.setContentType(reply->request().contentType());
     nextBlockRequest.setMessageType(reply->request().messageType());
     nextBlockRequest.setStatusCode(reply->requestMethod());
-    nextBlockRequest.setMessageId(pdu.messageId() + 1);
+    nextBlockRequest.setMessageId(createMessageId(Endpoint(reply->hostAddress(), reply->port())));
     nextBlockRequest.setToken(pdu.token());
 
     // Add the options in correct order
@@ -776,25 +904,36 @@ void Coap::processBlock2Notification(CoapReply *reply, const CoapPdu &pdu)
 
 void Coap::hostLookupFinished(const QHostInfo &hostInfo)
 {
-    CoapReply *reply = m_runningHostLookups.take(hostInfo.lookupId());;
-    reply->setPort(reply->request().url().port(5683));
-
-    if (hostInfo.error() != QHostInfo::NoError) {
-        qCDebug(dcCoap) << "Host lookup for" << reply->request().url().host() << "failed:" << hostInfo.errorString();
-        reply->setError(CoapReply::HostNotFoundError);
-        reply->setFinished();
+    QString host = m_runningHostLookups.take(hostInfo.lookupId());
+    QList<QPointer<CoapReply> > replies = m_hostLookupReplies.take(host);
+
+    if (hostInfo.error() != QHostInfo::NoError || hostInfo.addresses().isEmpty()) {
+        qCDebug(dcCoap) << "Host lookup for" << host << "failed:" << hostInfo.errorString();
+        foreach (const QPointer<CoapReply> &reply, replies) {
+            if (reply.isNull())
+                continue;
+
+            reply->setPort(reply->request().url().port(5683));
+            reply->setError(CoapReply::HostNotFoundError);
+            reply->setFinished();
+        }
         return;
     }
 
     QHostAddress hostAddress = hostInfo.addresses().first();
-    reply->setHostAddress(hostAddress);
+    qCDebug(dcCoap) << host << " -> " << hostAddress.toString();
 
-    // check if the url had to be looked up
-    if (reply->request().url().host() != hostAddress.toString()) {
-        qCDebug(dcCoap) << reply->request().url().host() << " -> " << hostAddress.toString();
-        sendRequest(reply, true);
-    } else {
-        sendRequest(reply);
+    CachedHost cachedHost;
+    cachedHost.address = hostAddress;
+    cachedHost.expiry = m_clock.elapsed() + hostCacheTimeout;
+    m_hostCache.insert(host, cachedHost);
+
+    foreach (const QPointer<CoapReply> &reply, replies) {
+        if (reply.isNull())
+            continue;
+
+        // check if the url had to be looked up
+        hostResolved(reply, hostAddress, host != hostAddress.toString());
     }
 }
 
@@ -807,10 +946,16 @@ void Coap::onReadyRead()
     while (m_socket->hasPendingDatagrams()) {
         data.resize(m_socket->pendingDatagramSize());
         m_socket->readDatagram(data.data(), data.size(), &hostAddress, &port);
-    }
 
-    CoapPdu pdu(data);
-    processResponse(pdu, hostAddress, port);
+        // Match IPv4 mapped addresses of the dual stack socket with the IPv4 address of the request
+        bool isIPv4 = false;
+        quint32 ipv4Address = hostAddress.toIPv4Address(&isIPv4);
+        if (isIPv4)
+            hostAddress = QHostAddress(ipv4Address);
+
+        CoapPdu pdu(data);
+        processResponse(pdu, hostAddress, port);
+    }
 }
 
 void Coap::onReplyTimeout()
@@ -835,16 +980,15 @@ void Coap::onReplyFinished()
         return;
     }
 
-    if (reply != m_reply)
-        qCWarning(dcCoap) << "This should never happen!! Please report a bug if you get this message!";
+    // Free the exchange slot before notifying, the receiver might start new requests to the same endpoint
+    Endpoint endpoint(reply->hostAddress(), reply->port());
+    QList<CoapReply *> &activeReplies = m_activeReplies[endpoint];
+    activeReplies.removeAll(reply);
+    if (activeReplies.isEmpty()) {
+        m_activeReplies.remove(endpoint);
+    }
 
     emit replyFinished(reply);
-    m_reply.clear();
 
-    // check if there is a request in the queue
-    if (!m_replyQueue.isEmpty()) {
-        m_reply = m_replyQueue.dequeue();
-        if (m_reply)
-            lookupHost();
-    }
+    startQueuedReplies(endpoint);
 }
@@ -38,6 +38,7 @@
 #include <QLoggingCategory>
 #include <QPointer>
 #include <QQueue>
+#include <QElapsedTimer>
 
 #include "libnymea.h"
 #include "coaprequest.h"
@@ -70,14 +71,28 @@ public:
     CoapReply *enableResourceNotifications(const CoapRequest &request);
     CoapReply *disableNotifications(const CoapRequest &request);
 
+    int nstart() const;
+    void setNStart(int nstart);
 
 private:
+    typedef QPair<QHostAddress, quint16> Endpoint;
+
+    class CachedHost {
+    public:
+        QHostAddress address;
+        qint64 expiry = 0;
+    };
+
     QUdpSocket *m_socket;
+    int m_nstart = 1;
 
-    QPointer<CoapReply> m_reply;
-    QQueue<CoapReply *> m_replyQueue;
+    QHash<Endpoint, QList<CoapReply *> > m_activeReplies;                // endpoint | outstanding exchanges
+    QHash<Endpoint, QQueue<CoapReply *> > m_queuedReplies;               // endpoint | replies waiting for a free exchange
 
-    QHash<int, CoapReply *> m_runningHostLookups;
+    QHash<int, QString> m_runningHostLookups;                           // lookup id | host
+    QHash<QString, QList<QPointer<CoapReply> > > m_hostLookupReplies;   // host | replies waiting for the lookup
+    QHash<QString, CachedHost> m_hostCache;                             // host | lookup result
+    QElapsedTimer m_clock;
 
     QHash<QByteArray, CoapObserveResource> m_observeResources;          // token | resource
 
@@ -86,7 +101,14 @@ private:
     QHash<CoapReply *, CoapObserveResource> m_observeReplyResource;     // observe reply | resource
     QHash<CoapReply *, int> m_observeBlockwise;                         // observe reply | observe nr.
 
-    void lookupHost();
+    void startReply(CoapReply *reply);
+    void hostResolved(CoapReply *reply, const QHostAddress &hostAddress, bool lookedUp);
+    void enqueueReply(CoapReply *reply);
+    void startQueuedReplies(const Endpoint &endpoint);
+    void removeReply(CoapReply *reply);
+    quint16 createMessageId(const Endpoint &endpoint) const;
+    bool tokenInUse(const QByteArray &token) const;
+
     void sendRequest(CoapReply *reply, const bool &lookedUp = false);
     void sendData(const QHostAddress &hostAddress, const quint16 &port, const QByteArray &data);
     void sendCoapPdu(const QHostAddress &address, const quint16 &port, const CoapPdu &pdu);
@@ -15,7 +15,9 @@ HEADERS += \
     $$PWD/coappdublock.h \
     $$PWD/corelinkparser.h \
     $$PWD/corelink.h \
-    $$PWD/coapobserveresource.h
+    $$PWD/coapobserveresource.h \
+    $$PWD/coapresource.h \
+    $$PWD/coapserver.h
 
 SOURCES += \
     $$PWD/coap.cpp \
@@ -26,5 +28,7 @@ SOURCES += \
     $$PWD/coappdublock.cpp \
     $$PWD/corelinkparser.cpp \
     $$PWD/corelink.cpp \
-    $$PWD/coapobserveresource.cpp
+    $$PWD/coapobserveresource.cpp \
+    $$PWD/coapresource.cpp \
+    $$PWD/coapserver.cpp
 
@@ -358,19 +358,13 @@ void CoapPdu::addOption(const CoapOption::Option &option, const QByteArray &data
 
     // insert option (keep the list sorted to ensure a positiv option delta)
     int index = 0;
-    for (int i = 0; i < m_options.length(); i ++) {
-        index = i;
-        if (m_options.at(i).option() <= option) {
-            continue;
-        } else {
-            break;
-        }
-    }
+    while (index < m_options.length() && m_options.at(index).option() <= option)
+        index++;
 
     CoapOption o;
     o.setOption(option);
     o.setData(data);
-    m_options.insert(index + 1, o);
+    m_options.insert(index, o);
 }
 
 /*! Returns the block of this \l{CoapPdu}. */
@@ -431,72 +425,52 @@ QByteArray CoapPdu::pack() const
     pduData.append(m_token);
 
     // options
-    QByteArray optionsData;
-    quint8 prevOption = 0;
+    quint16 prevOption = 0;
     foreach (const CoapOption &option, m_options) {
         quint8 optionByte = 0;
+        QByteArray extendedBytes;
 
         // encode option delta
-        quint16 optionDelta = (quint8)option.option() - prevOption;
-        prevOption = (quint8)option.option();
+        quint16 optionDelta = (quint16)option.option() - prevOption;
+        prevOption = (quint16)option.option();
 
-        quint8 extendedOptionDeltaByte = 0;
-        quint16 bigExtendedOptionDeltaByte = 0;
         if (optionDelta < 13) {
             optionByte = optionDelta << 4;
-        } else if (optionDelta < 270) {
+        } else if (optionDelta < 269) {
             // extended 8 bit option delta
             optionByte = 13 << 4;
-            extendedOptionDeltaByte = optionDelta - 13;
+            extendedBytes.append((char)(optionDelta - 13));
         } else {
             // extended 16 bit option delta
             optionByte = 14 << 4;
-            bigExtendedOptionDeltaByte = ((optionDelta - 269) >> 8) & 0xff;
-            bigExtendedOptionDeltaByte = (optionDelta - 269) & 0xff;
+            extendedBytes.append((char)(((optionDelta - 269) >> 8) & 0xff));
+            extendedBytes.append((char)((optionDelta - 269) & 0xff));
         }
 
         // encode option length
         int optionLength = option.data().length();
-        quint8 extendedOptionLengthByte = 0;
-        quint16 bigExtendedOptionLengthByte = 0;
         if (optionLength < 13) {
             optionByte |= optionLength;
-        } else if (optionLength < 270) {
+        } else if (optionLength < 269) {
             // extended 8 bit option length
             optionByte |= 13;
-            extendedOptionLengthByte = optionLength - 13;
+            extendedBytes.append((char)(optionLength - 13));
         } else {
             // extended 16 bit option length
             optionByte |= 14;
-            bigExtendedOptionLengthByte = ((optionLength - 269) >> 8) & 0xff;
-            bigExtendedOptionLengthByte = (optionLength - 269) & 0xff;
+            extendedBytes.append((char)(((optionLength - 269) >> 8) & 0xff));
+            extendedBytes.append((char)((optionLength - 269) & 0xff));
         }
 
-        // add obligatory option byte
+        // add obligatory option byte, the extended delta and length bytes and the option data
         pduData.append((char)optionByte);
-
-        // check extended option delta bytes
-        if (extendedOptionDeltaByte != 0)
-            pduData.append((char)extendedOptionDeltaByte);
-
-        if (bigExtendedOptionDeltaByte != 0)
-            pduData.append((char)bigExtendedOptionDeltaByte);
-
-        // check extended option length bytes
-        if (extendedOptionLengthByte != 0)
-            pduData.append((char)extendedOptionLengthByte);
-
-        if (bigExtendedOptionLengthByte != 0)
-            pduData.append((char)extendedOptionLengthByte);
-
-        // add the option data
+        pduData.append(extendedBytes);
         pduData.append(option.data());
     }
-    pduData.append(optionsData);
 
     if (!m_payload.isEmpty()) {
         pduData.append((char)255);
-        pduData.append(m_payload.data());
+        pduData.append(m_payload);
     }
 
     return pduData;
@@ -507,67 +481,95 @@ void CoapPdu::unpack(const QByteArray &data)
     // create a CoapPDU
     if (data.length() < 4) {
         m_error = InvalidPduSizeError;
+        return;
     }
 
-    quint8 *rawData = (quint8 *)data.data();
+    const quint8 *rawData = (const quint8 *)data.constData();
     setVersion((rawData[0] & 0xc0) >> 6);
     setMessageType(static_cast<MessageType>((rawData[0] & 0x30) >> 4));
     quint8 tokenLength = (rawData[0] & 0xf);
 
     if (tokenLength > 8) {
         m_error = InvalidTokenError;
+        return;
+    }
+
+    if (data.length() < 4 + tokenLength) {
+        m_error = InvalidPduSizeError;
+        return;
     }
 
     setToken(QByteArray((const char *)rawData + 4, tokenLength));
     setStatusCode(static_cast<StatusCode>(rawData[1]));
-    setMessageId((qint16)data.mid(2,2).toHex().toUInt(0,16));
+    setMessageId((quint16)((rawData[2] << 8) | rawData[3]));
 
     // parse options
     int index = 4 + tokenLength;
-    quint8 optionByte = rawData[index];
     quint16 delta = 0;
-    while (QByteArray::number(optionByte, 16) != "ff" && optionByte != 0) {
-        quint16 optionNumber = ((optionByte & 0xf0) >> 4);
+    while (index < data.length()) {
+        quint8 optionByte = rawData[index];
+        index += 1;
+
+        // payload marker
+        if (optionByte == 0xff) {
+            setPayload(data.mid(index));
+            break;
+        }
 
         // check option delta
-        if (optionNumber < 13) {
-            delta += optionNumber;
-        } else if (optionNumber == 13) {
+        quint16 optionNumber = ((optionByte & 0xf0) >> 4);
+        if (optionNumber == 13) {
             // extended 8 bit option delta
-            delta += (quint8)(rawData[index + 1] + 13);
+            if (index + 1 > data.length()) {
+                m_error = InvalidOptionDeltaError;
+                return;
+            }
+            optionNumber = rawData[index] + 13;
             index += 1;
         } else if (optionNumber == 14) {
             // extended 16 bit option delta
-            delta += ((rawData[index + 1] << 8) | rawData[index + 2]) + 269;
+            if (index + 2 > data.length()) {
+                m_error = InvalidOptionDeltaError;
+                return;
+            }
+            optionNumber = ((rawData[index] << 8) | rawData[index + 1]) + 269;
             index += 2;
         } else if (optionNumber == 15) {
             m_error = InvalidOptionDeltaError;
+            return;
         }
+        delta += optionNumber;
 
         // check option length
-        quint16 optionLength = (optionByte & 0xf);
+        int optionLength = (optionByte & 0xf);
         if (optionLength == 13) {
             // extended 8 bit option length
-            optionLength = (quint8)(rawData[index + 1] - 13);
+            if (index + 1 > data.length()) {
+                m_error = InvalidOptionLengthError;
+                return;
+            }
+            optionLength = rawData[index] + 13;
             index += 1;
         } else if (optionLength == 14) {
-            // extended 16 bit option delta
-            optionLength = ((rawData[index + 1] << 8) | rawData[index + 2]) - 269;
+            // extended 16 bit option length
+            if (index + 2 > data.length()) {
+                m_error = InvalidOptionLengthError;
+                return;
+            }
+            optionLength = ((rawData[index] << 8) | rawData[index + 1]) + 269;
             index += 2;
         } else if (optionLength == 15) {
             m_error = InvalidOptionLengthError;
+            return;
         }
 
-        QByteArray optionData = QByteArray((const char *)rawData + index + 1, optionLength);
-        addOption(static_cast<CoapOption::Option>(delta), optionData);
-
-        index += optionLength + 1;
-        optionByte = rawData[index];
-
-        if (QByteArray::number(optionByte, 16) == "ff") {
-            setPayload(data.right(data.length() - index - 1));
-            break;
+        if (index + optionLength > data.length()) {
+            m_error = InvalidOptionLengthError;
+            return;
         }
+
+        addOption(static_cast<CoapOption::Option>(delta), data.mid(index, optionLength));
+        index += optionLength;
     }
 }
 
@@ -0,0 +1,167 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* Copyright 2013 - 2020, nymea GmbH
+* Contact: contact@nymea.io
+*
+* This file is part of nymea.
+* This project including source code and documentation is protected by
+* copyright law, and remains the property of nymea GmbH. All rights, including
+* reproduction, publication, editing and translation, are reserved. The use of
+* this project is subject to the terms of a license agreement to be concluded
+* with nymea GmbH in accordance with the terms of use of nymea GmbH, available
+* under https://nymea.io/license
+*
+* GNU Lesser General Public License Usage
+* Alternatively, this project may be redistributed and/or modified under the
+* terms of the GNU Lesser General Public License as published by the Free
+* Software Foundation; version 3. This project is distributed in the hope that
+* it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+* warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this project. If not, see <https://www.gnu.org/licenses/>.
+*
+* For any further details and any questions please contact us under
+* contact@nymea.io or see our FAQ/Licensing Information on
+* https://nymea.io/license/faq
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+/*!
+    \class CoapResource
+    \brief Represents a resource served by a \l{CoapServer}.
+
+    \ingroup coap-group
+    \inmodule libnymea
+
+    A CoapResource holds the current representation of a resource at the given path. GET requests are answered
+    with the \l{payload()}. If the resource is \l{isWritable()}{writable}, the payload of PUT and POST requests is
+    emitted with \l{payloadReceived()}, a PUT request additionally replaces the payload of the resource.
+
+    An \l{isObservable()}{observable} resource notifies all registered observers according to
+    \l{https://tools.ietf.org/html/rfc7641}{RFC7641} whenever \l{changed()} is emitted, which happens automatically
+    when the payload changes.
+
+    For any other behavior, reimplement \l{processRequest()}.
+
+    \sa CoapServer
+*/
+
+/*! \class CoapResourceRequest
+    \brief Describes a request to a \l{CoapResource}.
+
+    \ingroup coap-group
+    \inmodule libnymea
+
+    Block-wise transfers have already been reassembled by the \l{CoapServer}, so the payload is always complete.
+*/
+
+/*! \fn void CoapResource::changed();
+    This signal is emitted when the representation of the resource changed. Observers of the resource will be notified.
+    Reimplementations of \l{processRequest()} may emit this signal if their representation changed.
+*/
+
+/*! \fn void CoapResource::payloadReceived(const QByteArray &payload, const QHostAddress &address, quint16 port);
+    This signal is emitted when the \a payload of a PUT or POST request from the client at \a address and \a port was received.
+*/
+
+#include "coapresource.h"
+
+/*! Constructs a CoapResource for the given \a path with the given \a parent. */
+CoapResource::CoapResource(const QString &path, QObject *parent) :
+    QObject(parent),
+    m_path(path)
+{
+    // Normalize the path to a single leading slash and no trailing slash
+    QStringList pathTokens = path.split('/');
+    pathTokens.removeAll(QString());
+    m_path = "/" + pathTokens.join('/');
+}
+
+/*! Returns the path of this resource, always starting with a slash. */
+QString CoapResource::path() const
+{
+    return m_path;
+}
+
+/*! Returns true if clients can observe this resource. */
+bool CoapResource::isObservable() const
+{
+    return m_observable;
+}
+
+/*! Sets the resource to be \a observable by clients. */
+void CoapResource::setObservable(bool observable)
+{
+    m_observable = observable;
+}
+
+/*! Returns true if clients are allowed to PUT and POST to this resource. */
+bool CoapResource::isWritable() const
+{
+    return m_writable;
+}
+
+/*! Sets the resource to be \a writable by clients using PUT and POST. */
+void CoapResource::setWritable(bool writable)
+{
+    m_writable = writable;
+}
+
+/*! Returns the content type of the payload. */
+CoapPdu::ContentType CoapResource::contentType() const
+{
+    return m_contentType;
+}
+
+/*! Sets the content type of the payload to \a contentType. */
+void CoapResource::setContentType(CoapPdu::ContentType contentType)
+{
+    m_contentType = contentType;
+}
+
+/*! Returns the current payload of this resource. */
+QByteArray CoapResource::payload() const
+{
+    return m_payload;
+}
+
+/*! Sets the current \a payload of this resource. Observers will be notified if the payload changed. */
+void CoapResource::setPayload(const QByteArray &payload)
+{
+    if (m_payload == payload)
+        return;
+
+    m_payload = payload;
+    emit changed();
+}
+
+/*! Processes the given \a request and returns the status code of the response. The payload of the response
+    is written to \a responsePayload. This method is also called to build the notifications for observers.
+
+    Reimplement this method to serve dynamic content or to handle requests differently.
+*/
+CoapPdu::StatusCode CoapResource::processRequest(const CoapResourceRequest &request, QByteArray *responsePayload)
+{
+    switch (request.method) {
+    case CoapPdu::Get:
+        *responsePayload = m_payload;
+        return CoapPdu::Content;
+    case CoapPdu::Put:
+        if (!m_writable)
+            return CoapPdu::MethodNotAllowed;
+
+        emit payloadReceived(request.payload, request.address, request.port);
+        setPayload(request.payload);
+        return CoapPdu::Changed;
+    case CoapPdu::Post:
+        if (!m_writable)
+            return CoapPdu::MethodNotAllowed;
+
+        emit payloadReceived(request.payload, request.address, request.port);
+        return CoapPdu::Changed;
+    default:
+        return CoapPdu::MethodNotAllowed;
+    }
+}
@@ -0,0 +1,86 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* Copyright 2013 - 2020, nymea GmbH
+* Contact: contact@nymea.io
+*
+* This file is part of nymea.
+* This project including source code and documentation is protected by
+* copyright law, and remains the property of nymea GmbH. All rights, including
+* reproduction, publication, editing and translation, are reserved. The use of
+* this project is subject to the terms of a license agreement to be concluded
+* with nymea GmbH in accordance with the terms of use of nymea GmbH, available
+* under https://nymea.io/license
+*
+* GNU Lesser General Public License Usage
+* Alternatively, this project may be redistributed and/or modified under the
+* terms of the GNU Lesser General Public License as published by the Free
+* Software Foundation; version 3. This project is distributed in the hope that
+* it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+* warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this project. If not, see <https://www.gnu.org/licenses/>.
+*
+* For any further details and any questions please contact us under
+* contact@nymea.io or see our FAQ/Licensing Information on
+* https://nymea.io/license/faq
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef COAPRESOURCE_H
+#define COAPRESOURCE_H
+
+#include <QObject>
+#include <QHostAddress>
+
+#include "libnymea.h"
+#include "coappdu.h"
+
+class LIBNYMEA_EXPORT CoapResourceRequest
+{
+public:
+    CoapPdu::StatusCode method = CoapPdu::Get;
+    QString query;
+    QByteArray payload;
+    CoapPdu::ContentType contentType = CoapPdu::TextPlain;
+    QHostAddress address;
+    quint16 port = 0;
+};
+
+class LIBNYMEA_EXPORT CoapResource : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit CoapResource(const QString &path, QObject *parent = nullptr);
+
+    QString path() const;
+
+    bool isObservable() const;
+    void setObservable(bool observable);
+
+    bool isWritable() const;
+    void setWritable(bool writable);
+
+    CoapPdu::ContentType contentType() const;
+    void setContentType(CoapPdu::ContentType contentType);
+
+    QByteArray payload() const;
+    void setPayload(const QByteArray &payload);
+
+    virtual CoapPdu::StatusCode processRequest(const CoapResourceRequest &request, QByteArray *responsePayload);
+
+signals:
+    void changed();
+    void payloadReceived(const QByteArray &payload, const QHostAddress &address, quint16 port);
+
+private:
+    QString m_path;
+    bool m_observable = false;
+    bool m_writable = false;
+    CoapPdu::ContentType m_contentType = CoapPdu::TextPlain;
+    QByteArray m_payload;
+};
+
+#endif // COAPRESOURCE_H
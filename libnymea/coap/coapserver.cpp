@@ -0,0 +1,581 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* Copyright 2013 - 2020, nymea GmbH
+* Contact: contact@nymea.io
+*
+* This file is part of nymea.
+* This project including source code and documentation is protected by
+* copyright law, and remains the property of nymea GmbH. All rights, including
+* reproduction, publication, editing and translation, are reserved. The use of
+* this project is subject to the terms of a license agreement to be concluded
+* with nymea GmbH in accordance with the terms of use of nymea GmbH, available
+* under https://nymea.io/license
+*
+* GNU Lesser General Public License Usage
+* Alternatively, this project may be redistributed and/or modified under the
+* terms of the GNU Lesser General Public License as published by the Free
+* Software Foundation; version 3. This project is distributed in the hope that
+* it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+* warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this project. If not, see <https://www.gnu.org/licenses/>.
+*
+* For any further details and any questions please contact us under
+* contact@nymea.io or see our FAQ/Licensing Information on
+* https://nymea.io/license/faq
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+/*!
+    \class CoapServer
+    \brief Serves \l{CoapResource}{CoapResources} to CoAP clients.
+
+    \ingroup coap-group
+    \inmodule libnymea
+
+    The CoapServer answers requests of CoAP clients according to \l{https://tools.ietf.org/html/rfc7252}{RFC7252}
+    using a single UDP socket for all registered resources. It supports block-wise transfers in both directions
+    according to \l{https://tools.ietf.org/html/rfc7959}{RFC7959} and observing resources according to
+    \l{https://tools.ietf.org/html/rfc7641}{RFC7641}. The list of resources is available for discovery at
+    \tt{/.well-known/core} in the \l{https://tools.ietf.org/html/rfc6690}{CoRE link format}.
+
+    Responses to confirmable requests are cached for a minute, so retransmitted requests are answered
+    without processing them again.
+
+    \section2 Example
+    \code
+        CoapServer *server = new CoapServer(this);
+        server->listen(QHostAddress::Any, 5683);
+
+        CoapResource *temperature = new CoapResource("/sensors/temperature", this);
+        temperature->setObservable(true);
+        temperature->setPayload("21.5");
+        server->registerResource(temperature);
+
+        // Notifies all observers of the resource
+        temperature->setPayload("22.0");
+    \endcode
+
+    \sa CoapResource, Coap
+*/
+
+#include "coapserver.h"
+#include "coapoption.h"
+#include "loggingcategories.h"
+
+// Largest block size offered for block-wise transfers (SZX 6)
+static const int maxBlockSize = 1024;
+// Largest payload accepted through block-wise uploads
+static const int maxUploadSize = 64 * 1024;
+// Time to keep responses and incomplete uploads (ms)
+static const qint64 exchangeLifetime = 60000;
+
+static QByteArray encodeUInt(quint32 value)
+{
+    QByteArray data;
+    while (value > 0) {
+        data.prepend((char)(value & 0xff));
+        value >>= 8;
+    }
+    return data;
+}
+
+static quint32 decodeUInt(const QByteArray &data)
+{
+    quint32 value = 0;
+    foreach (const char byte, data) {
+        value = (value << 8) | (quint8)byte;
+    }
+    return value;
+}
+
+static bool findOption(const CoapPdu &pdu, CoapOption::Option option, QByteArray *data)
+{
+    foreach (const CoapOption &o, pdu.options()) {
+        if (o.option() == option) {
+            *data = o.data();
+            return true;
+        }
+    }
+    return false;
+}
+
+static int blockSizeExponent(int blockSize)
+{
+    int exponent = 0;
+    while (exponent < 6 && (16 << exponent) < blockSize) {
+        exponent++;
+    }
+    return exponent;
+}
+
+static QString normalizedPath(const QString &path)
+{
+    QStringList pathTokens = path.split('/');
+    pathTokens.removeAll(QString());
+    return "/" + pathTokens.join('/');
+}
+
+static bool isSuccess(CoapPdu::StatusCode statusCode)
+{
+    return (statusCode >> 5) == 2;
+}
+
+/*! Constructs a CoapServer with the given \a parent. Call \l{listen()} to start serving. */
+CoapServer::CoapServer(QObject *parent) :
+    QObject(parent)
+{
+    m_clock.start();
+    m_messageId = (quint16)(qrand() % 65536);
+
+    m_socket = new QUdpSocket(this);
+    connect(m_socket, &QUdpSocket::readyRead, this, &CoapServer::onReadyRead);
+
+    m_cleanupTimer = new QTimer(this);
+    m_cleanupTimer->setInterval(10000);
+    connect(m_cleanupTimer, &QTimer::timeout, this, &CoapServer::cleanup);
+}
+
+/*! Starts listening for requests on the given \a address and \a port. Returns false if the socket could not be bound. */
+bool CoapServer::listen(const QHostAddress &address, quint16 port)
+{
+    if (isListening())
+        close();
+
+    if (!m_socket->bind(address, port)) {
+        qCWarning(dcCoap) << "Could not bind CoAP server to" << address.toString() << port << m_socket->errorString();
+        return false;
+    }
+
+    qCDebug(dcCoap) << "CoAP server listening on" << address.toString() << m_socket->localPort();
+    m_cleanupTimer->start();
+    return true;
+}
+
+/*! Stops listening. All observations and incomplete transfers are dropped. */
+void CoapServer::close()
+{
+    m_socket->close();
+    m_cleanupTimer->stop();
+    m_observers.clear();
+    m_blockTransfers.clear();
+    m_responseCache.clear();
+}
+
+/*! Returns true if the server is listening for requests. */
+bool CoapServer::isListening() const
+{
+    return m_socket->state() == QAbstractSocket::BoundState;
+}
+
+/*! Returns the port the server is listening on. */
+quint16 CoapServer::serverPort() const
+{
+    return m_socket->localPort();
+}
+
+/*! Registers the given \a resource to be served at its \l{CoapResource::path()}{path}. The server does not take the
+    ownership of the resource, deleting it unregisters it. Returns false if another resource is registered for that path. */
+bool CoapServer::registerResource(CoapResource *resource)
+{
+    CoapResource *existingResource = m_resources.value(resource->path());
+    if (existingResource) {
+        if (existingResource != resource)
+            qCWarning(dcCoap) << "A CoAP resource is already registered for" << resource->path();
+
+        return existingResource == resource;
+    }
+
+    m_resources.insert(resource->path(), resource);
+    connect(resource, &CoapResource::changed, this, &CoapServer::onResourceChanged);
+    connect(resource, &CoapResource::destroyed, this, [this, resource](){
+        removeResource(resource);
+    });
+    return true;
+}
+
+/*! Unregisters the given \a resource. All observers of the resource are dropped. */
+void CoapServer::unregisterResource(CoapResource *resource)
+{
+    disconnect(resource, nullptr, this, nullptr);
+    removeResource(resource);
+}
+
+/*! Returns the resource registered for the given \a path, or nullptr if there is none. */
+CoapResource *CoapServer::resource(const QString &path) const
+{
+    return m_resources.value(normalizedPath(path));
+}
+
+/*! Returns all registered resources. */
+QList<CoapResource *> CoapServer::resources() const
+{
+    return m_resources.values();
+}
+
+/*! Returns the number of clients currently observing the given \a resource. */
+int CoapServer::observerCount(CoapResource *resource) const
+{
+    return m_observers.value(resource).count();
+}
+
+void CoapServer::processRequest(const CoapPdu &request, const Endpoint &endpoint)
+{
+    bool confirmable = request.messageType() == CoapPdu::Confirmable;
+
+    // An empty confirmable message is a ping and answered with a reset
+    if (request.statusCode() == CoapPdu::Empty) {
+        if (confirmable) {
+            CoapPdu reset;
+            reset.setMessageType(CoapPdu::Reset);
+            reset.setMessageId(request.messageId());
+            sendPdu(endpoint, reset);
+        }
+        return;
+    }
+
+    if (request.statusCode() > CoapPdu::Delete) {
+        qCDebug(dcCoap) << "Ignoring unexpected response from" << endpoint.first.toString() << endpoint.second;
+        return;
+    }
+
+    // Answer retransmissions with the same response
+    QPair<Endpoint, quint16> exchange(endpoint, request.messageId());
+    if (confirmable && m_responseCache.contains(exchange)) {
+        qCDebug(dcCoap) << "Answering duplicate request" << request.messageId() << "from" << endpoint.first.toString() << endpoint.second;
+        m_socket->writeDatagram(m_responseCache.value(exchange).data, endpoint.first, endpoint.second);
+        return;
+    }
+
+    CoapPdu response;
+    response.setMessageType(confirmable ? CoapPdu::Acknowledgement : CoapPdu::NonConfirmable);
+    response.setMessageId(confirmable ? request.messageId() : m_messageId++);
+    response.setToken(request.token());
+
+    QStringList pathTokens;
+    foreach (const CoapOption &option, request.options()) {
+        if (option.option() == CoapOption::UriPath) {
+            pathTokens.append(QString::fromUtf8(option.data()));
+        }
+    }
+    QString path = normalizedPath(pathTokens.join('/'));
+
+    QByteArray payload = request.payload();
+    CoapPdu::StatusCode statusCode = CoapPdu::Empty;
+
+    // Reassemble block-wise uploads
+    QByteArray blockData;
+    if (findOption(request, CoapOption::Block1, &blockData)) {
+        CoapPduBlock block(blockData);
+        QPair<Endpoint, QString> transferKey(endpoint, path);
+        if (block.blockNumber() == 0) {
+            m_blockTransfers.insert(transferKey, BlockTransfer());
+        }
+
+        if (!m_blockTransfers.contains(transferKey) || m_blockTransfers.value(transferKey).nextBlockNumber != block.blockNumber()) {
+            qCDebug(dcCoap) << "Unexpected block" << block.blockNumber() << "for" << path << "from" << endpoint.first.toString() << endpoint.second;
+            m_blockTransfers.remove(transferKey);
+            statusCode = CoapPdu::RequestEntityIncomplete;
+        } else {
+            BlockTransfer &transfer = m_blockTransfers[transferKey];
+            transfer.payload.append(payload);
+            transfer.nextBlockNumber++;
+            transfer.expiry = m_clock.elapsed() + exchangeLifetime;
+
+            if (transfer.payload.size() > maxUploadSize) {
+                m_blockTransfers.remove(transferKey);
+                statusCode = CoapPdu::RequestEntityTooLarge;
+                response.addOption(CoapOption::Size1, encodeUInt(maxUploadSize));
+            } else if (block.moreFlag()) {
+                statusCode = CoapPdu::Continue;
+                response.addOption(CoapOption::Block1, CoapPduBlock::createBlock(block.blockNumber(), blockSizeExponent(block.blockSize()), true));
+            } else {
+                payload = m_blockTransfers.take(transferKey).payload;
+                response.addOption(CoapOption::Block1, CoapPduBlock::createBlock(block.blockNumber(), blockSizeExponent(block.blockSize()), false));
+            }
+        }
+    }
+
+    if (statusCode == CoapPdu::Empty) {
+        QByteArray responsePayload;
+        CoapPdu::ContentType contentType = CoapPdu::TextPlain;
+
+        if (path == "/.well-known/core") {
+            if (request.statusCode() == CoapPdu::Get) {
+                statusCode = CoapPdu::Content;
+                contentType = CoapPdu::ApplicationLink;
+                responsePayload = coreLinks();
+            } else {
+                statusCode = CoapPdu::MethodNotAllowed;
+            }
+        } else if (!m_resources.contains(path)) {
+            statusCode = CoapPdu::NotFound;
+        } else {
+            CoapResource *resource = m_resources.value(path);
+            contentType = resource->contentType();
+            statusCode = processResource(resource, request, endpoint, payload, &responsePayload, response);
+        }
+
+        // Split large representations into blocks
+        int blockSize = maxBlockSize;
+        int blockNumber = 0;
+        if (findOption(request, CoapOption::Block2, &blockData)) {
+            CoapPduBlock block(blockData);
+            blockSize = qMin(block.blockSize(), maxBlockSize);
+            blockNumber = block.blockNumber();
+        }
+        if (request.statusCode() == CoapPdu::Get && isSuccess(statusCode) && (responsePayload.size() > blockSize || blockNumber > 0)) {
+            int offset = blockNumber * blockSize;
+            if (offset >= responsePayload.size()) {
+                statusCode = CoapPdu::BadOption;
+                responsePayload.clear();
+            } else {
+                response.addOption(CoapOption::Block2, CoapPduBlock::createBlock(blockNumber, blockSizeExponent(blockSize), offset + blockSize < responsePayload.size()));
+                responsePayload = responsePayload.mid(offset, blockSize);
+            }
+        }
+
+        if (!responsePayload.isEmpty()) {
+            response.addOption(CoapOption::ContentFormat, encodeUInt(contentType));
+            response.setPayload(responsePayload);
+        }
+    }
+
+    response.setStatusCode(statusCode);
+    sendPdu(endpoint, response);
+
+    if (confirmable) {
+        CachedResponse cachedResponse;
+        cachedResponse.data = response.pack();
+        cachedResponse.expiry = m_clock.elapsed() + exchangeLifetime;
+        m_responseCache.insert(exchange, cachedResponse);
+    }
+}
+
+void CoapServer::processReset(const CoapPdu &pdu, const Endpoint &endpoint)
+{
+    // A reset in reply to a notification cancels the observation
+    foreach (CoapResource *resource, m_observers.keys()) {
+        foreach (const Observer &observer, m_observers.value(resource)) {
+            if (observer.endpoint == endpoint && observer.lastMessageId == pdu.messageId()) {
+                qCDebug(dcCoap) << "Observer" << endpoint.first.toString() << endpoint.second << "rejected notification for" << resource->path();
+                removeObserver(endpoint, observer.token);
+                return;
+            }
+        }
+    }
+}
+
+CoapPdu::StatusCode CoapServer::processResource(CoapResource *resource, const CoapPdu &request, const Endpoint &endpoint, const QByteArray &payload, QByteArray *responsePayload, CoapPdu &response)
+{
+    QStringList queryTokens;
+    foreach (const CoapOption &option, request.options()) {
+        if (option.option() == CoapOption::UriQuery) {
+            queryTokens.append(QString::fromUtf8(option.data()));
+        }
+    }
+
+    CoapResourceRequest resourceRequest;
+    resourceRequest.method = request.statusCode();
+    resourceRequest.query = queryTokens.join('&');
+    resourceRequest.payload = payload;
+    resourceRequest.contentType = request.contentType();
+    resourceRequest.address = endpoint.first;
+    resourceRequest.port = endpoint.second;
+
+    CoapPdu::StatusCode statusCode = resource->processRequest(resourceRequest, responsePayload);
+
+    QByteArray observeData;
+    if (request.statusCode() == CoapPdu::Get && findOption(request, CoapOption::Observe, &observeData)) {
+        if (decodeUInt(observeData) == 0 && resource->isObservable() && isSuccess(statusCode)) {
+            int blockSize = maxBlockSize;
+            QByteArray blockData;
+            if (findOption(request, CoapOption::Block2, &blockData)) {
+                blockSize = qMin(CoapPduBlock(blockData).blockSize(), maxBlockSize);
+            }
+            addObserver(resource, endpoint, request.token(), blockSize);
+            response.addOption(CoapOption::Observe, encodeUInt(m_observeSequence));
+        } else {
+            removeObserver(endpoint, request.token());
+        }
+    }
+
+    return statusCode;
+}
+
+QByteArray CoapServer::coreLinks() const
+{
+    QStringList paths = m_resources.keys();
+    paths.sort();
+
+    QList<QByteArray> links;
+    foreach (const QString &path, paths) {
+        CoapResource *resource = m_resources.value(path);
+        QByteArray link = "<" + path.toUtf8() + ">;ct=" + QByteArray::number(resource->contentType());
+        if (resource->isObservable())
+            link.append(";obs");
+
+        links.append(link);
+    }
+    return links.join(',');
+}
+
+void CoapServer::addObserver(CoapResource *resource, const Endpoint &endpoint, const QByteArray &token, int blockSize)
+{
+    // A new registration with the same token replaces the old one
+    removeObserver(endpoint, token);
+
+    Observer observer;
+    observer.endpoint = endpoint;
+    observer.token = token;
+    observer.blockSize = blockSize;
+    m_observers[resource].append(observer);
+    qCDebug(dcCoap) << "Client" << endpoint.first.toString() << endpoint.second << "observes" << resource->path();
+}
+
+void CoapServer::removeObserver(const Endpoint &endpoint, const QByteArray &token)
+{
+    foreach (CoapResource *resource, m_observers.keys()) {
+        QList<Observer> &observers = m_observers[resource];
+        for (int i = observers.count() - 1; i >= 0; i--) {
+            if (observers.at(i).endpoint == endpoint && observers.at(i).token == token) {
+                qCDebug(dcCoap) << "Client" << endpoint.first.toString() << endpoint.second << "stopped observing" << resource->path();
+                observers.removeAt(i);
+            }
+        }
+        if (observers.isEmpty()) {
+            m_observers.remove(resource);
+        }
+    }
+}
+
+void CoapServer::removeResource(CoapResource *resource)
+{
+    // Don't access the resource, it might be in destruction already
+    QMutableHashIterator<QString, CoapResource *> iterator(m_resources);
+    while (iterator.hasNext()) {
+        if (iterator.next().value() == resource) {
+            iterator.remove();
+        }
+    }
+    m_observers.remove(resource);
+}
+
+void CoapServer::sendPdu(const Endpoint &endpoint, const CoapPdu &pdu)
+{
+    qCDebug(dcCoap) << "--->" << QString("%1:%2").arg(endpoint.first.toString()).arg(endpoint.second) << pdu;
+    m_socket->writeDatagram(pdu.pack(), endpoint.first, endpoint.second);
+}
+
+void CoapServer::onReadyRead()
+{
+    while (m_socket->hasPendingDatagrams()) {
+        QByteArray data;
+        QHostAddress address;
+        quint16 port = 0;
+        data.resize(m_socket->pendingDatagramSize());
+        m_socket->readDatagram(data.data(), data.size(), &address, &port);
+
+        // Clients on a dual stack socket might be reported as IPv4 mapped IPv6 address
+        bool isIPv4 = false;
+        quint32 ipv4Address = address.toIPv4Address(&isIPv4);
+        if (isIPv4)
+            address = QHostAddress(ipv4Address);
+
+        Endpoint endpoint(address, port);
+        CoapPdu pdu(data);
+        qCDebug(dcCoap) << "<---" << QString("%1:%2").arg(address.toString()).arg(port) << pdu;
+
+        if (!pdu.isValid()) {
+            qCWarning(dcCoap) << "Got invalid PDU from" << address.toString() << port;
+            // Reject invalid confirmable messages
+            if (data.size() >= 4 && pdu.messageType() == CoapPdu::Confirmable) {
+                CoapPdu reset;
+                reset.setMessageType(CoapPdu::Reset);
+                reset.setMessageId((quint16)(((quint8)data.at(2) << 8) | (quint8)data.at(3)));
+                sendPdu(endpoint, reset);
+            }
+            continue;
+        }
+
+        switch (pdu.messageType()) {
+        case CoapPdu::Reset:
+            processReset(pdu, endpoint);
+            break;
+        case CoapPdu::Acknowledgement:
+            // Acknowledgements for notifications, nothing to do
+            break;
+        default:
+            processRequest(pdu, endpoint);
+            break;
+        }
+    }
+}
+
+void CoapServer::onResourceChanged()
+{
+    CoapResource *resource = qobject_cast<CoapResource *>(sender());
+    if (!resource || !resource->isObservable() || !m_observers.contains(resource))
+        return;
+
+    // The representation is the same for all observers
+    CoapResourceRequest request;
+    request.method = CoapPdu::Get;
+    QByteArray payload;
+    CoapPdu::StatusCode statusCode = resource->processRequest(request, &payload);
+
+    m_observeSequence = (m_observeSequence + 1) & 0xffffff;
+
+    QList<Observer> &observers = m_observers[resource];
+    for (int i = 0; i < observers.count(); i++) {
+        Observer &observer = observers[i];
+
+        CoapPdu notification;
+        notification.setMessageType(CoapPdu::NonConfirmable);
+        notification.setMessageId(m_messageId++);
+        notification.setToken(observer.token);
+        notification.setStatusCode(statusCode);
+        if (isSuccess(statusCode))
+            notification.addOption(CoapOption::Observe, encodeUInt(m_observeSequence));
+
+        QByteArray notificationPayload = payload;
+        if (!notificationPayload.isEmpty())
+            notification.addOption(CoapOption::ContentFormat, encodeUInt(resource->contentType()));
+
+        // Large representations are sent as first block, the client requests the remaining blocks
+        if (notificationPayload.size() > observer.blockSize) {
+            notification.addOption(CoapOption::Block2, CoapPduBlock::createBlock(0, blockSizeExponent(observer.blockSize), true));
+            notificationPayload = notificationPayload.left(observer.blockSize);
+        }
+        notification.setPayload(notificationPayload);
+
+        observer.lastMessageId = notification.messageId();
+        sendPdu(observer.endpoint, notification);
+    }
+
+    // An error response ends the observation
+    if (!isSuccess(statusCode)) {
+        m_observers.remove(resource);
+    }
+}
+
+void CoapServer::cleanup()
+{
+    qint64 now = m_clock.elapsed();
+
+    QMutableHashIterator<QPair<Endpoint, quint16>, CachedResponse> responseIterator(m_responseCache);
+    while (responseIterator.hasNext()) {
+        if (responseIterator.next().value().expiry < now) {
+            responseIterator.remove();
+        }
+    }
+
+    QMutableHashIterator<QPair<Endpoint, QString>, BlockTransfer> transferIterator(m_blockTransfers);
+    while (transferIterator.hasNext()) {
+        if (transferIterator.next().value().expiry < now) {
+            transferIterator.remove();
+        }
+    }
+}
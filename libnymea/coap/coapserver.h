@@ -0,0 +1,117 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* Copyright 2013 - 2020, nymea GmbH
+* Contact: contact@nymea.io
+*
+* This file is part of nymea.
+* This project including source code and documentation is protected by
+* copyright law, and remains the property of nymea GmbH. All rights, including
+* reproduction, publication, editing and translation, are reserved. The use of
+* this project is subject to the terms of a license agreement to be concluded
+* with nymea GmbH in accordance with the terms of use of nymea GmbH, available
+* under https://nymea.io/license
+*
+* GNU Lesser General Public License Usage
+* Alternatively, this project may be redistributed and/or modified under the
+* terms of the GNU Lesser General Public License as published by the Free
+* Software Foundation; version 3. This project is distributed in the hope that
+* it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+* warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this project. If not, see <https://www.gnu.org/licenses/>.
+*
+* For any further details and any questions please contact us under
+* contact@nymea.io or see our FAQ/Licensing Information on
+* https://nymea.io/license/faq
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef COAPSERVER_H
+#define COAPSERVER_H
+
+#include <QObject>
+#include <QHash>
+#include <QTimer>
+#include <QUdpSocket>
+#include <QHostAddress>
+#include <QElapsedTimer>
+
+#include "libnymea.h"
+#include "coappdu.h"
+#include "coapresource.h"
+
+class LIBNYMEA_EXPORT CoapServer : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit CoapServer(QObject *parent = nullptr);
+
+    bool listen(const QHostAddress &address = QHostAddress::Any, quint16 port = 5683);
+    void close();
+    bool isListening() const;
+    quint16 serverPort() const;
+
+    bool registerResource(CoapResource *resource);
+    void unregisterResource(CoapResource *resource);
+    CoapResource *resource(const QString &path) const;
+    QList<CoapResource *> resources() const;
+
+    int observerCount(CoapResource *resource) const;
+
+private:
+    typedef QPair<QHostAddress, quint16> Endpoint;
+
+    class Observer {
+    public:
+        Endpoint endpoint;
+        QByteArray token;
+        int blockSize = 1024;
+        quint16 lastMessageId = 0;
+    };
+
+    class BlockTransfer {
+    public:
+        QByteArray payload;
+        int nextBlockNumber = 0;
+        qint64 expiry = 0;
+    };
+
+    class CachedResponse {
+    public:
+        QByteArray data;
+        qint64 expiry = 0;
+    };
+
+    QUdpSocket *m_socket = nullptr;
+    QTimer *m_cleanupTimer = nullptr;
+    QElapsedTimer m_clock;
+    quint16 m_messageId = 0;
+    quint32 m_observeSequence = 0;
+
+    QHash<QString, CoapResource *> m_resources;                                 // path | resource
+    QHash<CoapResource *, QList<Observer> > m_observers;                        // resource | observers
+    QHash<QPair<Endpoint, QString>, BlockTransfer> m_blockTransfers;            // client, path | incoming Block1 payload
+    QHash<QPair<Endpoint, quint16>, CachedResponse> m_responseCache;            // client, message id | response
+
+    void processRequest(const CoapPdu &request, const Endpoint &endpoint);
+    void processReset(const CoapPdu &pdu, const Endpoint &endpoint);
+    CoapPdu::StatusCode processResource(CoapResource *resource, const CoapPdu &request, const Endpoint &endpoint, const QByteArray &payload, QByteArray *responsePayload, CoapPdu &response);
+    QByteArray coreLinks() const;
+
+    void addObserver(CoapResource *resource, const Endpoint &endpoint, const QByteArray &token, int blockSize);
+    void removeObserver(const Endpoint &endpoint, const QByteArray &token);
+    void removeResource(CoapResource *resource);
+
+    void sendPdu(const Endpoint &endpoint, const CoapPdu &pdu);
+
+private slots:
+    void onReadyRead();
+    void onResourceChanged();
+    void cleanup();
+
+};
+
+#endif // COAPSERVER_H
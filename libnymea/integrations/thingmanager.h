@@ -102,6 +102,8 @@ public:
     virtual ThingClass translateThingClass(const ThingClass &thingClass, const QLocale &locale) = 0;
     virtual Vendor translateVendor(const Vendor &vendor, const QLocale &locale) = 0;
 
+    virtual Thing::ThingError reloadPlugin(const PluginId &pluginId) = 0;
+
 protected:
     virtual IOConnectionResult connectIO(const IOConnection &connection) = 0;
 
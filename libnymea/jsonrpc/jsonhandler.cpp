@@ -364,7 +364,9 @@ QVariant JsonHandler::pack(const QMetaObject &metaObject, const void *value) con
                 }
                 propertyValue = propertyValue.toDateTime().toTime_t();
             } else if (metaProperty.type() == QVariant::Time) {
-                propertyValue = propertyValue.toTime().toString("hh:mm");
+                // Seconds are optional to stay compatible with clients only knowing minutes
+                QTime time = propertyValue.toTime();
+                propertyValue = time.toString(time.second() == 0 ? "hh:mm" : "hh:mm:ss");
             }
             ret.insert(metaProperty.name(), propertyValue);
         }
@@ -464,7 +466,11 @@ QVariant JsonHandler::unpack(const QMetaObject &metaObject, const QVariant &valu
                 if (metaProperty.type() == QVariant::DateTime) {
                     variant = QDateTime::fromTime_t(variant.toUInt());
                 } else if (metaProperty.type() == QVariant::Time) {
-                    variant = QTime::fromString(variant.toString(), "hh:mm");
+                    QTime time = QTime::fromString(variant.toString(), "hh:mm");
+                    if (!time.isValid()) {
+                        time = QTime::fromString(variant.toString(), "hh:mm:ss");
+                    }
+                    variant = time;
                 }
 
                 // For basic properties just write the veriant as is
@@ -67,6 +67,8 @@ HEADERS += \
     coap/corelinkparser.h \
     coap/corelink.h \
     coap/coapobserveresource.h \
+    coap/coapresource.h \
+    coap/coapserver.h \
     types/action.h \
     types/actiontype.h \
     types/state.h \
@@ -79,6 +81,7 @@ HEADERS += \
     types/param.h \
     types/paramdescriptor.h \
     types/statedescriptor.h \
+    types/triggerfilter.h \
     types/interface.h \
     time/timedescriptor.h \
     time/calendaritem.h \
@@ -146,6 +149,8 @@ SOURCES += \
     coap/corelinkparser.cpp \
     coap/corelink.cpp \
     coap/coapobserveresource.cpp \
+    coap/coapresource.cpp \
+    coap/coapserver.cpp \
     types/browseritem.cpp \
     types/browseritemaction.cpp \
     types/browseraction.cpp \
@@ -163,6 +168,7 @@ SOURCES += \
     types/param.cpp \
     types/paramdescriptor.cpp \
     types/statedescriptor.cpp \
+    types/triggerfilter.cpp \
     types/interface.cpp \
     time/timedescriptor.cpp \
     time/calendaritem.cpp \
@@ -276,6 +276,148 @@ bool CalendarItem::evaluateYearly(const QDateTime &dateTime) const
     return false;
 }
 
+/*! Returns the first point in time after the given \a dateTime at which the result of
+    evaluate() can change, or an invalid QDateTime if it will never change again.
+
+    The returned time may be earlier than the actual transition (e.g. a weekly item is
+    checked on every day at its start and end time), but it is never later. This allows
+    the rule engine to skip evaluating this item until the returned time has been reached.
+*/
+QDateTime CalendarItem::nextTransition(const QDateTime &dateTime) const
+{
+    if (!isValid())
+        return QDateTime();
+
+    if (m_startTime.isValid()) {
+        switch (m_repeatingOption.mode()) {
+        case RepeatingOption::RepeatingModeHourly:
+            // Always true if longer than an hour
+            if (duration() >= 60)
+                return QDateTime();
+
+            return nextHourlyTransition(dateTime);
+        case RepeatingOption::RepeatingModeNone:
+        case RepeatingOption::RepeatingModeDaily:
+            // Always true if longer than a day
+            if (duration() >= 1440)
+                return QDateTime();
+
+            return nextDailyTransition(dateTime);
+        case RepeatingOption::RepeatingModeWeekly:
+            // Always true if longer than a week
+            if (duration() >= 10080)
+                return QDateTime();
+
+            return nextDailyTransition(dateTime);
+        case RepeatingOption::RepeatingModeMonthly:
+        case RepeatingOption::RepeatingModeYearly:
+            return nextDailyTransition(dateTime);
+        }
+    }
+
+    if (m_repeatingOption.mode() == RepeatingOption::RepeatingModeYearly)
+        return nextYearlyTransition(dateTime);
+
+    QDateTime endDateTime = m_dateTime.addSecs(duration() * 60);
+    if (m_dateTime > dateTime)
+        return m_dateTime;
+
+    if (endDateTime > dateTime)
+        return endDateTime;
+
+    return QDateTime();
+}
+
+static QDateTime earliestDateTime(const QDateTime &first, const QDateTime &second)
+{
+    if (!first.isValid())
+        return second;
+
+    if (!second.isValid())
+        return first;
+
+    return qMin(first, second);
+}
+
+QDateTime CalendarItem::nextHourlyTransition(const QDateTime &dateTime) const
+{
+    // Same start time calculation as in evaluateHourly()
+    QDateTime startDateTime = QDateTime(dateTime.date(), QTime(dateTime.time().hour(), startTime().minute()));
+
+    QDateTime next;
+    for (int hour = -1; hour <= 1; hour++) {
+        QDateTime hourStartDateTime = startDateTime.addSecs(hour * 3600);
+        QDateTime hourEndDateTime = hourStartDateTime.addSecs(duration() * 60);
+        if (hourStartDateTime > dateTime)
+            next = earliestDateTime(next, hourStartDateTime);
+
+        if (hourEndDateTime > dateTime)
+            next = earliestDateTime(next, hourEndDateTime);
+    }
+
+    // Week and month days change at midnight
+    return earliestDateTime(next, QDateTime(dateTime.date().addDays(1), QTime(0, 0)));
+}
+
+QDateTime CalendarItem::nextDailyTransition(const QDateTime &dateTime) const
+{
+    // Check every day at start time and end time. Weekly and monthly items do not start on every day,
+    // but checking them more often than needed is cheap compared to evaluating them on every tick.
+    QDateTime next = dateTime;
+    next.setTime(startTime());
+    if (next <= dateTime) {
+        next = dateTime.addDays(1);
+        next.setTime(startTime());
+    }
+
+    // The end of an interval which started some days ago. The interval end can not be looked up
+    // by its time of day since a daylight saving time change could be in between.
+    int lookBackDays = qMin(duration() / 1440 + 1, 400u);
+    for (int day = lookBackDays; day >= 0; day--) {
+        QDateTime endDateTime = dateTime.addDays(-day);
+        endDateTime.setTime(startTime());
+        endDateTime = endDateTime.addSecs(duration() * 60);
+        if (endDateTime > dateTime) {
+            next = earliestDateTime(next, endDateTime);
+            break;
+        }
+    }
+
+    // The local time does not exist on this day (daylight saving time gap), check again later
+    if (!next.isValid())
+        return dateTime.addSecs(3600);
+
+    return next;
+}
+
+QDateTime CalendarItem::nextYearlyTransition(const QDateTime &dateTime) const
+{
+    QDateTime next;
+    for (int year = dateTime.date().year() - 1; year <= dateTime.date().year() + 1; year++) {
+        // Same start time calculation as in evaluateYearly()
+        QDate startDate(year, m_dateTime.date().month(), m_dateTime.date().day());
+        if (!startDate.isValid())
+            continue;
+
+        QDateTime startDateTime = dateTime;
+        startDateTime.setDate(startDate);
+        startDateTime.setTime(m_dateTime.time());
+        QDateTime endDateTime = startDateTime.addSecs(duration() * 60);
+
+        if (startDateTime > dateTime)
+            next = earliestDateTime(next, startDateTime);
+
+        if (endDateTime > dateTime)
+            next = earliestDateTime(next, endDateTime);
+    }
+
+    // A 29th of February, check again in the next leap year
+    if (!next.isValid())
+        return dateTime.addYears(1);
+
+    return next;
+}
+
 /*! Print a CalendarItem to QDebug. */
 QDebug operator<<(QDebug dbg, const CalendarItem &calendarItem)
 {
@@ -60,6 +60,7 @@ public:
 
     bool isValid() const;
     bool evaluate(const QDateTime &dateTime) const;
+    QDateTime nextTransition(const QDateTime &dateTime) const;
 
 private:
     QDateTime m_dateTime;
@@ -75,6 +76,10 @@ private:
     bool evaluateMonthly(const QDateTime &dateTime) const;
     bool evaluateYearly(const QDateTime &dateTime) const;
 
+    QDateTime nextHourlyTransition(const QDateTime &dateTime) const;
+    QDateTime nextDailyTransition(const QDateTime &dateTime) const;
+    QDateTime nextYearlyTransition(const QDateTime &dateTime) const;
+
 };
 
 class CalendarItems: public QList<CalendarItem>
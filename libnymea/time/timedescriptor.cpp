@@ -115,6 +115,32 @@ bool TimeDescriptor::evaluate(const QDateTime &lastEvaluationTime, const QDateTi
     return false;
 }
 
+/*! Returns the first point in time after the given \a dateTime at which the result of evaluate()
+    can change, or an invalid QDateTime if none of the \l{TimeEventItem}{TimeEventItems} or
+    \l{CalendarItem}{CalendarItems} will change anymore.
+
+    \sa CalendarItem::nextTransition(), TimeEventItem::nextTransition()
+*/
+QDateTime TimeDescriptor::nextTransition(const QDateTime &dateTime) const
+{
+    QDateTime next;
+    foreach (const CalendarItem &calendarItem, m_calendarItems) {
+        QDateTime itemTransition = calendarItem.nextTransition(dateTime);
+        if (itemTransition.isValid() && (!next.isValid() || itemTransition < next)) {
+            next = itemTransition;
+        }
+    }
+
+    foreach (const TimeEventItem &timeEventItem, m_timeEventItems) {
+        QDateTime itemTransition = timeEventItem.nextTransition(dateTime);
+        if (itemTransition.isValid() && (!next.isValid() || itemTransition < next)) {
+            next = itemTransition;
+        }
+    }
+
+    return next;
+}
+
 /*! Print a TimeDescriptor including the full lists of CalendarItems and TimeEventItems to QDebug. */
 QDebug operator<<(QDebug dbg, const TimeDescriptor &timeDescriptor)
 {
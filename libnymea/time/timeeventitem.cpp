@@ -142,6 +142,66 @@ bool TimeEventItem::evaluate(const QDateTime &lastEvaluationTime, const QDateTim
     return lastEvaluationTime < m_dateTime && m_dateTime <= dateTime;
 }
 
+/*! Returns the first point in time after the given \a dateTime at which evaluate() can
+    become true, or an invalid QDateTime if this \l{TimeEventItem} will never trigger again.
+
+    For weekly and monthly repeating items this is the next occurrence of the time on any day,
+    the week and month days are checked by evaluate().
+*/
+QDateTime TimeEventItem::nextTransition(const QDateTime &dateTime) const
+{
+    if (m_time.isValid()) {
+        switch (m_repeatingOption.mode()) {
+        case RepeatingOption::RepeatingModeNone:
+        case RepeatingOption::RepeatingModeDaily:
+        case RepeatingOption::RepeatingModeWeekly:
+        case RepeatingOption::RepeatingModeMonthly: {
+            QDateTime next = dateTime;
+            next.setTime(m_time);
+            if (next <= dateTime) {
+                next = dateTime.addDays(1);
+                next.setTime(m_time);
+            }
+
+            // The local time does not exist on this day (daylight saving time gap), check again later
+            if (!next.isValid())
+                return dateTime.addSecs(3600);
+
+            return next;
+        }
+        case RepeatingOption::RepeatingModeHourly: {
+            QDateTime next = QDateTime(dateTime.date(), QTime(dateTime.time().hour(), m_time.minute(), m_time.second()));
+            if (next <= dateTime)
+                next = next.addSecs(3600);
+
+            return next;
+        }
+        case RepeatingOption::RepeatingModeYearly:
+            return QDateTime();
+        }
+    }
+
+    if (m_repeatingOption.mode() == RepeatingOption::RepeatingModeYearly) {
+        // Same adjustment as in evaluate(), skipping years without a 29th of February
+        for (int year = dateTime.date().year(); year <= dateTime.date().year() + 8; year++) {
+            QDate date(year, m_dateTime.date().month(), m_dateTime.date().day());
+            if (!date.isValid())
+                continue;
+
+            QDateTime adjustedTime = m_dateTime;
+            adjustedTime.setDate(date);
+            if (adjustedTime > dateTime)
+                return adjustedTime;
+        }
+        return QDateTime();
+    }
+
+    if (m_dateTime > dateTime)
+        return m_dateTime;
+
+    return QDateTime();
+}
+
 /*! Print a TimeEvent to QDebug. */
 QDebug operator<<(QDebug dbg, const TimeEventItem &timeEventItem)
 {
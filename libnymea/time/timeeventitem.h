@@ -59,6 +59,7 @@ public:
     bool isValid() const;
 
     bool evaluate(const QDateTime &lastEvaluationTime, const QDateTime &dateTime) const;
+    QDateTime nextTransition(const QDateTime &dateTime) const;
 
 private:
     QDateTime m_dateTime;
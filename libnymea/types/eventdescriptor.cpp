@@ -157,6 +157,18 @@ ParamDescriptor EventDescriptor::paramDescriptor(const ParamTypeId &paramTypeId)
     return ParamDescriptor(QString());
 }
 
+/*! Returns the \l{TriggerFilter} limiting how often this EventDescriptor triggers. */
+TriggerFilter EventDescriptor::filter() const
+{
+    return m_filter;
+}
+
+/*! Sets the \l{TriggerFilter} limiting how often this EventDescriptor triggers to \a filter. */
+void EventDescriptor::setFilter(const TriggerFilter &filter)
+{
+    m_filter = filter;
+}
+
 /*! Compare this Event to the Event given by \a other.
  *  Events are equal (returns true) if eventTypeId, deviceId and params match. */
 bool EventDescriptor::operator ==(const EventDescriptor &other) const
@@ -172,6 +184,7 @@ bool EventDescriptor::operator ==(const EventDescriptor &other) const
 
     return m_eventTypeId == other.eventTypeId()
             && m_thingId == other.thingId()
+            && m_filter == other.filter()
             && paramsMatch;
 }
 
@@ -179,6 +192,9 @@ bool EventDescriptor::operator ==(const EventDescriptor &other) const
 QDebug operator<<(QDebug dbg, const EventDescriptor &eventDescriptor)
 {
     dbg.nospace() << "EventDescriptor(EventTypeId: " << eventDescriptor.eventTypeId().toString() << ", ThingId:" << eventDescriptor.thingId().toString() << ", Interface:" << eventDescriptor.interface() << ", InterfaceEvent:" << eventDescriptor.interfaceEvent() <<  ")" << endl;
+    if (eventDescriptor.filter().isValid()) {
+        dbg.nospace() << "    " << eventDescriptor.filter() << endl;
+    }
     for (int i = 0; i < eventDescriptor.paramDescriptors().count(); i++) {
         dbg.nospace() << "    " << i << ": " << eventDescriptor.paramDescriptors().at(i);
     }
@@ -35,6 +35,7 @@
 #include "typeutils.h"
 #include "paramdescriptor.h"
 #include "event.h"
+#include "triggerfilter.h"
 
 #include <QString>
 #include <QVariantList>
@@ -49,6 +50,7 @@ class LIBNYMEA_EXPORT EventDescriptor
     Q_PROPERTY(QString interface READ interface WRITE setInterface USER true)
     Q_PROPERTY(QString interfaceEvent READ interfaceEvent WRITE setInterfaceEvent USER true)
     Q_PROPERTY(ParamDescriptors paramDescriptors READ paramDescriptors WRITE setParamDescriptors USER true)
+    Q_PROPERTY(TriggerFilter filter READ filter WRITE setFilter USER true)
 public:
     enum Type {
         TypeThing,
@@ -78,6 +80,9 @@ public:
     void setParamDescriptors(const QList<ParamDescriptor> &paramDescriptors);
     ParamDescriptor paramDescriptor(const ParamTypeId &paramTypeId) const;
 
+    TriggerFilter filter() const;
+    void setFilter(const TriggerFilter &filter);
+
     bool operator ==(const EventDescriptor &other) const;
 
 private:
@@ -86,6 +91,7 @@ private:
     QString m_interface;
     QString m_interfaceEvent;
     QList<ParamDescriptor> m_paramDescriptors;
+    TriggerFilter m_filter;
 };
 Q_DECLARE_METATYPE(EventDescriptor)
 
@@ -152,6 +152,18 @@ void StateDescriptor::setOperatorType(Types::ValueOperator opertatorType)
     m_operatorType = opertatorType;
 }
 
+/*! Returns the \l{TriggerFilter} limiting how often this StateDescriptor changes its matching state. */
+TriggerFilter StateDescriptor::filter() const
+{
+    return m_filter;
+}
+
+/*! Sets the \l{TriggerFilter} limiting how often this StateDescriptor changes its matching state to \a filter. */
+void StateDescriptor::setFilter(const TriggerFilter &filter)
+{
+    m_filter = filter;
+}
+
 /*! Compare this StateDescriptor to \a other.
  *  StateDescriptors are equal (returns true) if stateTypeId, stateValue and operatorType match. */
 bool StateDescriptor::operator ==(const StateDescriptor &other) const
@@ -161,7 +173,8 @@ bool StateDescriptor::operator ==(const StateDescriptor &other) const
             m_interface == other.interface() &&
             m_interfaceState == other.interfaceState() &&
             m_stateValue == other.stateValue() &&
-            m_operatorType == other.operatorType();
+            m_operatorType == other.operatorType() &&
+            m_filter == other.filter();
 }
 
 /*! Compare this StateDescriptor to the \l{State} given by \a state.
@@ -215,5 +228,8 @@ QDebug operator<<(QDebug dbg, const StateDescriptor &stateDescriptor)
     dbg.nospace() << "StateDescriptor(ThingId:" << stateDescriptor.thingId().toString() << ", StateTypeId:"
                   << stateDescriptor.stateTypeId().toString() << ", Interface:" << stateDescriptor.interface()
                   << ", InterfaceState:" << stateDescriptor.interfaceState() << ", Operator:" << stateDescriptor.operatorType() << ", Value:" << stateDescriptor.stateValue();
+    if (stateDescriptor.filter().isValid()) {
+        dbg.nospace() << ", " << stateDescriptor.filter();
+    }
     return dbg;
 }
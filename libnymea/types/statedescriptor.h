@@ -36,6 +36,7 @@
 #include "paramdescriptor.h"
 #include "state.h"
 #include "event.h"
+#include "triggerfilter.h"
 
 #include <QString>
 #include <QVariantList>
@@ -51,6 +52,7 @@ class LIBNYMEA_EXPORT StateDescriptor
     Q_PROPERTY(QString interfaceState READ interfaceState WRITE setInterfaceState USER true)
     Q_PROPERTY(QVariant value READ stateValue WRITE setStateValue)
     Q_PROPERTY(Types::ValueOperator operator READ operatorType WRITE setOperatorType)
+    Q_PROPERTY(TriggerFilter filter READ filter WRITE setFilter USER true)
 public:
     enum Type {
         TypeThing,
@@ -81,6 +83,9 @@ public:
     Types::ValueOperator operatorType() const;
     void setOperatorType(Types::ValueOperator opertatorType);
 
+    TriggerFilter filter() const;
+    void setFilter(const TriggerFilter &filter);
+
     Q_INVOKABLE bool isValid() const;
 
     bool operator ==(const StateDescriptor &other) const;
@@ -95,6 +100,7 @@ private:
     QString m_interfaceState;
     QVariant m_stateValue;
     Types::ValueOperator m_operatorType = Types::ValueOperatorEquals;
+    TriggerFilter m_filter;
 };
 Q_DECLARE_METATYPE(StateDescriptor)
 
@@ -0,0 +1,127 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* Copyright 2013 - 2020, nymea GmbH
+* Contact: contact@nymea.io
+*
+* This file is part of nymea.
+* This project including source code and documentation is protected by
+* copyright law, and remains the property of nymea GmbH. All rights, including
+* reproduction, publication, editing and translation, are reserved. The use of
+* this project is subject to the terms of a license agreement to be concluded
+* with nymea GmbH in accordance with the terms of use of nymea GmbH, available
+* under https://nymea.io/license
+*
+* GNU Lesser General Public License Usage
+* Alternatively, this project may be redistributed and/or modified under the
+* terms of the GNU Lesser General Public License as published by the Free
+* Software Foundation; version 3. This project is distributed in the hope that
+* it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+* warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this project. If not, see <https://www.gnu.org/licenses/>.
+*
+* For any further details and any questions please contact us under
+* contact@nymea.io or see our FAQ/Licensing Information on
+* https://nymea.io/license/faq
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+/*!
+    \class TriggerFilter
+    \brief Limits how often an \l{EventDescriptor} or \l{StateDescriptor} triggers a rule.
+
+    \ingroup nymea-types
+    \ingroup rules
+    \inmodule libnymea
+
+    Noisy sensors may match a descriptor many times in a short period. A TriggerFilter allows
+    to tame them without having to resort to scripts:
+
+    \list
+    \li The \l{debounce()} time is the number of milliseconds a descriptor needs to be stable before
+        it is taken into account. For events, the rule is triggered once no further matching event
+        has happened for that time. For states, a change of the matching result only takes effect
+        once it persisted for that time.
+    \li The \l{throttle()} time is the minimum number of milliseconds between two triggers of a
+        descriptor. Events matching in between are dropped, state changes are delayed.
+    \li The \l{hysteresis()} applies to descriptors comparing values with the greater or less
+        operators. Once matching, the value needs to fall back beyond the threshold by the given
+        hysteresis before the descriptor stops matching, or, for events, before it triggers again.
+    \endlist
+
+    \sa EventDescriptor, StateDescriptor, nymeaserver::Rule
+*/
+
+#include "triggerfilter.h"
+
+/*! Constructs a TriggerFilter with the given \a debounce and \a throttle times in milliseconds and the given \a hysteresis. */
+TriggerFilter::TriggerFilter(uint debounce, uint throttle, double hysteresis):
+    m_debounce(debounce),
+    m_throttle(throttle),
+    m_hysteresis(hysteresis)
+{
+
+}
+
+/*! Returns the time in milliseconds a descriptor needs to be stable before it triggers. */
+uint TriggerFilter::debounce() const
+{
+    return m_debounce;
+}
+
+/*! Sets the time in milliseconds a descriptor needs to be stable before it triggers to \a debounce. */
+void TriggerFilter::setDebounce(uint debounce)
+{
+    m_debounce = debounce;
+}
+
+/*! Returns the minimum time in milliseconds between two triggers. */
+uint TriggerFilter::throttle() const
+{
+    return m_throttle;
+}
+
+/*! Sets the minimum time in milliseconds between two triggers to \a throttle. */
+void TriggerFilter::setThrottle(uint throttle)
+{
+    m_throttle = throttle;
+}
+
+/*! Returns the distance a value needs to fall back beyond the threshold before the descriptor stops matching. */
+double TriggerFilter::hysteresis() const
+{
+    return m_hysteresis;
+}
+
+/*! Sets the distance a value needs to fall back beyond the threshold before the descriptor stops matching to \a hysteresis. */
+void TriggerFilter::setHysteresis(double hysteresis)
+{
+    m_hysteresis = hysteresis;
+}
+
+/*! Returns true if any of the filter options is set. */
+bool TriggerFilter::isValid() const
+{
+    return m_debounce > 0 || m_throttle > 0 || !qFuzzyIsNull(m_hysteresis);
+}
+
+/*! Returns true if this TriggerFilter has the same options as \a other. */
+bool TriggerFilter::operator ==(const TriggerFilter &other) const
+{
+    return m_debounce == other.debounce() && m_throttle == other.throttle() && qFuzzyCompare(1 + m_hysteresis, 1 + other.hysteresis());
+}
+
+/*! Returns true if this TriggerFilter differs from \a other. */
+bool TriggerFilter::operator !=(const TriggerFilter &other) const
+{
+    return !operator==(other);
+}
+
+/*! Print a TriggerFilter to QDebug. */
+QDebug operator<<(QDebug dbg, const TriggerFilter &triggerFilter)
+{
+    dbg.nospace() << "TriggerFilter(Debounce: " << triggerFilter.debounce() << ", Throttle: " << triggerFilter.throttle() << ", Hysteresis: " << triggerFilter.hysteresis() << ")";
+    return dbg;
+}
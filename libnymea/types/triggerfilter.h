@@ -0,0 +1,72 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* Copyright 2013 - 2020, nymea GmbH
+* Contact: contact@nymea.io
+*
+* This file is part of nymea.
+* This project including source code and documentation is protected by
+* copyright law, and remains the property of nymea GmbH. All rights, including
+* reproduction, publication, editing and translation, are reserved. The use of
+* this project is subject to the terms of a license agreement to be concluded
+* with nymea GmbH in accordance with the terms of use of nymea GmbH, available
+* under https://nymea.io/license
+*
+* GNU Lesser General Public License Usage
+* Alternatively, this project may be redistributed and/or modified under the
+* terms of the GNU Lesser General Public License as published by the Free
+* Software Foundation; version 3. This project is distributed in the hope that
+* it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+* warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this project. If not, see <https://www.gnu.org/licenses/>.
+*
+* For any further details and any questions please contact us under
+* contact@nymea.io or see our FAQ/Licensing Information on
+* https://nymea.io/license/faq
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef TRIGGERFILTER_H
+#define TRIGGERFILTER_H
+
+#include "libnymea.h"
+
+#include <QObject>
+#include <QVariant>
+#include <QDebug>
+
+class LIBNYMEA_EXPORT TriggerFilter
+{
+    Q_GADGET
+    Q_PROPERTY(uint debounce READ debounce WRITE setDebounce USER true)
+    Q_PROPERTY(uint throttle READ throttle WRITE setThrottle USER true)
+    Q_PROPERTY(double hysteresis READ hysteresis WRITE setHysteresis USER true)
+public:
+    TriggerFilter(uint debounce = 0, uint throttle = 0, double hysteresis = 0);
+
+    uint debounce() const;
+    void setDebounce(uint debounce);
+
+    uint throttle() const;
+    void setThrottle(uint throttle);
+
+    double hysteresis() const;
+    void setHysteresis(double hysteresis);
+
+    Q_INVOKABLE bool isValid() const;
+
+    bool operator ==(const TriggerFilter &other) const;
+    bool operator !=(const TriggerFilter &other) const;
+
+private:
+    uint m_debounce = 0;
+    uint m_throttle = 0;
+    double m_hysteresis = 0;
+};
+Q_DECLARE_METATYPE(TriggerFilter)
+
+QDebug operator<<(QDebug dbg, const TriggerFilter &triggerFilter);
+
+#endif // TRIGGERFILTER_H
@@ -49,6 +49,7 @@
 #include "nymeacore.h"
 #include "nymeaservice.h"
 #include "nymeasettings.h"
+#include "startuptracer.h"
 #include "nymeadbusservice.h"
 #include "nymeaapplication.h"
 #include "loggingcategories.h"
@@ -125,8 +126,15 @@ int main(int argc, char *argv[])
     QCommandLineOption debugOption(QStringList() << "d" << "debug-category", debugDescription, "[No]DebugCategory[Warnings]");
     parser.addOption(debugOption);
 
+    QCommandLineOption startupTraceOption(QStringList() << "startup-trace", QCoreApplication::translate("nymea", "Record a trace of the startup phases and write it to the given file in the Chrome trace event format. A summary is available on the debug server."), "tracefile");
+    parser.addOption(startupTraceOption);
+
     parser.process(application);
 
+    if (parser.isSet(startupTraceOption)) {
+        StartupTracer::instance()->enable(parser.value(startupTraceOption));
+    }
+
     // Open the logfile, if any specified
     if (!initLogging(parser.value(logOption), !parser.isSet(noColorOption))) {
         qWarning() << "Error opening log file" << parser.value(logOption);
@@ -23,5 +23,5 @@ SUBDIRS = \
         versioning \
         webserver \
         websocketserver \
-        #coap \ # temporary removed until fixed
+        coap \
 
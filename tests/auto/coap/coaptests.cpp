@@ -19,12 +19,45 @@
  * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
 
 #include "coaptests.h"
+#include "coap/coapresource.h"
 
 #include <QJsonDocument>
+#include <QUdpSocket>
+
+#include <functional>
+
+static const quint16 serverPort = 5688;
+
+// A resource answering requests with the given handler
+class TestResource : public CoapResource
+{
+public:
+    typedef std::function<CoapPdu::StatusCode(const CoapResourceRequest &request, QByteArray *responsePayload)> Handler;
+
+    TestResource(const QString &path, Handler handler, QObject *parent = nullptr) :
+        CoapResource(path, parent),
+        m_handler(handler)
+    {
+    }
+
+    CoapPdu::StatusCode processRequest(const CoapResourceRequest &request, QByteArray *responsePayload) override
+    {
+        return m_handler(request, responsePayload);
+    }
+
+private:
+    Handler m_handler;
+};
+
+static CoapResource *createTextResource(const QString &path, const QByteArray &payload, QObject *parent)
+{
+    CoapResource *resource = new CoapResource(path, parent);
+    resource->setPayload(payload);
+    return resource;
+}
 
 CoapTests::CoapTests(QObject *parent) : QObject(parent)
 {
-    m_coap = new Coap(this);
     m_uploadData = QByteArray("                   GNU GENERAL PUBLIC LICENSE \n"
                               "                    Version 3, 29 June 2007 \n"
                               "\n"
@@ -52,7 +85,172 @@ CoapTests::CoapTests(QObject *parent) : QObject(parent)
                               "them if you wish), that you receive source code or can get it if you\n"
                               "want it, that you can change the software or use pieces of it in new\n"
                               "free programs, and that you know you can do these things.");
+}
+
+QUrl CoapTests::serverUrl(const QString &path) const
+{
+    return QUrl(QString("coap://127.0.0.1:%1%2").arg(serverPort).arg(path));
+}
 
+void CoapTests::initTestCase()
+{
+    // The client uses a random port, the loopback server a fixed one
+    m_coap = new Coap(this, 0);
+
+    m_server = new CoapServer(this);
+    QVERIFY(m_server->listen(QHostAddress::LocalHost, serverPort));
+
+    m_server->registerResource(createTextResource("/hello", "world", this));
+    m_server->registerResource(createTextResource("/path/sub1", "TD_CORE_COAP_09 sub1", this));
+    m_server->registerResource(createTextResource("/123412341234123412341234", "very long resource name", this));
+    m_server->registerResource(createTextResource(QString::fromUtf8("/blåbærsyltetøy"), QString::fromUtf8("Übergrößenträger = 特大の人 = 超大航母").toUtf8(), this));
+    m_server->registerResource(createTextResource("/large", QByteArray(1700, 'n'), this));
+
+    CoapResource *json = createTextResource("/json", "{\"nymea\": \"awesome\", \"values\": [1, 2, 3]}", this);
+    json->setContentType(CoapPdu::ApplicationJson);
+    m_server->registerResource(json);
+
+    CoapResource *largeUpdate = new CoapResource("/large-update", this);
+    largeUpdate->setWritable(true);
+    m_server->registerResource(largeUpdate);
+
+    m_server->registerResource(new TestResource("/broken", [](const CoapResourceRequest &, QByteArray *responsePayload) {
+        *responsePayload = "Oops: broken";
+        return CoapPdu::InternalServerError;
+    }, this));
+
+    m_server->registerResource(new TestResource("/secret", [](const CoapResourceRequest &, QByteArray *responsePayload) {
+        *responsePayload = "Not authorized";
+        return CoapPdu::Unauthorized;
+    }, this));
+
+    m_server->registerResource(new TestResource("/query", [](const CoapResourceRequest &request, QByteArray *responsePayload) {
+        *responsePayload = "You asked me about: " + request.query.toUtf8();
+        return CoapPdu::Content;
+    }, this));
+
+    m_server->registerResource(new TestResource("/validate", [](const CoapResourceRequest &request, QByteArray *responsePayload) {
+        switch (request.method) {
+        case CoapPdu::Put:
+            *responsePayload = "PUT OK";
+            return CoapPdu::Changed;
+        case CoapPdu::Post:
+            *responsePayload = "POST OK";
+            return CoapPdu::Created;
+        case CoapPdu::Delete:
+            *responsePayload = "DELETE OK";
+            return CoapPdu::Deleted;
+        default:
+            return CoapPdu::MethodNotAllowed;
+        }
+    }, this));
+
+    m_server->registerResource(new TestResource("/large-create", [this](const CoapResourceRequest &request, QByteArray *responsePayload) {
+        if (request.method == CoapPdu::Post) {
+            m_largeCreateData = request.payload;
+            return CoapPdu::Created;
+        }
+        *responsePayload = m_largeCreateData;
+        return CoapPdu::Content;
+    }, this));
+
+    m_server->registerResource(new TestResource("/counter", [this](const CoapResourceRequest &, QByteArray *responsePayload) {
+        m_counterRequests++;
+        *responsePayload = QByteArray::number(m_counterRequests);
+        return CoapPdu::Content;
+    }, this));
+
+    m_observableResource = createTextResource("/obs", "0", this);
+    m_observableResource->setObservable(true);
+    m_server->registerResource(m_observableResource);
+
+    m_observableLargeResource = createTextResource("/obs-large", QByteArray(1500, '0'), this);
+    m_observableLargeResource->setObservable(true);
+    m_server->registerResource(m_observableLargeResource);
+}
+
+void CoapTests::pduPacking_data()
+{
+    QTest::addColumn<int>("optionLength");
+    QTest::addColumn<QByteArray>("payload");
+
+    QTest::newRow("empty option") << 0 << QByteArray("payload");
+    QTest::newRow("12 bytes option") << 12 << QByteArray("payload");
+    QTest::newRow("13 bytes option") << 13 << QByteArray("payload");
+    QTest::newRow("268 bytes option") << 268 << QByteArray("payload");
+    QTest::newRow("269 bytes option") << 269 << QByteArray("payload");
+    QTest::newRow("600 bytes option") << 600 << QByteArray("payload");
+    QTest::newRow("binary payload") << 5 << QByteArray::fromHex("00ff0001ff");
+    QTest::newRow("no payload") << 5 << QByteArray();
+}
+
+void CoapTests::pduPacking()
+{
+    QFETCH(int, optionLength);
+    QFETCH(QByteArray, payload);
+
+    CoapPdu pdu;
+    pdu.setMessageType(CoapPdu::Confirmable);
+    pdu.setStatusCode(CoapPdu::Post);
+    pdu.setMessageId(0xbeef);
+    pdu.setToken(QByteArray::fromHex("0102030405"));
+    pdu.addOption(CoapOption::UriPath, QByteArray(optionLength, 'p'));
+    pdu.addOption(CoapOption::ContentFormat, QByteArray(1, (char)CoapPdu::ApplicationJson));
+    // Option delta > 13 from Block2 to Size1
+    pdu.addOption(CoapOption::Block2, CoapPduBlock::createBlock(3, 2, true));
+    pdu.addOption(CoapOption::Size1, QByteArray::fromHex("0400"));
+    pdu.setPayload(payload);
+
+    CoapPdu parsed(pdu.pack());
+    QVERIFY(parsed.isValid());
+    QCOMPARE(parsed.messageType(), CoapPdu::Confirmable);
+    QCOMPARE(parsed.statusCode(), CoapPdu::Post);
+    QCOMPARE(parsed.messageId(), (quint16)0xbeef);
+    QCOMPARE(parsed.token(), QByteArray::fromHex("0102030405"));
+    QCOMPARE(parsed.contentType(), CoapPdu::ApplicationJson);
+    QCOMPARE(parsed.payload(), payload);
+    QCOMPARE(parsed.options().count(), 4);
+    QCOMPARE(parsed.options().at(0).option(), CoapOption::UriPath);
+    QCOMPARE(parsed.options().at(0).data(), QByteArray(optionLength, 'p'));
+    QCOMPARE(parsed.options().at(3).option(), CoapOption::Size1);
+    QCOMPARE(parsed.options().at(3).data(), QByteArray::fromHex("0400"));
+
+    // Truncated PDUs must not be accepted
+    QByteArray truncated = pdu.pack();
+    truncated.chop(payload.size() + 3);
+    QVERIFY(!CoapPdu(truncated).isValid());
+    QVERIFY(!CoapPdu(QByteArray::fromHex("40")).isValid());
+}
+
+void CoapTests::blockOption_data()
+{
+    QTest::addColumn<int>("blockNumber");
+    QTest::addColumn<int>("sizeExponent");
+    QTest::addColumn<bool>("moreFlag");
+    QTest::addColumn<int>("optionLength");
+
+    QTest::newRow("first") << 0 << 2 << true << 1;
+    QTest::newRow("15") << 15 << 6 << false << 1;
+    QTest::newRow("16") << 16 << 2 << true << 2;
+    QTest::newRow("4095") << 4095 << 0 << false << 2;
+    QTest::newRow("4096") << 4096 << 4 << true << 3;
+    QTest::newRow("100000") << 100000 << 2 << false << 3;
+}
+
+void CoapTests::blockOption()
+{
+    QFETCH(int, blockNumber);
+    QFETCH(int, sizeExponent);
+    QFETCH(bool, moreFlag);
+    QFETCH(int, optionLength);
+
+    QByteArray blockData = CoapPduBlock::createBlock(blockNumber, sizeExponent, moreFlag);
+    QCOMPARE(blockData.length(), optionLength);
+
+    CoapPduBlock block(blockData);
+    QCOMPARE(block.blockNumber(), blockNumber);
+    QCOMPARE(block.blockSize(), 16 << sizeExponent);
+    QCOMPARE(block.moreFlag(), moreFlag);
 }
 
 void CoapTests::invalidUrl_data()
@@ -60,7 +258,7 @@ void CoapTests::invalidUrl_data()
     QTest::addColumn<QUrl>("url");
 
     QTest::newRow("missing backslash") << QUrl("coap:/coap.me");
-    QTest::newRow("invalid host") << QUrl("coap://foo.bar");
+    QTest::newRow("invalid host") << QUrl("coap://nymea.invalid");
 }
 
 void CoapTests::invalidUrl()
@@ -81,7 +279,7 @@ void CoapTests::invalidUrl()
 
 void CoapTests::invalidScheme()
 {
-    CoapRequest request(QUrl("http://coap.me"));
+    CoapRequest request(QUrl("http://127.0.0.1"));
 
     QSignalSpy spy(m_coap, SIGNAL(replyFinished(CoapReply*)));
 
@@ -135,7 +333,7 @@ void CoapTests::invalidScheme()
 void CoapTests::ping()
 {
     CoapRequest request;
-    request.setUrl(QUrl("coap://coap.me/"));
+    request.setUrl(serverUrl("/"));
     qDebug() << request.url().toString();
 
     QSignalSpy spy(m_coap, SIGNAL(replyFinished(CoapReply*)));
@@ -152,7 +350,7 @@ void CoapTests::ping()
 
 void CoapTests::hello()
 {
-    CoapRequest request(QUrl("coap://coap.me/hello"));
+    CoapRequest request(serverUrl("/hello"));
     request.setMessageType(CoapPdu::Confirmable);
 
     qDebug() << request.url().toString();
@@ -173,7 +371,7 @@ void CoapTests::hello()
 
 void CoapTests::broken()
 {
-    CoapRequest request(QUrl("coap://coap.me:5683/broken"));
+    CoapRequest request(serverUrl("/broken"));
     qDebug() << request.url().toString();
 
     QSignalSpy spy(m_coap, SIGNAL(replyFinished(CoapReply*)));
@@ -191,7 +389,7 @@ void CoapTests::broken()
 
 void CoapTests::query()
 {
-    CoapRequest request(QUrl("coap://coap.me/query?nymea=awesome"));
+    CoapRequest request(serverUrl("/query?nymea=awesome"));
     qDebug() << request.url().toString();
 
     QSignalSpy spy(m_coap, SIGNAL(replyFinished(CoapReply*)));
@@ -209,7 +407,7 @@ void CoapTests::query()
 
 void CoapTests::subPath()
 {
-    CoapRequest request(QUrl("coap://coap.me/path/sub1"));
+    CoapRequest request(serverUrl("/path/sub1"));
     qDebug() << request.url().toString();
 
     QSignalSpy spy(m_coap, SIGNAL(replyFinished(CoapReply*)));
@@ -227,7 +425,7 @@ void CoapTests::subPath()
 
 void CoapTests::extendedOptionLength()
 {
-    CoapRequest request(QUrl("coap://coap.me:5683/123412341234123412341234"));
+    CoapRequest request(serverUrl("/123412341234123412341234"));
     qDebug() << request.url().toString();
 
     QSignalSpy spy(m_coap, SIGNAL(replyFinished(CoapReply*)));
@@ -245,7 +443,7 @@ void CoapTests::extendedOptionLength()
 
 void CoapTests::specialCharacters()
 {
-    CoapRequest request(QUrl("coap://coap.me:5683/blåbærsyltetøy"));
+    CoapRequest request(serverUrl(QString::fromUtf8("/blåbærsyltetøy")));
     qDebug() << request.url().toString();
 
     QSignalSpy spy(m_coap, SIGNAL(replyFinished(CoapReply*)));
@@ -257,27 +455,13 @@ void CoapTests::specialCharacters()
     QCOMPARE(reply->statusCode(), CoapPdu::Content);
     QCOMPARE(reply->contentType(), CoapPdu::TextPlain);
     QCOMPARE(reply->error(), CoapReply::NoError);
-    QVERIFY2(reply->payload() == "Übergrößenträger = 特大の人 = 超大航母", "Invalid payload");
+    QCOMPARE(QString::fromUtf8(reply->payload()), QString::fromUtf8("Übergrößenträger = 特大の人 = 超大航母"));
     reply->deleteLater();
 }
 
-void CoapTests::extendedDelta_data()
-{
-    QTest::addColumn<QUrl>("url");
-
-    QTest::newRow("weird33") << QUrl("coap://coap.me/weird33");
-    QTest::newRow("weird44") << QUrl("coap://coap.me/weird44");
-    QTest::newRow("weird55") << QUrl("coap://coap.me/weird55");
-    QTest::newRow("weird333") << QUrl("coap://coap.me/weird333");
-    QTest::newRow("weird3333") << QUrl("coap://coap.me/weird3333");
-    QTest::newRow("weird33333") << QUrl("coap://coap.me/weird33333");
-}
-
-void CoapTests::extendedDelta()
+void CoapTests::notFound()
 {
-    QFETCH(QUrl, url);
-
-    CoapRequest request(url);
+    CoapRequest request(serverUrl("/does/not/exist"));
     qDebug() << request.url().toString();
 
     QSignalSpy spy(m_coap, SIGNAL(replyFinished(CoapReply*)));
@@ -286,16 +470,14 @@ void CoapTests::extendedDelta()
 
     QVERIFY2(spy.count() > 0, "Did not get a response.");
     QCOMPARE(reply->messageType(), CoapPdu::Acknowledgement);
-    QCOMPARE(reply->statusCode(), CoapPdu::Content);
-    QCOMPARE(reply->contentType(), CoapPdu::TextPlain);
+    QCOMPARE(reply->statusCode(), CoapPdu::NotFound);
     QCOMPARE(reply->error(), CoapReply::NoError);
-    QVERIFY2(reply->payload().startsWith("resource with option"), "Invalid payload");
     reply->deleteLater();
 }
 
 void CoapTests::secret()
 {
-    CoapRequest request(QUrl("coap://coap.me/secret"));
+    CoapRequest request(serverUrl("/secret"));
     qDebug() << request.url().toString();
 
     QSignalSpy spy(m_coap, SIGNAL(replyFinished(CoapReply*)));
@@ -311,27 +493,9 @@ void CoapTests::secret()
     reply->deleteLater();
 }
 
-void CoapTests::separated()
-{
-    CoapRequest request(QUrl("coap://coap.me:5683/separate"));
-    qDebug() << request.url().toString();
-
-    QSignalSpy spy(m_coap, SIGNAL(replyFinished(CoapReply*)));
-    CoapReply *reply = m_coap->get(request);
-    spy.wait(10000);
-
-    QVERIFY2(spy.count() > 0, "Did not get a response.");
-    QCOMPARE(reply->messageType(), CoapPdu::Acknowledgement);
-    QCOMPARE(reply->statusCode(), CoapPdu::Content);
-    QCOMPARE(reply->contentType(), CoapPdu::TextPlain);
-    QCOMPARE(reply->error(), CoapReply::NoError);
-    QVERIFY2(reply->payload() == "That took a long time", "Invalid payload");
-    reply->deleteLater();
-}
-
 void CoapTests::deleteResource()
 {
-    CoapRequest request(QUrl("coap://coap.me:5683/validate"));
+    CoapRequest request(serverUrl("/validate"));
     qDebug() << request.url().toString();
 
     QSignalSpy spy(m_coap, SIGNAL(replyFinished(CoapReply*)));
@@ -349,7 +513,7 @@ void CoapTests::deleteResource()
 
 void CoapTests::post()
 {
-    CoapRequest request(QUrl("coap://coap.me:5683/validate"));
+    CoapRequest request(serverUrl("/validate"));
     request.setContentType();
     qDebug() << request.url().toString();
 
@@ -368,7 +532,7 @@ void CoapTests::post()
 
 void CoapTests::put()
 {
-    CoapRequest request(QUrl("coap://coap.me:5683/validate"));
+    CoapRequest request(serverUrl("/validate"));
     qDebug() << request.url().toString();
 
     QSignalSpy spy(m_coap, SIGNAL(replyFinished(CoapReply*)));
@@ -387,7 +551,7 @@ void CoapTests::put()
 
 void CoapTests::jsonMessage()
 {
-    CoapRequest request(QUrl("coap://coap.me:5683/5"));
+    CoapRequest request(serverUrl("/json"));
     qDebug() << request.url().toString();
 
     QSignalSpy spy(m_coap, SIGNAL(replyFinished(CoapReply*)));
@@ -403,40 +567,39 @@ void CoapTests::jsonMessage()
     QJsonDocument jsonDoc = QJsonDocument::fromJson(reply->payload(), &error);
     QCOMPARE(error.error, QJsonParseError::NoError);
 
-    qDebug() << "====================================";
-    qDebug() << jsonDoc.toJson();
+    QCOMPARE(jsonDoc.toVariant().toMap().value("nymea").toString(), QString("awesome"));
 
     reply->deleteLater();
 }
 
 void CoapTests::largeDownload()
 {
-    CoapRequest request(QUrl("coap://coap.me:5683/large"));
+    CoapRequest request(serverUrl("/large"));
     qDebug() << request.url().toString();
 
     QSignalSpy spy(m_coap, SIGNAL(replyFinished(CoapReply*)));
     CoapReply *reply = m_coap->get(request);
-    spy.wait(20000);
+    spy.wait();
 
     QVERIFY2(spy.count() > 0, "Did not get a response.");
     QCOMPARE(reply->messageType(), CoapPdu::Acknowledgement);
     QCOMPARE(reply->statusCode(), CoapPdu::Content);
     QCOMPARE(reply->contentType(), CoapPdu::TextPlain);
     QCOMPARE(reply->error(), CoapReply::NoError);
-    QVERIFY2(reply->payload().size() == 1700, "Invalid payload size.");
+    QCOMPARE(reply->payload(), QByteArray(1700, 'n'));
 
     reply->deleteLater();
 }
 
 void CoapTests::largeCreate()
 {
-    CoapRequest request(QUrl("coap://coap.me:5683/large-create"));
+    CoapRequest request(serverUrl("/large-create"));
     qDebug() << request.url().toString();
 
     QSignalSpy spy(m_coap, SIGNAL(replyFinished(CoapReply*)));
 
     CoapReply *reply = m_coap->post(request, m_uploadData);
-    spy.wait(20000);
+    spy.wait();
 
     QVERIFY2(spy.count() > 0, "Did not get a response.");
     QCOMPARE(reply->messageType(), CoapPdu::Acknowledgement);
@@ -450,7 +613,7 @@ void CoapTests::largeCreate()
 
     // check if the upload was really successful
     reply = m_coap->get(request);
-    spy.wait(20000);
+    spy.wait();
 
     QVERIFY2(spy.count() > 0, "Did not get a response.");
     QCOMPARE(reply->messageType(), CoapPdu::Acknowledgement);
@@ -464,13 +627,13 @@ void CoapTests::largeCreate()
 
 void CoapTests::largeUpdate()
 {
-    CoapRequest request(QUrl("coap://coap.me:5683/large-update"));
+    CoapRequest request(serverUrl("/large-update"));
     qDebug() << request.url().toString();
 
     QSignalSpy spy(m_coap, SIGNAL(replyFinished(CoapReply*)));
 
     CoapReply *reply = m_coap->put(request, m_uploadData);
-    spy.wait(20000);
+    spy.wait();
 
     QVERIFY2(spy.count() > 0, "Did not get a response.");
     QCOMPARE(reply->messageType(), CoapPdu::Acknowledgement);
@@ -484,7 +647,7 @@ void CoapTests::largeUpdate()
 
     // check if the upload was successful
     reply = m_coap->get(request);
-    spy.wait(20000);
+    spy.wait();
 
     QVERIFY2(spy.count() > 0, "Did not get a response.");
     QCOMPARE(reply->messageType(), CoapPdu::Acknowledgement);
@@ -502,30 +665,82 @@ void CoapTests::multipleCalls()
 
     QList<CoapReply *> replies;
 
-    replies.append(m_coap->get(CoapRequest(QUrl("coap://coap.me:5683/separate"))));
-    replies.append(m_coap->ping(CoapRequest(QUrl("coap://coap.me"))));
-    replies.append(m_coap->get(CoapRequest(QUrl("coap://coap.me:5683/large"))));
-    replies.append(m_coap->get(CoapRequest(QUrl("coap://coap.me"))));
-    spy.wait(10000);
-    spy.wait();
-    spy.wait(10000);
-    spy.wait();
+    replies.append(m_coap->get(CoapRequest(serverUrl("/hello"))));
+    replies.append(m_coap->ping(CoapRequest(serverUrl("/"))));
+    replies.append(m_coap->get(CoapRequest(serverUrl("/large"))));
+    replies.append(m_coap->get(CoapRequest(serverUrl("/.well-known/core"))));
 
-    QVERIFY2(spy.count() == 4, "Did not get all responses.");
-    spy.clear();
+    QTRY_COMPARE(spy.count(), 4);
 
     foreach (CoapReply *reply, replies) {
         QCOMPARE(reply->messageType(), CoapPdu::Acknowledgement);
         QCOMPARE(reply->error(), CoapReply::NoError);
-        reply->deleteLater();
     }
 
     qDeleteAll(replies);
 }
 
+void CoapTests::hostLookup()
+{
+    CoapRequest request(QUrl(QString("coap://localhost:%1/hello").arg(serverPort)));
+    qDebug() << request.url().toString();
+
+    QSignalSpy spy(m_coap, SIGNAL(replyFinished(CoapReply*)));
+
+    // The second request must be served from the host cache
+    for (int i = 0; i < 2; i++) {
+        spy.clear();
+        CoapReply *reply = m_coap->get(request);
+        spy.wait();
+
+        QVERIFY2(spy.count() > 0, "Did not get a response.");
+        QCOMPARE(reply->statusCode(), CoapPdu::Content);
+        QCOMPARE(reply->error(), CoapReply::NoError);
+        QCOMPARE(reply->payload(), QByteArray("world"));
+        reply->deleteLater();
+    }
+}
+
+void CoapTests::duplicateRequest()
+{
+    m_counterRequests = 0;
+
+    CoapPdu pdu;
+    pdu.setMessageType(CoapPdu::Confirmable);
+    pdu.setStatusCode(CoapPdu::Get);
+    pdu.setMessageId(4242);
+    pdu.setToken(QByteArray::fromHex("cafe"));
+    pdu.addOption(CoapOption::UriPath, "counter");
+
+    QUdpSocket socket;
+    QVERIFY(socket.bind(QHostAddress::LocalHost, 0));
+
+    // A retransmitted request must be answered from the response cache
+    QList<QByteArray> responses;
+    for (int i = 0; i < 2; i++) {
+        socket.writeDatagram(pdu.pack(), QHostAddress::LocalHost, serverPort);
+        QTRY_VERIFY(socket.hasPendingDatagrams());
+
+        QByteArray datagram;
+        datagram.resize(socket.pendingDatagramSize());
+        socket.readDatagram(datagram.data(), datagram.size());
+        responses.append(datagram);
+    }
+
+    QCOMPARE(responses.at(0), responses.at(1));
+    QCOMPARE(m_counterRequests, 1);
+
+    CoapPdu response(responses.first());
+    QVERIFY(response.isValid());
+    QCOMPARE(response.messageType(), CoapPdu::Acknowledgement);
+    QCOMPARE(response.messageId(), (quint16)4242);
+    QCOMPARE(response.token(), QByteArray::fromHex("cafe"));
+    QCOMPARE(response.payload(), QByteArray("1"));
+}
+
 void CoapTests::coreLinkParser()
 {
-    CoapRequest request(QUrl("coap://coap.me/.well-known/core"));
+    CoapRequest request(serverUrl("/.well-known/core"));
     qDebug() << request.url().toString();
 
     QSignalSpy spy(m_coap, SIGNAL(replyFinished(CoapReply*)));
@@ -539,18 +754,24 @@ void CoapTests::coreLinkParser()
     QCOMPARE(reply->error(), CoapReply::NoError);
 
     CoreLinkParser parser(reply->payload());
-    QCOMPARE(parser.links().count(), 28);
+    QCOMPARE(parser.links().count(), m_server->resources().count());
 
+    bool observableFound = false;
     foreach (const CoreLink &link, parser.links()) {
         qDebug() << link;
+        if (link.path() == "/obs") {
+            QVERIFY(link.observable());
+            observableFound = true;
+        }
     }
+    QVERIFY(observableFound);
 
     reply->deleteLater();
 }
 
 void CoapTests::observeResource()
 {
-    CoapRequest request(QUrl("coap://vs0.inf.ethz.ch/obs"));
+    CoapRequest request(serverUrl("/obs"));
     qDebug() << request.url().toString();
 
     QSignalSpy spy(m_coap, SIGNAL(replyFinished(CoapReply*)));
@@ -563,18 +784,25 @@ void CoapTests::observeResource()
     QCOMPARE(reply->messageType(), CoapPdu::Acknowledgement);
     QCOMPARE(reply->statusCode(), CoapPdu::Content);
     QCOMPARE(reply->error(), CoapReply::NoError);
+    QCOMPARE(m_server->observerCount(m_observableResource), 1);
     reply->deleteLater();
 
-    notificationSpy.wait(6000);
+    m_observableResource->setPayload("1");
+    notificationSpy.wait();
     QVERIFY2(notificationSpy.count() > 0, "Did not get a notification.");
-    qDebug() << notificationSpy.first();
-    m_coap->disableNotifications(request);
-    QTest::qWait(5000);
+    QCOMPARE(notificationSpy.first().at(2).toByteArray(), QByteArray("1"));
+
+    spy.clear();
+    reply = m_coap->disableNotifications(request);
+    spy.wait();
+    QVERIFY2(spy.count() > 0, "Did not get a response.");
+    QCOMPARE(m_server->observerCount(m_observableResource), 0);
+    reply->deleteLater();
 }
 
 void CoapTests::observeLargeResource()
 {
-    CoapRequest request(QUrl("coap://vs0.inf.ethz.ch/obs-large"));
+    CoapRequest request(serverUrl("/obs-large"));
     qDebug() << request.url().toString();
 
     QSignalSpy spy(m_coap, SIGNAL(replyFinished(CoapReply*)));
@@ -587,13 +815,22 @@ void CoapTests::observeLargeResource()
     QCOMPARE(reply->messageType(), CoapPdu::Acknowledgement);
     QCOMPARE(reply->statusCode(), CoapPdu::Content);
     QCOMPARE(reply->error(), CoapReply::NoError);
+    QCOMPARE(reply->payload(), m_observableLargeResource->payload());
+    QCOMPARE(m_server->observerCount(m_observableLargeResource), 1);
     reply->deleteLater();
 
-    notificationSpy.wait(6000);
-    QVERIFY2(notificationSpy.count() > 0, "Did not get a notification.");
-    qDebug() << notificationSpy.first();
-    m_coap->disableNotifications(request);
-    QTest::qWait(5000);
+    // The notification is larger than one block and gets fetched block-wise
+    QByteArray largePayload(1500, '1');
+    m_observableLargeResource->setPayload(largePayload);
+    QTRY_VERIFY(notificationSpy.count() > 0);
+    QCOMPARE(notificationSpy.last().at(2).toByteArray(), largePayload);
+
+    spy.clear();
+    reply = m_coap->disableNotifications(request);
+    spy.wait();
+    QVERIFY2(spy.count() > 0, "Did not get a response.");
+    QCOMPARE(m_server->observerCount(m_observableLargeResource), 0);
+    reply->deleteLater();
 }
 
 QTEST_MAIN(CoapTests)
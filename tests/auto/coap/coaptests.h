@@ -32,6 +32,7 @@
 #include "coap/coap.h"
 #include "coap/coappdu.h"
 #include "coap/coapreply.h"
+#include "coap/coapserver.h"
 #include "coap/corelinkparser.h"
 
 class CoapTests : public QObject
@@ -42,10 +43,26 @@ public:
     explicit CoapTests(QObject *parent = 0);
 
 private:
-    Coap *m_coap;
+    Coap *m_coap = nullptr;
+    CoapServer *m_server = nullptr;
     QByteArray m_uploadData;
+    QByteArray m_largeCreateData;
+    int m_counterRequests = 0;
+
+    CoapResource *m_observableResource = nullptr;
+    CoapResource *m_observableLargeResource = nullptr;
+
+    QUrl serverUrl(const QString &path) const;
 
 private slots:
+    void initTestCase();
+
+    void pduPacking_data();
+    void pduPacking();
+
+    void blockOption_data();
+    void blockOption();
+
     void invalidUrl_data();
     void invalidUrl();
 
@@ -60,11 +77,8 @@ private slots:
 
     void specialCharacters();
 
-    void extendedDelta_data();
-    void extendedDelta();
-
+    void notFound();
     void secret();
-    void separated();
 
     void deleteResource();
     void post();
@@ -77,6 +91,9 @@ private slots:
     void largeUpdate();
 
     void multipleCalls();
+    void hostLookup();
+
+    void duplicateRequest();
 
     void coreLinkParser();
 
@@ -63,6 +63,8 @@ private slots:
     void setPluginConfig_data();
     void setPluginConfig();
 
+    void reloadPlugin();
+
     void getSupportedVendors();
 
     void getThingClasses_data();
@@ -268,6 +270,69 @@ void TestIntegrations::setPluginConfig()
     }
 }
 
+void TestIntegrations::reloadPlugin()
+{
+    QVariantMap params;
+    params.insert("pluginId", PluginId::createPluginId());
+    QVariant response = injectAndWait("Integrations.ReloadPlugin", params);
+    verifyThingError(response, Thing::ThingErrorPluginNotFound);
+
+    enableNotifications({"Integrations"});
+    QSignalSpy notificationSpy(m_mockTcpServer, SIGNAL(outgoingData(QUuid,QByteArray)));
+
+    params.insert("pluginId", mockPluginId);
+    response = injectAndWait("Integrations.ReloadPlugin", params);
+    verifyThingError(response);
+
+    // The things of the plugin are kept and set up again
+    bool setupComplete = false;
+    QDateTime maxTime = QDateTime::currentDateTime().addSecs(10);
+    while (QDateTime::currentDateTime() < maxTime && !setupComplete) {
+        QList<QList<QVariant>> notifications = notificationSpy;
+        notificationSpy.clear();
+        foreach (const QList<QVariant> &notificationArgs, notifications) {
+            QVariantMap notification = QJsonDocument::fromJson(notificationArgs.at(1).toByteArray()).toVariant().toMap();
+            if (notification.value("notification").toString() != "Integrations.ThingChanged") {
+                continue;
+            }
+            QVariantMap thing = notification.value("params").toMap().value("thing").toMap();
+            if (ThingId(thing.value("id").toString()) == m_mockThingId && thing.value("setupStatus").toString() == "ThingSetupStatusComplete") {
+                setupComplete = true;
+            }
+        }
+        if (!setupComplete) {
+            notificationSpy.wait();
+        }
+    }
+    QVERIFY2(setupComplete, "The mock thing has not been set up again after reloading the plugin.");
+
+    params.clear();
+    params.insert("thingId", m_mockThingId);
+    response = injectAndWait("Integrations.GetThings", params);
+    QCOMPARE(response.toMap().value("params").toMap().value("things").toList().count(), 1);
+
+    bool found = false;
+    foreach (const QVariant &pluginVariant, injectAndWait("Integrations.GetPlugins").toMap().value("params").toMap().value("plugins").toList()) {
+        if (PluginId(pluginVariant.toMap().value("id").toString()) == mockPluginId) {
+            found = true;
+        }
+    }
+    QVERIFY2(found, "The mock plugin is not loaded after reloading it.");
+
+    // Actions are handled by the new plugin instance
+    params.clear();
+    params.insert("thingId", m_mockThingId);
+    params.insert("actionTypeId", mockPowerActionTypeId);
+    QVariantList actionParams;
+    QVariantMap powerParam;
+    powerParam.insert("paramTypeId", mockPowerActionPowerParamTypeId);
+    powerParam.insert("value", true);
+    actionParams.append(powerParam);
+    params.insert("params", actionParams);
+    response = injectAndWait("Integrations.ExecuteAction", params);
+    verifyThingError(response);
+}
+
 void TestIntegrations::getSupportedVendors()
 {
     QVariant supportedVendors = injectAndWait("Integrations.GetVendors");
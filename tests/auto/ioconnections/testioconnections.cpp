@@ -65,6 +65,8 @@ private slots:
 
     void testAnalogIO_data();
     void testAnalogIO();
+
+    void testAnalogIOCoalescing();
 };
 
 void TestIOConnections::initTestCase()
@@ -330,6 +332,53 @@ void TestIOConnections::testAnalogIO()
 
 }
 
+void TestIOConnections::testAnalogIOCoalescing()
+{
+    Thing *ioThing = NymeaCore::instance()->thingManager()->findConfiguredThing(m_ioThingId);
+    Thing *tempSensorThing = NymeaCore::instance()->thingManager()->findConfiguredThing(m_tempSensorThingId);
+    QVERIFY(ioThing);
+    QVERIFY(tempSensorThing);
+
+    ioThing->setStateValue(genericIoMockAnalogInput1StateTypeId, 0);
+
+    QVariantMap params;
+    params.insert("inputThingId", m_ioThingId);
+    params.insert("inputStateTypeId", genericIoMockAnalogInput1StateTypeId);
+    params.insert("outputThingId", m_tempSensorThingId);
+    params.insert("outputStateTypeId", virtualIoTemperatureSensorMockInputStateTypeId);
+    params.insert("inverted", false);
+    QVariant response = injectAndWait("Integrations.ConnectIO", params);
+    verifyThingError(response);
+    IOConnectionId ioConnectionId = response.toMap().value("params").toMap().value("ioConnectionId").toUuid();
+
+    QList<double> outputValues;
+    QMetaObject::Connection connection = connect(NymeaCore::instance()->thingManager(), &ThingManager::thingStateChanged, this, [&](Thing *thing, const StateTypeId &stateTypeId, const QVariant &value){
+        if (thing == tempSensorThing && stateTypeId == virtualIoTemperatureSensorMockInputStateTypeId) {
+            outputValues.append(value.toDouble());
+        }
+    });
+
+    // Change the input several times without returning to the event loop. The first change
+    // starts an output action, the others arrive while it is still running and must be coalesced.
+    ioThing->setStateValue(genericIoMockAnalogInput1StateTypeId, 0.33);
+    ioThing->setStateValue(genericIoMockAnalogInput1StateTypeId, 0.66);
+    ioThing->setStateValue(genericIoMockAnalogInput1StateTypeId, 0.99);
+    ioThing->setStateValue(genericIoMockAnalogInput1StateTypeId, 1.65);
+
+    QTRY_COMPARE(outputValues.count(), 2);
+    QTest::qWait(200);
+    QCOMPARE(outputValues.count(), 2);
+    QVERIFY2(qFuzzyCompare(outputValues.first(), 0.1), QString("First output action is not at 0.1 but at %1").arg(outputValues.first()).toUtf8());
+    QVERIFY2(qFuzzyCompare(outputValues.last(), 0.5), QString("Follow-up output action is not at 0.5 but at %1").arg(outputValues.last()).toUtf8());
+
+    disconnect(connection);
+
+    params.clear();
+    params.insert("ioConnectionId", ioConnectionId);
+    response = injectAndWait("Integrations.DisconnectIO", params);
+    verifyThingError(response);
+}
+
 #include "testioconnections.moc"
 QTEST_MAIN(TestIOConnections)
 
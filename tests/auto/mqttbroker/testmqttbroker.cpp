@@ -32,6 +32,7 @@
 #include "nymeacore.h"
 #include "servers/mqttbroker.h"
 #include "servers/mocktcpserver.h"
+#include "servers/mqtttopictrie.h"
 
 #include "nymea-mqtt/mqttclient.h"
 
@@ -57,6 +58,9 @@ private slots:
 
     void testSubscribePolicy_data();
     void testSubscribePolicy();
+
+    void testTopicTrie_data();
+    void testTopicTrie();
 };
 
 void TestMqttBroker::initTestCase()
@@ -448,6 +452,47 @@ void TestMqttBroker::testSubscribePolicy()
     QCOMPARE(clientSubscribedSpy.count(), (allowed ? 1 : 0));
 }
 
+void TestMqttBroker::testTopicTrie_data()
+{
+    QTest::addColumn<QStringList>("topicFilters");
+    QTest::addColumn<QString>("topic");
+    QTest::addColumn<bool>("matches");
+
+    QTest::newRow("none, a") << QStringList() << "a" << false;
+    QTest::newRow("#, a/b/c") << (QStringList() << "#") << "a/b/c" << true;
+    QTest::newRow("#, empty") << (QStringList() << "#") << "" << true;
+    QTest::newRow("a/b, a") << (QStringList() << "a/b") << "a" << false;
+    QTest::newRow("a/b, a/b/c") << (QStringList() << "a/b") << "a/b/c" << false;
+    QTest::newRow("a/b, a/b") << (QStringList() << "a/b") << "a/b" << true;
+    QTest::newRow("a/#, a") << (QStringList() << "a/#") << "a" << true;
+    QTest::newRow("a/#, ab") << (QStringList() << "a/#") << "ab" << false;
+    QTest::newRow("a/+, a/b") << (QStringList() << "a/+") << "a/b" << true;
+    QTest::newRow("a/+, a/b/c") << (QStringList() << "a/+") << "a/b/c" << false;
+    QTest::newRow("a/+, a/") << (QStringList() << "a/+") << "a/" << true;
+    QTest::newRow("a/+/c, a/b/c") << (QStringList() << "a/+/c") << "a/b/c" << true;
+    QTest::newRow("a/#/c, a/b/c") << (QStringList() << "a/#/c") << "a/b/c" << true;
+    QTest::newRow("a/b a/+, a/+") << (QStringList() << "a/b" << "a/+") << "a/+" << true;
+    QTest::newRow("a/b, a/+") << (QStringList() << "a/b") << "a/+" << false;
+    QTest::newRow("a/+, a/#") << (QStringList() << "a/+") << "a/#" << true;
+    QTest::newRow("a/b/c a/+/d, a/b/d") << (QStringList() << "a/b/c" << "a/+/d") << "a/b/d" << true;
+    QTest::newRow("c b a, b") << (QStringList() << "c" << "b" << "a") << "b" << true;
+    QTest::newRow("c b a, d") << (QStringList() << "c" << "b" << "a") << "d" << false;
+}
+
+void TestMqttBroker::testTopicTrie()
+{
+    QFETCH(QStringList, topicFilters);
+    QFETCH(QString, topic);
+    QFETCH(bool, matches);
+
+    MqttTopicTrie trie(topicFilters);
+    QCOMPARE(trie.isEmpty(), topicFilters.isEmpty());
+    QCOMPARE(trie.matches(topic), matches);
+
+    trie.clear();
+    QVERIFY(trie.isEmpty());
+    QVERIFY(!trie.matches(topic));
+}
 
 #include "testmqttbroker.moc"
 QTEST_MAIN(TestMqttBroker)
@@ -33,6 +33,8 @@
 #include "servers/mocktcpserver.h"
 #include "nymeacore.h"
 #include "jsonrpc/jsonhandler.h"
+#include "ruleengine/ruleactionexecutor.h"
+#include "ruleengine/rulesnapshot.h"
 
 using namespace nymeaserver;
 
@@ -51,6 +53,7 @@ private:
     QVariantMap createStateEvaluatorFromSingleDescriptor(const QVariantMap &stateDescriptor);
 
     void setWritableStateValue(const ThingId &thingId, const StateTypeId &stateTypeId, const QVariant &value);
+    QString writeRulesConfig(const RuleId &ruleId, const QString &name);
 
     void verifyRuleExecuted(const ActionTypeId &actionTypeId);
     void verifyRuleNotExecuted();
@@ -89,6 +92,9 @@ private slots:
 
     void loadStoreConfig();
 
+    void importRulesFromSettings();
+    void recoverCorruptRuleSnapshot();
+
     void evaluateEvent();
 
     void evaluateEventParams();
@@ -132,6 +138,16 @@ private slots:
 
     void testLoopingRules();
 
+    void testRuleActionQueue();
+    void testRuleActionQueueStatelessActions();
+
+    void testTriggerFilters();
+    void testTriggerFilterDebounceCancelled();
+
+    void testNumericStateThresholds();
+
+    void testRuleStatistics();
+
     void testScene();
 
     void testHousekeeping_data();
@@ -231,6 +247,33 @@ QVariantMap TestRules::createStateEvaluatorFromSingleDescriptor(const QVariantMa
     return stateEvaluator;
 }
 
+QString TestRules::writeRulesConfig(const RuleId &ruleId, const QString &name)
+{
+    NymeaSettings settings(NymeaSettings::SettingsRoleRules);
+    settings.beginGroup(ruleId.toString());
+    settings.setValue("name", name);
+    settings.setValue("enabled", true);
+    settings.setValue("executable", true);
+    settings.beginGroup("events");
+    settings.beginGroup("EventDescriptor-0");
+    settings.setValue("thingId", m_mockThingId.toString());
+    settings.setValue("eventTypeId", mockEvent1EventTypeId.toString());
+    settings.endGroup();
+    settings.endGroup();
+    settings.beginGroup("ruleActions");
+    settings.beginGroup("0");
+    settings.setValue("thingId", m_mockThingId.toString());
+    settings.setValue("actionTypeId", mockPowerActionTypeId.toString());
+    settings.beginGroup("RuleActionParam-" + mockPowerActionPowerParamTypeId.toString());
+    settings.setValue("valueType", static_cast<int>(QVariant::Bool));
+    settings.setValue("value", true);
+    settings.endGroup();
+    settings.endGroup();
+    settings.endGroup();
+    settings.endGroup();
+    return settings.fileName();
+}
+
 void TestRules::setWritableStateValue(const ThingId &thingId, const StateTypeId &stateTypeId, const QVariant &value)
 {
     enableNotifications({"Integrations"});
@@ -1594,6 +1637,69 @@ void TestRules::loadStoreConfig()
     QVERIFY2(rules.count() == 0, "There should be no rules.");
 }
 
+void TestRules::importRulesFromSettings()
+{
+    // Write a rule in the rules.conf format of older nymea versions
+    RuleId ruleId = RuleId::createRuleId();
+    QString rulesConfigFileName = writeRulesConfig(ruleId, "Imported rule");
+
+    restartServer();
+
+    QVariantMap params;
+    params.insert("ruleId", ruleId);
+    QVariant response = injectAndWait("Rules.GetRuleDetails", params);
+    verifyRuleError(response);
+    QVariantMap rule = response.toMap().value("params").toMap().value("rule").toMap();
+    QCOMPARE(rule.value("name").toString(), QString("Imported rule"));
+    QCOMPARE(rule.value("eventDescriptors").toList().count(), 1);
+    QCOMPARE(rule.value("actions").toList().count(), 1);
+
+    // The rules.conf is moved away once imported and the rule is in the snapshot now
+    QVERIFY2(!QFile::exists(rulesConfigFileName), "rules.conf should have been moved after importing it.");
+    QVERIFY2(QFile::exists(rulesConfigFileName + ".imported"), "rules.conf should be kept as backup.");
+    QFile::remove(rulesConfigFileName + ".imported");
+
+    restartServer();
+
+    response = injectAndWait("Rules.GetRuleDetails", params);
+    verifyRuleError(response);
+    QCOMPARE(response.toMap().value("params").toMap().value("rule").toMap().value("name").toString(), QString("Imported rule"));
+}
+
+void TestRules::recoverCorruptRuleSnapshot()
+{
+    RuleId ruleId = RuleId::createRuleId();
+    QString rulesConfigFileName = writeRulesConfig(ruleId, "Recovered rule");
+    restartServer();
+
+    QVariantMap params;
+    params.insert("ruleId", ruleId);
+    verifyRuleError(injectAndWait("Rules.GetRuleDetails", params));
+    QVERIFY(QFile::exists(rulesConfigFileName + ".imported"));
+
+    // Truncate the snapshot, the rules are unchanged since it has been written so it isn't saved again on shutdown
+    QString snapshotFileName = RuleSnapshot::fileName();
+    QFile snapshotFile(snapshotFileName);
+    QVERIFY(snapshotFile.open(QFile::ReadWrite));
+    snapshotFile.resize(snapshotFile.size() / 2);
+    snapshotFile.close();
+    restartServer();
+
+    // The broken snapshot is kept aside and the rules are recovered from the last imported rules.conf
+    QVariant response = injectAndWait("Rules.GetRuleDetails", params);
+    verifyRuleError(response);
+    QCOMPARE(response.toMap().value("params").toMap().value("rule").toMap().value("name").toString(), QString("Recovered rule"));
+    QVERIFY2(QFile::exists(snapshotFileName + ".corrupt"), "The broken snapshot should have been kept aside.");
+    QFile::remove(snapshotFileName + ".corrupt");
+    QFile::remove(rulesConfigFileName + ".imported");
+
+    // And they made it into a new snapshot
+    restartServer();
+    response = injectAndWait("Rules.GetRuleDetails", params);
+    verifyRuleError(response);
+    QCOMPARE(response.toMap().value("params").toMap().value("rule").toMap().value("name").toString(), QString("Recovered rule"));
+}
+
 void TestRules::evaluateEvent()
 {
     // Add a rule
@@ -3076,6 +3182,15 @@ void TestRules::testLoopingRules()
 
     cleanupMockHistory();
 
+    // Count the power actions executed by the looping rules
+    int powerActions = 0;
+    QMetaObject::Connection connection = connect(NymeaCore::instance()->ruleActionExecutor(), &RuleActionExecutor::actionExecuted, this, [&](const Action &action){
+        if (action.actionTypeId() == mockPowerActionTypeId) {
+            powerActions++;
+        }
+    });
+    qulonglong droppedBefore = NymeaCore::instance()->eventQueueStatistics().value("dropped").toULongLong();
+
     params.clear();
     params.insert("thingId", m_mockThingId);
     params.insert("actionTypeId", mockPowerStateTypeId);
@@ -3083,7 +3198,351 @@ void TestRules::testLoopingRules()
     response = injectAndWait("Integrations.ExecuteAction", params);
     verifyRuleExecuted(mockPowerActionTypeId);
 
-    // No need to check anything else. This test sets up a binding loop and if the core doesn't catch it it'll crash here.
+    // This test sets up a binding loop and if the core doesn't catch it it'll spin forever.
+    // The loop is cut off by the event queue once the maximum cascade depth is reached.
+    QTest::qWait(500);
+    QVariantMap statistics = NymeaCore::instance()->eventQueueStatistics();
+    QVERIFY2(statistics.value("dropped").toULongLong() > droppedBefore, "The rule loop has not been cut off");
+    QVERIFY(statistics.value("maxDepth").toInt() <= statistics.value("maxCascadeDepth").toInt());
+    QCOMPARE(statistics.value("pending").toInt(), 0);
+    QVERIFY2(powerActions <= statistics.value("maxCascadeDepth").toInt() + 1, "The rule loop executed too many actions");
+
+    // Once cut off, no further actions are executed
+    int powerActionsAfterLoop = powerActions;
+    QTest::qWait(500);
+    QCOMPARE(powerActions, powerActionsAfterLoop);
+    disconnect(connection);
+}
+
+void TestRules::testRuleActionQueue()
+{
+    RuleActionExecutor *executor = NymeaCore::instance()->ruleActionExecutor();
+    QList<Action> executedActions;
+    QList<Thing::ThingError> executedStatus;
+    QMetaObject::Connection connection = connect(executor, &RuleActionExecutor::actionExecuted, this, [&](const Action &action, Thing::ThingError status){
+        executedActions.append(action);
+        executedStatus.append(status);
+    });
+
+    int supersededBefore = 0;
+    foreach (const QVariant &pluginStatistics, executor->statistics().value("plugins").toMap()) {
+        supersededBefore += pluginStatistics.toMap().value("superseded").toInt();
+    }
+
+    // The async action keeps the thing busy for a second, everything else needs to wait for it
+    executor->execute(Action(mockAsyncActionTypeId, m_mockThingId));
+    QCOMPARE(executor->runningActions(), 1);
+
+    Action powerOn(mockPowerActionTypeId, m_mockThingId);
+    powerOn.setParams(ParamList() << Param(mockPowerActionPowerParamTypeId, true));
+    executor->execute(powerOn);
+    executor->execute(Action(mockWithoutParamsActionTypeId, m_mockThingId));
+
+    // Powering off again supersedes the pending power on and takes its place in the queue
+    Action powerOff(mockPowerActionTypeId, m_mockThingId);
+    powerOff.setParams(ParamList() << Param(mockPowerActionPowerParamTypeId, false));
+    executor->execute(powerOff);
+
+    QCOMPARE(executor->pendingActions(), 2);
+    QCOMPARE(executor->runningActions(), 1);
+
+    QTRY_COMPARE_WITH_TIMEOUT(executedActions.count(), 3, 5000);
+    disconnect(connection);
+    QCOMPARE(executedActions.at(0).actionTypeId(), mockAsyncActionTypeId);
+    QCOMPARE(executedActions.at(1).actionTypeId(), mockPowerActionTypeId);
+    QCOMPARE(executedActions.at(1).param(mockPowerActionPowerParamTypeId).value().toBool(), false);
+    QCOMPARE(executedActions.at(2).actionTypeId(), mockWithoutParamsActionTypeId);
+    QCOMPARE(executedStatus.count(Thing::ThingErrorNoError), 3);
+
+    QCOMPARE(executor->pendingActions(), 0);
+    QCOMPARE(executor->runningActions(), 0);
+
+    int supersededAfter = 0;
+    foreach (const QVariant &pluginStatistics, executor->statistics().value("plugins").toMap()) {
+        supersededAfter += pluginStatistics.toMap().value("superseded").toInt();
+    }
+    QCOMPARE(supersededAfter - supersededBefore, 1);
+}
+
+void TestRules::testRuleActionQueueStatelessActions()
+{
+    RuleActionExecutor *executor = NymeaCore::instance()->ruleActionExecutor();
+    QList<Action> executedActions;
+    QMetaObject::Connection connection = connect(executor, &RuleActionExecutor::actionExecuted, this, [&](const Action &action){
+        executedActions.append(action);
+    });
+
+    // Keep the thing busy so both actions end up in the queue together
+    executor->execute(Action(mockAsyncActionTypeId, m_mockThingId));
+
+    // Actions not backed by a state, like notifications, must not supersede each other
+    Action firstNotification(mockWithParamsActionTypeId, m_mockThingId);
+    firstNotification.setParams(ParamList() << Param(mockWithParamsActionParam1ParamTypeId, 1) << Param(mockWithParamsActionParam2ParamTypeId, true));
+    executor->execute(firstNotification);
+    Action secondNotification(mockWithParamsActionTypeId, m_mockThingId);
+    secondNotification.setParams(ParamList() << Param(mockWithParamsActionParam1ParamTypeId, 2) << Param(mockWithParamsActionParam2ParamTypeId, false));
+    executor->execute(secondNotification);
+
+    QCOMPARE(executor->pendingActions(), 2);
+
+    QTRY_COMPARE_WITH_TIMEOUT(executedActions.count(), 3, 5000);
+    disconnect(connection);
+    QCOMPARE(executedActions.at(1).actionTypeId(), mockWithParamsActionTypeId);
+    QCOMPARE(executedActions.at(1).param(mockWithParamsActionParam1ParamTypeId).value().toInt(), 1);
+    QCOMPARE(executedActions.at(2).actionTypeId(), mockWithParamsActionTypeId);
+    QCOMPARE(executedActions.at(2).param(mockWithParamsActionParam1ParamTypeId).value().toInt(), 2);
+}
+
+void TestRules::testTriggerFilters()
+{
+    QVariantMap action;
+    action.insert("actionTypeId", mockWithoutParamsActionTypeId);
+    action.insert("thingId", m_mockThingId);
+    action.insert("ruleActionParams", QVariantList());
+
+    // Throttled rule: only the first event within a minute triggers the actions
+    QVariantMap filter;
+    filter.insert("throttle", 60000);
+    QVariantMap eventDescriptor;
+    eventDescriptor.insert("eventTypeId", mockEvent1EventTypeId);
+    eventDescriptor.insert("thingId", m_mockThingId);
+    eventDescriptor.insert("filter", filter);
+
+    QVariantMap params;
+    params.insert("name", "Throttled rule");
+    params.insert("eventDescriptors", QVariantList() << eventDescriptor);
+    params.insert("actions", QVariantList() << action);
+    QVariant response = injectAndWait("Rules.AddRule", params);
+    verifyRuleError(response);
+    RuleId ruleId = RuleId(response.toMap().value("params").toMap().value("ruleId").toString());
+
+    params.clear();
+    params.insert("ruleId", ruleId);
+    response = injectAndWait("Rules.GetRuleDetails", params);
+    QVariantMap rule = response.toMap().value("params").toMap().value("rule").toMap();
+    QCOMPARE(rule.value("eventDescriptors").toList().first().toMap().value("filter").toMap().value("throttle").toUInt(), 60000u);
+
+    generateEvent(mockEvent1EventTypeId);
+    verifyRuleExecuted(mockWithoutParamsActionTypeId);
+    cleanupMockHistory();
+
+    generateEvent(mockEvent1EventTypeId);
+    QTest::qWait(200);
+    verifyRuleNotExecuted();
+
+    verifyRuleError(injectAndWait("Rules.RemoveRule", params));
+
+    // Debounced rule: the actions are executed once the event has been quiet for the debounce time
+    filter.clear();
+    filter.insert("debounce", 500);
+    eventDescriptor.insert("filter", filter);
+
+    params.clear();
+    params.insert("name", "Debounced rule");
+    params.insert("eventDescriptors", QVariantList() << eventDescriptor);
+    params.insert("actions", QVariantList() << action);
+    response = injectAndWait("Rules.AddRule", params);
+    verifyRuleError(response);
+
+    generateEvent(mockEvent1EventTypeId);
+    verifyRuleNotExecuted();
+    verifyRuleExecuted(mockWithoutParamsActionTypeId);
+    cleanupMockHistory();
+
+    // A negative hysteresis is not allowed
+    filter.clear();
+    filter.insert("hysteresis", -1);
+    QVariantMap stateDescriptor;
+    stateDescriptor.insert("thingId", m_mockThingId);
+    stateDescriptor.insert("stateTypeId", mockIntStateTypeId);
+    stateDescriptor.insert("operator", enumValueName(Types::ValueOperatorGreater));
+    stateDescriptor.insert("value", 20);
+    stateDescriptor.insert("filter", filter);
+    QVariantMap stateEvaluator;
+    stateEvaluator.insert("stateDescriptor", stateDescriptor);
+
+    params.clear();
+    params.insert("name", "Hysteresis rule");
+    params.insert("stateEvaluator", stateEvaluator);
+    params.insert("actions", QVariantList() << action);
+    response = injectAndWait("Rules.AddRule", params);
+    verifyRuleError(response, RuleEngine::RuleErrorInvalidStateEvaluatorValue);
+}
+
+void TestRules::testTriggerFilterDebounceCancelled()
+{
+    QNetworkAccessManager nam;
+    QSignalSpy spy(&nam, SIGNAL(finished(QNetworkReply*)));
+    auto setIntState = [&](int value) {
+        spy.clear();
+        QNetworkRequest request(QUrl(QString("http://localhost:%1/setstate?%2=%3").arg(m_mockThing1Port).arg(mockIntStateTypeId.toString()).arg(value)));
+        QNetworkReply *reply = nam.get(request);
+        spy.wait();
+        QCOMPARE(spy.count(), 1);
+        reply->deleteLater();
+    };
+
+    setIntState(10);
+
+    // Triggers once the int state stayed above 20 for the debounce time
+    QVariantMap filter;
+    filter.insert("debounce", 500);
+    QVariantMap paramDescriptor;
+    paramDescriptor.insert("paramTypeId", mockIntEventIntParamTypeId);
+    paramDescriptor.insert("operator", enumValueName(Types::ValueOperatorGreater));
+    paramDescriptor.insert("value", 20);
+    QVariantMap eventDescriptor;
+    eventDescriptor.insert("eventTypeId", mockIntEventTypeId);
+    eventDescriptor.insert("thingId", m_mockThingId);
+    eventDescriptor.insert("paramDescriptors", QVariantList() << paramDescriptor);
+    eventDescriptor.insert("filter", filter);
+
+    QVariantMap action;
+    action.insert("actionTypeId", mockWithoutParamsActionTypeId);
+    action.insert("thingId", m_mockThingId);
+    action.insert("ruleActionParams", QVariantList());
+
+    QVariantMap params;
+    params.insert("name", "Debounced range rule");
+    params.insert("eventDescriptors", QVariantList() << eventDescriptor);
+    params.insert("actions", QVariantList() << action);
+    QVariant response = injectAndWait("Rules.AddRule", params);
+    verifyRuleError(response);
+    cleanupMockHistory();
+
+    // Leaving the range again before the debounce time passed cancels the trigger
+    setIntState(30);
+    setIntState(10);
+    QTest::qWait(800);
+    verifyRuleNotExecuted();
+
+    // Staying in the range triggers
+    setIntState(30);
+    QTest::qWait(800);
+    verifyRuleExecuted(mockWithoutParamsActionTypeId);
+}
+
+void TestRules::testNumericStateThresholds()
+{
+    QNetworkAccessManager nam;
+    QSignalSpy spy(&nam, SIGNAL(finished(QNetworkReply*)));
+
+    // Init int state below the thresholds
+    QNetworkRequest request(QUrl(QString("http://localhost:%1/setstate?%2=%3").arg(m_mockThing1Port).arg(mockIntStateTypeId.toString()).arg(10)));
+    QNetworkReply *reply = nam.get(request);
+    spy.wait();
+    QCOMPARE(spy.count(), 1);
+    reply->deleteLater();
+
+    // Rule active while 20 < int <= 40
+    QVariantMap lowerDescriptor;
+    lowerDescriptor.insert("thingId", m_mockThingId);
+    lowerDescriptor.insert("stateTypeId", mockIntStateTypeId);
+    lowerDescriptor.insert("operator", enumValueName(Types::ValueOperatorGreater));
+    lowerDescriptor.insert("value", 20);
+    QVariantMap lowerEvaluator;
+    lowerEvaluator.insert("stateDescriptor", lowerDescriptor);
+
+    QVariantMap upperDescriptor = lowerDescriptor;
+    upperDescriptor.insert("operator", enumValueName(Types::ValueOperatorLessOrEqual));
+    upperDescriptor.insert("value", 40);
+    QVariantMap upperEvaluator;
+    upperEvaluator.insert("stateDescriptor", upperDescriptor);
+
+    QVariantMap stateEvaluator;
+    stateEvaluator.insert("operator", enumValueName(Types::StateOperatorAnd));
+    stateEvaluator.insert("childEvaluators", QVariantList() << lowerEvaluator << upperEvaluator);
+
+    QVariantMap action;
+    action.insert("actionTypeId", mockWithoutParamsActionTypeId);
+    action.insert("thingId", m_mockThingId);
+    action.insert("ruleActionParams", QVariantList());
+
+    QVariantMap params;
+    params.insert("name", "Threshold rule");
+    params.insert("stateEvaluator", stateEvaluator);
+    params.insert("actions", QVariantList() << action);
+    QVariant response = injectAndWait("Rules.AddRule", params);
+    verifyRuleError(response);
+    RuleId ruleId = RuleId(response.toMap().value("params").toMap().value("ruleId").toString());
+
+    params.clear();
+    params.insert("ruleId", ruleId);
+    response = injectAndWait("Rules.GetRuleDetails", params);
+    QCOMPARE(response.toMap().value("params").toMap().value("rule").toMap().value("active").toBool(), false);
+
+    // Crossing the lower threshold activates the rule
+    spy.clear();
+    request = QNetworkRequest(QUrl(QString("http://localhost:%1/setstate?%2=%3").arg(m_mockThing1Port).arg(mockIntStateTypeId.toString()).arg(40)));
+    reply = nam.get(request);
+    spy.wait();
+    QCOMPARE(spy.count(), 1);
+    reply->deleteLater();
+
+    verifyRuleExecuted(mockWithoutParamsActionTypeId);
+    response = injectAndWait("Rules.GetRuleDetails", params);
+    QCOMPARE(response.toMap().value("params").toMap().value("rule").toMap().value("active").toBool(), true);
+
+    // Crossing the upper threshold deactivates it again
+    spy.clear();
+    request = QNetworkRequest(QUrl(QString("http://localhost:%1/setstate?%2=%3").arg(m_mockThing1Port).arg(mockIntStateTypeId.toString()).arg(41)));
+    reply = nam.get(request);
+    spy.wait();
+    QCOMPARE(spy.count(), 1);
+    reply->deleteLater();
+
+    response = injectAndWait("Rules.GetRuleDetails", params);
+    QCOMPARE(response.toMap().value("params").toMap().value("rule").toMap().value("active").toBool(), false);
+}
+
+void TestRules::testRuleStatistics()
+{
+    // Event based rule
+    QVariantMap eventDescriptor;
+    eventDescriptor.insert("eventTypeId", mockEvent1EventTypeId);
+    eventDescriptor.insert("thingId", m_mockThingId);
+
+    QVariantMap action;
+    action.insert("actionTypeId", mockWithoutParamsActionTypeId);
+    action.insert("thingId", m_mockThingId);
+    action.insert("ruleActionParams", QVariantList());
+
+    QVariantMap params;
+    params.insert("name", "Statistics rule");
+    params.insert("eventDescriptors", QVariantList() << eventDescriptor);
+    params.insert("actions", QVariantList() << action);
+    QVariant response = injectAndWait("Rules.AddRule", params);
+    verifyRuleError(response);
+    RuleId ruleId = RuleId(response.toMap().value("params").toMap().value("ruleId").toString());
+
+    params.clear();
+    params.insert("ruleId", ruleId);
+    response = injectAndWait("Rules.GetRuleStatistics", params);
+    verifyRuleError(response);
+    QVariantList statistics = response.toMap().value("params").toMap().value("ruleStatistics").toList();
+    QCOMPARE(statistics.count(), 1);
+    QCOMPARE(statistics.first().toMap().value("ruleId").toUuid(), ruleId);
+    QCOMPARE(statistics.first().toMap().value("evaluations").toInt(), 0);
+
+    generateEvent(mockEvent1EventTypeId);
+    verifyRuleExecuted(mockWithoutParamsActionTypeId);
+
+    response = injectAndWait("Rules.GetRuleStatistics", params);
+    verifyRuleError(response);
+    QVariantMap ruleStatistics = response.toMap().value("params").toMap().value("ruleStatistics").toList().first().toMap();
+    QVERIFY2(ruleStatistics.value("evaluations").toInt() >= 1, "Rule has not been evaluated");
+    QCOMPARE(ruleStatistics.value("matches").toInt(), 1);
+    QCOMPARE(ruleStatistics.value("actionDispatches").toInt(), 1);
+
+    // Without a ruleId all rules are returned
+    response = injectAndWait("Rules.GetRuleStatistics");
+    verifyRuleError(response);
+    QCOMPARE(response.toMap().value("params").toMap().value("ruleStatistics").toList().count(), 1);
+
+    // Unknown rule
+    params.insert("ruleId", RuleId::createRuleId());
+    response = injectAndWait("Rules.GetRuleStatistics", params);
+    verifyRuleError(response, RuleEngine::RuleErrorRuleNotFound);
 }
 
 void TestRules::testScene()
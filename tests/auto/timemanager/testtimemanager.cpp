@@ -31,6 +31,7 @@
 #include "nymeatestbase.h"
 #include "nymeacore.h"
 #include "servers/mocktcpserver.h"
+#include "hardware/plugintimermanagerimplementation.h"
 
 #include "platform/platform.h"
 #include "platform/platformsystemcontroller.h"
@@ -100,6 +101,8 @@ private slots:
     void testEventItemDaily_data();
     void testEventItemDaily();
 
+    void testEventItemSeconds();
+
     void testEventItemWeekly_data();
     void testEventItemWeekly();
 
@@ -114,6 +117,9 @@ private slots:
 
     void testEnableDisableTimeRule();
 
+    void testPluginTimerPhases();
+    void testPluginTimerDeletedInTimeout();
+
 private:
     void initTimeManager();
 
@@ -1641,6 +1647,58 @@ void TestTimeManager::testEventItemDaily()
     verifyRuleError(response);
 }
 
+void TestTimeManager::testEventItemSeconds()
+{
+    initTimeManager();
+
+    QTime time(7, 30, 15);
+
+    // Action
+    QVariantMap action;
+    action.insert("actionTypeId", mockWithoutParamsActionTypeId);
+    action.insert("thingId", m_mockThingId);
+    action.insert("ruleActionParams", QVariantList());
+
+    QVariantMap ruleMap;
+    ruleMap.insert("name", "Time based event rule with seconds");
+    ruleMap.insert("actions", QVariantList() << action);
+    ruleMap.insert("timeDescriptor", createTimeDescriptorTimeEvent(createTimeEventItem(time.toString("hh:mm:ss"))));
+
+    QVariant response = injectAndWait("Rules.AddRule", ruleMap);
+    verifyRuleError(response);
+    RuleId ruleId = RuleId(response.toMap().value("params").toMap().value("ruleId").toString());
+
+    // The seconds must survive the round trip
+    QVariantMap params;
+    params.insert("ruleId", ruleId);
+    response = injectAndWait("Rules.GetRuleDetails", params);
+    QVariantMap timeEventItem = response.toMap().value("params").toMap().value("rule").toMap().value("timeDescriptor").toMap().value("timeEventItems").toList().first().toMap();
+    QCOMPARE(timeEventItem.value("time").toString(), QString("07:30:15"));
+
+    QDateTime currentDateTime = NymeaCore::instance()->timeManager()->currentDateTime();
+    QDateTime eventDateTime = QDateTime(currentDateTime.date(), time);
+
+    // not triggering one second before
+    NymeaCore::instance()->timeManager()->setTime(eventDateTime.addSecs(-2));
+    NymeaCore::instance()->timeManager()->setTime(eventDateTime.addSecs(-1));
+    verifyRuleNotExecuted();
+    // trigger on the second
+    NymeaCore::instance()->timeManager()->setTime(eventDateTime);
+    verifyRuleExecuted(mockWithoutParamsActionTypeId);
+    cleanupMockHistory();
+    // not triggering again
+    NymeaCore::instance()->timeManager()->setTime(eventDateTime.addSecs(1));
+    verifyRuleNotExecuted();
+
+    cleanupMockHistory();
+
+    // REMOVE rule
+    QVariantMap removeParams;
+    removeParams.insert("ruleId", ruleId);
+    response = injectAndWait("Rules.RemoveRule", removeParams);
+    verifyRuleError(response);
+}
+
 void TestTimeManager::testEventItemWeekly_data()
 {
     QTest::addColumn<QTime>("time");
@@ -2024,6 +2082,90 @@ void TestTimeManager::testEnableDisableTimeRule()
     verifyRuleError(response);
 }
 
+void TestTimeManager::testPluginTimerPhases()
+{
+    initTimeManager();
+
+    PluginTimerManagerImplementation *pluginTimerManager = qobject_cast<PluginTimerManagerImplementation *>(NymeaCore::instance()->hardwareManager()->pluginTimerManager());
+    QVERIFY(pluginTimerManager);
+
+    // Timers with the same interval must not time out in the same second
+    int interval = 6;
+    QList<PluginTimer *> timers;
+    QList<QSignalSpy *> spies;
+    for (int i = 0; i < interval; i++) {
+        PluginTimer *timer = pluginTimerManager->registerTimer(interval, "phasetest");
+        timers.append(timer);
+        spies.append(new QSignalSpy(timer, &PluginTimer::timeout));
+    }
+
+    for (int period = 0; period < 2; period++) {
+        for (int tick = 0; tick < interval; tick++) {
+            emit NymeaCore::instance()->timeManager()->tick();
+
+            int timeouts = 0;
+            foreach (QSignalSpy *spy, spies) {
+                timeouts += spy->count();
+            }
+            QCOMPARE(timeouts, period * interval + tick + 1);
+        }
+    }
+
+    foreach (QSignalSpy *spy, spies) {
+        QCOMPARE(spy->count(), 2);
+    }
+
+    QVariantMap statistics = pluginTimerManager->statistics().value("owners").toMap().value("phasetest").toMap();
+    QCOMPARE(statistics.value("timers").toInt(), interval);
+    QCOMPARE(statistics.value("timeouts").toInt(), 2 * interval);
+    QCOMPARE(statistics.value("timeoutsPerMinute").toDouble(), 60.0);
+
+    // A paused timer holds its position
+    timers.first()->pause();
+    for (int tick = 0; tick < interval; tick++) {
+        emit NymeaCore::instance()->timeManager()->tick();
+    }
+    QCOMPARE(spies.first()->count(), 2);
+    timers.first()->resume();
+    for (int tick = 0; tick < interval; tick++) {
+        emit NymeaCore::instance()->timeManager()->tick();
+    }
+    QCOMPARE(spies.first()->count(), 3);
+
+    qDeleteAll(spies);
+    foreach (PluginTimer *timer, timers) {
+        pluginTimerManager->unregisterTimer(timer);
+    }
+    QVERIFY(!pluginTimerManager->statistics().value("owners").toMap().contains("phasetest"));
+}
+
+void TestTimeManager::testPluginTimerDeletedInTimeout()
+{
+    initTimeManager();
+
+    PluginTimerManagerImplementation *pluginTimerManager = qobject_cast<PluginTimerManagerImplementation *>(NymeaCore::instance()->hardwareManager()->pluginTimerManager());
+    QVERIFY(pluginTimerManager);
+
+    // Both timers are due in the same tick and whichever times out first deletes the other one
+    QPointer<PluginTimer> first = pluginTimerManager->registerTimer(1, "deletetest");
+    QPointer<PluginTimer> second = pluginTimerManager->registerTimer(1, "deletetest");
+    int timeouts = 0;
+    connect(first.data(), &PluginTimer::timeout, this, [&](){ timeouts++; delete second.data(); });
+    connect(second.data(), &PluginTimer::timeout, this, [&](){ timeouts++; delete first.data(); });
+
+    emit NymeaCore::instance()->timeManager()->tick();
+
+    QCOMPARE(timeouts, 1);
+    QVERIFY(first.isNull() != second.isNull());
+
+    PluginTimer *remaining = first.isNull() ? second.data() : first.data();
+    emit NymeaCore::instance()->timeManager()->tick();
+    QCOMPARE(timeouts, 2);
+
+    pluginTimerManager->unregisterTimer(remaining);
+    QVERIFY(!pluginTimerManager->statistics().value("owners").toMap().contains("deletetest"));
+}
+
 void TestTimeManager::initTimeManager()
 {
     cleanupMockHistory();
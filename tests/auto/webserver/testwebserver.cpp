@@ -30,9 +30,13 @@
 
 #include "nymeatestbase.h"
 #include "nymeacore.h"
+#include "servers/httprequestparser.h"
+#include "servermanager.h"
 
 #include <QXmlReader>
 
+#include <openssl/ssl.h>
+
 using namespace nymeaserver;
 
 class TestWebserver: public NymeaTestBase
@@ -48,6 +52,11 @@ private slots:
 
     void multiPackageMessage();
 
+    void parseRequests_data();
+    void parseRequests();
+
+    void pipelinedRequests();
+
     void checkAllowedMethodCall_data();
     void checkAllowedMethodCall();
 
@@ -57,6 +66,9 @@ private slots:
     void getFiles_data();
     void getFiles();
 
+    void getCachedFiles();
+    void getFileRanges();
+
     void getServerDescription();
 
     void getIcons_data();
@@ -65,6 +77,8 @@ private slots:
     void getDebugServer_data();
     void getDebugServer();
 
+    void resumeTlsSession();
+
 public slots:
     void onSslErrors(const QList<QSslError> &) {
         qWarning() << "SSL error";
@@ -73,6 +87,45 @@ public slots:
     }
 };
 
+// Reads one reply from the socket and returns the status code, headers and payload
+static int readReply(QSslSocket *socket, QHash<QByteArray, QByteArray> &headers, QByteArray &payload)
+{
+    // The server runs in this process, wait with the event loop running
+    QSignalSpy readyReadSpy(socket, &QSslSocket::readyRead);
+
+    while (!socket->canReadLine()) {
+        if (!readyReadSpy.wait(5000)) {
+            return 0;
+        }
+    }
+    QByteArray statusLine = socket->readLine();
+
+    headers.clear();
+    forever {
+        while (!socket->canReadLine()) {
+            if (!readyReadSpy.wait(5000)) {
+                return 0;
+            }
+        }
+        QByteArray line = socket->readLine().trimmed();
+        if (line.isEmpty())
+            break;
+
+        int index = line.indexOf(':');
+        headers.insert(line.left(index).trimmed().toLower(), line.mid(index + 1).trimmed());
+    }
+
+    int contentLength = headers.value("content-length").toInt();
+    payload.clear();
+    while (payload.size() < contentLength) {
+        if (!socket->bytesAvailable() && !readyReadSpy.wait(5000)) {
+            return 0;
+        }
+        payload.append(socket->read(contentLength - payload.size()));
+    }
+    return statusLine.split(' ').value(1).toInt();
+}
+
 void TestWebserver::initTestCase()
 {
     NymeaTestBase::initTestCase();
@@ -194,6 +247,107 @@ void TestWebserver::multiPackageMessage()
     socket->deleteLater();
 }
 
+void TestWebserver::parseRequests_data()
+{
+    QTest::addColumn<QByteArray>("data");
+    QTest::addColumn<int>("requestCount");
+    QTest::addColumn<QByteArray>("lastPayload");
+    QTest::addColumn<int>("errorStatusCode");
+
+    QByteArray get("GET / HTTP/1.1\r\nUser-Agent: nymea webserver test\r\n\r\n");
+
+    QTest::newRow("single") << get << 1 << QByteArray() << 0;
+    QTest::newRow("pipelined") << get + get + get << 3 << QByteArray() << 0;
+    QTest::newRow("bare line feeds") << QByteArray("GET / HTTP/1.1\nUser-Agent: test\n\n") << 1 << QByteArray() << 0;
+    QTest::newRow("content length") << "PUT / HTTP/1.1\r\nContent-Length: 5\r\n\r\nhello" + get << 2 << QByteArray() << 0;
+    QTest::newRow("body") << get + "PUT / HTTP/1.1\r\nContent-Length: 5\r\n\r\nhello" << 2 << QByteArray("hello") << 0;
+    QTest::newRow("chunked") << QByteArray("POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n5\r\nhello\r\n6;name=value\r\n world\r\n0\r\nTrailer: x\r\n\r\n") << 1 << QByteArray("hello world") << 0;
+    QTest::newRow("incomplete") << QByteArray("PUT / HTTP/1.1\r\nContent-Length: 10\r\n\r\nhello") << 0 << QByteArray() << 0;
+    QTest::newRow("garbage") << QByteArray("this is not a http request") << 0 << QByteArray() << 400;
+    QTest::newRow("header without colon") << QByteArray("GET / HTTP/1.1\r\nUser-Agent test\r\n\r\n") << 0 << QByteArray() << 400;
+    QTest::newRow("both framings") << QByteArray("POST / HTTP/1.1\r\nContent-Length: 5\r\nTransfer-Encoding: chunked\r\n\r\n") << 0 << QByteArray() << 400;
+    QTest::newRow("invalid content length") << QByteArray("POST / HTTP/1.1\r\nContent-Length: -5\r\n\r\n") << 0 << QByteArray() << 400;
+    QTest::newRow("unknown transfer encoding") << QByteArray("POST / HTTP/1.1\r\nTransfer-Encoding: gzip\r\n\r\n") << 0 << QByteArray() << 501;
+    QTest::newRow("chunk longer than size") << QByteArray("POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n2\r\nhello\r\n0\r\n\r\n") << 0 << QByteArray() << 400;
+    QTest::newRow("request line too long") << "GET /" + QByteArray(100, 'a') + " HTTP/1.1\r\n\r\n" << 0 << QByteArray() << 414;
+    QTest::newRow("header too long") << "GET / HTTP/1.1\r\nX-Data: " + QByteArray(300, 'a') + "\r\n\r\n" << 0 << QByteArray() << 431;
+    QTest::newRow("too many headers") << QByteArray("GET / HTTP/1.1\r\nA: 1\r\nB: 2\r\nC: 3\r\nD: 4\r\nE: 5\r\n\r\n") << 0 << QByteArray() << 431;
+    QTest::newRow("body too large") << "PUT / HTTP/1.1\r\nContent-Length: 17\r\n\r\n" + QByteArray(17, 'a') << 0 << QByteArray() << 413;
+    QTest::newRow("chunked body too large") << "PUT / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n10\r\n" + QByteArray(16, 'a') + "\r\n1\r\na\r\n0\r\n\r\n" << 0 << QByteArray() << 413;
+}
+
+void TestWebserver::parseRequests()
+{
+    QFETCH(QByteArray, data);
+    QFETCH(int, requestCount);
+    QFETCH(QByteArray, lastPayload);
+    QFETCH(int, errorStatusCode);
+
+    HttpRequestParser::Limits limits;
+    limits.maxRequestLineSize = 64;
+    limits.maxHeaderSize = 256;
+    limits.maxHeaderCount = 4;
+    limits.maxBodySize = 16;
+
+    // The result must not depend on how the data is split up
+    QList<int> chunkSizes = {data.size(), 7, 1};
+    foreach (int chunkSize, chunkSizes) {
+        HttpRequestParser parser(limits);
+        QList<HttpRequest> requests;
+        HttpRequestParser::Result result = HttpRequestParser::NeedMoreData;
+        for (int i = 0; i < data.size() && result != HttpRequestParser::Error; i += chunkSize) {
+            parser.addData(data.mid(i, chunkSize));
+            result = parser.parse();
+            while (result == HttpRequestParser::HeaderComplete || result == HttpRequestParser::RequestComplete) {
+                if (result == HttpRequestParser::RequestComplete) {
+                    requests.append(parser.takeRequest());
+                }
+                result = parser.parse();
+            }
+        }
+
+        if (errorStatusCode != 0) {
+            QCOMPARE(result, HttpRequestParser::Error);
+            QCOMPARE(static_cast<int>(parser.errorStatusCode()), errorStatusCode);
+        } else {
+            QCOMPARE(result, HttpRequestParser::NeedMoreData);
+        }
+
+        QCOMPARE(requests.count(), requestCount);
+        if (!requests.isEmpty()) {
+            QVERIFY(requests.last().isValid());
+            QCOMPARE(requests.last().payload(), lastPayload);
+        }
+    }
+}
+
+void TestWebserver::pipelinedRequests()
+{
+    QSslSocket *socket = new QSslSocket(this);
+    typedef void (QSslSocket:: *sslErrorsSignal)(const QList<QSslError> &);
+    connect(socket, static_cast<sslErrorsSignal>(&QSslSocket::sslErrors), this, &TestWebserver::onSslErrors);
+    socket->connectToHostEncrypted("127.0.0.1", 3333);
+    QSignalSpy encryptedSpy(socket, SIGNAL(encrypted()));
+    QVERIFY2(encryptedSpy.wait(), "could not created encrypted webserver connection.");
+
+    // All requests in one go, the replies have to come back in order
+    QByteArray requestData;
+    requestData.append("GET /server.xml HTTP/1.1\r\nUser-Agent: nymea webserver test\r\n\r\n");
+    requestData.append("GET /does-not-exist HTTP/1.1\r\nUser-Agent: nymea webserver test\r\n\r\n");
+    requestData.append("GET /server.xml HTTP/1.1\r\nUser-Agent: nymea webserver test\r\n\r\n");
+    socket->write(requestData);
+
+    QHash<QByteArray, QByteArray> headers;
+    QByteArray payload;
+    QCOMPARE(readReply(socket, headers, payload), 200);
+    QVERIFY(headers.value("content-type").startsWith("text/xml"));
+    QCOMPARE(readReply(socket, headers, payload), 404);
+    QCOMPARE(readReply(socket, headers, payload), 200);
+    QVERIFY(headers.value("content-type").startsWith("text/xml"));
+
+    socket->deleteLater();
+}
+
 void TestWebserver::checkAllowedMethodCall_data()
 {
     QTest::addColumn<QString>("method");
@@ -367,6 +521,119 @@ void TestWebserver::getFiles()
     reply->deleteLater();
 }
 
+void TestWebserver::getCachedFiles()
+{
+    QString fileName = QCoreApplication::applicationDirPath() + "/cachetest.html";
+    QFile file(fileName);
+    QVERIFY(file.open(QFile::WriteOnly | QFile::Truncate));
+    QByteArray content = "<html><body>" + QByteArray("nymea ").repeated(500) + "</body></html>";
+    file.write(content);
+    file.close();
+    QFile gzipFile(fileName + ".gz");
+    QVERIFY(gzipFile.open(QFile::WriteOnly | QFile::Truncate));
+    gzipFile.write("precompressed");
+    gzipFile.close();
+
+    QSslSocket *socket = new QSslSocket(this);
+    typedef void (QSslSocket:: *sslErrorsSignal)(const QList<QSslError> &);
+    connect(socket, static_cast<sslErrorsSignal>(&QSslSocket::sslErrors), this, &TestWebserver::onSslErrors);
+    socket->connectToHostEncrypted("127.0.0.1", 3333);
+    QSignalSpy encryptedSpy(socket, SIGNAL(encrypted()));
+    QVERIFY2(encryptedSpy.wait(), "could not created encrypted webserver connection.");
+
+
+    QHash<QByteArray, QByteArray> headers;
+    QByteArray payload;
+
+    // Plain request
+    socket->write("GET /cachetest.html HTTP/1.1\r\nUser-Agent: nymea webserver test\r\n\r\n");
+    QCOMPARE(readReply(socket, headers, payload), 200);
+    QCOMPARE(payload, content);
+    QVERIFY(headers.value("content-type").startsWith("text/html"));
+    QVERIFY(!headers.value("last-modified").isEmpty());
+    QByteArray etag = headers.value("etag");
+    QVERIFY(!etag.isEmpty());
+
+    // Conditional request on the same connection
+    socket->write("GET /cachetest.html HTTP/1.1\r\nUser-Agent: nymea webserver test\r\nIf-None-Match: " + etag + "\r\n\r\n");
+    QCOMPARE(readReply(socket, headers, payload), 304);
+    QVERIFY(payload.isEmpty());
+
+    // Pre-compressed variant
+    socket->write("GET /cachetest.html HTTP/1.1\r\nUser-Agent: nymea webserver test\r\nAccept-Encoding: gzip, deflate\r\n\r\n");
+    QCOMPARE(readReply(socket, headers, payload), 200);
+    QCOMPARE(headers.value("content-encoding"), QByteArray("gzip"));
+    QCOMPARE(headers.value("vary"), QByteArray("Accept-Encoding"));
+    QCOMPARE(payload, QByteArray("precompressed"));
+    QVERIFY(headers.value("etag") != etag);
+
+    // The client asks to close the connection
+    QSignalSpy disconnectedSpy(socket, &QSslSocket::disconnected);
+    socket->write("GET /cachetest.html HTTP/1.1\r\nUser-Agent: nymea webserver test\r\nConnection: close\r\n\r\n");
+    QCOMPARE(readReply(socket, headers, payload), 200);
+    QCOMPARE(headers.value("connection"), QByteArray("close"));
+    QVERIFY(disconnectedSpy.count() > 0 || disconnectedSpy.wait());
+
+    socket->deleteLater();
+    QFile::remove(fileName);
+    QFile::remove(fileName + ".gz");
+}
+
+void TestWebserver::getFileRanges()
+{
+    // Bigger than the static file cache accepts, this one gets streamed from disk
+    QString fileName = QCoreApplication::applicationDirPath() + "/streamtest.bin";
+    QByteArray content;
+    for (int i = 0; i < 3 * 1024 * 1024 / 4; i++) {
+        content.append(reinterpret_cast<const char *>(&i), 4);
+    }
+    QFile file(fileName);
+    QVERIFY(file.open(QFile::WriteOnly | QFile::Truncate));
+    file.write(content);
+    file.close();
+
+    QSslSocket *socket = new QSslSocket(this);
+    typedef void (QSslSocket:: *sslErrorsSignal)(const QList<QSslError> &);
+    connect(socket, static_cast<sslErrorsSignal>(&QSslSocket::sslErrors), this, &TestWebserver::onSslErrors);
+    socket->connectToHostEncrypted("127.0.0.1", 3333);
+    QSignalSpy encryptedSpy(socket, SIGNAL(encrypted()));
+    QVERIFY2(encryptedSpy.wait(), "could not created encrypted webserver connection.");
+
+    QHash<QByteArray, QByteArray> headers;
+    QByteArray payload;
+
+    // Whole file
+    socket->write("GET /streamtest.bin HTTP/1.1\r\nUser-Agent: nymea webserver test\r\n\r\n");
+    QCOMPARE(readReply(socket, headers, payload), 200);
+    QCOMPARE(headers.value("accept-ranges"), QByteArray("bytes"));
+    QCOMPARE(payload.size(), content.size());
+    QVERIFY(payload == content);
+
+    // Range in the middle
+    socket->write("GET /streamtest.bin HTTP/1.1\r\nUser-Agent: nymea webserver test\r\nRange: bytes=1000-1999\r\n\r\n");
+    QCOMPARE(readReply(socket, headers, payload), 206);
+    QCOMPARE(headers.value("content-range"), QByteArray("bytes 1000-1999/") + QByteArray::number(content.size()));
+    QVERIFY(payload == content.mid(1000, 1000));
+
+    // Suffix range
+    socket->write("GET /streamtest.bin HTTP/1.1\r\nUser-Agent: nymea webserver test\r\nRange: bytes=-100\r\n\r\n");
+    QCOMPARE(readReply(socket, headers, payload), 206);
+    QVERIFY(payload == content.right(100));
+
+    // Outdated If-Range returns the whole file
+    socket->write("GET /streamtest.bin HTTP/1.1\r\nUser-Agent: nymea webserver test\r\nRange: bytes=0-9\r\nIf-Range: \"outdated\"\r\n\r\n");
+    QCOMPARE(readReply(socket, headers, payload), 200);
+    QCOMPARE(payload.size(), content.size());
+
+    // Range behind the end of the file
+    socket->write("GET /streamtest.bin HTTP/1.1\r\nUser-Agent: nymea webserver test\r\nRange: bytes=" + QByteArray::number(content.size()) + "-\r\n\r\n");
+    QCOMPARE(readReply(socket, headers, payload), 416);
+    QCOMPARE(headers.value("content-range"), QByteArray("bytes */") + QByteArray::number(content.size()));
+
+    socket->deleteLater();
+    QFile::remove(fileName);
+}
+
 void TestWebserver::getServerDescription()
 {
     QNetworkAccessManager nam;
@@ -634,5 +901,42 @@ void TestWebserver::getDebugServer()
     QCOMPARE(statusCode, expectedStatusCode);
 }
 
+void TestWebserver::resumeTlsSession()
+{
+    int resumedBefore = NymeaCore::instance()->serverManager()->clientStatistics().value("tls").toMap().value("resumedHandshakes").toInt();
+
+    // Connect twice, the second connection offers the session of the first one
+    QByteArray session;
+    for (int i = 0; i < 2; i++) {
+        QSslSocket *socket = new QSslSocket(this);
+        typedef void (QSslSocket:: *sslErrorsSignal)(const QList<QSslError> &);
+        connect(socket, static_cast<sslErrorsSignal>(&QSslSocket::sslErrors), this, &TestWebserver::onSslErrors);
+
+        QSslConfiguration configuration = socket->sslConfiguration();
+        configuration.setProtocol(QSsl::TlsV1_2);
+        configuration.setSslOption(QSsl::SslOptionDisableSessionPersistence, false);
+        configuration.setSessionTicket(session);
+        socket->setSslConfiguration(configuration);
+
+        QSignalSpy encryptedSpy(socket, SIGNAL(encrypted()));
+        socket->connectToHostEncrypted("127.0.0.1", 3333);
+        QVERIFY2(encryptedSpy.wait(), "could not created encrypted webserver connection.");
+
+        bool reused = SSL_session_reused(static_cast<SSL *>(socket->sslHandle()));
+        if (i == 0) {
+            QVERIFY2(!reused, "The first connection can't resume a session");
+            session = socket->sslConfiguration().sessionTicket();
+            QVERIFY2(!session.isEmpty(), "The server did not provide a session");
+        } else {
+            QVERIFY2(reused, "The session of the previous connection has not been resumed");
+        }
+
+        socket->close();
+        socket->deleteLater();
+    }
+
+    QTRY_COMPARE(NymeaCore::instance()->serverManager()->clientStatistics().value("tls").toMap().value("resumedHandshakes").toInt(), resumedBefore + 1);
+}
+
 #include "testwebserver.moc"
 QTEST_MAIN(TestWebserver)
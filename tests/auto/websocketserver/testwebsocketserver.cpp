@@ -47,6 +47,8 @@ private slots:
 
     void pingTest();
 
+    void fragmentedPackets();
+
     void testBasicCall_data();
     void testBasicCall();
 
@@ -132,6 +134,38 @@ void TestWebSocketServer::pingTest()
     socket->deleteLater();
 }
 
+void TestWebSocketServer::fragmentedPackets()
+{
+    QWebSocket *socket = new QWebSocket("nymea tests", QWebSocketProtocol::Version13);
+    connect(socket, &QWebSocket::sslErrors, this, &TestWebSocketServer::sslErrors);
+    QSignalSpy spyConnection(socket, SIGNAL(connected()));
+    socket->open(QUrl(QStringLiteral("wss://localhost:4444")));
+    spyConnection.wait();
+    QVERIFY2(spyConnection.count() > 0, "not connected");
+
+    // A packet split across two messages
+    QSignalSpy spy(socket, SIGNAL(textMessageReceived(QString)));
+    socket->sendTextMessage("{\"id\":0, \"met");
+    socket->sendTextMessage("hod\": \"JSONRPC.Hello\"}");
+    spy.wait();
+    QCOMPARE(spy.count(), 1);
+    QCOMPARE(QJsonDocument::fromJson(spy.first().first().toByteArray()).toVariant().toMap().value("id").toInt(), 0);
+
+    // Two packets in a single message
+    spy.clear();
+    socket->sendTextMessage("{\"id\":1, \"method\": \"JSONRPC.Introspect\"}\n{\"id\":2, \"method\": \"JSONRPC.Introspect\"}");
+    spy.wait();
+    if (spy.count() < 2) {
+        spy.wait();
+    }
+    QCOMPARE(spy.count(), 2);
+    QCOMPARE(QJsonDocument::fromJson(spy.at(0).first().toByteArray()).toVariant().toMap().value("id").toInt(), 1);
+    QCOMPARE(QJsonDocument::fromJson(spy.at(1).first().toByteArray()).toVariant().toMap().value("id").toInt(), 2);
+
+    socket->close();
+    socket->deleteLater();
+}
+
 void TestWebSocketServer::testBasicCall_data()
 {
     QTest::addColumn<QByteArray>("data");
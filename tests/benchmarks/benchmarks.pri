@@ -0,0 +1,17 @@
+QT += testlib network sql
+
+INCLUDEPATH += $$top_srcdir/libnymea \
+               $$top_srcdir/libnymea-core \
+               $$top_srcdir/tests/testlib/ \
+               $$top_builddir
+
+LIBS += -L$$top_builddir/libnymea/ -lnymea \
+        -L$$top_builddir/libnymea-core/ -lnymea-core \
+        -L$$top_builddir/tests/testlib/ -lnymea-testlib \
+        -L$$top_builddir/plugins/mock/ \
+        -lssl -lcrypto -lnymea-remoteproxyclient
+
+# Benchmarks are not part of "make check", run them manually:
+# LD_LIBRARY_PATH=../../../libnymea:../../../libnymea-core/:../../testlib/ ./rulesbenchmark
+benchmark.commands = LD_LIBRARY_PATH=../../../libnymea:../../../libnymea-core/:../../testlib/ ./$(TARGET)
+QMAKE_EXTRA_TARGETS += benchmark
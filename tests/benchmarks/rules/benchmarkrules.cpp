@@ -0,0 +1,278 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* Copyright 2013 - 2020, nymea GmbH
+* Contact: contact@nymea.io
+*
+* This file is part of nymea.
+* This project including source code and documentation is protected by
+* copyright law, and remains the property of nymea GmbH. All rights, including
+* reproduction, publication, editing and translation, are reserved. The use of
+* this project is subject to the terms of a license agreement to be concluded
+* with nymea GmbH in accordance with the terms of use of nymea GmbH, available
+* under https://nymea.io/license
+*
+* GNU General Public License Usage
+* Alternatively, this project may be redistributed and/or modified under the
+* terms of the GNU General Public License as published by the Free Software
+* Foundation, GNU version 3. This project is distributed in the hope that it
+* will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+* of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+* Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with
+* this project. If not, see <https://www.gnu.org/licenses/>.
+*
+* For any further details and any questions please contact us under
+* contact@nymea.io or see our FAQ/Licensing Information on
+* https://nymea.io/license/faq
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include "nymeatestbase.h"
+#include "nymeacore.h"
+#include "ruleengine/ruleengine.h"
+#include "integrations/thingmanager.h"
+#include "integrations/thing.h"
+#include "time/calendaritem.h"
+#include "time/repeatingoption.h"
+
+#include <algorithm>
+
+using namespace nymeaserver;
+
+// Benchmarks the rule engine with the mock plugin. The numbers of things and rules can be changed with
+// NYMEA_BENCHMARK_THINGS, NYMEA_BENCHMARK_RULES and NYMEA_BENCHMARK_MIX ("event:state:time" weights).
+class BenchmarkRules: public NymeaTestBase
+{
+    Q_OBJECT
+
+private:
+    QList<ThingId> m_things;
+
+    void addRules(int count, int eventWeight, int stateWeight, int timeWeight);
+    void removeRules();
+    void addRuleRows();
+    void printLatencies(const QString &name, QVector<qint64> latencies);
+
+    static qint64 residentMemory();
+
+private slots:
+    void initTestCase();
+
+    void eventThroughput_data();
+    void eventThroughput();
+
+    void stateChangeThroughput_data();
+    void stateChangeThroughput();
+};
+
+void BenchmarkRules::initTestCase()
+{
+    NymeaTestBase::initTestCase();
+    QLoggingCategory::setFilterRules("*.debug=false\nTests.debug=true");
+
+    int thingCount = qEnvironmentVariableIsSet("NYMEA_BENCHMARK_THINGS") ? qMax(1, qEnvironmentVariableIntValue("NYMEA_BENCHMARK_THINGS")) : 10;
+
+    // The mock created by the test base is the first one
+    for (int i = 1; i < thingCount; i++) {
+        QVariantMap httpPortParam;
+        httpPortParam.insert("paramTypeId", mockThingHttpportParamTypeId);
+        httpPortParam.insert("value", m_mockThing1Port + 100 + i);
+        QVariantMap params;
+        params.insert("thingClassId", mockThingClassId);
+        params.insert("name", QString("Benchmark mock %1").arg(i));
+        params.insert("thingParams", QVariantList() << httpPortParam);
+        QVariant response = injectAndWait("Integrations.AddThing", params);
+        verifyError(response, "thingError", "ThingErrorNoError");
+    }
+
+    foreach (Thing *thing, NymeaCore::instance()->thingManager()->findConfiguredThings(mockThingClassId)) {
+        m_things.append(thing->id());
+    }
+    qCDebug(dcTests()) << "Benchmarking with" << m_things.count() << "mock things";
+}
+
+void BenchmarkRules::eventThroughput_data()
+{
+    addRuleRows();
+}
+
+void BenchmarkRules::eventThroughput()
+{
+    QFETCH(int, ruleCount);
+    QFETCH(int, eventWeight);
+    QFETCH(int, stateWeight);
+    QFETCH(int, timeWeight);
+
+    addRules(ruleCount, eventWeight, stateWeight, timeWeight);
+
+    QList<Event> events;
+    foreach (const ThingId &thingId, m_things) {
+        events.append(Event(mockEvent1EventTypeId, thingId));
+    }
+
+    // Actions are dispatched to the RuleActionExecutor from within gotEvent(), so the time spent in there
+    // is the latency from the event to the dispatch of all its actions.
+    QVector<qint64> latencies;
+    QElapsedTimer timer;
+    int index = 0;
+    QBENCHMARK {
+        for (int i = 0; i < 100; i++) {
+            const Event &event = events.at(index++ % events.count());
+            timer.start();
+            QMetaObject::invokeMethod(NymeaCore::instance(), "gotEvent", Qt::DirectConnection, Q_ARG(Event, event));
+            latencies.append(timer.nsecsElapsed());
+        }
+    }
+    printLatencies(QTest::currentDataTag(), latencies);
+
+    removeRules();
+}
+
+void BenchmarkRules::stateChangeThroughput_data()
+{
+    addRuleRows();
+}
+
+void BenchmarkRules::stateChangeThroughput()
+{
+    QFETCH(int, ruleCount);
+    QFETCH(int, eventWeight);
+    QFETCH(int, stateWeight);
+    QFETCH(int, timeWeight);
+
+    addRules(ruleCount, eventWeight, stateWeight, timeWeight);
+
+    QList<Thing *> things;
+    foreach (const ThingId &thingId, m_things) {
+        things.append(NymeaCore::instance()->thingManager()->findConfiguredThing(thingId));
+    }
+
+    // Sweeping the int state over all thresholds, the state change goes through NymeaCore::gotEvent() too
+    QVector<qint64> latencies;
+    QElapsedTimer timer;
+    int index = 0;
+    QBENCHMARK {
+        for (int i = 0; i < 100; i++) {
+            Thing *thing = things.at(index % things.count());
+            int value = (index / things.count()) % 100;
+            index++;
+            timer.start();
+            thing->setStateValue(mockIntStateTypeId, value);
+            latencies.append(timer.nsecsElapsed());
+        }
+    }
+    printLatencies(QTest::currentDataTag(), latencies);
+
+    removeRules();
+}
+
+void BenchmarkRules::addRuleRows()
+{
+    QTest::addColumn<int>("ruleCount");
+    QTest::addColumn<int>("eventWeight");
+    QTest::addColumn<int>("stateWeight");
+    QTest::addColumn<int>("timeWeight");
+
+    QTest::newRow("no rules") << 0 << 1 << 1 << 1;
+    QTest::newRow("100 event rules") << 100 << 1 << 0 << 0;
+    QTest::newRow("100 state rules") << 100 << 0 << 1 << 0;
+    QTest::newRow("1000 mixed rules") << 1000 << 2 << 2 << 1;
+
+    if (qEnvironmentVariableIsSet("NYMEA_BENCHMARK_RULES")) {
+        QStringList mix = QString::fromLocal8Bit(qgetenv("NYMEA_BENCHMARK_MIX")).split(':', QString::SkipEmptyParts);
+        if (mix.isEmpty()) {
+            mix = QStringList() << "1" << "1" << "1";
+        }
+        while (mix.count() < 3) {
+            mix.append("0");
+        }
+        QTest::newRow("custom") << qEnvironmentVariableIntValue("NYMEA_BENCHMARK_RULES") << mix.at(0).toInt() << mix.at(1).toInt() << mix.at(2).toInt();
+    }
+}
+
+void BenchmarkRules::addRules(int count, int eventWeight, int stateWeight, int timeWeight)
+{
+    int totalWeight = qMax(1, eventWeight + stateWeight + timeWeight);
+    qint64 memoryBefore = residentMemory();
+
+    for (int i = 0; i < count; i++) {
+        ThingId thingId = m_things.at(i % m_things.count());
+        RuleAction action(mockWithoutParamsActionTypeId, thingId);
+
+        Rule rule;
+        rule.setId(RuleId::createRuleId());
+        rule.setName(QString("Benchmark rule %1").arg(i));
+        rule.setActions(RuleActions() << action);
+
+        int slot = i % totalWeight;
+        if (slot < eventWeight) {
+            rule.setEventDescriptors(QList<EventDescriptor>() << EventDescriptor(mockEvent1EventTypeId, thingId));
+        } else if (slot < eventWeight + stateWeight) {
+            rule.setStateEvaluator(StateEvaluator(StateDescriptor(mockIntStateTypeId, thingId, i % 100, Types::ValueOperatorGreater)));
+            rule.setExitActions(RuleActions() << action);
+        } else {
+            CalendarItem calendarItem;
+            calendarItem.setStartTime(QTime(8, 0));
+            calendarItem.setDuration(60);
+            calendarItem.setRepeatingOption(RepeatingOption(RepeatingOption::RepeatingModeDaily));
+            TimeDescriptor timeDescriptor;
+            timeDescriptor.setCalendarItems(CalendarItems() << calendarItem);
+            rule.setTimeDescriptor(timeDescriptor);
+        }
+
+        QCOMPARE(NymeaCore::instance()->ruleEngine()->addRule(rule), RuleEngine::RuleErrorNoError);
+    }
+
+    qint64 memoryAfter = residentMemory();
+    if (count > 0 && memoryBefore > 0 && memoryAfter > 0) {
+        qCDebug(dcTests()).noquote() << QString("%1 rules use %2 kB (%3 bytes per rule)").arg(count).arg((memoryAfter - memoryBefore) / 1024).arg((memoryAfter - memoryBefore) / count);
+    }
+}
+
+void BenchmarkRules::removeRules()
+{
+    // Let the dispatched actions finish before starting over
+    QTest::qWait(100);
+    foreach (const RuleId &ruleId, NymeaCore::instance()->ruleEngine()->ruleIds()) {
+        NymeaCore::instance()->ruleEngine()->removeRule(ruleId);
+    }
+}
+
+void BenchmarkRules::printLatencies(const QString &name, QVector<qint64> latencies)
+{
+    if (latencies.isEmpty()) {
+        return;
+    }
+    qint64 total = 0;
+    foreach (qint64 latency, latencies) {
+        total += latency;
+    }
+    std::sort(latencies.begin(), latencies.end());
+    qint64 p50 = latencies.at(latencies.count() * 50 / 100);
+    qint64 p99 = latencies.at(latencies.count() * 99 / 100);
+    double eventsPerSecond = total > 0 ? latencies.count() * 1000000000.0 / total : 0;
+    qCDebug(dcTests()).noquote() << QString("%1: %2 events/s, latency p50 %3 us, p99 %4 us, resident memory %5 kB")
+                                    .arg(name)
+                                    .arg(eventsPerSecond, 0, 'f', 0)
+                                    .arg(p50 / 1000.0, 0, 'f', 1)
+                                    .arg(p99 / 1000.0, 0, 'f', 1)
+                                    .arg(residentMemory() / 1024);
+}
+
+qint64 BenchmarkRules::residentMemory()
+{
+    QFile status("/proc/self/status");
+    if (!status.open(QFile::ReadOnly)) {
+        return -1;
+    }
+    foreach (const QByteArray &line, status.readAll().split('\n')) {
+        if (line.startsWith("VmRSS:")) {
+            return line.mid(6).trimmed().split(' ').first().toLongLong() * 1024;
+        }
+    }
+    return -1;
+}
+
+#include "benchmarkrules.moc"
+QTEST_MAIN(BenchmarkRules)
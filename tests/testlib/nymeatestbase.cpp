@@ -33,6 +33,7 @@
 #include "nymeasettings.h"
 #include "servers/mocktcpserver.h"
 #include "usermanager/usermanager.h"
+#include "ruleengine/rulesnapshot.h"
 
 using namespace nymeaserver;
 
@@ -60,6 +61,7 @@ void NymeaTestBase::initTestCase()
     // If testcase asserts cleanup won't do. Lets clear any previous test run settings leftovers
     NymeaSettings rulesSettings(NymeaSettings::SettingsRoleRules);
     rulesSettings.clear();
+    QFile::remove(RuleSnapshot::fileName());
     NymeaSettings thingSettings(NymeaSettings::SettingsRoleThings);
     thingSettings.clear();
     NymeaSettings pluginSettings(NymeaSettings::SettingsRolePlugins);
@@ -1,5 +1,6 @@
 TEMPLATE = subdirs
 
-SUBDIRS = testlib auto tools/simplepushbuttonhandler
+SUBDIRS = testlib auto benchmarks tools/simplepushbuttonhandler tools/mqttloadtest
 
 auto.depends += testlib
+benchmarks.depends += testlib
@@ -0,0 +1,190 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* Copyright 2013 - 2020, nymea GmbH
+* Contact: contact@nymea.io
+*
+* This file is part of nymea.
+* This project including source code and documentation is protected by
+* copyright law, and remains the property of nymea GmbH. All rights, including
+* reproduction, publication, editing and translation, are reserved. The use of
+* this project is subject to the terms of a license agreement to be concluded
+* with nymea GmbH in accordance with the terms of use of nymea GmbH, available
+* under https://nymea.io/license
+*
+* GNU General Public License Usage
+* Alternatively, this project may be redistributed and/or modified under the
+* terms of the GNU General Public License as published by the Free Software
+* Foundation, GNU version 3. This project is distributed in the hope that it
+* will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+* of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+* Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with
+* this project. If not, see <https://www.gnu.org/licenses/>.
+*
+* For any further details and any questions please contact us under
+* contact@nymea.io or see our FAQ/Licensing Information on
+* https://nymea.io/license/faq
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#include "loadtester.h"
+
+#include <QDebug>
+
+#include <algorithm>
+
+LoadTester::LoadTester(const Options &options, QObject *parent) :
+    QObject(parent),
+    m_options(options)
+{
+    m_statisticsTimer.setInterval(1000);
+    connect(&m_statisticsTimer, &QTimer::timeout, this, &LoadTester::printStatistics);
+}
+
+void LoadTester::start()
+{
+    m_clock.start();
+
+    qDebug().noquote() << QString("Connecting %1 clients to %2:%3").arg(m_options.clients).arg(m_options.host).arg(m_options.port);
+
+    // The monitor receives all publishes of the publishing clients and measures the latency
+    m_monitor = createClient(QString("%1-monitor").arg(m_options.topicPrefix));
+    connect(m_monitor, &MqttClient::publishReceived, this, &LoadTester::onMonitorPublishReceived);
+    connect(m_monitor, &MqttClient::subscribed, this, [this](){
+        m_monitorSubscribed = true;
+        onClientConnected();
+    });
+
+    for (int i = 0; i < m_options.clients; i++) {
+        m_clients.append(createClient(QString("%1-%2").arg(m_options.topicPrefix).arg(i)));
+    }
+}
+
+MqttClient *LoadTester::createClient(const QString &clientId)
+{
+    MqttClient *client = new MqttClient(clientId, this);
+    client->setUsername(m_options.username);
+    client->setPassword(m_options.password);
+    client->setAutoReconnect(false);
+    connect(client, &MqttClient::connected, this, [this, client](){
+        if (client == m_monitor) {
+            m_monitor->subscribe(QString("%1/#").arg(m_options.topicPrefix), m_options.qos);
+            return;
+        }
+        m_connectedClients++;
+        onClientConnected();
+    });
+    connect(client, &MqttClient::disconnected, this, [this, clientId](){
+        if (m_statisticsTimer.isActive()) {
+            qWarning().noquote() << "Client" << clientId << "disconnected during the test.";
+        }
+    });
+    client->connectToHost(m_options.host, m_options.port);
+    return client;
+}
+
+void LoadTester::onClientConnected()
+{
+    // Start once all publishers are connected and the monitor is listening
+    if (m_connectedClients < m_options.clients || !m_monitorSubscribed) {
+        return;
+    }
+
+    qDebug().noquote() << QString("All clients connected after %1 ms").arg(m_clock.elapsed());
+    startPublishing();
+}
+
+void LoadTester::startPublishing()
+{
+    qDebug().noquote() << QString("Publishing at %1 Hz per client (%2 messages/s) for %3 s")
+                          .arg(m_options.rate).arg(m_options.rate * m_options.clients).arg(m_options.duration);
+
+    int interval = qMax(1, qRound(1000 / m_options.rate));
+    for (int i = 0; i < m_clients.count(); i++) {
+        QTimer *timer = new QTimer(this);
+        timer->setInterval(interval);
+        connect(timer, &QTimer::timeout, this, [this, i](){ publish(i); });
+        m_publishTimers.append(timer);
+
+        // Spread the clients over the interval instead of publishing in bursts
+        QTimer::singleShot(interval * i / m_clients.count(), timer, static_cast<void (QTimer::*)()>(&QTimer::start));
+    }
+
+    m_startTime = m_clock.nsecsElapsed();
+    m_statisticsTimer.start();
+    QTimer::singleShot(m_options.duration * 1000, this, &LoadTester::finish);
+}
+
+void LoadTester::publish(int clientIndex)
+{
+    // The payload carries the send time so the monitor can calculate the latency
+    QByteArray payload = QByteArray::number(m_clock.nsecsElapsed());
+    if (payload.size() < m_options.payloadSize) {
+        payload.append(' ');
+        payload.append(QByteArray(m_options.payloadSize - payload.size(), 'x'));
+    }
+
+    m_clients.at(clientIndex)->publish(QString("%1/%2/load").arg(m_options.topicPrefix).arg(clientIndex), payload, m_options.qos);
+    m_sent++;
+}
+
+void LoadTester::onMonitorPublishReceived(const QString &topic, const QByteArray &payload)
+{
+    Q_UNUSED(topic)
+    int separator = payload.indexOf(' ');
+    bool ok = false;
+    qint64 sendTime = payload.left(separator).toLongLong(&ok);
+    if (!ok) {
+        return;
+    }
+
+    m_received++;
+    m_intervalReceived++;
+    m_latencies.append(m_clock.nsecsElapsed() - sendTime);
+}
+
+void LoadTester::printStatistics()
+{
+    qDebug().noquote() << QString("Sent: %1, received: %2, throughput: %3 messages/s")
+                          .arg(m_sent).arg(m_received).arg(m_intervalReceived);
+    m_intervalReceived = 0;
+}
+
+void LoadTester::finish()
+{
+    m_statisticsTimer.stop();
+    foreach (QTimer *timer, m_publishTimers) {
+        timer->stop();
+    }
+
+    double seconds = (m_clock.nsecsElapsed() - m_startTime) / 1e9;
+    qDebug().noquote() << "";
+    qDebug().noquote() << QString("Clients:    %1").arg(m_options.clients);
+    qDebug().noquote() << QString("Sent:       %1").arg(m_sent);
+    qDebug().noquote() << QString("Received:   %1 (%2 lost)").arg(m_received).arg(m_sent > m_received ? m_sent - m_received : 0);
+    qDebug().noquote() << QString("Throughput: %1 messages/s").arg(m_received / seconds, 0, 'f', 1);
+
+    if (!m_latencies.isEmpty()) {
+        std::sort(m_latencies.begin(), m_latencies.end());
+        qint64 sum = 0;
+        foreach (qint64 latency, m_latencies) {
+            sum += latency;
+        }
+        auto percentile = [this](double p) {
+            return m_latencies.at(qMin(m_latencies.count() - 1, static_cast<int>(m_latencies.count() * p))) / 1e6;
+        };
+        qDebug().noquote() << QString("Latency:    min %1 ms, avg %2 ms, p50 %3 ms, p99 %4 ms, max %5 ms")
+                              .arg(m_latencies.first() / 1e6, 0, 'f', 2)
+                              .arg(sum / m_latencies.count() / 1e6, 0, 'f', 2)
+                              .arg(percentile(0.5), 0, 'f', 2)
+                              .arg(percentile(0.99), 0, 'f', 2)
+                              .arg(m_latencies.last() / 1e6, 0, 'f', 2);
+    }
+
+    foreach (MqttClient *client, m_clients) {
+        client->disconnectFromHost();
+    }
+    m_monitor->disconnectFromHost();
+
+    emit finished(m_received > 0);
+}
@@ -0,0 +1,95 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* Copyright 2013 - 2020, nymea GmbH
+* Contact: contact@nymea.io
+*
+* This file is part of nymea.
+* This project including source code and documentation is protected by
+* copyright law, and remains the property of nymea GmbH. All rights, including
+* reproduction, publication, editing and translation, are reserved. The use of
+* this project is subject to the terms of a license agreement to be concluded
+* with nymea GmbH in accordance with the terms of use of nymea GmbH, available
+* under https://nymea.io/license
+*
+* GNU General Public License Usage
+* Alternatively, this project may be redistributed and/or modified under the
+* terms of the GNU General Public License as published by the Free Software
+* Foundation, GNU version 3. This project is distributed in the hope that it
+* will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+* of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+* Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with
+* this project. If not, see <https://www.gnu.org/licenses/>.
+*
+* For any further details and any questions please contact us under
+* contact@nymea.io or see our FAQ/Licensing Information on
+* https://nymea.io/license/faq
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#ifndef LOADTESTER_H
+#define LOADTESTER_H
+
+#include <QObject>
+#include <QList>
+#include <QVector>
+#include <QTimer>
+#include <QElapsedTimer>
+
+#include "nymea-mqtt/mqttclient.h"
+
+class LoadTester : public QObject
+{
+    Q_OBJECT
+public:
+    class Options {
+    public:
+        QString host = "127.0.0.1";
+        quint16 port = 1883;
+        QString username;
+        QString password;
+        QString topicPrefix = "nymea-loadtest";
+        int clients = 100;
+        double rate = 1;
+        int duration = 30;
+        int payloadSize = 64;
+        Mqtt::QoS qos = Mqtt::QoS0;
+    };
+
+    explicit LoadTester(const Options &options, QObject *parent = nullptr);
+
+    void start();
+
+signals:
+    void finished(bool success);
+
+private slots:
+    void onClientConnected();
+    void onMonitorPublishReceived(const QString &topic, const QByteArray &payload);
+    void publish(int clientIndex);
+    void printStatistics();
+    void finish();
+
+private:
+    MqttClient *createClient(const QString &clientId);
+    void startPublishing();
+
+    Options m_options;
+
+    MqttClient *m_monitor = nullptr;
+    QList<MqttClient*> m_clients;
+    QList<QTimer*> m_publishTimers;
+    int m_connectedClients = 0;
+    bool m_monitorSubscribed = false;
+
+    QElapsedTimer m_clock;
+    qint64 m_startTime = 0;
+    QTimer m_statisticsTimer;
+
+    quint64 m_sent = 0;
+    quint64 m_received = 0;
+    quint64 m_intervalReceived = 0;
+    QVector<qint64> m_latencies;
+};
+
+#endif // LOADTESTER_H
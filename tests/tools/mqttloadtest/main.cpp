@@ -0,0 +1,94 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* Copyright 2013 - 2020, nymea GmbH
+* Contact: contact@nymea.io
+*
+* This file is part of nymea.
+* This project including source code and documentation is protected by
+* copyright law, and remains the property of nymea GmbH. All rights, including
+* reproduction, publication, editing and translation, are reserved. The use of
+* this project is subject to the terms of a license agreement to be concluded
+* with nymea GmbH in accordance with the terms of use of nymea GmbH, available
+* under https://nymea.io/license
+*
+* GNU General Public License Usage
+* Alternatively, this project may be redistributed and/or modified under the
+* terms of the GNU General Public License as published by the Free Software
+* Foundation, GNU version 3. This project is distributed in the hope that it
+* will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+* of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+* Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with
+* this project. If not, see <https://www.gnu.org/licenses/>.
+*
+* For any further details and any questions please contact us under
+* contact@nymea.io or see our FAQ/Licensing Information on
+* https://nymea.io/license/faq
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#include <QCoreApplication>
+#include <QDebug>
+#include <QCommandLineParser>
+#include <QCommandLineOption>
+
+#include "loadtester.h"
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+
+    LoadTester::Options options;
+
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    parser.setApplicationDescription(QCoreApplication::translate("MqttLoadTest", "Connects a number of MQTT clients to a broker, publishes at a fixed rate and reports the throughput and latency.\n"
+                                                                                  "If the broker requires authentication, the given credentials are used for all clients."));
+    QCommandLineOption hostOption(QStringList() << "host", QCoreApplication::translate("MqttLoadTest", "The broker host. Default: %1").arg(options.host), "host", options.host);
+    parser.addOption(hostOption);
+    QCommandLineOption portOption(QStringList() << "p" << "port", QCoreApplication::translate("MqttLoadTest", "The broker port. Default: %1").arg(options.port), "port", QString::number(options.port));
+    parser.addOption(portOption);
+    QCommandLineOption usernameOption(QStringList() << "username", QCoreApplication::translate("MqttLoadTest", "The username for the clients."), "username");
+    parser.addOption(usernameOption);
+    QCommandLineOption passwordOption(QStringList() << "password", QCoreApplication::translate("MqttLoadTest", "The password for the clients."), "password");
+    parser.addOption(passwordOption);
+    QCommandLineOption clientsOption(QStringList() << "n" << "clients", QCoreApplication::translate("MqttLoadTest", "The number of publishing clients. Default: %1").arg(options.clients), "clients", QString::number(options.clients));
+    parser.addOption(clientsOption);
+    QCommandLineOption rateOption(QStringList() << "r" << "rate", QCoreApplication::translate("MqttLoadTest", "The publish rate of each client in Hz. Default: %1").arg(options.rate), "rate", QString::number(options.rate));
+    parser.addOption(rateOption);
+    QCommandLineOption durationOption(QStringList() << "d" << "duration", QCoreApplication::translate("MqttLoadTest", "The test duration in seconds. Default: %1").arg(options.duration), "seconds", QString::number(options.duration));
+    parser.addOption(durationOption);
+    QCommandLineOption payloadSizeOption(QStringList() << "s" << "payload-size", QCoreApplication::translate("MqttLoadTest", "The payload size in bytes. Default: %1").arg(options.payloadSize), "bytes", QString::number(options.payloadSize));
+    parser.addOption(payloadSizeOption);
+    QCommandLineOption qosOption(QStringList() << "q" << "qos", QCoreApplication::translate("MqttLoadTest", "The QoS for publishing and subscribing (0-2). Default: 0"), "qos", "0");
+    parser.addOption(qosOption);
+    QCommandLineOption topicPrefixOption(QStringList() << "topic-prefix", QCoreApplication::translate("MqttLoadTest", "The topic prefix and client ID prefix. Default: %1").arg(options.topicPrefix), "prefix", options.topicPrefix);
+    parser.addOption(topicPrefixOption);
+
+    parser.process(a);
+
+    options.host = parser.value(hostOption);
+    options.port = parser.value(portOption).toUShort();
+    options.username = parser.value(usernameOption);
+    options.password = parser.value(passwordOption);
+    options.clients = parser.value(clientsOption).toInt();
+    options.rate = parser.value(rateOption).toDouble();
+    options.duration = parser.value(durationOption).toInt();
+    options.payloadSize = parser.value(payloadSizeOption).toInt();
+    options.topicPrefix = parser.value(topicPrefixOption);
+
+    int qos = parser.value(qosOption).toInt();
+    if (options.port == 0 || options.clients <= 0 || options.rate <= 0 || options.duration <= 0 || qos < 0 || qos > 2) {
+        qWarning() << "Invalid arguments.";
+        parser.showHelp(1);
+    }
+    options.qos = static_cast<Mqtt::QoS>(qos);
+
+    LoadTester loadTester(options);
+    QObject::connect(&loadTester, &LoadTester::finished, &a, [&a](bool success){
+        a.exit(success ? 0 : 1);
+    });
+    loadTester.start();
+
+    return a.exec();
+}
@@ -0,0 +1,15 @@
+QT -= gui
+QT += network
+
+CONFIG += c++11 console link_pkgconfig
+CONFIG -= app_bundle
+
+PKGCONFIG += nymea-mqtt
+
+DEFINES += QT_DEPRECATED_WARNINGS
+
+SOURCES += main.cpp \
+    loadtester.cpp
+
+HEADERS += \
+    loadtester.h